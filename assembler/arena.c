@@ -0,0 +1,47 @@
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+void arena_init(Arena *arena) {
+    arena->blocks = NULL;
+    arena->bytes = 0;
+}
+
+/* 8-byte aligned; NULL if out of memory */
+void* arena_alloc(Arena *arena, size_t size) {
+    size = (size + 7) & ~(size_t)7;
+
+    ArenaBlock *block = arena->blocks;
+    if (!block || block->size - block->used < size) {
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = (ArenaBlock*)malloc(sizeof(ArenaBlock) + block_size);
+        if (!block) return NULL;
+        block->used = 0;
+        block->size = block_size;
+        block->next = arena->blocks;
+        arena->blocks = block;
+    }
+
+    void *ptr = block->data + block->used;
+    block->used += size;
+    arena->bytes += size;
+    return ptr;
+}
+
+char* arena_strndup(Arena *arena, const char *text, size_t length) {
+    char *copy = (char*)arena_alloc(arena, length + 1);
+    if (!copy) return NULL;
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+void arena_free(Arena *arena) {
+    ArenaBlock *block = arena->blocks;
+    while (block) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena_init(arena);
+}
@@ -0,0 +1,30 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_BLOCK_SIZE 65536
+
+/*
+ * Bump allocator for data that lives as long as one assembly: label names
+ * and the like. Allocations are never freed one by one; arena_free
+ * releases every block at once.
+ */
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t used;
+    size_t size;
+    char data[];
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock *blocks;    /* Newest first */
+    size_t bytes;          /* Bytes handed out */
+} Arena;
+
+void arena_init(Arena *arena);
+void* arena_alloc(Arena *arena, size_t size);
+char* arena_strndup(Arena *arena, const char *text, size_t length);
+void arena_free(Arena *arena);
+
+#endif
@@ -0,0 +1,275 @@
+/*
+ * Assembler Benchmarks
+ *
+ * Purpose: Measure assembler throughput and memory on large generated
+ * sources, the lexer's token rate, how label definition and
+ * resolution scale with the number of labels, and how batch assembly of
+ * many files scales with threads.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include "assembler.h"
+#include "batch.h"
+#include "lexer.h"
+
+#define HELPERS 64   /* Functions every generated block may call */
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static long peak_rss_kb(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+/*
+ * Write about target_bytes of code in the shape our code generators emit:
+ * indented, commented blocks of stack code that call a fixed set of helper
+ * functions, defined at the end.
+ */
+static long write_source(const char *path, long target_bytes) {
+    FILE *file = fopen(path, "w");
+    if (!file) return -1;
+
+    unsigned seed = 12345;
+    long block = 0;
+    fprintf(file, "; generated benchmark source\n");
+    while (ftell(file) < target_bytes) {
+        seed = seed * 1103515245 + 12345;
+        int value = (int)(seed >> 8) % 100000;
+        fprintf(file, "    ; block %ld\n", block);
+        fprintf(file, "    PUSH %d\n", value);
+        fprintf(file, "    STORE %d\n", (int)(block % 200));
+        fprintf(file, "    LOAD %d      ; reload\n", (int)(block % 200));
+        fprintf(file, "    PUSH -%d\n", value % 977);
+        fprintf(file, "    ADD\n");
+        fprintf(file, "    CALL helper_%d\n", (int)((seed >> 4) % HELPERS));
+        fprintf(file, "    POP\n");
+        block++;
+    }
+    fprintf(file, "    HALT\n");
+    for (int i = 0; i < HELPERS; i++) {
+        fprintf(file, "helper_%d:\n    DUP\n    RET\n", i);
+    }
+
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+/* Lexing only: every token of the source, best of three runs */
+static void bench_lexer(long megabytes) {
+    char source[64];
+    snprintf(source, sizeof(source), "/tmp/asm_bench_%d.asm", (int)getpid());
+
+    long size = write_source(source, megabytes * 1024 * 1024);
+    if (size < 0) {
+        fprintf(stderr, "Error: Cannot write '%s'\n", source);
+        return;
+    }
+
+    long tokens = 0;
+    double best = 0;
+    for (int run = 0; run < 3; run++) {
+        FILE *file = fopen(source, "r");
+        Lexer lexer;
+        Token token;
+        if (!file || !lexer_init_file(&lexer, file)) {
+            fprintf(stderr, "Error: Cannot read '%s'\n", source);
+            if (file) fclose(file);
+            break;
+        }
+
+        double start = now_ms();
+        tokens = 0;
+        while (lexer_next(&lexer, &token) && token.type != TOKEN_EOF) {
+            tokens++;
+        }
+        double elapsed = now_ms() - start;
+        if (run == 0 || elapsed < best) best = elapsed;
+
+        lexer_free(&lexer);
+        fclose(file);
+    }
+
+    printf("%8ld %12ld %10.1f %12.1f %10.1f\n", megabytes, tokens, best,
+           tokens / (best / 1000.0) / 1e6, size / 1048576.0 / (best / 1000.0));
+    remove(source);
+}
+
+/*
+ * A label-heavy source: every block is a label that jumps forward to the
+ * next block and, on a branch, back to a random earlier one, so each label
+ * is defined once and referenced about twice.
+ */
+static long write_label_source(const char *path, int labels) {
+    FILE *file = fopen(path, "w");
+    if (!file) return -1;
+
+    unsigned seed = 12345;
+    fprintf(file, "; generated label benchmark source\n");
+    for (int i = 0; i < labels; i++) {
+        seed = seed * 1103515245 + 12345;
+        fprintf(file, "block_%d:\n", i);
+        fprintf(file, "    LOAD 0\n");
+        fprintf(file, "    JZ Block_%d\n", (int)((seed >> 8) % (unsigned)(i + 1)));
+        fprintf(file, "    JMP block_%d\n", i + 1);
+    }
+    fprintf(file, "block_%d:\n    HALT\n", labels);
+
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+static void bench_labels(int labels) {
+    char source[64];
+    char output[64];
+    snprintf(source, sizeof(source), "/tmp/asm_bench_%d.asm", (int)getpid());
+    snprintf(output, sizeof(output), "/tmp/asm_bench_%d.bc", (int)getpid());
+
+    long size = write_label_source(source, labels);
+    if (size < 0) {
+        fprintf(stderr, "Error: Cannot write '%s'\n", source);
+        return;
+    }
+
+    double start = now_ms();
+    AssemblerResult result = assemble_file(source, output);
+    double elapsed = now_ms() - start;
+
+    if (!result.success) {
+        fprintf(stderr, "Error: %s\n", result.error_msg);
+    } else {
+        printf("%8d %12d %10.1f %10.1f\n", result.label_count, result.instruction_count,
+               elapsed, size / 1048576.0 / (elapsed / 1000.0));
+    }
+    remove(source);
+    remove(output);
+}
+
+static void bench_throughput(long megabytes) {
+    char source[64];
+    char output[64];
+    snprintf(source, sizeof(source), "/tmp/asm_bench_%d.asm", (int)getpid());
+    snprintf(output, sizeof(output), "/tmp/asm_bench_%d.bc", (int)getpid());
+
+    long size = write_source(source, megabytes * 1024 * 1024);
+    if (size < 0) {
+        fprintf(stderr, "Error: Cannot write '%s'\n", source);
+        return;
+    }
+
+    long rss_before = peak_rss_kb();
+    double start = now_ms();
+    AssemblerResult result = assemble_file(source, output);
+    double elapsed = now_ms() - start;
+    long rss_after = peak_rss_kb();
+
+    if (!result.success) {
+        fprintf(stderr, "Error: %s\n", result.error_msg);
+    } else {
+        printf("%8ld %12d %10.1f %10.1f %12ld\n", megabytes, result.instruction_count,
+               elapsed, size / 1048576.0 / (elapsed / 1000.0),
+               rss_after > rss_before ? (rss_after - rss_before) / 1024 : 0);
+    }
+    remove(source);
+    remove(output);
+}
+
+/*
+ * Many small files, as a build of a modular program sees them: each is
+ * assembled by batch_run with 1, 2, 4 ... threads up to one per CPU.
+ */
+static void bench_batch(int files, long file_bytes) {
+    char dir[64];
+    snprintf(dir, sizeof(dir), "/tmp/asm_bench_%d", (int)getpid());
+    if (mkdir(dir, 0700) != 0) {
+        fprintf(stderr, "Error: Cannot create '%s'\n", dir);
+        return;
+    }
+
+    char path[128];
+    for (int i = 0; i < files; i++) {
+        snprintf(path, sizeof(path), "%s/module_%04d.asm", dir, i);
+        if (write_source(path, file_bytes) < 0) {
+            fprintf(stderr, "Error: Cannot write '%s'\n", path);
+            files = i;
+            break;
+        }
+    }
+
+    AssemblerOptions options;
+    assembler_default_options(&options);
+    int cpus = batch_default_threads();
+    double single = 0;
+    for (int threads = 1; ; threads *= 2) {
+        if (threads > cpus) threads = cpus;
+
+        Batch batch;
+        batch_init(&batch, ".bc");
+        batch_add(&batch, dir, NULL);
+        double start = now_ms();
+        batch_run(&batch, &options, threads);
+        double elapsed = now_ms() - start;
+        if (threads == 1) single = elapsed;
+        printf("%8d %8d %10.1f %12.0f %8.2fx\n", threads, batch.job_count, elapsed,
+               batch.job_count / (elapsed / 1000.0), single / elapsed);
+        if (batch_failures(&batch) > 0) {
+            fprintf(stderr, "Error: %d files failed\n", batch_failures(&batch));
+        }
+        batch_free(&batch);
+        if (threads == cpus) break;
+    }
+
+    for (int i = 0; i < files; i++) {
+        snprintf(path, sizeof(path), "%s/module_%04d.asm", dir, i);
+        remove(path);
+        snprintf(path, sizeof(path), "%s/module_%04d.bc", dir, i);
+        remove(path);
+    }
+    rmdir(dir);
+}
+
+int main() {
+    printf("=======================================\n");
+    printf("  Assembler Benchmarks\n");
+    printf("=======================================\n\n");
+
+    /* Peak RSS only grows, so sizes run smallest first */
+    printf("Generated sources:\n");
+    printf("%8s %12s %10s %10s %12s\n", "MB", "instrs", "ms", "MB/s", "peak +MB");
+    long sizes[] = {1, 10, 100};
+    for (int i = 0; i < 3; i++) {
+        bench_throughput(sizes[i]);
+    }
+
+    printf("\nLexer alone:\n");
+    printf("%8s %12s %10s %12s %10s\n", "MB", "tokens", "ms", "Mtokens/s", "MB/s");
+    bench_lexer(10);
+
+    printf("\nLabel-heavy sources:\n");
+    printf("%8s %12s %10s %10s\n", "labels", "instrs", "ms", "MB/s");
+    int label_counts[] = {10000, 100000, 300000};
+    for (int i = 0; i < 3; i++) {
+        bench_labels(label_counts[i]);
+    }
+
+    printf("\nBatch of 2000 files of 20 KB:\n");
+    printf("%8s %8s %10s %12s %9s\n", "threads", "files", "ms", "files/s", "speedup");
+    bench_batch(2000, 20 * 1024);
+
+    return 0;
+}
@@ -2,137 +2,248 @@
 #include <stdlib.h>
 #include <string.h>
 #include "assembler.h"
+#include "arena.h"
 #include "lexer.h"
 #include "parser.h"
 #include "labels.h"
 #include "codegen.h"
+#include "optimize.h"
+#include "profile.h"
+#include "object.h"
 
-static char* read_file(const char *filename) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        return NULL;
-    }
-
-    fseek(file, 0, SEEK_END);
-    long size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-
-    if (size <= 0 || size > MAX_SOURCE_SIZE) {
-        fclose(file);
-        return NULL;
-    }
-
-    char *buffer = (char*)malloc(size + 1);
-    if (!buffer) {
-        fclose(file);
-        return NULL;
-    }
-
-    size_t read = fread(buffer, 1, size, file);
-    buffer[read] = '\0';
-
-    fclose(file);
-    return buffer;
-}
-
-AssemblerResult assemble_string(const char *source, const char *output_file) {
+static AssemblerResult empty_result(void) {
     AssemblerResult result;
     result.success = false;
     result.instruction_count = 0;
     result.bytecode_size = 0;
     result.label_count = 0;
+    result.reused = false;
+    memset(&result.optimizer, 0, sizeof(result.optimizer));
     result.error_msg[0] = '\0';
+    return result;
+}
 
-    Lexer lexer;
-    lexer_init(&lexer, source);
-
-    if (!lexer_tokenize(&lexer)) {
-        snprintf(result.error_msg, sizeof(result.error_msg),
-                 "Lexer error: %s", lexer.error_msg);
-        return result;
-    }
+void assembler_default_options(AssemblerOptions *options) {
+    options->optimize = false;
+    options->unroll = 1;
+    options->profile_file = NULL;
+    options->object = false;
+}
 
+/*
+ * Tokens stream from the lexer into the parser, so the only per-program
+ * memory is the instruction and label arrays, the names in the arena and
+ * the bytecode.
+ *
+ * With options->object, label references are resolved by object_build
+ * instead and the output is an object module stamped with source_hash.
+ */
+static AssemblerResult assemble(Lexer *lexer, const char *output_file,
+                                const AssemblerOptions *options, uint64_t source_hash) {
+    AssemblerResult result = empty_result();
+
+    Arena arena;
+    arena_init(&arena);
     Parser parser;
-    parser_init(&parser, lexer.tokens, lexer.token_count);
+    parser_init(&parser, lexer, &arena);
+    SymbolTable symtab;
+    symtab_init(&symtab);
+    Optimizer optimizer;
+    optimizer_init(&optimizer);
+    optimizer.unroll = options->unroll;
+    ExecutionProfile profile;
+    profile_init(&profile);
+    CodeGenerator codegen;
+    codegen_init(&codegen);
+    ObjectModule module;
+    object_init(&module);
+    module.source_hash = source_hash;
 
     if (!parser_parse(&parser)) {
-        snprintf(result.error_msg, sizeof(result.error_msg),
-                 "Parser error: %s", parser.error_msg);
-        return result;
+        if (lexer->has_error) {
+            snprintf(result.error_msg, sizeof(result.error_msg),
+                     "Lexer error: %s", lexer->error_msg);
+        } else {
+            snprintf(result.error_msg, sizeof(result.error_msg),
+                     "Parser error: %s", parser.error_msg);
+        }
+        goto done;
     }
 
     result.instruction_count = parser.instruction_count;
 
-    SymbolTable symtab;
-    symtab_init(&symtab);
-
-    if (!symtab_collect_labels(&symtab, lexer.tokens, lexer.token_count,
+    if (!symtab_collect_labels(&symtab, parser.labels, parser.label_count,
                                parser.instructions, parser.instruction_count)) {
         snprintf(result.error_msg, sizeof(result.error_msg),
                  "Label error: %s", symtab.error_msg);
-        return result;
+        goto done;
     }
 
     result.label_count = symtab.label_count;
 
-    if (!symtab_resolve_labels(&symtab, parser.instructions, parser.instruction_count)) {
+    if (options->object) {
+        if (!object_build(&module, parser.instructions, parser.instruction_count, &symtab,
+                          parser.linkage, parser.linkage_count)) {
+            snprintf(result.error_msg, sizeof(result.error_msg),
+                     "Label error: %s", module.error_msg);
+            goto done;
+        }
+    } else if (!symtab_resolve_labels(&symtab, parser.instructions, parser.instruction_count)) {
         snprintf(result.error_msg, sizeof(result.error_msg),
                  "Label error: %s", symtab.error_msg);
-        return result;
+        goto done;
     }
 
-    CodeGenerator codegen;
-    codegen_init(&codegen);
+    ParsedInstruction *program = parser.instructions;
+    int program_count = parser.instruction_count;
+    if (options->optimize && !options->object) {
+        if (options->profile_file) {
+            if (!profile_load(&profile, options->profile_file)) {
+                snprintf(result.error_msg, sizeof(result.error_msg),
+                         "Profile error: %s", profile.error_msg);
+                goto done;
+            }
+            optimizer.profile = &profile;
+        }
+        if (!optimizer_run(&optimizer, parser.instructions, parser.instruction_count)) {
+            snprintf(result.error_msg, sizeof(result.error_msg),
+                     "Optimizer error: %s", optimizer.error_msg);
+            goto done;
+        }
+        result.optimizer = optimizer.stats;
+        program = optimizer.instructions;
+        program_count = optimizer.instruction_count;
+    }
 
-    if (!codegen_generate(&codegen, parser.instructions, parser.instruction_count)) {
+    if (!codegen_generate(&codegen, program, program_count)) {
         snprintf(result.error_msg, sizeof(result.error_msg),
                  "Codegen error: %s", codegen.error_msg);
-        return result;
+        goto done;
     }
 
     result.bytecode_size = codegen.bytecode_size;
 
-    if (!codegen_write_file(&codegen, output_file)) {
+    if (options->object) {
+        if (!object_write_file(&module, codegen.bytecode, codegen.bytecode_size, output_file)) {
+            snprintf(result.error_msg, sizeof(result.error_msg),
+                     "File error: %s", module.error_msg);
+            goto done;
+        }
+    } else if (!codegen_write_file(&codegen, output_file)) {
         snprintf(result.error_msg, sizeof(result.error_msg),
                  "File error: %s", codegen.error_msg);
-        return result;
+        goto done;
     }
 
     result.success = true;
+
+done:
+    object_free(&module);
+    codegen_free(&codegen);
+    optimizer_free(&optimizer);
+    profile_free(&profile);
+    symtab_free(&symtab);
+    parser_free(&parser);
+    arena_free(&arena);
     return result;
 }
 
+AssemblerResult assemble_string(const char *source, const char *output_file) {
+    AssemblerOptions options;
+    assembler_default_options(&options);
+    return assemble_string_with_options(source, output_file, &options);
+}
+
 AssemblerResult assemble_file(const char *input_file, const char *output_file) {
-    AssemblerResult result;
-    result.success = false;
-    result.instruction_count = 0;
-    result.bytecode_size = 0;
-    result.label_count = 0;
+    AssemblerOptions options;
+    assembler_default_options(&options);
+    return assemble_file_with_options(input_file, output_file, &options);
+}
+
+AssemblerResult assemble_string_with_options(const char *source, const char *output_file,
+                                             const AssemblerOptions *options) {
+    Lexer lexer;
+    lexer_init(&lexer, source);
+    uint64_t hash = object_source_hash(source, strlen(source), object_hash_seed());
+    return assemble(&lexer, output_file, options, hash);
+}
+
+/* 64-bit FNV-1a of the whole file, read in chunks; the file is left rewound */
+static bool hash_source_file(FILE *file, uint64_t *hash) {
+    char chunk[8192];
+    size_t length;
+    *hash = object_hash_seed();
+    while ((length = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        *hash = object_source_hash(chunk, length, *hash);
+    }
+    bool ok = !ferror(file);
+    rewind(file);
+    return ok;
+}
 
-    char *source = read_file(input_file);
-    if (!source) {
+AssemblerResult assemble_file_with_options(const char *input_file, const char *output_file,
+                                           const AssemblerOptions *options) {
+    AssemblerResult result = empty_result();
+
+    FILE *file = fopen(input_file, "r");
+    if (!file) {
         snprintf(result.error_msg, sizeof(result.error_msg),
                  "Cannot read file '%s'", input_file);
         return result;
     }
 
-    result = assemble_string(source, output_file);
+    /* An object module assembled from the same source text is reused as it is */
+    uint64_t source_hash = 0;
+    if (options->object) {
+        uint64_t previous;
+        if (!hash_source_file(file, &source_hash)) {
+            snprintf(result.error_msg, sizeof(result.error_msg),
+                     "Cannot read file '%s'", input_file);
+            fclose(file);
+            return result;
+        }
+        if (object_read_source_hash(output_file, &previous) && previous == source_hash) {
+            fclose(file);
+            result.success = true;
+            result.reused = true;
+            return result;
+        }
+    }
 
-    free(source);
+    Lexer lexer;
+    if (lexer_init_file(&lexer, file)) {
+        result = assemble(&lexer, output_file, options, source_hash);
+    } else {
+        snprintf(result.error_msg, sizeof(result.error_msg),
+                 "Lexer error: %s", lexer.error_msg);
+    }
 
+    lexer_free(&lexer);
+    fclose(file);
     return result;
 }
 
 void print_usage(const char *program_name) {
     printf("Usage: %s <input.asm> [-o <output.bc>]\n", program_name);
+    printf("       %s -c <module.asm> [-o <module.bco>]\n", program_name);
+    printf("       %s [-j N] <input.asm | directory | @manifest> ...\n", program_name);
     printf("\n");
-    printf("Assembles an assembly source file into bytecode.\n");
+    printf("Assembles an assembly source file into bytecode. Several inputs, every\n");
+    printf(".asm file in a directory, or the files a manifest lists one per line are\n");
+    printf("assembled in parallel, each to a file named after its input.\n");
     printf("\n");
     printf("Options:\n");
-    printf("  -o <file>   Specify output file (default: input with .bc extension)\n");
-    printf("  -h, --help  Show this help message\n");
+    printf("  -o <file>       Specify output file (default: input with .bc extension)\n");
+    printf("  -O              Optimize: dataflow, inlining, loop and peephole passes\n");
+    printf("  --unroll=N      With -O, also unroll counted loops up to N times\n");
+    printf("  --profile=FILE  With -O, lay out code by a profile from vm --exec-profile\n");
+    printf("  -c              Write a relocatable object module for bclink\n");
+    printf("  -j N            Assemble up to N files at once (default: one per CPU)\n");
+    printf("  -h, --help      Show this help message\n");
     printf("\n");
     printf("Example:\n");
     printf("  %s program.asm              # Creates program.bc\n", program_name);
     printf("  %s program.asm -o out.bc    # Creates out.bc\n", program_name);
+    printf("  %s -c module.asm            # Creates module.bco\n", program_name);
+    printf("  %s tests/                   # Creates a .bc for each tests/*.asm\n", program_name);
 }
@@ -2,19 +2,32 @@
 #define ASSEMBLER_H
 
 #include <stdbool.h>
+#include "optimize.h"
 
-#define MAX_SOURCE_SIZE 65536
+typedef struct {
+    bool optimize;            /* -O: optimize between label resolution and codegen */
+    int unroll;               /* --unroll=N: unroll counted loops up to N times (with -O) */
+    const char *profile_file; /* --profile=FILE: lay out blocks by a VM profile (with -O) */
+    bool object;              /* -c: write an object module for bclink; ignores -O */
+} AssemblerOptions;
 
 typedef struct {
     bool success;
-    int instruction_count;
+    int instruction_count;    /* As written, before optimization */
     int bytecode_size;
     int label_count;
+    bool reused;              /* -c: the output was already assembled from this source */
+    OptimizerStats optimizer; /* Zero unless options.optimize */
     char error_msg[512];
 } AssemblerResult;
 
+void assembler_default_options(AssemblerOptions *options);
 AssemblerResult assemble_file(const char *input_file, const char *output_file);
 AssemblerResult assemble_string(const char *source, const char *output_file);
+AssemblerResult assemble_file_with_options(const char *input_file, const char *output_file,
+                                           const AssemblerOptions *options);
+AssemblerResult assemble_string_with_options(const char *source, const char *output_file,
+                                             const AssemblerOptions *options);
 void print_usage(const char *program_name);
 
 #endif
@@ -0,0 +1,328 @@
+#define _XOPEN_SOURCE 700  /* opendir, realpath, stat, sysconf */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "batch.h"
+
+#define MANIFEST_LINE_MAX 4096
+
+static bool batch_error(Batch *batch, const char *message, const char *path) {
+    snprintf(batch->error_msg, sizeof(batch->error_msg), message, path);
+    batch->has_error = true;
+    return false;
+}
+
+static bool out_of_memory(Batch *batch) {
+    snprintf(batch->error_msg, sizeof(batch->error_msg), "Out of memory");
+    batch->has_error = true;
+    return false;
+}
+
+static char* copy_string(const char *text, size_t length) {
+    char *copy = (char*)malloc(length + 1);
+    if (!copy) return NULL;
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+/* The input with its extension replaced, or appended if it has none */
+static char* default_output(const char *input, const char *extension) {
+    size_t length = strlen(input);
+    const char *dot = strrchr(input, '.');
+    const char *slash = strrchr(input, '/');
+    if (dot && (!slash || dot > slash)) length = (size_t)(dot - input);
+
+    char *output = (char*)malloc(length + strlen(extension) + 1);
+    if (!output) return NULL;
+    memcpy(output, input, length);
+    strcpy(output + length, extension);
+    return output;
+}
+
+void batch_init(Batch *batch, const char *extension) {
+    batch->jobs = NULL;
+    batch->job_count = 0;
+    batch->job_capacity = 0;
+    batch->extension = extension;
+    batch->has_error = false;
+    batch->error_msg[0] = '\0';
+}
+
+void batch_free(Batch *batch) {
+    for (int i = 0; i < batch->job_count; i++) {
+        free(batch->jobs[i].input);
+        free(batch->jobs[i].output);
+    }
+    free(batch->jobs);
+    batch->jobs = NULL;
+    batch->job_count = 0;
+    batch->job_capacity = 0;
+}
+
+static bool add_file(Batch *batch, const char *path, size_t length, const char *output) {
+    if (batch->job_count == batch->job_capacity) {
+        int capacity = batch->job_capacity ? batch->job_capacity * 2 : 16;
+        BatchJob *grown = (BatchJob*)realloc(batch->jobs, capacity * sizeof(BatchJob));
+        if (!grown) return out_of_memory(batch);
+        batch->jobs = grown;
+        batch->job_capacity = capacity;
+    }
+
+    BatchJob *job = &batch->jobs[batch->job_count];
+    job->input = copy_string(path, length);
+    job->output = !job->input ? NULL
+                : output ? copy_string(output, strlen(output))
+                : default_output(job->input, batch->extension);
+    if (!job->input || !job->output) {
+        free(job->input);
+        return out_of_memory(batch);
+    }
+    memset(&job->result, 0, sizeof(job->result));
+    batch->job_count++;
+    return true;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static bool has_asm_extension(const char *name) {
+    size_t length = strlen(name);
+    return length > 4 && strcmp(name + length - 4, ".asm") == 0;
+}
+
+/* Every .asm file directly in the directory, sorted so the order never depends on readdir */
+static bool add_directory(Batch *batch, const char *path) {
+    DIR *dir = opendir(path);
+    if (!dir) return batch_error(batch, "Cannot open directory '%s'", path);
+
+    char **names = NULL;
+    int count = 0;
+    int capacity = 0;
+    bool ok = true;
+    size_t prefix = strlen(path);
+    bool slash = prefix > 0 && path[prefix - 1] == '/';
+
+    struct dirent *entry;
+    while (ok && (entry = readdir(dir)) != NULL) {
+        if (!has_asm_extension(entry->d_name)) continue;
+
+        size_t length = prefix + (slash ? 0 : 1) + strlen(entry->d_name);
+        char *name = (char*)malloc(length + 1);
+        if (!name) {
+            ok = out_of_memory(batch);
+            break;
+        }
+        snprintf(name, length + 1, "%s%s%s", path, slash ? "" : "/", entry->d_name);
+
+        struct stat info;
+        if (stat(name, &info) != 0 || !S_ISREG(info.st_mode)) {
+            free(name);
+            continue;
+        }
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            char **grown = (char**)realloc(names, capacity * sizeof(char*));
+            if (!grown) {
+                free(name);
+                ok = out_of_memory(batch);
+                break;
+            }
+            names = grown;
+        }
+        names[count++] = name;
+    }
+    closedir(dir);
+
+    if (ok) qsort(names, count, sizeof(char*), compare_names);
+    for (int i = 0; i < count; i++) {
+        if (ok) ok = add_file(batch, names[i], strlen(names[i]), NULL);
+        free(names[i]);
+    }
+    free(names);
+    return ok;
+}
+
+static bool add_path(Batch *batch, const char *path, const char *output) {
+    struct stat info;
+    if (stat(path, &info) == 0 && S_ISDIR(info.st_mode)) {
+        if (output) return batch_error(batch, "-o cannot name the output of directory '%s'", path);
+        return add_directory(batch, path);
+    }
+    /* A file that cannot be read fails as its own job */
+    return add_file(batch, path, strlen(path), output);
+}
+
+/* One file or directory per line; blank lines and lines starting with '#' are skipped */
+static bool add_manifest(Batch *batch, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) return batch_error(batch, "Cannot read manifest '%s'", path);
+
+    char line[MANIFEST_LINE_MAX];
+    int line_number = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file)) {
+        line_number++;
+        size_t length = strlen(line);
+        if (length == sizeof(line) - 1 && line[length - 1] != '\n' && !feof(file)) {
+            snprintf(batch->error_msg, sizeof(batch->error_msg),
+                     "%s:%d: Path too long", path, line_number);
+            batch->has_error = true;
+            ok = false;
+            break;
+        }
+        while (length > 0 && isspace((unsigned char)line[length - 1])) line[--length] = '\0';
+        char *start = line;
+        while (isspace((unsigned char)*start)) start++;
+        if (*start == '\0' || *start == '#') continue;
+        ok = add_path(batch, start, NULL);
+    }
+    if (ok && ferror(file)) ok = batch_error(batch, "Cannot read manifest '%s'", path);
+    fclose(file);
+    return ok;
+}
+
+bool batch_add(Batch *batch, const char *path, const char *output) {
+    if (path[0] == '@') {
+        if (output) return batch_error(batch, "-o cannot name the outputs of manifest '%s'", path + 1);
+        return add_manifest(batch, path + 1);
+    }
+    return add_path(batch, path, output);
+}
+
+/* An output path with its directory resolved, so two spellings of one file compare equal */
+typedef struct {
+    char *key;
+    const BatchJob *job;
+} OutputKey;
+
+/* realpath() of the output's directory plus its name; the path as given if that fails */
+static char* output_key(const char *output) {
+    const char *slash = strrchr(output, '/');
+    const char *name = slash ? slash + 1 : output;
+    char *directory = slash ? copy_string(output, slash == output ? 1 : (size_t)(slash - output))
+                            : copy_string(".", 1);
+    if (!directory) return NULL;
+    char *resolved = realpath(directory, NULL);
+    free(directory);
+    if (!resolved) return copy_string(output, strlen(output));
+
+    size_t length = strlen(resolved) + 1 + strlen(name);
+    char *key = (char*)malloc(length + 1);
+    if (key) snprintf(key, length + 1, "%s/%s", resolved, name);
+    free(resolved);
+    return key;
+}
+
+static int compare_outputs(const void *a, const void *b) {
+    const OutputKey *x = (const OutputKey*)a;
+    const OutputKey *y = (const OutputKey*)b;
+    int order = strcmp(x->key, y->key);
+    if (order != 0) return order;
+    return (x->job > y->job) - (x->job < y->job);
+}
+
+/* Two jobs writing one file would race; report the first such pair in input order */
+static bool check_outputs(Batch *batch) {
+    if (batch->job_count < 2) return true;
+    OutputKey *sorted = (OutputKey*)calloc(batch->job_count, sizeof(OutputKey));
+    if (!sorted) return out_of_memory(batch);
+    bool ok = true;
+    for (int i = 0; ok && i < batch->job_count; i++) {
+        sorted[i].job = &batch->jobs[i];
+        sorted[i].key = output_key(batch->jobs[i].output);
+        if (!sorted[i].key) ok = out_of_memory(batch);
+    }
+    if (ok) qsort(sorted, batch->job_count, sizeof(OutputKey), compare_outputs);
+
+    const BatchJob *first = NULL;
+    const BatchJob *second = NULL;
+    for (int i = 1; ok && i < batch->job_count; i++) {
+        if (strcmp(sorted[i - 1].key, sorted[i].key) != 0) continue;
+        if (!second || sorted[i].job < second) {
+            first = sorted[i - 1].job;
+            second = sorted[i].job;
+        }
+    }
+    for (int i = 0; i < batch->job_count; i++) free(sorted[i].key);
+    free(sorted);
+    if (second) {
+        snprintf(batch->error_msg, sizeof(batch->error_msg),
+                 "'%s' and '%s' would both write '%s'", first->input, second->input,
+                 first->output);
+        batch->has_error = true;
+        return false;
+    }
+    return ok;
+}
+
+/* Jobs are handed out one at a time, in order, to whichever thread asks next */
+typedef struct {
+    Batch *batch;
+    const AssemblerOptions *options;
+    int next;
+    pthread_mutex_t lock;
+} BatchQueue;
+
+static void* batch_worker(void *arg) {
+    BatchQueue *queue = (BatchQueue*)arg;
+    for (;;) {
+        pthread_mutex_lock(&queue->lock);
+        int index = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+        if (index >= queue->batch->job_count) return NULL;
+
+        BatchJob *job = &queue->batch->jobs[index];
+        job->result = assemble_file_with_options(job->input, job->output, queue->options);
+    }
+}
+
+bool batch_run(Batch *batch, const AssemblerOptions *options, int threads) {
+    if (!check_outputs(batch)) return false;
+
+    BatchQueue queue;
+    queue.batch = batch;
+    queue.options = options;
+    queue.next = 0;
+    pthread_mutex_init(&queue.lock, NULL);
+
+    if (threads > batch->job_count) threads = batch->job_count;
+    pthread_t *workers = NULL;
+    int started = 0;
+    if (threads > 1) {
+        workers = (pthread_t*)malloc((threads - 1) * sizeof(pthread_t));
+    }
+    /* This thread is a worker too; if no more can start, it does every job itself */
+    for (int i = 0; workers && i < threads - 1; i++) {
+        if (pthread_create(&workers[started], NULL, batch_worker, &queue) != 0) break;
+        started++;
+    }
+    batch_worker(&queue);
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    free(workers);
+    pthread_mutex_destroy(&queue.lock);
+    return true;
+}
+
+int batch_failures(const Batch *batch) {
+    int failures = 0;
+    for (int i = 0; i < batch->job_count; i++) {
+        if (!batch->jobs[i].result.success) failures++;
+    }
+    return failures;
+}
+
+int batch_default_threads(void) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    return online > 0 ? (int)online : 1;
+}
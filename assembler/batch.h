@@ -0,0 +1,46 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include "assembler.h"
+
+/* One source file to assemble and what happened to it */
+typedef struct {
+    char *input;              /* Owned */
+    char *output;             /* Owned */
+    AssemblerResult result;   /* Filled in by batch_run */
+} BatchJob;
+
+/*
+ * Many source files assembled with the same options on a pool of threads.
+ * Every job runs the whole pipeline with its own lexer, parser, symbol
+ * table and code generator, so jobs share nothing but the options. Jobs
+ * stay in the order they were added, whatever order they finish in.
+ */
+typedef struct {
+    BatchJob *jobs;
+    int job_count;
+    int job_capacity;
+    const char *extension;    /* Of default output names: ".bc" or ".bco" */
+
+    char error_msg[512];
+    bool has_error;
+} Batch;
+
+void batch_init(Batch *batch, const char *extension);
+void batch_free(Batch *batch);
+
+/*
+ * Add path: a source file, every .asm file in a directory (sorted by
+ * name), or with a leading '@', each file a manifest lists one per line.
+ * output may only be given for a single file; NULL picks the input's name
+ * with the batch's extension.
+ */
+bool batch_add(Batch *batch, const char *path, const char *output);
+
+/* Fails only if two jobs would write the same file; see each job's result */
+bool batch_run(Batch *batch, const AssemblerOptions *options, int threads);
+int batch_failures(const Batch *batch);
+int batch_default_threads(void);
+
+#endif
@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include "cfg.h"
+#include "instructions.h"
+
+bool is_branch_opcode(uint8_t opcode) {
+    return opcode == OP_JMP || opcode == OP_JZ || opcode == OP_JNZ || opcode == OP_CALL;
+}
+
+/* Control does not fall through to the next instruction */
+static bool ends_flow(uint8_t opcode) {
+    return opcode == OP_JMP || opcode == OP_RET || opcode == OP_HALT;
+}
+
+static bool ends_block(uint8_t opcode) {
+    return is_branch_opcode(opcode) || opcode == OP_RET || opcode == OP_HALT;
+}
+
+static bool mark_reachable(ControlFlowGraph *cfg) {
+    if (cfg->block_count == 0) return true;
+
+    /* Each block is pushed at most once */
+    int *work = (int*)malloc(cfg->block_count * sizeof(int));
+    if (!work) return false;
+    int top = 0;
+    cfg->blocks[0].reachable = true;
+    work[top++] = 0;
+
+    while (top > 0) {
+        BasicBlock *block = &cfg->blocks[work[--top]];
+        int next[3] = {block->succ[0], block->succ[1], block->callee};
+        for (int i = 0; i < 3; i++) {
+            if (next[i] >= 0 && !cfg->blocks[next[i]].reachable) {
+                cfg->blocks[next[i]].reachable = true;
+                work[top++] = next[i];
+            }
+        }
+    }
+    free(work);
+    return true;
+}
+
+bool cfg_build(ControlFlowGraph *cfg, const ParsedInstruction *instructions, int count) {
+    cfg->blocks = NULL;
+    cfg->block_count = 0;
+    cfg->instruction_count = count;
+    cfg->block_of = (int*)malloc((count + 1) * sizeof(int));
+    bool *leader = (bool*)calloc(count + 1, sizeof(bool));
+    if (!cfg->block_of || !leader) {
+        free(leader);
+        cfg_free(cfg);
+        return false;
+    }
+
+    if (count > 0) leader[0] = true;
+    for (int i = 0; i < count; i++) {
+        uint8_t opcode = instructions[i].opcode;
+        if (is_branch_opcode(opcode)) leader[instructions[i].operand] = true;
+        if (ends_block(opcode)) leader[i + 1] = true;
+    }
+
+    int blocks = 0;
+    for (int i = 0; i < count; i++) {
+        if (leader[i]) blocks++;
+    }
+    cfg->blocks = (BasicBlock*)malloc((blocks > 0 ? blocks : 1) * sizeof(BasicBlock));
+    if (!cfg->blocks) {
+        free(leader);
+        cfg_free(cfg);
+        return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (leader[i]) {
+            BasicBlock *block = &cfg->blocks[cfg->block_count++];
+            block->start = i;
+            block->succ_count = 0;
+            block->callee = -1;
+            block->reachable = false;
+        }
+        cfg->block_of[i] = cfg->block_count - 1;
+        cfg->blocks[cfg->block_count - 1].end = i + 1;
+    }
+    cfg->block_of[count] = -1;
+    free(leader);
+
+    for (int b = 0; b < cfg->block_count; b++) {
+        BasicBlock *block = &cfg->blocks[b];
+        const ParsedInstruction *last = &instructions[block->end - 1];
+
+        block->succ[0] = -1;
+        block->succ[1] = -1;
+        if (!ends_flow(last->opcode) && block->end < count) {
+            block->succ[block->succ_count++] = cfg->block_of[block->end];
+        }
+        if (last->opcode == OP_CALL) {
+            block->callee = cfg->block_of[last->operand];
+        } else if (is_branch_opcode(last->opcode) && cfg->block_of[last->operand] >= 0) {
+            block->succ[block->succ_count++] = cfg->block_of[last->operand];
+        }
+    }
+
+    if (!mark_reachable(cfg)) {
+        cfg_free(cfg);
+        return false;
+    }
+    return true;
+}
+
+void cfg_free(ControlFlowGraph *cfg) {
+    free(cfg->blocks);
+    free(cfg->block_of);
+    cfg->blocks = NULL;
+    cfg->block_of = NULL;
+    cfg->block_count = 0;
+}
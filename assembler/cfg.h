@@ -0,0 +1,37 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include <stdbool.h>
+#include "parser.h"
+
+/*
+ * Control-flow graph over a program whose branch and call operands are
+ * instruction indices (as inside the optimizer). A block ends at a
+ * branch, CALL, RET or HALT, or before an instruction that is a branch
+ * target or the return point of a CALL.
+ *
+ * A CALL block's only successor is its return point; the callee is
+ * recorded separately. RET and HALT blocks, and blocks that run off the
+ * end of the code, have no successors.
+ */
+typedef struct {
+    int start;                /* First instruction */
+    int end;                  /* One past the last */
+    int succ[2];              /* Fall-through, if any, then branch target; -1 if unused */
+    int succ_count;
+    int callee;               /* Block a CALL enters, -1 otherwise */
+    bool reachable;           /* From instruction 0, through calls and returns */
+} BasicBlock;
+
+typedef struct {
+    BasicBlock *blocks;       /* In program order */
+    int block_count;
+    int *block_of;            /* Instruction index -> block; index count -> -1 */
+    int instruction_count;
+} ControlFlowGraph;
+
+bool is_branch_opcode(uint8_t opcode);
+bool cfg_build(ControlFlowGraph *cfg, const ParsedInstruction *instructions, int count);
+void cfg_free(ControlFlowGraph *cfg);
+
+#endif
@@ -3,13 +3,32 @@
 #include <string.h>
 #include "codegen.h"
 
-static bool emit_byte(CodeGenerator *gen, uint8_t byte) {
-    if (gen->bytecode_size >= MAX_BYTECODE_SIZE) {
+static bool reserve(CodeGenerator *gen, int64_t size) {
+    if (size <= gen->bytecode_capacity) return true;
+    if (size > INT32_MAX) {
+        snprintf(gen->error_msg, sizeof(gen->error_msg),
+                 "Bytecode too large (%lld bytes)", (long long)size);
+        gen->has_error = true;
+        return false;
+    }
+
+    int64_t capacity = gen->bytecode_capacity ? (int64_t)gen->bytecode_capacity * 2 : 4096;
+    if (capacity < size) capacity = size;
+    if (capacity > INT32_MAX) capacity = INT32_MAX;
+    uint8_t *grown = (uint8_t*)realloc(gen->bytecode, (size_t)capacity);
+    if (!grown) {
         snprintf(gen->error_msg, sizeof(gen->error_msg),
-                 "Bytecode too large (max %d bytes)", MAX_BYTECODE_SIZE);
+                 "Out of memory for %lld bytes of bytecode", (long long)size);
         gen->has_error = true;
         return false;
     }
+    gen->bytecode = grown;
+    gen->bytecode_capacity = (int)capacity;
+    return true;
+}
+
+static bool emit_byte(CodeGenerator *gen, uint8_t byte) {
+    if (!reserve(gen, (int64_t)gen->bytecode_size + 1)) return false;
     gen->bytecode[gen->bytecode_size] = byte;
     gen->bytecode_size++;
     return true;
@@ -33,13 +52,27 @@ static bool write_uint32(FILE *file, uint32_t value) {
 }
 
 void codegen_init(CodeGenerator *gen) {
+    gen->bytecode = NULL;
     gen->bytecode_size = 0;
+    gen->bytecode_capacity = 0;
     gen->has_error = false;
     gen->error_msg[0] = '\0';
 }
 
+void codegen_free(CodeGenerator *gen) {
+    free(gen->bytecode);
+    gen->bytecode = NULL;
+}
+
 bool codegen_generate(CodeGenerator *gen, ParsedInstruction *instructions,
                       int instruction_count) {
+    /* Size the buffer once up front */
+    int64_t size = gen->bytecode_size;
+    for (int i = 0; i < instruction_count; i++) {
+        size += instructions[i].has_operand ? 5 : 1;
+    }
+    if (!reserve(gen, size)) return false;
+
     for (int i = 0; i < instruction_count; i++) {
         ParsedInstruction *inst = &instructions[i];
 
@@ -7,17 +7,18 @@
 
 #define BYTECODE_MAGIC   0xCAFEBABE
 #define BYTECODE_VERSION 0x00000001
-#define MAX_BYTECODE_SIZE 65536
 
 typedef struct {
-    uint8_t bytecode[MAX_BYTECODE_SIZE];
+    uint8_t *bytecode;        /* Sized by codegen_generate */
     int bytecode_size;
+    int bytecode_capacity;
 
     char error_msg[256];
     bool has_error;
 } CodeGenerator;
 
 void codegen_init(CodeGenerator *gen);
+void codegen_free(CodeGenerator *gen);
 bool codegen_generate(CodeGenerator *gen, ParsedInstruction *instructions,
                       int instruction_count);
 bool codegen_write_file(CodeGenerator *gen, const char *filename);
@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "intern.h"
+
+/* FNV-1a over the upper-cased bytes */
+uint32_t name_hash(const char *text, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (uint32_t)toupper((unsigned char)text[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+bool name_equal(const char *a, const char *b) {
+    while (*a && *b) {
+        if (toupper((unsigned char)*a) != toupper((unsigned char)*b)) return false;
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+/* name against text[0 .. length), which need not be NUL-terminated */
+bool name_equal_span(const char *name, const char *text, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (name[i] == '\0' || toupper((unsigned char)name[i]) != toupper((unsigned char)text[i])) {
+            return false;
+        }
+    }
+    return name[length] == '\0';
+}
+
+void intern_init(InternTable *table, Arena *arena) {
+    table->arena = arena;
+    table->slots = NULL;
+    table->capacity = 0;
+    table->count = 0;
+}
+
+static bool grow(InternTable *table) {
+    size_t capacity = table->capacity ? table->capacity * 2 : 256;
+    InternEntry *slots = (InternEntry*)calloc(capacity, sizeof(InternEntry));
+    if (!slots) return false;
+
+    for (size_t i = 0; i < table->capacity; i++) {
+        InternEntry *entry = &table->slots[i];
+        if (!entry->name) continue;
+        size_t j = entry->hash & (capacity - 1);
+        while (slots[j].name) j = (j + 1) & (capacity - 1);
+        slots[j] = *entry;
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->capacity = capacity;
+    return true;
+}
+
+/* The one copy of text[0 .. length) and its hash; NULL if out of memory */
+const char* intern_name(InternTable *table, const char *text, size_t length, uint32_t *hash) {
+    if ((table->count + 1) * 2 > table->capacity && !grow(table)) return NULL;
+
+    uint32_t h = name_hash(text, length);
+    size_t i = h & (table->capacity - 1);
+    while (table->slots[i].name) {
+        InternEntry *entry = &table->slots[i];
+        if (entry->hash == h && name_equal_span(entry->name, text, length)) {
+            *hash = h;
+            return entry->name;
+        }
+        i = (i + 1) & (table->capacity - 1);
+    }
+
+    char *name = arena_strndup(table->arena, text, length);
+    if (!name) return NULL;
+    table->slots[i].name = name;
+    table->slots[i].hash = h;
+    table->count++;
+    *hash = h;
+    return name;
+}
+
+void intern_free(InternTable *table) {
+    free(table->slots);
+    table->slots = NULL;
+    table->capacity = 0;
+    table->count = 0;
+}
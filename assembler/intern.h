@@ -0,0 +1,33 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+
+/*
+ * Label names, interned without regard to case: every spelling of a name
+ * maps to one copy in the arena, so equal names are equal pointers and
+ * carry a hash computed once.
+ */
+typedef struct {
+    const char *name;
+    uint32_t hash;
+} InternEntry;
+
+typedef struct {
+    Arena *arena;
+    InternEntry *slots;       /* Open-addressed; name NULL when empty */
+    size_t capacity;          /* Power of two */
+    size_t count;
+} InternTable;
+
+uint32_t name_hash(const char *text, size_t length);
+bool name_equal(const char *a, const char *b);
+bool name_equal_span(const char *name, const char *text, size_t length);
+void intern_init(InternTable *table, Arena *arena);
+const char* intern_name(InternTable *table, const char *text, size_t length, uint32_t *hash);
+void intern_free(InternTable *table);
+
+#endif
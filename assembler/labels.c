@@ -1,21 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include "labels.h"
+#include "intern.h"
 #include "instructions.h"
 
-static int strcasecmp_local(const char *s1, const char *s2) {
-    while (*s1 && *s2) {
-        char c1 = toupper((unsigned char)*s1);
-        char c2 = toupper((unsigned char)*s2);
-        if (c1 != c2) return c1 - c2;
-        s1++;
-        s2++;
-    }
-    return toupper((unsigned char)*s1) - toupper((unsigned char)*s2);
-}
-
 static int instruction_size(ParsedInstruction *inst) {
     if (inst->has_operand) {
         return 5;
@@ -24,22 +13,72 @@ static int instruction_size(ParsedInstruction *inst) {
 }
 
 void symtab_init(SymbolTable *table) {
+    table->labels = NULL;
     table->label_count = 0;
+    table->label_capacity = 0;
+    table->slots = NULL;
+    table->slot_capacity = 0;
     table->has_error = false;
     table->error_msg[0] = '\0';
 }
 
+void symtab_free(SymbolTable *table) {
+    free(table->labels);
+    free(table->slots);
+    table->labels = NULL;
+    table->slots = NULL;
+}
+
+/* Slot for name: the one holding it, or the empty one where it would go */
+static int find_slot(SymbolTable *table, const char *name, uint32_t hash) {
+    int mask = table->slot_capacity - 1;
+    int i = (int)(hash & (uint32_t)mask);
+    while (table->slots[i] >= 0) {
+        LabelEntry *entry = &table->labels[table->slots[i]];
+        /* Interned names match by pointer; other callers pass any spelling */
+        if (entry->hash == hash && (entry->name == name || name_equal(entry->name, name))) {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static LabelEntry* lookup_hashed(SymbolTable *table, const char *name, uint32_t hash) {
+    if (table->slot_capacity == 0) return NULL;
+    int slot = table->slots[find_slot(table, name, hash)];
+    return slot >= 0 ? &table->labels[slot] : NULL;
+}
+
 LabelEntry* symtab_lookup(SymbolTable *table, const char *name) {
+    return lookup_hashed(table, name, name_hash(name, strlen(name)));
+}
+
+static bool grow_slots(SymbolTable *table) {
+    int capacity = table->slot_capacity ? table->slot_capacity * 2 : 256;
+    int *slots = (int*)malloc(capacity * sizeof(int));
+    if (!slots) return false;
+    for (int i = 0; i < capacity; i++) slots[i] = -1;
+
+    free(table->slots);
+    table->slots = slots;
+    table->slot_capacity = capacity;
     for (int i = 0; i < table->label_count; i++) {
-        if (strcasecmp_local(table->labels[i].name, name) == 0) {
-            return &table->labels[i];
-        }
+        LabelEntry *entry = &table->labels[i];
+        slots[find_slot(table, entry->name, entry->hash)] = i;
     }
-    return NULL;
+    return true;
 }
 
-static bool add_label(SymbolTable *table, const char *name, int32_t address, int line) {
-    LabelEntry *existing = symtab_lookup(table, name);
+static bool out_of_memory(SymbolTable *table) {
+    snprintf(table->error_msg, sizeof(table->error_msg), "Out of memory");
+    table->has_error = true;
+    return false;
+}
+
+static bool add_label(SymbolTable *table, const char *name, uint32_t hash,
+                      int32_t address, int line) {
+    LabelEntry *existing = lookup_hashed(table, name, hash);
     if (existing && existing->defined) {
         snprintf(table->error_msg, sizeof(table->error_msg),
                  "Line %d: Label '%s' already defined on line %d",
@@ -48,55 +87,44 @@ static bool add_label(SymbolTable *table, const char *name, int32_t address, int
         return false;
     }
 
-    if (table->label_count >= MAX_LABELS) {
-        snprintf(table->error_msg, sizeof(table->error_msg),
-                 "Too many labels (max %d)", MAX_LABELS);
-        table->has_error = true;
-        return false;
+    if (table->label_count == table->label_capacity) {
+        int capacity = table->label_capacity ? table->label_capacity * 2 : 64;
+        LabelEntry *grown = (LabelEntry*)realloc(table->labels, capacity * sizeof(LabelEntry));
+        if (!grown) return out_of_memory(table);
+        table->labels = grown;
+        table->label_capacity = capacity;
+    }
+    if ((table->label_count + 1) * 2 > table->slot_capacity && !grow_slots(table)) {
+        return out_of_memory(table);
     }
 
     LabelEntry *entry = &table->labels[table->label_count];
-    strncpy(entry->name, name, MAX_LABEL_LENGTH - 1);
-    entry->name[MAX_LABEL_LENGTH - 1] = '\0';
+    entry->name = name;
+    entry->hash = hash;
     entry->address = address;
     entry->line = line;
     entry->defined = true;
 
+    table->slots[find_slot(table, name, hash)] = table->label_count;
     table->label_count++;
     return true;
 }
 
-bool symtab_collect_labels(SymbolTable *table, Token *tokens, int token_count,
+/* Labels arrive in source order, so one walk over the instructions gives every address */
+bool symtab_collect_labels(SymbolTable *table, ParsedLabel *labels, int label_count,
                            ParsedInstruction *instructions, int instruction_count) {
-    int current_address = 0;
+    int32_t current_address = 0;
     int instruction_index = 0;
-    bool prev_was_instruction = false;
 
-    for (int i = 0; i < token_count; i++) {
-        Token *token = &tokens[i];
+    for (int i = 0; i < label_count; i++) {
+        ParsedLabel *label = &labels[i];
 
-        if (token->type == TOKEN_LABEL_DEF) {
-            if (!add_label(table, token->text, current_address, token->line)) {
-                return false;
-            }
-            prev_was_instruction = false;
-        }
-        else if (token->type == TOKEN_INSTRUCTION) {
-            if (!prev_was_instruction) {
-                if (instruction_index < instruction_count) {
-                    current_address += instruction_size(&instructions[instruction_index]);
-                    instruction_index++;
-                }
-                prev_was_instruction = true;
-            } else {
-                prev_was_instruction = false;
-            }
-        }
-        else if (token->type == TOKEN_NUMBER) {
-            prev_was_instruction = false;
+        while (instruction_index < label->instruction && instruction_index < instruction_count) {
+            current_address += instruction_size(&instructions[instruction_index]);
+            instruction_index++;
         }
-        else if (token->type == TOKEN_NEWLINE || token->type == TOKEN_EOF) {
-            prev_was_instruction = false;
+        if (!add_label(table, label->name, label->hash, current_address, label->line)) {
+            return false;
         }
     }
 
@@ -109,7 +137,7 @@ bool symtab_resolve_labels(SymbolTable *table, ParsedInstruction *instructions,
         ParsedInstruction *inst = &instructions[i];
 
         if (inst->is_label_ref) {
-            LabelEntry *entry = symtab_lookup(table, inst->label_name);
+            LabelEntry *entry = lookup_hashed(table, inst->label_name, inst->label_hash);
             if (!entry) {
                 snprintf(table->error_msg, sizeof(table->error_msg),
                          "Line %d: Undefined label '%s'",
@@ -6,25 +6,28 @@
 #include "lexer.h"
 #include "parser.h"
 
-#define MAX_LABELS 256
-
 typedef struct {
-    char name[MAX_LABEL_LENGTH];
+    const char *name;         /* Interned by the parser */
+    uint32_t hash;            /* name_hash of name */
     int32_t address;
     int line;
     bool defined;
 } LabelEntry;
 
 typedef struct {
-    LabelEntry labels[MAX_LABELS];
+    LabelEntry *labels;       /* Grows as labels are added */
     int label_count;
+    int label_capacity;
+    int *slots;               /* Open-addressed hash index into labels; -1 when empty */
+    int slot_capacity;        /* Power of two, at least twice label_count */
 
     char error_msg[256];
     bool has_error;
 } SymbolTable;
 
 void symtab_init(SymbolTable *table);
-bool symtab_collect_labels(SymbolTable *table, Token *tokens, int token_count,
+void symtab_free(SymbolTable *table);
+bool symtab_collect_labels(SymbolTable *table, ParsedLabel *labels, int label_count,
                            ParsedInstruction *instructions, int instruction_count);
 bool symtab_resolve_labels(SymbolTable *table, ParsedInstruction *instructions,
                            int instruction_count);
@@ -1,11 +1,38 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <limits.h>
 #include "lexer.h"
 
+/*
+ * Make at least want bytes available from pos unless the file ends first.
+ * Unread bytes move to the front of the window, so offsets into the window
+ * are only valid until the next refill.
+ */
+static void fill(Lexer *lexer, size_t want) {
+    if (!lexer->file) return;
+    while (!lexer->at_eof && lexer->end - lexer->pos < want) {
+        size_t left = lexer->end - lexer->pos;
+        memmove(lexer->buffer, lexer->buffer + lexer->pos, left);
+        lexer->pos = 0;
+        lexer->end = left;
+
+        size_t read = fread(lexer->buffer + left, 1, LEXER_BUFFER_SIZE - left, lexer->file);
+        lexer->end += read;
+        if (read == 0) {
+            if (ferror(lexer->file)) {
+                snprintf(lexer->error_msg, sizeof(lexer->error_msg),
+                         "Line %d: Read error", lexer->line);
+                lexer->has_error = true;
+            }
+            lexer->at_eof = true;
+        }
+    }
+}
+
 static bool is_at_end(Lexer *lexer) {
-    return lexer->source[lexer->pos] == '\0';
+    if (lexer->pos >= lexer->end) fill(lexer, 1);
+    return lexer->pos >= lexer->end;
 }
 
 static char peek(Lexer *lexer) {
@@ -16,8 +43,35 @@ static char advance(Lexer *lexer) {
     return lexer->source[lexer->pos++];
 }
 
+#define WORD_ONES  0x0101010101010101ull
+#define WORD_HIGHS 0x8080808080808080ull
+
+/* High bit set in each byte of word equal to c, and nowhere else */
+static uint64_t bytes_equal(uint64_t word, unsigned char c) {
+    uint64_t x = word ^ (WORD_ONES * c);
+    return ~(((x & ~WORD_HIGHS) + ~WORD_HIGHS) | x | ~WORD_HIGHS);
+}
+
+/* Spaces, tabs and carriage returns, eight bytes at a time where the window allows */
 static void skip_whitespace(Lexer *lexer) {
     while (!is_at_end(lexer)) {
+        while (lexer->end - lexer->pos >= 8) {
+            uint64_t word;
+            memcpy(&word, lexer->source + lexer->pos, 8);
+            uint64_t other = ~(bytes_equal(word, ' ') | bytes_equal(word, '\t') |
+                               bytes_equal(word, '\r')) & WORD_HIGHS;
+            if (!other) {
+                lexer->pos += 8;
+                continue;
+            }
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            lexer->pos += __builtin_clzll(other) / 8;
+#else
+            lexer->pos += __builtin_ctzll(other) / 8;
+#endif
+            return;
+        }
+
         char c = peek(lexer);
         if (c == ' ' || c == '\t' || c == '\r') {
             advance(lexer);
@@ -27,9 +81,15 @@ static void skip_whitespace(Lexer *lexer) {
     }
 }
 
+/* Up to the newline that ends the comment, via memchr over the window */
 static void skip_comment(Lexer *lexer) {
-    while (!is_at_end(lexer) && peek(lexer) != '\n') {
-        advance(lexer);
+    while (!is_at_end(lexer)) {
+        const char *newline = memchr(lexer->source + lexer->pos, '\n', lexer->end - lexer->pos);
+        if (newline) {
+            lexer->pos = newline - lexer->source;
+            return;
+        }
+        lexer->pos = lexer->end;
     }
 }
 
@@ -47,33 +107,25 @@ static bool is_digit(char c) {
     return c >= '0' && c <= '9';
 }
 
-static bool add_token(Lexer *lexer, TokenType type, const char *text, int32_t value) {
-    if (lexer->token_count >= MAX_TOKENS) {
-        snprintf(lexer->error_msg, sizeof(lexer->error_msg),
-                 "Too many tokens (max %d)", MAX_TOKENS);
-        lexer->has_error = true;
-        return false;
-    }
-
-    Token *token = &lexer->tokens[lexer->token_count];
+static bool set_token(Lexer *lexer, Token *token, TokenType type,
+                      const char *text, size_t length, int32_t value) {
     token->type = type;
-    strncpy(token->text, text, MAX_TOKEN_LENGTH - 1);
-    token->text[MAX_TOKEN_LENGTH - 1] = '\0';
+    token->text = text;
+    token->length = (int)length;
     token->value = value;
     token->line = lexer->line;
-
-    lexer->token_count++;
     return true;
 }
 
-static bool read_identifier(Lexer *lexer) {
-    int start = lexer->pos;
+/* The caller has filled the window with MAX_TOKEN_LENGTH + 1 bytes, or to the end */
+static bool read_identifier(Lexer *lexer, Token *token) {
+    size_t start = lexer->pos;
 
-    while (!is_at_end(lexer) && is_alnum(peek(lexer))) {
+    while (lexer->pos < lexer->end && is_alnum(peek(lexer))) {
         advance(lexer);
     }
 
-    int length = lexer->pos - start;
+    size_t length = lexer->pos - start;
     if (length >= MAX_TOKEN_LENGTH) {
         snprintf(lexer->error_msg, sizeof(lexer->error_msg),
                  "Line %d: Identifier too long", lexer->line);
@@ -81,61 +133,95 @@ static bool read_identifier(Lexer *lexer) {
         return false;
     }
 
-    char text[MAX_TOKEN_LENGTH];
-    strncpy(text, lexer->source + start, length);
-    text[length] = '\0';
-
-    if (!is_at_end(lexer) && peek(lexer) == ':') {
+    if (lexer->pos < lexer->end && peek(lexer) == ':') {
         advance(lexer);
-        return add_token(lexer, TOKEN_LABEL_DEF, text, 0);
+        return set_token(lexer, token, TOKEN_LABEL_DEF, lexer->source + start, length, 0);
     }
 
-    return add_token(lexer, TOKEN_INSTRUCTION, text, 0);
+    return set_token(lexer, token, TOKEN_INSTRUCTION, lexer->source + start, length, 0);
 }
 
-static bool read_number(Lexer *lexer) {
-    int start = lexer->pos;
+/* The value is accumulated while scanning, with atoi's clamping to long */
+static bool read_number(Lexer *lexer, Token *token) {
+    size_t start = lexer->pos;
+    bool negative = false;
 
     if (peek(lexer) == '-') {
         advance(lexer);
+        negative = true;
     }
 
-    if (is_at_end(lexer) || !is_digit(peek(lexer))) {
+    if (lexer->pos >= lexer->end || !is_digit(peek(lexer))) {
         snprintf(lexer->error_msg, sizeof(lexer->error_msg),
                  "Line %d: Expected digit after '-'", lexer->line);
         lexer->has_error = true;
         return false;
     }
 
-    while (!is_at_end(lexer) && is_digit(peek(lexer))) {
-        advance(lexer);
+    unsigned long magnitude = 0;
+    unsigned long limit = negative ? (unsigned long)LONG_MAX + 1 : (unsigned long)LONG_MAX;
+    while (lexer->pos < lexer->end && is_digit(peek(lexer))) {
+        unsigned digit = (unsigned)(advance(lexer) - '0');
+        if (magnitude > (limit - digit) / 10) {
+            magnitude = limit;
+        } else {
+            magnitude = magnitude * 10 + digit;
+        }
     }
 
-    int length = lexer->pos - start;
-    char text[MAX_TOKEN_LENGTH];
-    strncpy(text, lexer->source + start, length);
-    text[length] = '\0';
-
-    int32_t value = atoi(text);
+    size_t length = lexer->pos - start;
+    if (length >= MAX_TOKEN_LENGTH) {
+        snprintf(lexer->error_msg, sizeof(lexer->error_msg),
+                 "Line %d: Number too long", lexer->line);
+        lexer->has_error = true;
+        return false;
+    }
 
-    return add_token(lexer, TOKEN_NUMBER, text, value);
+    long value = negative ? (long)(0ul - magnitude) : (long)magnitude;
+    return set_token(lexer, token, TOKEN_NUMBER, lexer->source + start, length, (int32_t)value);
 }
 
 void lexer_init(Lexer *lexer, const char *source) {
+    lexer->file = NULL;
+    lexer->buffer = NULL;
     lexer->source = source;
     lexer->pos = 0;
+    lexer->end = strlen(source);
+    lexer->at_eof = true;
     lexer->line = 1;
-    lexer->token_count = 0;
     lexer->has_error = false;
     lexer->error_msg[0] = '\0';
 }
 
-bool lexer_tokenize(Lexer *lexer) {
+/* Read the source from file; false if out of memory */
+bool lexer_init_file(Lexer *lexer, FILE *file) {
+    lexer_init(lexer, "");
+    lexer->buffer = (char*)malloc(LEXER_BUFFER_SIZE);
+    if (!lexer->buffer) {
+        snprintf(lexer->error_msg, sizeof(lexer->error_msg), "Out of memory");
+        lexer->has_error = true;
+        return false;
+    }
+    lexer->file = file;
+    lexer->source = lexer->buffer;
+    lexer->at_eof = false;
+    return true;
+}
+
+void lexer_free(Lexer *lexer) {
+    free(lexer->buffer);
+    lexer->buffer = NULL;
+}
+
+/* Scan the next token into *token; TOKEN_EOF once the source is used up */
+bool lexer_next(Lexer *lexer, Token *token) {
     while (!is_at_end(lexer)) {
         skip_whitespace(lexer);
 
         if (is_at_end(lexer)) break;
 
+        /* A whole identifier or number, its ':' and one more byte fit in the window */
+        fill(lexer, MAX_TOKEN_LENGTH + 1);
         char c = peek(lexer);
 
         if (c == ';') {
@@ -144,20 +230,19 @@ bool lexer_tokenize(Lexer *lexer) {
         }
 
         if (c == '\n') {
+            set_token(lexer, token, TOKEN_NEWLINE, lexer->source + lexer->pos, 1, 0);
             advance(lexer);
-            if (!add_token(lexer, TOKEN_NEWLINE, "\\n", 0)) return false;
             lexer->line++;
-            continue;
+            return true;
         }
 
-        if (is_digit(c) || (c == '-' && is_digit(lexer->source[lexer->pos + 1]))) {
-            if (!read_number(lexer)) return false;
-            continue;
+        if (is_digit(c) || (c == '-' && lexer->pos + 1 < lexer->end &&
+                            is_digit(lexer->source[lexer->pos + 1]))) {
+            return read_number(lexer, token);
         }
 
         if (is_alpha(c)) {
-            if (!read_identifier(lexer)) return false;
-            continue;
+            return read_identifier(lexer, token);
         }
 
         snprintf(lexer->error_msg, sizeof(lexer->error_msg),
@@ -166,21 +251,8 @@ bool lexer_tokenize(Lexer *lexer) {
         return false;
     }
 
-    return add_token(lexer, TOKEN_EOF, "EOF", 0);
-}
-
-void lexer_print_tokens(Lexer *lexer) {
-    printf("=== Tokens (%d total) ===\n", lexer->token_count);
-    for (int i = 0; i < lexer->token_count; i++) {
-        Token *t = &lexer->tokens[i];
-        printf("[%3d] Line %2d: %-15s '%s'",
-               i, t->line, token_type_string(t->type), t->text);
-        if (t->type == TOKEN_NUMBER) {
-            printf(" (value: %d)", t->value);
-        }
-        printf("\n");
-    }
-    printf("========================\n");
+    if (lexer->has_error) return false;  /* Read error */
+    return set_token(lexer, token, TOKEN_EOF, "", 0, 0);
 }
 
 const char* token_type_string(TokenType type) {
@@ -1,11 +1,12 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include <stdio.h>
 #include <stdbool.h>
 #include <stdint.h>
 
 #define MAX_TOKEN_LENGTH 64
-#define MAX_TOKENS 1024
+#define LEXER_BUFFER_SIZE 65536  /* Bytes of a source file held at a time */
 
 typedef enum {
     TOKEN_INSTRUCTION,
@@ -17,28 +18,40 @@ typedef enum {
     TOKEN_ERROR
 } TokenType;
 
+/*
+ * text is a span into the lexer's window, not NUL-terminated, and is only
+ * valid until the next lexer_next call: a refill moves the window.
+ */
 typedef struct {
     TokenType type;
-    char text[MAX_TOKEN_LENGTH];
+    const char *text;
+    int length;
     int32_t value;
     int line;
 } Token;
 
+/*
+ * Tokens are produced one at a time by lexer_next. A file is read through
+ * a fixed LEXER_BUFFER_SIZE window, so the source is never held in memory
+ * whole; a string source is scanned in place.
+ */
 typedef struct {
-    const char *source;
-    int pos;
+    FILE *file;            /* NULL for a string source */
+    char *buffer;          /* File window; NULL for a string source */
+    const char *source;    /* Unread text is source[pos .. end) */
+    size_t pos;
+    size_t end;
+    bool at_eof;           /* Nothing left to read past end */
     int line;
 
-    Token tokens[MAX_TOKENS];
-    int token_count;
-
     char error_msg[256];
     bool has_error;
 } Lexer;
 
 void lexer_init(Lexer *lexer, const char *source);
-bool lexer_tokenize(Lexer *lexer);
-void lexer_print_tokens(Lexer *lexer);
+bool lexer_init_file(Lexer *lexer, FILE *file);
+bool lexer_next(Lexer *lexer, Token *token);
+void lexer_free(Lexer *lexer);
 const char* token_type_string(TokenType type);
 
 #endif
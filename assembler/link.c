@@ -0,0 +1,411 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "link.h"
+#include "codegen.h"
+#include "intern.h"
+
+static bool out_of_memory(Linker *linker) {
+    snprintf(linker->error_msg, sizeof(linker->error_msg), "Out of memory");
+    linker->has_error = true;
+    return false;
+}
+
+void linker_init(Linker *linker) {
+    memset(linker, 0, sizeof(*linker));
+    linker->strip = true;
+}
+
+void linker_free(Linker *linker) {
+    for (int i = 0; i < linker->module_count; i++) {
+        object_free(&linker->modules[i]);
+    }
+    free(linker->modules);
+    free(linker->paths);
+    free(linker->code);
+    linker->modules = NULL;
+    linker->paths = NULL;
+    linker->code = NULL;
+}
+
+bool linker_add_file(Linker *linker, const char *path) {
+    if (linker->module_count == linker->module_capacity) {
+        int capacity = linker->module_capacity ? linker->module_capacity * 2 : 16;
+        ObjectModule *modules = (ObjectModule*)realloc(linker->modules,
+                                                       capacity * sizeof(ObjectModule));
+        if (!modules) return out_of_memory(linker);
+        linker->modules = modules;
+        const char **paths = (const char**)realloc(linker->paths, capacity * sizeof(char*));
+        if (!paths) return out_of_memory(linker);
+        linker->paths = paths;
+        linker->module_capacity = capacity;
+    }
+
+    ObjectModule *module = &linker->modules[linker->module_count];
+    object_init(module);
+    if (!object_read_file(module, path)) {
+        snprintf(linker->error_msg, sizeof(linker->error_msg), "%s", module->error_msg);
+        linker->has_error = true;
+        object_free(module);
+        return false;
+    }
+    linker->paths[linker->module_count++] = path;
+    return true;
+}
+
+/* Where an address in some module ends up */
+typedef struct {
+    int module;
+    int32_t address;
+} LinkTarget;
+
+/* Per-link working state; indices into sections are module base + section */
+typedef struct {
+    Linker *linker;
+    int *section_base;        /* Module -> its first global section index; module_count + 1 entries */
+    LinkTarget **imports;     /* Module -> symbol -> the export it resolves to */
+    bool *kept;
+    int *worklist;
+    int worklist_count;
+    int32_t *new_start;       /* Global section -> address in the linked program */
+    int32_t *module_end;      /* Module -> address just past its kept code */
+} LinkState;
+
+/* Exports by name: open addressing over (module, symbol) pairs */
+typedef struct {
+    int module;               /* -1 when empty */
+    int symbol;
+} ExportSlot;
+
+static bool build_exports(LinkState *state, ExportSlot **table, size_t *capacity) {
+    Linker *linker = state->linker;
+    size_t exports = 0;
+    for (int m = 0; m < linker->module_count; m++) {
+        for (int s = 0; s < linker->modules[m].symbol_count; s++) {
+            if (!linker->modules[m].symbols[s].import) exports++;
+        }
+    }
+    size_t size = 16;
+    while (size < exports * 2) size *= 2;
+    ExportSlot *slots = (ExportSlot*)malloc(size * sizeof(ExportSlot));
+    if (!slots) return out_of_memory(linker);
+    for (size_t i = 0; i < size; i++) slots[i].module = -1;
+
+    for (int m = 0; m < linker->module_count; m++) {
+        ObjectModule *module = &linker->modules[m];
+        for (int s = 0; s < module->symbol_count; s++) {
+            ObjectSymbol *symbol = &module->symbols[s];
+            if (symbol->import) continue;
+            size_t at = symbol->hash & (size - 1);
+            while (slots[at].module >= 0) {
+                ObjectSymbol *other = &linker->modules[slots[at].module].symbols[slots[at].symbol];
+                if (other->hash == symbol->hash && name_equal(other->name, symbol->name)) {
+                    snprintf(linker->error_msg, sizeof(linker->error_msg),
+                             "'%s' is exported by both '%s' and '%s'", symbol->name,
+                             linker->paths[slots[at].module], linker->paths[m]);
+                    linker->has_error = true;
+                    free(slots);
+                    return false;
+                }
+                at = (at + 1) & (size - 1);
+            }
+            slots[at].module = m;
+            slots[at].symbol = s;
+        }
+    }
+    *table = slots;
+    *capacity = size;
+    return true;
+}
+
+static bool resolve_imports(LinkState *state) {
+    Linker *linker = state->linker;
+    ExportSlot *slots;
+    size_t size;
+    if (!build_exports(state, &slots, &size)) return false;
+
+    for (int m = 0; m < linker->module_count; m++) {
+        ObjectModule *module = &linker->modules[m];
+        state->imports[m] = (LinkTarget*)calloc(module->symbol_count + 1, sizeof(LinkTarget));
+        if (!state->imports[m]) {
+            free(slots);
+            return out_of_memory(linker);
+        }
+        for (int s = 0; s < module->symbol_count; s++) {
+            ObjectSymbol *symbol = &module->symbols[s];
+            if (!symbol->import) continue;
+            size_t at = symbol->hash & (size - 1);
+            while (slots[at].module >= 0) {
+                ObjectSymbol *other = &linker->modules[slots[at].module].symbols[slots[at].symbol];
+                if (other->hash == symbol->hash && name_equal(other->name, symbol->name)) break;
+                at = (at + 1) & (size - 1);
+            }
+            if (slots[at].module < 0) {
+                snprintf(linker->error_msg, sizeof(linker->error_msg),
+                         "'%s' imports '%s', which no module exports",
+                         linker->paths[m], symbol->name);
+                linker->has_error = true;
+                free(slots);
+                return false;
+            }
+            state->imports[m][s].module = slots[at].module;
+            state->imports[m][s].address =
+                linker->modules[slots[at].module].symbols[slots[at].symbol].address;
+        }
+    }
+    free(slots);
+    return true;
+}
+
+/* The section of module holding address; -1 past the end of its code */
+static int find_section(const ObjectModule *module, int32_t address) {
+    if (address >= module->code_size) return -1;
+    int low = 0;
+    int high = module->section_count - 1;
+    while (low < high) {
+        int mid = (low + high + 1) / 2;
+        if (module->sections[mid].start <= address) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+static int32_t section_end(const ObjectModule *module, int section) {
+    return section + 1 < module->section_count ? module->sections[section + 1].start
+                                               : module->code_size;
+}
+
+static void keep_section(LinkState *state, int module, int section) {
+    int global = state->section_base[module] + section;
+    if (state->kept[global]) return;
+    state->kept[global] = true;
+    state->worklist[state->worklist_count++] = global;
+}
+
+/*
+ * Reaching the end of a module's code reaches whatever follows it: the
+ * next module that has any.
+ */
+static void keep_after_module(LinkState *state, int module) {
+    for (int m = module + 1; m < state->linker->module_count; m++) {
+        if (state->linker->modules[m].section_count > 0) {
+            keep_section(state, m, 0);
+            return;
+        }
+    }
+}
+
+static void keep_address(LinkState *state, int module, int32_t address) {
+    int section = find_section(&state->linker->modules[module], address);
+    if (section >= 0) {
+        keep_section(state, module, section);
+    } else {
+        keep_after_module(state, module);
+    }
+}
+
+static LinkTarget relocation_target(LinkState *state, int module, const ObjectRelocation *reloc) {
+    if (reloc->symbol >= 0) return state->imports[module][reloc->symbol];
+
+    const uint8_t *operand = state->linker->modules[module].code + reloc->offset + 1;
+    LinkTarget target;
+    target.module = module;
+    target.address = (int32_t)((uint32_t)operand[0] | ((uint32_t)operand[1] << 8) |
+                               ((uint32_t)operand[2] << 16) | ((uint32_t)operand[3] << 24));
+    return target;
+}
+
+/* First relocation at or after offset */
+static int first_relocation(const ObjectModule *module, int32_t offset) {
+    int low = 0;
+    int high = module->relocation_count;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (module->relocations[mid].offset < offset) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static int module_of_section(const LinkState *state, int global) {
+    int low = 0;
+    int high = state->linker->module_count - 1;
+    while (low < high) {
+        int mid = (low + high + 1) / 2;
+        if (state->section_base[mid] <= global) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+static void mark_reachable(LinkState *state) {
+    Linker *linker = state->linker;
+    int total = state->section_base[linker->module_count];
+    if (!linker->strip) {
+        for (int i = 0; i < total; i++) state->kept[i] = true;
+        return;
+    }
+    if (linker->modules[0].section_count > 0) {
+        keep_section(state, 0, 0);
+    } else {
+        keep_after_module(state, 0);
+    }
+
+    while (state->worklist_count > 0) {
+        int global = state->worklist[--state->worklist_count];
+        int m = module_of_section(state, global);
+        int s = global - state->section_base[m];
+        ObjectModule *module = &linker->modules[m];
+
+        int32_t end = section_end(module, s);
+        for (int r = first_relocation(module, module->sections[s].start);
+             r < module->relocation_count && module->relocations[r].offset < end; r++) {
+            LinkTarget target = relocation_target(state, m, &module->relocations[r]);
+            keep_address(state, target.module, target.address);
+        }
+        if (module->sections[s].falls_through) {
+            if (s + 1 < module->section_count) {
+                keep_section(state, m, s + 1);
+            } else {
+                keep_after_module(state, m);
+            }
+        }
+    }
+}
+
+static int32_t new_address(LinkState *state, LinkTarget target) {
+    ObjectModule *module = &state->linker->modules[target.module];
+    int section = find_section(module, target.address);
+    if (section < 0) return state->module_end[target.module];
+    return state->new_start[state->section_base[target.module] + section] +
+           (target.address - module->sections[section].start);
+}
+
+/* Lay out the kept sections in order, then copy them and patch every relocated operand */
+static bool emit_program(LinkState *state) {
+    Linker *linker = state->linker;
+    int32_t size = 0;
+    for (int m = 0; m < linker->module_count; m++) {
+        ObjectModule *module = &linker->modules[m];
+        for (int s = 0; s < module->section_count; s++) {
+            int global = state->section_base[m] + s;
+            state->new_start[global] = size;
+            if (state->kept[global]) {
+                size += section_end(module, s) - module->sections[s].start;
+                linker->stats.sections_kept++;
+            }
+        }
+        state->module_end[m] = size;
+    }
+
+    linker->code = (uint8_t*)malloc(size > 0 ? size : 1);
+    if (!linker->code) return out_of_memory(linker);
+    linker->code_size = size;
+
+    for (int m = 0; m < linker->module_count; m++) {
+        ObjectModule *module = &linker->modules[m];
+        for (int s = 0; s < module->section_count; s++) {
+            int global = state->section_base[m] + s;
+            if (!state->kept[global]) continue;
+            int32_t start = module->sections[s].start;
+            int32_t end = section_end(module, s);
+            uint8_t *out = linker->code + state->new_start[global];
+            memcpy(out, module->code + start, end - start);
+
+            for (int r = first_relocation(module, start);
+                 r < module->relocation_count && module->relocations[r].offset < end; r++) {
+                LinkTarget target = relocation_target(state, m, &module->relocations[r]);
+                uint32_t address = (uint32_t)new_address(state, target);
+                uint8_t *operand = out + (module->relocations[r].offset - start) + 1;
+                operand[0] = (uint8_t)(address & 0xFF);
+                operand[1] = (uint8_t)((address >> 8) & 0xFF);
+                operand[2] = (uint8_t)((address >> 16) & 0xFF);
+                operand[3] = (uint8_t)((address >> 24) & 0xFF);
+            }
+        }
+    }
+    return true;
+}
+
+bool linker_link(Linker *linker) {
+    if (linker->module_count == 0) {
+        snprintf(linker->error_msg, sizeof(linker->error_msg), "No modules to link");
+        linker->has_error = true;
+        return false;
+    }
+
+    LinkState state;
+    memset(&state, 0, sizeof(state));
+    state.linker = linker;
+    state.section_base = (int*)malloc((linker->module_count + 1) * sizeof(int));
+    state.imports = (LinkTarget**)calloc(linker->module_count, sizeof(LinkTarget*));
+    state.module_end = (int32_t*)malloc(linker->module_count * sizeof(int32_t));
+    bool ok = state.section_base && state.imports && state.module_end;
+
+    int64_t total = 0;
+    int64_t bytes = 0;
+    for (int m = 0; ok && m < linker->module_count; m++) {
+        state.section_base[m] = (int)total;
+        total += linker->modules[m].section_count;
+        bytes += linker->modules[m].code_size;
+        if (bytes > INT32_MAX) {
+            snprintf(linker->error_msg, sizeof(linker->error_msg),
+                     "Linked program too large (%lld bytes)", (long long)bytes);
+            linker->has_error = true;
+            ok = false;
+        }
+    }
+    if (ok) {
+        state.section_base[linker->module_count] = (int)total;
+        state.kept = (bool*)calloc(total + 1, sizeof(bool));
+        state.worklist = (int*)malloc((total + 1) * sizeof(int));
+        state.new_start = (int32_t*)malloc((total + 1) * sizeof(int32_t));
+        if (!state.kept || !state.worklist || !state.new_start) ok = out_of_memory(linker);
+    } else if (!linker->has_error) {
+        out_of_memory(linker);
+    }
+
+    if (ok) ok = resolve_imports(&state);
+    if (ok) {
+        linker->stats.modules = linker->module_count;
+        linker->stats.sections_total = (int)total;
+        linker->stats.bytes_before = (int)bytes;
+        mark_reachable(&state);
+        ok = emit_program(&state);
+        linker->stats.bytes_after = linker->code_size;
+    }
+
+    if (state.imports) {
+        for (int m = 0; m < linker->module_count; m++) free(state.imports[m]);
+    }
+    free(state.imports);
+    free(state.section_base);
+    free(state.kept);
+    free(state.worklist);
+    free(state.new_start);
+    free(state.module_end);
+    return ok;
+}
+
+bool linker_write_file(Linker *linker, const char *filename) {
+    CodeGenerator gen;
+    codegen_init(&gen);
+    gen.bytecode = linker->code;
+    gen.bytecode_size = linker->code_size;
+    gen.bytecode_capacity = linker->code_size;
+    bool ok = codegen_write_file(&gen, filename);
+    if (!ok) {
+        snprintf(linker->error_msg, sizeof(linker->error_msg), "%s", gen.error_msg);
+        linker->has_error = true;
+    }
+    return ok;
+}
@@ -0,0 +1,47 @@
+#ifndef LINK_H
+#define LINK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "object.h"
+
+/* What the linker did to one program */
+typedef struct {
+    int modules;
+    int sections_total;
+    int sections_kept;
+    int bytes_before;         /* All modules' code */
+    int bytes_after;          /* The linked program's code */
+} LinkerStats;
+
+/*
+ * Combines object modules into one program. The first module added runs
+ * first: the program starts at its first instruction. Modules are laid
+ * out in the order they were added.
+ *
+ * With strip set, only sections reachable from that first instruction are
+ * kept: a kept section keeps every section it jumps to, calls or pushes
+ * the address of, and the section it falls through into.
+ */
+typedef struct {
+    ObjectModule *modules;
+    const char **paths;       /* For error messages; not owned */
+    int module_count;
+    int module_capacity;
+    bool strip;               /* Default true */
+
+    uint8_t *code;            /* The linked program, once linker_link succeeds */
+    int code_size;
+
+    LinkerStats stats;
+    char error_msg[256];
+    bool has_error;
+} Linker;
+
+void linker_init(Linker *linker);
+void linker_free(Linker *linker);
+bool linker_add_file(Linker *linker, const char *path);
+bool linker_link(Linker *linker);
+bool linker_write_file(Linker *linker, const char *filename);
+
+#endif
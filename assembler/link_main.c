@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "link.h"
+
+static void print_link_usage(const char *program_name) {
+    printf("Usage: %s [-o <output.bc>] <main.bco> [module.bco ...]\n", program_name);
+    printf("\n");
+    printf("Links object modules from asm -c into one bytecode program. The program\n");
+    printf("starts at the first instruction of the first module.\n");
+    printf("\n");
+    printf("Options:\n");
+    printf("  -o <file>       Specify output file (default: a.bc)\n");
+    printf("  --no-strip      Keep functions nothing calls\n");
+    printf("  -h, --help      Show this help message\n");
+    printf("\n");
+    printf("Example:\n");
+    printf("  %s main.bco math.bco -o program.bc\n", program_name);
+}
+
+int main(int argc, char *argv[]) {
+    const char *output_file = "a.bc";
+    Linker linker;
+    linker_init(&linker);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            print_link_usage(argv[0]);
+            linker_free(&linker);
+            return 0;
+        }
+        else if (strcmp(argv[i], "-o") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: -o requires a filename\n");
+                linker_free(&linker);
+                return 1;
+            }
+            output_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--no-strip") == 0) {
+            linker.strip = false;
+        }
+        else if (argv[i][0] == '-') {
+            fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
+            print_link_usage(argv[0]);
+            linker_free(&linker);
+            return 1;
+        }
+        else if (!linker_add_file(&linker, argv[i])) {
+            fprintf(stderr, "\nLink failed!\n");
+            fprintf(stderr, "%s\n", linker.error_msg);
+            linker_free(&linker);
+            return 1;
+        }
+    }
+
+    if (linker.module_count == 0) {
+        fprintf(stderr, "Error: No object modules specified\n\n");
+        print_link_usage(argv[0]);
+        linker_free(&linker);
+        return 1;
+    }
+
+    if (!linker_link(&linker) || !linker_write_file(&linker, output_file)) {
+        fprintf(stderr, "\nLink failed!\n");
+        fprintf(stderr, "%s\n", linker.error_msg);
+        linker_free(&linker);
+        return 1;
+    }
+
+    LinkerStats *stats = &linker.stats;
+    printf("Output:     %s\n", output_file);
+    printf("\n");
+    printf("Link successful!\n");
+    printf("  Modules:      %d\n", stats->modules);
+    printf("  Sections:     %d of %d kept\n", stats->sections_kept, stats->sections_total);
+    printf("  Bytecode:     %d bytes (+ 12 byte header), %d stripped\n",
+           stats->bytes_after, stats->bytes_before - stats->bytes_after);
+    linker_free(&linker);
+    return 0;
+}
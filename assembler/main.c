@@ -2,28 +2,93 @@
 #include <stdlib.h>
 #include <string.h>
 #include "assembler.h"
+#include "batch.h"
 
-static void make_output_filename(const char *input, char *output, size_t size) {
-    strncpy(output, input, size - 1);
-    output[size - 1] = '\0';
+/* The full report for a single input */
+static int report_single(const BatchJob *job, const AssemblerOptions *options) {
+    const AssemblerResult *result = &job->result;
 
-    char *dot = strrchr(output, '.');
-    char *slash = strrchr(output, '/');
-
-    if (dot && (!slash || dot > slash)) {
-        strcpy(dot, ".bc");
+    if (result->success && result->reused) {
+        printf("Output:     %s (up to date)\n", job->output);
+        return 0;
+    } else if (result->success) {
+        printf("Output:     %s\n", job->output);
+        printf("\n");
+        printf("Assembly successful!\n");
+        printf("  Instructions: %d\n", result->instruction_count);
+        printf("  Labels:       %d\n", result->label_count);
+        if (options->object) {
+            printf("  Bytecode:     %d bytes (object module)\n", result->bytecode_size);
+        } else {
+            printf("  Bytecode:     %d bytes (+ 12 byte header)\n", result->bytecode_size);
+        }
+        if (options->optimize) {
+            const OptimizerStats *stats = &result->optimizer;
+            if (stats->skipped) {
+                printf("  Optimized:    skipped (a jump target is not an instruction boundary)\n");
+            } else {
+                printf("  Optimized:    %d -> %d instructions, %d -> %d bytes (%d rewrites, %d folds)\n",
+                       stats->instructions_before, stats->instructions_after,
+                       stats->bytes_before, stats->bytes_after,
+                       stats->peephole_rewrites, stats->constants_folded);
+                printf("  Dataflow:     %d loads, %d branches resolved; %d unreachable, "
+                       "%d dead stores removed; %d jumps threaded\n",
+                       stats->loads_replaced, stats->branches_folded,
+                       stats->instructions_unreachable, stats->stores_removed,
+                       stats->jumps_threaded);
+                printf("  Inlined:      %d calls\n", stats->calls_inlined);
+                printf("  Loops:        %d invariants hoisted, %d multiplies reduced, %d unrolled\n",
+                       stats->invariants_hoisted, stats->multiplies_reduced, stats->loops_unrolled);
+                if (options->profile_file) {
+                    printf("  Layout:       %d blocks moved, %d cold; %d branches flipped\n",
+                           stats->blocks_moved, stats->cold_blocks, stats->branches_flipped);
+                }
+            }
+        }
+        return 0;
     } else {
-        size_t len = strlen(output);
-        if (len + 3 < size) {
-            strcat(output, ".bc");
+        fprintf(stderr, "\nAssembly failed!\n");
+        fprintf(stderr, "%s\n", result->error_msg);
+        return 1;
+    }
+}
+
+/* One line per file in input order, then every error; nonzero if any failed */
+static int report_batch(const Batch *batch, int threads) {
+    for (int i = 0; i < batch->job_count; i++) {
+        const BatchJob *job = &batch->jobs[i];
+        if (!job->result.success) {
+            printf("  %s: failed\n", job->input);
+        } else if (job->result.reused) {
+            printf("  %s -> %s (up to date)\n", job->input, job->output);
+        } else {
+            printf("  %s -> %s (%d bytes)\n", job->input, job->output,
+                   job->result.bytecode_size);
+        }
+    }
+
+    int failures = batch_failures(batch);
+    printf("Assembled %d of %d files on %d thread%s\n",
+           batch->job_count - failures, batch->job_count, threads, threads == 1 ? "" : "s");
+    if (failures == 0) return 0;
+
+    fprintf(stderr, "\nAssembly failed for %d of %d files!\n", failures, batch->job_count);
+    for (int i = 0; i < batch->job_count; i++) {
+        const BatchJob *job = &batch->jobs[i];
+        if (!job->result.success) {
+            fprintf(stderr, "%s: %s\n", job->input, job->result.error_msg);
         }
     }
+    return 1;
 }
 
 int main(int argc, char *argv[]) {
-    const char *input_file = NULL;
     const char *output_file = NULL;
-    char default_output[256];
+    int threads = 0;
+    int input_count = 0;
+    const char *first_input = NULL;
+    AssemblerOptions options;
+    assembler_default_options(&options);
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
@@ -37,46 +102,107 @@ int main(int argc, char *argv[]) {
             }
             output_file = argv[++i];
         }
+        else if (strcmp(argv[i], "-O") == 0) {
+            options.optimize = true;
+        }
+        else if (strncmp(argv[i], "--unroll=", 9) == 0) {
+            char *end;
+            long factor = strtol(argv[i] + 9, &end, 10);
+            if (end == argv[i] + 9 || *end != '\0' || factor < 1 || factor > 16) {
+                fprintf(stderr, "Error: --unroll expects a factor from 1 to 16\n");
+                return 1;
+            }
+            options.unroll = (int)factor;
+        }
+        else if (strncmp(argv[i], "--profile=", 10) == 0 && argv[i][10] != '\0') {
+            options.profile_file = argv[i] + 10;
+        }
+        else if (strcmp(argv[i], "-c") == 0) {
+            options.object = true;
+        }
+        else if (strcmp(argv[i], "-j") == 0) {
+            char *end = NULL;
+            long count = i + 1 < argc ? strtol(argv[i + 1], &end, 10) : 0;
+            if (!end || end == argv[i + 1] || *end != '\0' || count < 1 || count > 1024) {
+                fprintf(stderr, "Error: -j expects a thread count from 1 to 1024\n");
+                return 1;
+            }
+            threads = (int)count;
+            i++;
+        }
         else if (argv[i][0] == '-') {
             fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
             print_usage(argv[0]);
             return 1;
         }
         else {
-            if (input_file) {
-                fprintf(stderr, "Error: Multiple input files not supported\n");
-                return 1;
-            }
-            input_file = argv[i];
+            if (!first_input) first_input = argv[i];
+            input_count++;
         }
     }
 
-    if (!input_file) {
+    if (input_count == 0) {
         fprintf(stderr, "Error: No input file specified\n\n");
         print_usage(argv[0]);
         return 1;
     }
 
-    if (!output_file) {
-        make_output_filename(input_file, default_output, sizeof(default_output));
-        output_file = default_output;
+    /* The optimizer needs every jump target, and an object module's imports are unknown */
+    if (options.object && options.optimize) {
+        fprintf(stderr, "Error: -O cannot be used with -c; object modules are not optimized\n");
+        return 1;
     }
 
-    printf("Assembling: %s\n", input_file);
+    Batch batch;
+    batch_init(&batch, options.object ? ".bco" : ".bc");
+    for (int i = 1; i < argc && !batch.has_error; i++) {
+        if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "-j") == 0) {
+            i++;
+        } else if (argv[i][0] != '-') {
+            batch_add(&batch, argv[i], input_count == 1 ? output_file : NULL);
+        }
+    }
+    /* A single file gets the full report; a directory or manifest is a batch */
+    bool single = input_count == 1 && first_input[0] != '@' && batch.job_count == 1 &&
+                  strcmp(batch.jobs[0].input, first_input) == 0;
 
-    AssemblerResult result = assemble_file(input_file, output_file);
+    if (!batch.has_error && !single) {
+        if (output_file) {
+            snprintf(batch.error_msg, sizeof(batch.error_msg),
+                     "-o needs a single input file; each output is named after its input");
+            batch.has_error = true;
+        } else if (options.profile_file) {
+            snprintf(batch.error_msg, sizeof(batch.error_msg),
+                     "--profile needs a single input file");
+            batch.has_error = true;
+        } else if (batch.job_count == 0) {
+            snprintf(batch.error_msg, sizeof(batch.error_msg), "No .asm files to assemble");
+            batch.has_error = true;
+        }
+    }
+    if (batch.has_error) {
+        fprintf(stderr, "Error: %s\n", batch.error_msg);
+        batch_free(&batch);
+        return 1;
+    }
 
-    if (result.success) {
-        printf("Output:     %s\n", output_file);
-        printf("\n");
-        printf("Assembly successful!\n");
-        printf("  Instructions: %d\n", result.instruction_count);
-        printf("  Labels:       %d\n", result.label_count);
-        printf("  Bytecode:     %d bytes (+ 12 byte header)\n", result.bytecode_size);
-        return 0;
+    if (single) {
+        printf("Assembling: %s\n", batch.jobs[0].input);
+        threads = 1;
+    } else if (threads == 0) {
+        threads = batch_default_threads();
+    }
+    if (threads > batch.job_count) threads = batch.job_count;
+
+    int status;
+    if (!batch_run(&batch, &options, threads)) {
+        fprintf(stderr, "Error: %s\n", batch.error_msg);
+        status = 1;
+    } else if (single) {
+        status = report_single(&batch.jobs[0], &options);
     } else {
-        fprintf(stderr, "\nAssembly failed!\n");
-        fprintf(stderr, "%s\n", result.error_msg);
-        return 1;
+        status = report_batch(&batch, threads);
     }
+    batch_free(&batch);
+    return status;
 }
@@ -0,0 +1,436 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "object.h"
+#include "cfg.h"
+#include "intern.h"
+#include "instructions.h"
+
+#define OBJECT_HEADER_FIELDS 9
+#define SECTION_FALLS_THROUGH 1u
+#define SYMBOL_IMPORT 1u
+
+static int instruction_size(const ParsedInstruction *inst) {
+    return inst->has_operand ? 5 : 1;
+}
+
+static bool object_error(ObjectModule *module, const char *message) {
+    snprintf(module->error_msg, sizeof(module->error_msg), "%s", message);
+    module->has_error = true;
+    return false;
+}
+
+static bool out_of_memory(ObjectModule *module) {
+    return object_error(module, "Out of memory");
+}
+
+void object_init(ObjectModule *module) {
+    memset(module, 0, sizeof(*module));
+}
+
+void object_free(ObjectModule *module) {
+    free(module->code);
+    free(module->sections);
+    free(module->symbols);
+    free(module->relocations);
+    free(module->strings);
+    module->code = NULL;
+    module->sections = NULL;
+    module->symbols = NULL;
+    module->relocations = NULL;
+    module->strings = NULL;
+}
+
+uint64_t object_source_hash(const char *text, size_t length, uint64_t hash) {
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)text[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t object_hash_seed(void) {
+    const uint8_t version[4] = {
+        OBJECT_VERSION & 0xFF, (OBJECT_VERSION >> 8) & 0xFF,
+        (OBJECT_VERSION >> 16) & 0xFF, (OBJECT_VERSION >> 24) & 0xFF
+    };
+    return object_source_hash((const char*)version, sizeof(version), 14695981039346656037ull);
+}
+
+static int find_symbol(const ObjectModule *module, const char *name, uint32_t hash) {
+    for (int i = 0; i < module->symbol_count; i++) {
+        const ObjectSymbol *symbol = &module->symbols[i];
+        if (symbol->hash == hash && name_equal(symbol->name, name)) return i;
+    }
+    return -1;
+}
+
+/* Symbols from the declarations, in order; a name declared twice the same way counts once */
+static bool collect_symbols(ObjectModule *module, SymbolTable *symtab,
+                            const ParsedLinkage *linkage, int linkage_count) {
+    size_t string_bytes = 0;
+    for (int i = 0; i < linkage_count; i++) {
+        string_bytes += strlen(linkage[i].name) + 1;
+    }
+    module->symbols = (ObjectSymbol*)malloc((linkage_count > 0 ? linkage_count : 1) *
+                                            sizeof(ObjectSymbol));
+    module->strings = (char*)malloc(string_bytes > 0 ? string_bytes : 1);
+    if (!module->symbols || !module->strings) return out_of_memory(module);
+
+    for (int i = 0; i < linkage_count; i++) {
+        const ParsedLinkage *decl = &linkage[i];
+        LabelEntry *label = symtab_lookup(symtab, decl->name);
+
+        int existing = find_symbol(module, decl->name, decl->hash);
+        if (existing >= 0) {
+            if (module->symbols[existing].import != decl->import) {
+                snprintf(module->error_msg, sizeof(module->error_msg),
+                         "Line %d: Label '%s' is both imported and exported",
+                         decl->line, decl->name);
+                module->has_error = true;
+                return false;
+            }
+            continue;
+        }
+        if (decl->import && label) {
+            snprintf(module->error_msg, sizeof(module->error_msg),
+                     "Line %d: Imported label '%s' is also defined on line %d",
+                     decl->line, decl->name, label->line);
+            module->has_error = true;
+            return false;
+        }
+        if (!decl->import && !label) {
+            snprintf(module->error_msg, sizeof(module->error_msg),
+                     "Line %d: Exported label '%s' is not defined", decl->line, decl->name);
+            module->has_error = true;
+            return false;
+        }
+
+        size_t length = strlen(decl->name) + 1;
+        ObjectSymbol *symbol = &module->symbols[module->symbol_count++];
+        memcpy(module->strings + module->string_bytes, decl->name, length);
+        symbol->name = module->strings + module->string_bytes;
+        symbol->hash = decl->hash;
+        symbol->import = decl->import;
+        symbol->address = decl->import ? 0 : label->address;
+        module->string_bytes += (int)length;
+    }
+    return true;
+}
+
+static int compare_addresses(const void *a, const void *b) {
+    int32_t x = *(const int32_t*)a;
+    int32_t y = *(const int32_t*)b;
+    return (x > y) - (x < y);
+}
+
+/* Section starts: 0, exported labels and local CALL targets; each ends where the next starts */
+static bool collect_sections(ObjectModule *module, const ParsedInstruction *instructions,
+                             int instruction_count, int32_t code_size) {
+    int capacity = 1 + module->symbol_count + module->relocation_count;
+    int32_t *starts = (int32_t*)malloc(capacity * sizeof(int32_t));
+    if (!starts) return out_of_memory(module);
+
+    int count = 0;
+    starts[count++] = 0;
+    for (int i = 0; i < module->symbol_count; i++) {
+        if (!module->symbols[i].import) starts[count++] = module->symbols[i].address;
+    }
+    int r = 0;
+    int32_t address = 0;
+    for (int i = 0; i < instruction_count; i++) {
+        while (r < module->relocation_count && module->relocations[r].offset < address) r++;
+        if (instructions[i].opcode == OP_CALL && r < module->relocation_count &&
+            module->relocations[r].offset == address && module->relocations[r].symbol < 0) {
+            starts[count++] = instructions[i].operand;
+        }
+        address += instruction_size(&instructions[i]);
+    }
+    qsort(starts, count, sizeof(int32_t), compare_addresses);
+
+    module->sections = (ObjectSection*)malloc(count * sizeof(ObjectSection));
+    if (!module->sections) {
+        free(starts);
+        return out_of_memory(module);
+    }
+    for (int i = 0; i < count; i++) {
+        if (starts[i] >= code_size) break;
+        if (module->section_count > 0 &&
+            module->sections[module->section_count - 1].start == starts[i]) continue;
+        module->sections[module->section_count].start = starts[i];
+        module->sections[module->section_count].falls_through = true;
+        module->section_count++;
+    }
+    free(starts);
+
+    /* Each section's last instruction decides whether it falls through */
+    int s = 0;
+    address = 0;
+    for (int i = 0; i < instruction_count; i++) {
+        while (s + 1 < module->section_count && module->sections[s + 1].start <= address) s++;
+        uint8_t opcode = instructions[i].opcode;
+        module->sections[s].falls_through =
+            opcode != OP_JMP && opcode != OP_RET && opcode != OP_HALT;
+        address += instruction_size(&instructions[i]);
+    }
+    return true;
+}
+
+bool object_build(ObjectModule *module, ParsedInstruction *instructions, int instruction_count,
+                  SymbolTable *symtab, const ParsedLinkage *linkage, int linkage_count) {
+    if (!collect_symbols(module, symtab, linkage, linkage_count)) return false;
+
+    int references = 0;
+    for (int i = 0; i < instruction_count; i++) {
+        if (instructions[i].is_label_ref) references++;
+    }
+    module->relocations = (ObjectRelocation*)malloc((references > 0 ? references : 1) *
+                                                    sizeof(ObjectRelocation));
+    if (!module->relocations) return out_of_memory(module);
+
+    int32_t address = 0;
+    for (int i = 0; i < instruction_count; i++) {
+        ParsedInstruction *inst = &instructions[i];
+
+        if (inst->is_label_ref) {
+            ObjectRelocation *reloc = &module->relocations[module->relocation_count++];
+            reloc->offset = address;
+            LabelEntry *label = symtab_lookup(symtab, inst->label_name);
+            int symbol = find_symbol(module, inst->label_name, inst->label_hash);
+            if (label) {
+                inst->operand = label->address;
+                reloc->symbol = -1;
+            } else if (symbol >= 0 && module->symbols[symbol].import) {
+                inst->operand = 0;
+                reloc->symbol = symbol;
+            } else {
+                snprintf(module->error_msg, sizeof(module->error_msg),
+                         "Line %d: Undefined label '%s' (IMPORT it if another module defines it)",
+                         inst->line, inst->label_name);
+                module->has_error = true;
+                return false;
+            }
+            inst->is_label_ref = false;
+        } else if (is_branch_opcode(inst->opcode)) {
+            snprintf(module->error_msg, sizeof(module->error_msg),
+                     "Line %d: A jump to a numeric address cannot be relocated; use a label",
+                     inst->line);
+            module->has_error = true;
+            return false;
+        }
+        address += instruction_size(inst);
+    }
+
+    return collect_sections(module, instructions, instruction_count, address);
+}
+
+static void put_uint32(uint8_t *at, uint32_t value) {
+    at[0] = (uint8_t)(value & 0xFF);
+    at[1] = (uint8_t)((value >> 8) & 0xFF);
+    at[2] = (uint8_t)((value >> 16) & 0xFF);
+    at[3] = (uint8_t)((value >> 24) & 0xFF);
+}
+
+static uint32_t get_uint32(const uint8_t *at) {
+    return (uint32_t)at[0] | ((uint32_t)at[1] << 8) | ((uint32_t)at[2] << 16) |
+           ((uint32_t)at[3] << 24);
+}
+
+bool object_write_file(ObjectModule *module, const uint8_t *code, int code_size,
+                       const char *filename) {
+    size_t size = 4 * OBJECT_HEADER_FIELDS + (size_t)code_size +
+                  8 * (size_t)module->section_count + 12 * (size_t)module->symbol_count +
+                  8 * (size_t)module->relocation_count + (size_t)module->string_bytes;
+    uint8_t *buffer = (uint8_t*)malloc(size);
+    if (!buffer) return out_of_memory(module);
+
+    uint32_t header[OBJECT_HEADER_FIELDS] = {
+        OBJECT_MAGIC, OBJECT_VERSION, (uint32_t)module->source_hash,
+        (uint32_t)(module->source_hash >> 32), (uint32_t)code_size,
+        (uint32_t)module->section_count, (uint32_t)module->symbol_count,
+        (uint32_t)module->relocation_count, (uint32_t)module->string_bytes
+    };
+    uint8_t *at = buffer;
+    for (int i = 0; i < OBJECT_HEADER_FIELDS; i++, at += 4) put_uint32(at, header[i]);
+    if (code_size > 0) memcpy(at, code, code_size);
+    at += code_size;
+    for (int i = 0; i < module->section_count; i++, at += 8) {
+        put_uint32(at, (uint32_t)module->sections[i].start);
+        put_uint32(at + 4, module->sections[i].falls_through ? SECTION_FALLS_THROUGH : 0);
+    }
+    for (int i = 0; i < module->symbol_count; i++, at += 12) {
+        put_uint32(at, (uint32_t)(module->symbols[i].name - module->strings));
+        put_uint32(at + 4, module->symbols[i].import ? SYMBOL_IMPORT : 0);
+        put_uint32(at + 8, (uint32_t)module->symbols[i].address);
+    }
+    for (int i = 0; i < module->relocation_count; i++, at += 8) {
+        put_uint32(at, (uint32_t)module->relocations[i].offset);
+        put_uint32(at + 4, (uint32_t)module->relocations[i].symbol);
+    }
+    if (module->string_bytes > 0) memcpy(at, module->strings, module->string_bytes);
+
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        free(buffer);
+        snprintf(module->error_msg, sizeof(module->error_msg),
+                 "Cannot create file '%s'", filename);
+        module->has_error = true;
+        return false;
+    }
+    bool written = fwrite(buffer, 1, size, file) == size;
+    written = fclose(file) == 0 && written;
+    free(buffer);
+    if (!written) {
+        snprintf(module->error_msg, sizeof(module->error_msg),
+                 "Failed to write '%s'", filename);
+        module->has_error = true;
+        return false;
+    }
+    return true;
+}
+
+bool object_read_source_hash(const char *filename, uint64_t *hash) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) return false;
+    uint8_t header[16];
+    bool ok = fread(header, 1, sizeof(header), file) == sizeof(header) &&
+              get_uint32(header) == OBJECT_MAGIC && get_uint32(header + 4) == OBJECT_VERSION;
+    fclose(file);
+    if (ok) *hash = get_uint32(header + 8) | ((uint64_t)get_uint32(header + 12) << 32);
+    return ok;
+}
+
+static bool corrupt(ObjectModule *module, const char *filename, const char *what) {
+    snprintf(module->error_msg, sizeof(module->error_msg),
+             "'%s' is not a valid object module (%s)", filename, what);
+    module->has_error = true;
+    return false;
+}
+
+/* Read the whole file and check every table against the code before trusting it */
+bool object_read_file(ObjectModule *module, const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        snprintf(module->error_msg, sizeof(module->error_msg),
+                 "Cannot open object module '%s'", filename);
+        module->has_error = true;
+        return false;
+    }
+    long size = -1;
+    if (fseek(file, 0, SEEK_END) == 0) size = ftell(file);
+    rewind(file);
+    if (size < 4 * OBJECT_HEADER_FIELDS) {
+        fclose(file);
+        return corrupt(module, filename, "too short");
+    }
+    uint8_t *buffer = (uint8_t*)malloc((size_t)size);
+    if (!buffer) {
+        fclose(file);
+        return out_of_memory(module);
+    }
+    bool read_all = fread(buffer, 1, (size_t)size, file) == (size_t)size;
+    fclose(file);
+    if (!read_all) {
+        free(buffer);
+        return corrupt(module, filename, "read error");
+    }
+
+    uint32_t header[OBJECT_HEADER_FIELDS];
+    for (int i = 0; i < OBJECT_HEADER_FIELDS; i++) header[i] = get_uint32(buffer + 4 * i);
+    if (header[0] != OBJECT_MAGIC) {
+        free(buffer);
+        return corrupt(module, filename, "bad magic number");
+    }
+    if (header[1] != OBJECT_VERSION) {
+        free(buffer);
+        return corrupt(module, filename, "unsupported version");
+    }
+    uint64_t expected = 4 * OBJECT_HEADER_FIELDS + (uint64_t)header[4] + 8 * (uint64_t)header[5] +
+                        12 * (uint64_t)header[6] + 8 * (uint64_t)header[7] + header[8];
+    if (expected != (uint64_t)size || header[4] > INT32_MAX) {
+        free(buffer);
+        return corrupt(module, filename, "table sizes do not match the file");
+    }
+
+    module->source_hash = header[2] | ((uint64_t)header[3] << 32);
+    module->code_size = (int)header[4];
+    module->section_count = (int)header[5];
+    module->symbol_count = (int)header[6];
+    module->relocation_count = (int)header[7];
+    module->string_bytes = (int)header[8];
+    module->code = (uint8_t*)malloc(module->code_size > 0 ? module->code_size : 1);
+    module->sections = (ObjectSection*)malloc((module->section_count + 1) * sizeof(ObjectSection));
+    module->symbols = (ObjectSymbol*)malloc((module->symbol_count + 1) * sizeof(ObjectSymbol));
+    module->relocations = (ObjectRelocation*)malloc((module->relocation_count + 1) *
+                                                    sizeof(ObjectRelocation));
+    module->strings = (char*)malloc(module->string_bytes + 1);
+    if (!module->code || !module->sections || !module->symbols || !module->relocations ||
+        !module->strings) {
+        free(buffer);
+        return out_of_memory(module);
+    }
+
+    const uint8_t *at = buffer + 4 * OBJECT_HEADER_FIELDS;
+    memcpy(module->code, at, module->code_size);
+    at += module->code_size;
+    const char *problem = NULL;
+
+    for (int i = 0; i < module->section_count; i++, at += 8) {
+        ObjectSection *section = &module->sections[i];
+        uint32_t start = get_uint32(at);
+        section->start = (int32_t)start;
+        section->falls_through = (get_uint32(at + 4) & SECTION_FALLS_THROUGH) != 0;
+        if (start >= (uint32_t)module->code_size ||
+            (i == 0 ? start != 0 : section->start <= module->sections[i - 1].start)) {
+            problem = "sections out of order";
+        }
+    }
+    if (module->code_size > 0 && module->section_count == 0) problem = "no sections";
+
+    const uint8_t *symbols = at;
+    at += 12 * (size_t)module->symbol_count;
+    for (int i = 0; i < module->relocation_count; i++, at += 8) {
+        ObjectRelocation *reloc = &module->relocations[i];
+        uint32_t offset = get_uint32(at);
+        reloc->offset = (int32_t)offset;
+        reloc->symbol = (int32_t)get_uint32(at + 4);
+        if ((uint64_t)offset + 5 > (uint64_t)module->code_size ||
+            (i > 0 && reloc->offset <= module->relocations[i - 1].offset)) {
+            problem = "relocations out of order";
+        } else if (reloc->symbol < -1 || reloc->symbol >= module->symbol_count) {
+            problem = "relocation against an unknown symbol";
+        } else if (reloc->symbol < 0 &&
+                   get_uint32(module->code + offset + 1) > (uint32_t)module->code_size) {
+            problem = "relocated address outside the code";
+        }
+    }
+
+    memcpy(module->strings, at, module->string_bytes);
+    module->strings[module->string_bytes] = '\0';
+    for (int i = 0; i < module->symbol_count; i++, symbols += 12) {
+        ObjectSymbol *symbol = &module->symbols[i];
+        uint32_t name = get_uint32(symbols);
+        symbol->import = (get_uint32(symbols + 4) & SYMBOL_IMPORT) != 0;
+        symbol->address = (int32_t)get_uint32(symbols + 8);
+        if (name >= (uint32_t)module->string_bytes) {
+            problem = "symbol name outside the strings";
+            symbol->name = "";
+        } else {
+            symbol->name = module->strings + name;
+        }
+        symbol->hash = name_hash(symbol->name, strlen(symbol->name));
+        if (!symbol->import && (symbol->address < 0 || symbol->address > module->code_size)) {
+            problem = "exported address outside the code";
+        }
+    }
+    for (int i = 0; i < module->relocation_count && !problem; i++) {
+        int symbol = module->relocations[i].symbol;
+        if (symbol >= 0 && !module->symbols[symbol].import) {
+            problem = "relocation against an export";
+        }
+    }
+
+    free(buffer);
+    if (problem) return corrupt(module, filename, problem);
+    return true;
+}
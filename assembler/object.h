@@ -0,0 +1,95 @@
+#ifndef OBJECT_H
+#define OBJECT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "parser.h"
+#include "labels.h"
+
+/*
+ * Bump OBJECT_VERSION whenever the file layout changes, and whenever the
+ * code asm -c emits for the same source does (parsing, label resolution,
+ * code generation or section splitting). asm -c reuses an existing module
+ * only if its version matches, and the version also seeds the source
+ * hash, so modules from an older assembler are reassembled rather than
+ * linked stale.
+ */
+#define OBJECT_MAGIC   0xCAFEB0B0
+#define OBJECT_VERSION 0x00000002
+
+/*
+ * A relocatable object module, written by asm -c and combined into a
+ * program by bclink. Addresses in the code are relative to the start of
+ * the module; each relocation names an instruction whose operand is one.
+ *
+ * The code is divided into sections for the linker to keep or strip: one
+ * starts at the module's first instruction, at each exported label and
+ * at each label the module CALLs.
+ *
+ * File format (all fields 4-byte little-endian unless noted):
+ *   - Magic number: 0xCAFEB0B0, version: 2
+ *   - Source hash: 64-bit FNV-1a of the .asm text the module was
+ *     assembled from, seeded by object_hash_seed; low word first
+ *   - Code size, section count, symbol count, relocation count, string bytes
+ *   - Code: code size bytes
+ *   - Sections: start, flags (bit 0: falls through into the next section)
+ *   - Symbols: name (offset into the strings), flags (bit 0: import), address
+ *   - Relocations: code offset of the instruction, symbol index or -1
+ *     when the operand is an address in this module
+ *   - Strings: NUL-terminated names
+ */
+typedef struct {
+    int32_t start;
+    bool falls_through;       /* Its last instruction can continue into the next section */
+} ObjectSection;
+
+typedef struct {
+    const char *name;         /* Points into the module's strings */
+    uint32_t hash;            /* name_hash of name */
+    bool import;              /* Defined by another module; otherwise exported from this one */
+    int32_t address;          /* Exports only */
+} ObjectSymbol;
+
+typedef struct {
+    int32_t offset;           /* Of the instruction whose operand is an address */
+    int32_t symbol;           /* Import the address is in, or -1 for this module */
+} ObjectRelocation;
+
+typedef struct {
+    uint64_t source_hash;
+    uint8_t *code;
+    int code_size;
+    ObjectSection *sections;  /* In address order */
+    int section_count;
+    ObjectSymbol *symbols;
+    int symbol_count;
+    ObjectRelocation *relocations;  /* In offset order */
+    int relocation_count;
+    char *strings;
+    int string_bytes;
+
+    char error_msg[256];
+    bool has_error;
+} ObjectModule;
+
+void object_init(ObjectModule *module);
+void object_free(ObjectModule *module);
+
+/*
+ * Resolve the program's label references for an object module: local
+ * labels to module addresses, imports to zero with a relocation, and
+ * fill in the symbols and sections. The code is copied in afterwards,
+ * once generated, by object_write_file.
+ */
+bool object_build(ObjectModule *module, ParsedInstruction *instructions, int instruction_count,
+                  SymbolTable *symtab, const ParsedLinkage *linkage, int linkage_count);
+bool object_write_file(ObjectModule *module, const uint8_t *code, int code_size,
+                       const char *filename);
+bool object_read_file(ObjectModule *module, const char *filename);
+
+/* The source hash of an existing object file; false if there is none to read */
+bool object_read_source_hash(const char *filename, uint64_t *hash);
+uint64_t object_source_hash(const char *text, size_t length, uint64_t hash);
+uint64_t object_hash_seed(void);  /* The FNV-1a offset basis with OBJECT_VERSION mixed in */
+
+#endif
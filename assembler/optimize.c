@@ -0,0 +1,2198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "optimize.h"
+#include "cfg.h"
+#include "instructions.h"
+
+#define MAX_WINDOW 4
+#define MAX_ROUNDS 8          /* Rounds of the global passes and peephole */
+#define TRACKED_DEPTH 16      /* Stack entries constant propagation follows */
+#define MEMORY_SLOTS 256      /* The VM's MEMORY_SIZE */
+#define MAX_PROPAGATION_BLOCKS 16384  /* Each block's entry state is about 2 KB */
+#define MAX_UNROLLED_BODY 64  /* Instructions in an unrolled loop body */
+#define MAX_INLINE_BODY 16    /* Instructions in a function worth inlining */
+#define MAX_INLINE_ROUNDS 4   /* Nesting of calls inlined away */
+
+static int instruction_size(const ParsedInstruction *inst) {
+    return inst->has_operand ? 5 : 1;
+}
+
+static int program_bytes(const ParsedInstruction *instructions, int count) {
+    int bytes = 0;
+    for (int i = 0; i < count; i++) {
+        bytes += instruction_size(&instructions[i]);
+    }
+    return bytes;
+}
+
+static bool out_of_memory(Optimizer *opt) {
+    snprintf(opt->error_msg, sizeof(opt->error_msg), "Out of memory");
+    opt->has_error = true;
+    return false;
+}
+
+/* The VM's arithmetic: wrapping, and INT32_MIN / -1 is INT32_MIN. False for division by zero */
+static bool fold_binary(uint8_t opcode, int32_t a, int32_t b, int32_t *result) {
+    switch (opcode) {
+        case OP_ADD: *result = (int32_t)((uint32_t)a + (uint32_t)b); return true;
+        case OP_SUB: *result = (int32_t)((uint32_t)a - (uint32_t)b); return true;
+        case OP_MUL: *result = (int32_t)((uint32_t)a * (uint32_t)b); return true;
+        case OP_CMP: *result = a < b ? 1 : 0; return true;
+        case OP_DIV:
+            if (b == 0) return false;
+            *result = (a == INT32_MIN && b == -1) ? INT32_MIN : a / b;
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* An instruction at the same source line as from */
+static ParsedInstruction make(const ParsedInstruction *from, uint8_t opcode,
+                              bool has_operand, int32_t operand) {
+    ParsedInstruction inst = *from;
+    inst.opcode = opcode;
+    inst.has_operand = has_operand;
+    inst.operand = has_operand ? operand : 0;
+    return inst;
+}
+
+/* ============================================
+ * Peephole rules
+ * ============================================ */
+
+/*
+ * A rewrite fills out with the replacement for window and returns its
+ * length, or -1 if the window's operands do not fit the rule. A
+ * replacement is never longer than its window, and always cheaper.
+ */
+typedef int (*RewriteFn)(const ParsedInstruction *window, ParsedInstruction *out);
+
+typedef struct {
+    int length;
+    uint8_t opcodes[MAX_WINDOW];
+    RewriteFn rewrite;
+    bool folds;               /* Counts as a constant fold */
+} PeepholeRule;
+
+/* PUSH 0; ADD and PUSH 0; SUB */
+static int drop_zero(const ParsedInstruction *window, ParsedInstruction *out) {
+    (void)out;
+    return window[0].operand == 0 ? 0 : -1;
+}
+
+/* PUSH 1; MUL and PUSH 1; DIV */
+static int drop_one(const ParsedInstruction *window, ParsedInstruction *out) {
+    (void)out;
+    return window[0].operand == 1 ? 0 : -1;
+}
+
+/* DUP; POP and PUSH n; POP */
+static int drop_pair(const ParsedInstruction *window, ParsedInstruction *out) {
+    (void)window;
+    (void)out;
+    return 0;
+}
+
+/* STORE n; LOAD n -> DUP; STORE n */
+static int store_load(const ParsedInstruction *window, ParsedInstruction *out) {
+    if (window[0].operand != window[1].operand) return -1;
+    out[0] = make(&window[0], OP_DUP, false, 0);
+    out[1] = window[0];
+    return 2;
+}
+
+/* LOAD n; LOAD n -> LOAD n; DUP */
+static int load_load(const ParsedInstruction *window, ParsedInstruction *out) {
+    if (window[0].operand != window[1].operand) return -1;
+    out[0] = window[0];
+    out[1] = make(&window[1], OP_DUP, false, 0);
+    return 2;
+}
+
+/* DUP; STORE n; POP -> STORE n */
+static int dup_store_pop(const ParsedInstruction *window, ParsedInstruction *out) {
+    out[0] = window[1];
+    return 1;
+}
+
+/* PUSH a; PUSH b; op -> PUSH (a op b) */
+static int fold_constants(const ParsedInstruction *window, ParsedInstruction *out) {
+    int32_t result;
+    if (!fold_binary(window[2].opcode, window[0].operand, window[1].operand, &result)) return -1;
+    out[0] = make(&window[0], OP_PUSH, true, result);
+    return 1;
+}
+
+/* PUSH a; ADD|SUB; PUSH b; ADD|SUB -> PUSH (+-a +-b); ADD */
+static int merge_offsets(const ParsedInstruction *window, ParsedInstruction *out) {
+    uint32_t a = (uint32_t)window[0].operand;
+    uint32_t b = (uint32_t)window[2].operand;
+    uint32_t offset = (window[1].opcode == OP_ADD ? a : 0u - a) +
+                      (window[3].opcode == OP_ADD ? b : 0u - b);
+    out[0] = make(&window[0], OP_PUSH, true, (int32_t)offset);
+    out[1] = make(&window[1], OP_ADD, false, 0);
+    return 2;
+}
+
+/* Longest windows first */
+static const PeepholeRule peephole_rules[] = {
+    {4, {OP_PUSH, OP_ADD, OP_PUSH, OP_ADD}, merge_offsets, true},
+    {4, {OP_PUSH, OP_ADD, OP_PUSH, OP_SUB}, merge_offsets, true},
+    {4, {OP_PUSH, OP_SUB, OP_PUSH, OP_ADD}, merge_offsets, true},
+    {4, {OP_PUSH, OP_SUB, OP_PUSH, OP_SUB}, merge_offsets, true},
+
+    {3, {OP_PUSH, OP_PUSH, OP_ADD},  fold_constants, true},
+    {3, {OP_PUSH, OP_PUSH, OP_SUB},  fold_constants, true},
+    {3, {OP_PUSH, OP_PUSH, OP_MUL},  fold_constants, true},
+    {3, {OP_PUSH, OP_PUSH, OP_DIV},  fold_constants, true},
+    {3, {OP_PUSH, OP_PUSH, OP_CMP},  fold_constants, true},
+    {3, {OP_DUP, OP_STORE, OP_POP},  dup_store_pop,  false},
+
+    {2, {OP_PUSH, OP_ADD},    drop_zero,  false},
+    {2, {OP_PUSH, OP_SUB},    drop_zero,  false},
+    {2, {OP_PUSH, OP_MUL},    drop_one,   false},
+    {2, {OP_PUSH, OP_DIV},    drop_one,   false},
+    {2, {OP_DUP, OP_POP},     drop_pair,  false},
+    {2, {OP_PUSH, OP_POP},    drop_pair,  false},
+    {2, {OP_STORE, OP_LOAD},  store_load, false},
+    {2, {OP_LOAD, OP_LOAD},   load_load,  false},
+};
+
+#define PEEPHOLE_RULE_COUNT ((int)(sizeof(peephole_rules) / sizeof(peephole_rules[0])))
+
+/* ============================================
+ * Branch targets
+ * ============================================ */
+
+/*
+ * Turn branch operands from byte addresses into instruction indices; the
+ * end of the code becomes index count. False if some target is not an
+ * instruction boundary, in which case the program is left alone.
+ */
+static bool targets_to_indices(Optimizer *opt, ParsedInstruction *instructions, int count) {
+    int32_t *address = (int32_t*)malloc((count + 1) * sizeof(int32_t));
+    if (!address) return out_of_memory(opt);
+
+    int32_t pc = 0;
+    for (int i = 0; i < count; i++) {
+        address[i] = pc;
+        pc += instruction_size(&instructions[i]);
+    }
+    address[count] = pc;
+
+    bool ok = true;
+    for (int i = 0; i < count && ok; i++) {
+        ParsedInstruction *inst = &instructions[i];
+        if (!is_branch_opcode(inst->opcode)) continue;
+
+        int low = 0, high = count;
+        while (low < high) {
+            int mid = low + (high - low) / 2;
+            if (address[mid] < inst->operand) low = mid + 1;
+            else high = mid;
+        }
+        if (address[low] == inst->operand) {
+            inst->operand = low;
+        } else {
+            ok = false;
+        }
+    }
+
+    free(address);
+    if (!ok) opt->stats.skipped = true;
+    return ok;
+}
+
+static bool targets_to_addresses(Optimizer *opt, ParsedInstruction *instructions, int count) {
+    int32_t *address = (int32_t*)malloc((count + 1) * sizeof(int32_t));
+    if (!address) return out_of_memory(opt);
+
+    int32_t pc = 0;
+    for (int i = 0; i < count; i++) {
+        address[i] = pc;
+        pc += instruction_size(&instructions[i]);
+    }
+    address[count] = pc;
+
+    for (int i = 0; i < count; i++) {
+        if (is_branch_opcode(instructions[i].opcode)) {
+            instructions[i].operand = address[instructions[i].operand];
+        }
+    }
+    free(address);
+    return true;
+}
+
+/*
+ * Instructions that control can reach other than by falling through:
+ * branch targets and return points after a CALL. A rewrite never spans
+ * one, except at the start of its window.
+ */
+static bool* find_targets(const ParsedInstruction *instructions, int count) {
+    bool *target = (bool*)calloc(count + 1, sizeof(bool));
+    if (!target) return NULL;
+    for (int i = 0; i < count; i++) {
+        if (is_branch_opcode(instructions[i].opcode)) {
+            target[instructions[i].operand] = true;
+        }
+        if (instructions[i].opcode == OP_CALL) {
+            target[i + 1] = true;
+        }
+    }
+    return target;
+}
+
+/* ============================================
+ * Peephole pass
+ * ============================================ */
+
+static const PeepholeRule* match_rule(const ParsedInstruction *tail_end, int available,
+                                      const bool *out_target, ParsedInstruction *out, int *length) {
+    for (int r = 0; r < PEEPHOLE_RULE_COUNT; r++) {
+        const PeepholeRule *rule = &peephole_rules[r];
+        if (rule->length > available) continue;
+
+        const ParsedInstruction *window = tail_end - rule->length;
+        const bool *window_target = out_target - rule->length;
+        bool match = true;
+        for (int k = 0; k < rule->length && match; k++) {
+            if (window[k].opcode != rule->opcodes[k]) match = false;
+            if (k > 0 && window_target[k]) match = false;
+        }
+        if (!match) continue;
+
+        *length = rule->rewrite(window, out);
+        if (*length >= 0) return rule;
+    }
+    return NULL;
+}
+
+/*
+ * One sweep over the program. Each instruction is appended to the output
+ * prefix, and rules are tried on the windows ending at the new tail until
+ * none applies, so a rewrite can enable another further back.
+ *
+ * origin[w] is the input index an output instruction came from; origins
+ * increase along the output, so a branch to input index t goes to the
+ * first output instruction whose origin is at least t. Removed
+ * instructions had no effect, so falling into the next survivor is right.
+ *
+ * Returns the number of rewrites, or -1 if out of memory.
+ */
+static int peephole_sweep(Optimizer *opt) {
+    ParsedInstruction *program = opt->instructions;
+    int count = opt->instruction_count;
+
+    bool *is_target = find_targets(program, count);
+    int *targets_before = (int*)malloc((count + 2) * sizeof(int));
+    int *origin = (int*)malloc((count + 1) * sizeof(int));
+    bool *out_target = (bool*)malloc((count + 1) * sizeof(bool));
+    if (!is_target || !targets_before || !origin || !out_target) {
+        free(is_target);
+        free(targets_before);
+        free(origin);
+        free(out_target);
+        out_of_memory(opt);
+        return -1;
+    }
+
+    /* targets_before[i + 1]: targets among input indices below i */
+    targets_before[0] = 0;
+    for (int i = 0; i <= count; i++) {
+        targets_before[i + 1] = targets_before[i] + (is_target[i] ? 1 : 0);
+    }
+
+    int rewrites = 0;
+    int w = 0;
+    for (int r = 0; r < count; r++) {
+        /* In place: w <= r, so program[r] is read before anything is written over it */
+        ParsedInstruction inst = program[r];
+        int previous = w > 0 ? origin[w - 1] : -1;
+        program[w] = inst;
+        origin[w] = r;
+        /* A target whose instruction was removed now lands here */
+        out_target[w] = targets_before[r + 1] - targets_before[previous + 1] > 0;
+        w++;
+
+        ParsedInstruction replacement[MAX_WINDOW];
+        int length;
+        const PeepholeRule *rule;
+        while ((rule = match_rule(program + w, w, out_target + w, replacement, &length))) {
+            int start = w - rule->length;
+            for (int k = 0; k < length; k++) {
+                program[start + k] = replacement[k];
+            }
+            w = start + length;
+            rewrites++;
+            if (rule->folds) opt->stats.constants_folded++;
+        }
+    }
+
+    /* Branches to input index t go to the first output origin >= t, or the end */
+    for (int i = 0; i < w; i++) {
+        if (!is_branch_opcode(program[i].opcode)) continue;
+        int t = program[i].operand;
+        int low = 0, high = w;
+        while (low < high) {
+            int mid = low + (high - low) / 2;
+            if (origin[mid] < t) low = mid + 1;
+            else high = mid;
+        }
+        program[i].operand = low;
+    }
+
+    opt->instruction_count = w;
+    free(is_target);
+    free(targets_before);
+    free(origin);
+    free(out_target);
+    return rewrites;
+}
+
+static bool peephole(Optimizer *opt) {
+    int rewrites;
+    do {
+        rewrites = peephole_sweep(opt);
+        if (rewrites < 0) return false;
+        opt->stats.peephole_rewrites += rewrites;
+    } while (rewrites > 0);
+    return true;
+}
+
+/* ============================================
+ * Rebuilding the program
+ * ============================================ */
+
+/*
+ * Each input instruction is replaced by zero or more output instructions,
+ * whose branch operands are still input indices. rebuild_finish maps them
+ * to the output: a branch to an input instruction goes to the first
+ * instruction emitted for it, or for the next input instruction that
+ * emitted anything.
+ *
+ * A pass may also reserve extra indices past the end of the input, mark
+ * output positions with them, and use them as branch operands. The loop
+ * passes use one to send back edges past code inserted before a header.
+ */
+typedef struct {
+    ParsedInstruction *out;
+    int count;
+    int capacity;
+    int *first;               /* Input index -> first output index at or after it */
+    int input_count;
+} Rebuild;
+
+static bool rebuild_begin(Optimizer *opt, Rebuild *rb, int extra) {
+    rb->input_count = opt->instruction_count;
+    rb->capacity = opt->instruction_count > 0 ? opt->instruction_count : 1;
+    rb->count = 0;
+    rb->out = (ParsedInstruction*)malloc(rb->capacity * sizeof(ParsedInstruction));
+    rb->first = (int*)malloc((rb->input_count + 1 + extra) * sizeof(int));
+    if (!rb->out || !rb->first) {
+        free(rb->out);
+        free(rb->first);
+        return out_of_memory(opt);
+    }
+    return true;
+}
+
+/* Call before emitting the replacement for each input instruction, in order */
+static void rebuild_next(Rebuild *rb, int input_index) {
+    rb->first[input_index] = rb->count;
+}
+
+/* Point extra index n (from 0) at the next instruction emitted */
+static void rebuild_mark(Rebuild *rb, int n) {
+    rb->first[rb->input_count + 1 + n] = rb->count;
+}
+
+static bool rebuild_emit(Optimizer *opt, Rebuild *rb, ParsedInstruction inst) {
+    if (rb->count == rb->capacity) {
+        int capacity = rb->capacity * 2;
+        ParsedInstruction *grown = (ParsedInstruction*)realloc(
+            rb->out, capacity * sizeof(ParsedInstruction));
+        if (!grown) return out_of_memory(opt);
+        rb->out = grown;
+        rb->capacity = capacity;
+    }
+    rb->out[rb->count++] = inst;
+    return true;
+}
+
+static void rebuild_finish(Optimizer *opt, Rebuild *rb) {
+    rb->first[rb->input_count] = rb->count;
+    for (int i = 0; i < rb->count; i++) {
+        if (is_branch_opcode(rb->out[i].opcode)) {
+            rb->out[i].operand = rb->first[rb->out[i].operand];
+        }
+    }
+    free(rb->first);
+    free(opt->instructions);
+    opt->instructions = rb->out;
+    opt->instruction_count = rb->count;
+    opt->instruction_capacity = rb->capacity;
+}
+
+static void rebuild_abort(Rebuild *rb) {
+    free(rb->out);
+    free(rb->first);
+}
+
+/* ============================================
+ * Constant propagation
+ * ============================================ */
+
+typedef struct {
+    bool known;
+    int32_t value;
+} Constant;
+
+/*
+ * What is known on entry to a block: the values of the top entries of
+ * the stack, over an untracked base, and of each memory slot. Nothing is
+ * assumed about memory when the program starts, nor about the stack or
+ * memory on entry to a function or after a CALL returns.
+ */
+typedef struct {
+    bool reached;
+    int depth;                        /* Tracked entries */
+    Constant stack[TRACKED_DEPTH];    /* stack[depth - 1] is the top */
+    Constant memory[MEMORY_SLOTS];
+} StackState;
+
+static const Constant unknown = {false, 0};
+
+static void state_forget(StackState *state) {
+    state->depth = 0;
+    for (int i = 0; i < MEMORY_SLOTS; i++) state->memory[i] = unknown;
+}
+
+static void state_push(StackState *state, Constant value) {
+    if (state->depth == TRACKED_DEPTH) {
+        memmove(state->stack, state->stack + 1, (TRACKED_DEPTH - 1) * sizeof(Constant));
+        state->depth--;
+    }
+    state->stack[state->depth++] = value;
+}
+
+static Constant state_pop(StackState *state) {
+    return state->depth > 0 ? state->stack[--state->depth] : unknown;
+}
+
+static bool in_memory(int32_t slot) {
+    return slot >= 0 && slot < MEMORY_SLOTS;
+}
+
+/* The effect of one instruction on what is known */
+static void transfer(StackState *state, const ParsedInstruction *inst) {
+    Constant a, b;
+    switch (inst->opcode) {
+        case OP_PUSH: {
+            Constant value = {true, inst->operand};
+            state_push(state, value);
+            break;
+        }
+        case OP_POP:
+        case OP_JZ:
+        case OP_JNZ:
+        case OP_NEWARRAY:
+        case OP_NEWBYTES:
+            state_pop(state);
+            break;
+        case OP_DUP:
+            a = state_pop(state);
+            state_push(state, a);
+            state_push(state, a);
+            break;
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_CMP: {
+            b = state_pop(state);
+            a = state_pop(state);
+            Constant result = unknown;
+            if (a.known && b.known && fold_binary(inst->opcode, a.value, b.value, &result.value)) {
+                result.known = true;
+            }
+            state_push(state, result);
+            break;
+        }
+        case OP_STORE:
+            a = state_pop(state);
+            if (in_memory(inst->operand)) state->memory[inst->operand] = a;
+            break;
+        case OP_LOAD:
+            state_push(state, in_memory(inst->operand) ? state->memory[inst->operand] : unknown);
+            break;
+        case OP_CALL:
+            state_forget(state);
+            break;
+        case OP_ALOAD:
+        case OP_BLOAD:
+        case OP_MAPGET:
+        case OP_MAPDEL:
+            state_pop(state);
+            state_push(state, unknown);
+            break;
+        case OP_ASTORE:
+        case OP_BSTORE:
+        case OP_MAPSET:
+            state_pop(state);
+            state_pop(state);
+            break;
+        case OP_ALEN:
+            state_push(state, unknown);
+            break;
+        default:              /* JMP, RET, HALT, DROP, NEWMAP */
+            break;
+    }
+}
+
+static bool same_constant(Constant a, Constant b) {
+    return a.known == b.known && (!a.known || a.value == b.value);
+}
+
+/* Merge from into into, aligning the stacks at the top; true if into changed */
+static bool state_join(StackState *into, const StackState *from) {
+    if (!into->reached) {
+        *into = *from;
+        into->reached = true;
+        return true;
+    }
+
+    bool changed = false;
+    if (from->depth < into->depth) {
+        int drop = into->depth - from->depth;
+        memmove(into->stack, into->stack + drop, from->depth * sizeof(Constant));
+        into->depth = from->depth;
+        changed = true;
+    }
+    int offset = from->depth - into->depth;
+    for (int i = 0; i < into->depth; i++) {
+        if (into->stack[i].known && !same_constant(into->stack[i], from->stack[i + offset])) {
+            into->stack[i] = unknown;
+            changed = true;
+        }
+    }
+    for (int i = 0; i < MEMORY_SLOTS; i++) {
+        if (into->memory[i].known && !same_constant(into->memory[i], from->memory[i])) {
+            into->memory[i] = unknown;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+/* Block entry states, iterated to a fixed point over the reachable blocks */
+static StackState* solve_constants(Optimizer *opt, const ControlFlowGraph *cfg) {
+    StackState *in = (StackState*)calloc(cfg->block_count, sizeof(StackState));
+    int *work = (int*)malloc(cfg->block_count * sizeof(int));
+    bool *queued = (bool*)calloc(cfg->block_count, sizeof(bool));
+    StackState *state = (StackState*)malloc(sizeof(StackState));
+    StackState *entry = (StackState*)malloc(sizeof(StackState));
+    if (!in || !work || !queued || !state || !entry) {
+        free(in);
+        in = NULL;
+        out_of_memory(opt);
+        goto done;
+    }
+
+    int top = 0;
+    if (cfg->block_count > 0) {
+        state_forget(&in[0]);
+        in[0].reached = true;
+        work[top++] = 0;
+        queued[0] = true;
+    }
+    state_forget(entry);
+    entry->reached = true;
+
+    while (top > 0) {
+        int b = work[--top];
+        queued[b] = false;
+        const BasicBlock *block = &cfg->blocks[b];
+
+        *state = in[b];
+        for (int i = block->start; i < block->end; i++) {
+            transfer(state, &opt->instructions[i]);
+        }
+
+        int next[3] = {block->succ[0], block->succ[1], block->callee};
+        for (int k = 0; k < 3; k++) {
+            if (next[k] < 0) continue;
+            /* A function is entered knowing nothing */
+            const StackState *from = k == 2 ? entry : state;
+            if (state_join(&in[next[k]], from) && !queued[next[k]]) {
+                work[top++] = next[k];
+                queued[next[k]] = true;
+            }
+        }
+    }
+
+done:
+    free(work);
+    free(queued);
+    free(state);
+    free(entry);
+    return in;
+}
+
+/*
+ * Replace each LOAD of a known value by a PUSH, which the peephole rules
+ * can then fold, and each conditional branch on a known value by a POP,
+ * followed by a JMP if the branch is taken. Returns the number of
+ * changes, or -1 if out of memory.
+ */
+static int propagate_constants(Optimizer *opt) {
+    ControlFlowGraph cfg;
+    if (!cfg_build(&cfg, opt->instructions, opt->instruction_count)) {
+        out_of_memory(opt);
+        return -1;
+    }
+    if (cfg.block_count > MAX_PROPAGATION_BLOCKS) {
+        cfg_free(&cfg);
+        return 0;
+    }
+    StackState *in = solve_constants(opt, &cfg);
+    StackState *state = (StackState*)malloc(sizeof(StackState));
+    Rebuild rb;
+    if (!in || !state || !rebuild_begin(opt, &rb, 0)) {
+        free(in);
+        free(state);
+        cfg_free(&cfg);
+        if (!opt->has_error) out_of_memory(opt);
+        return -1;
+    }
+
+    int changes = 0;
+    bool ok = true;
+    for (int b = 0; b < cfg.block_count && ok; b++) {
+        const BasicBlock *block = &cfg.blocks[b];
+        *state = in[b];
+        for (int i = block->start; i < block->end && ok; i++) {
+            const ParsedInstruction *inst = &opt->instructions[i];
+            rebuild_next(&rb, i);
+
+            Constant top = state->depth > 0 ? state->stack[state->depth - 1] : unknown;
+            if (!state->reached) {
+                ok = rebuild_emit(opt, &rb, *inst);
+            } else if (inst->opcode == OP_LOAD && in_memory(inst->operand) &&
+                       state->memory[inst->operand].known) {
+                ok = rebuild_emit(opt, &rb, make(inst, OP_PUSH, true,
+                                                 state->memory[inst->operand].value));
+                opt->stats.loads_replaced++;
+                changes++;
+            } else if ((inst->opcode == OP_JZ || inst->opcode == OP_JNZ) && top.known) {
+                bool taken = (top.value == 0) == (inst->opcode == OP_JZ);
+                ok = rebuild_emit(opt, &rb, make(inst, OP_POP, false, 0));
+                if (ok && taken) ok = rebuild_emit(opt, &rb, make(inst, OP_JMP, true, inst->operand));
+                opt->stats.branches_folded++;
+                changes++;
+            } else {
+                ok = rebuild_emit(opt, &rb, *inst);
+            }
+            transfer(state, inst);
+        }
+    }
+
+    free(in);
+    free(state);
+    cfg_free(&cfg);
+    if (!ok) {
+        rebuild_abort(&rb);
+        return -1;
+    }
+    rebuild_finish(opt, &rb);
+    return changes;
+}
+
+/* ============================================
+ * Dead code
+ * ============================================ */
+
+/*
+ * Drop blocks no path from the start reaches, and turn stores nothing
+ * reads into POPs: stores to a slot no LOAD names, and stores overwritten
+ * later in the same block before any LOAD or CALL could see them.
+ * Returns the number of changes, or -1 if out of memory.
+ */
+static int eliminate_dead_code(Optimizer *opt) {
+    ControlFlowGraph cfg;
+    if (!cfg_build(&cfg, opt->instructions, opt->instruction_count)) {
+        out_of_memory(opt);
+        return -1;
+    }
+
+    bool loaded[MEMORY_SLOTS] = {false};
+    for (int i = 0; i < opt->instruction_count; i++) {
+        const ParsedInstruction *inst = &opt->instructions[i];
+        if (inst->opcode == OP_LOAD && in_memory(inst->operand)) loaded[inst->operand] = true;
+    }
+
+    Rebuild rb;
+    if (!rebuild_begin(opt, &rb, 0)) {
+        cfg_free(&cfg);
+        return -1;
+    }
+
+    int changes = 0;
+    bool ok = true;
+    for (int b = 0; b < cfg.block_count && ok; b++) {
+        const BasicBlock *block = &cfg.blocks[b];
+        if (!block->reachable) {
+            for (int i = block->start; i < block->end; i++) rebuild_next(&rb, i);
+            opt->stats.instructions_unreachable += block->end - block->start;
+            changes++;
+            continue;
+        }
+
+        for (int i = block->start; i < block->end && ok; i++) {
+            const ParsedInstruction *inst = &opt->instructions[i];
+            rebuild_next(&rb, i);
+
+            bool dead = false;
+            if (inst->opcode == OP_STORE && in_memory(inst->operand)) {
+                dead = !loaded[inst->operand];
+                for (int j = i + 1; j < block->end && !dead; j++) {
+                    const ParsedInstruction *later = &opt->instructions[j];
+                    if (later->opcode == OP_CALL) break;
+                    if (later->opcode == OP_LOAD && later->operand == inst->operand) break;
+                    if (later->opcode == OP_STORE && later->operand == inst->operand) dead = true;
+                }
+            }
+
+            if (dead) {
+                ok = rebuild_emit(opt, &rb, make(inst, OP_POP, false, 0));
+                opt->stats.stores_removed++;
+                changes++;
+            } else {
+                ok = rebuild_emit(opt, &rb, *inst);
+            }
+        }
+    }
+
+    cfg_free(&cfg);
+    if (!ok) {
+        rebuild_abort(&rb);
+        return -1;
+    }
+    rebuild_finish(opt, &rb);
+    return changes;
+}
+
+/* ============================================
+ * Jump threading
+ * ============================================ */
+
+/* Where a branch to target ends up after following unconditional JMPs */
+static int final_target(const Optimizer *opt, int target) {
+    /* A chain longer than the program is a loop of JMPs; leave it */
+    for (int steps = 0; steps < opt->instruction_count; steps++) {
+        if (target >= opt->instruction_count || opt->instructions[target].opcode != OP_JMP) {
+            return target;
+        }
+        target = opt->instructions[target].operand;
+    }
+    return target;
+}
+
+/*
+ * Retarget branches that land on a JMP, replace a JMP to a RET or HALT
+ * by that instruction, drop branches to the next instruction, and turn
+ * "JZ A; JMP B; A:" into "JNZ B" (and likewise for JNZ). Returns the
+ * number of changes, or -1 if out of memory.
+ */
+static int thread_jumps(Optimizer *opt) {
+    ParsedInstruction *program = opt->instructions;
+    int count = opt->instruction_count;
+    int changes = 0;
+
+    for (int i = 0; i < count; i++) {
+        ParsedInstruction *inst = &program[i];
+        if (!is_branch_opcode(inst->opcode)) continue;
+        int target = final_target(opt, inst->operand);
+        if (target != inst->operand) {
+            inst->operand = target;
+            opt->stats.jumps_threaded++;
+            changes++;
+        }
+        if (inst->opcode == OP_JMP && target < count &&
+            (program[target].opcode == OP_RET || program[target].opcode == OP_HALT)) {
+            *inst = make(inst, program[target].opcode, false, 0);
+            opt->stats.jumps_threaded++;
+            changes++;
+        }
+    }
+
+    bool *is_target = find_targets(program, count);
+    Rebuild rb;
+    if (!is_target || !rebuild_begin(opt, &rb, 0)) {
+        free(is_target);
+        if (!opt->has_error) out_of_memory(opt);
+        return -1;
+    }
+
+    bool ok = true;
+    for (int i = 0; i < count && ok; i++) {
+        ParsedInstruction *inst = &program[i];
+        rebuild_next(&rb, i);
+
+        if ((inst->opcode == OP_JZ || inst->opcode == OP_JNZ) && inst->operand == i + 2 &&
+            program[i + 1].opcode == OP_JMP && program[i + 1].operand != i + 1 &&
+            !is_target[i + 1]) {
+            /* Branch around a JMP: invert it and take the JMP's target */
+            uint8_t inverted = inst->opcode == OP_JZ ? OP_JNZ : OP_JZ;
+            ok = rebuild_emit(opt, &rb, make(inst, inverted, true, program[i + 1].operand));
+            rebuild_next(&rb, ++i);
+            opt->stats.jumps_threaded++;
+            changes++;
+        } else if (inst->opcode == OP_JMP && inst->operand == i + 1) {
+            changes++;
+            opt->stats.jumps_threaded++;
+        } else if ((inst->opcode == OP_JZ || inst->opcode == OP_JNZ) && inst->operand == i + 1) {
+            /* Either way control falls through; only the pop remains */
+            ok = rebuild_emit(opt, &rb, make(inst, OP_POP, false, 0));
+            opt->stats.jumps_threaded++;
+            changes++;
+        } else {
+            ok = rebuild_emit(opt, &rb, *inst);
+        }
+    }
+
+    free(is_target);
+    if (!ok) {
+        rebuild_abort(&rb);
+        return -1;
+    }
+    rebuild_finish(opt, &rb);
+    return changes;
+}
+
+/* ============================================
+ * Inlining
+ * ============================================ */
+
+/*
+ * The end of the function starting at start, if it can be inlined: the
+ * instructions reachable from start without entering calls must be the
+ * contiguous range [start, end), at most MAX_INLINE_BODY long, with no
+ * CALL among them, and control must leave it only by RET or HALT.
+ * Returns -1 otherwise. seen must be all false, and is left that way.
+ */
+static int inline_end(const Optimizer *opt, int start, bool *seen, int *stack) {
+    const ParsedInstruction *program = opt->instructions;
+    int count = opt->instruction_count;
+    int visited[MAX_INLINE_BODY];
+    int visited_count = 0;
+    int top = 0;
+    int end = start;
+    bool ok = true;
+
+    seen[start] = true;
+    visited[visited_count++] = start;
+    stack[top++] = start;
+    while (top > 0 && ok) {
+        int j = stack[--top];
+        const ParsedInstruction *inst = &program[j];
+        if (inst->opcode == OP_CALL) {
+            ok = false;
+            break;
+        }
+        if (j + 1 > end) end = j + 1;
+
+        int next[2];
+        int next_count = 0;
+        if (inst->opcode == OP_JMP || inst->opcode == OP_JZ || inst->opcode == OP_JNZ) {
+            next[next_count++] = inst->operand;
+        }
+        if (inst->opcode != OP_JMP && inst->opcode != OP_RET && inst->opcode != OP_HALT) {
+            next[next_count++] = j + 1;
+        }
+        for (int k = 0; k < next_count && ok; k++) {
+            int to = next[k];
+            if (to < start || to >= count) {
+                ok = false;
+            } else if (!seen[to]) {
+                if (visited_count == MAX_INLINE_BODY) {
+                    ok = false;
+                } else {
+                    seen[to] = true;
+                    visited[visited_count++] = to;
+                    stack[top++] = to;
+                }
+            }
+        }
+    }
+
+    for (int k = 0; k < visited_count; k++) seen[visited[k]] = false;
+    if (!ok || visited_count != end - start) return -1;
+    return end;
+}
+
+/*
+ * Replace CALLs of small functions by a copy of the function's body, with
+ * its branches pointing into the copy and each RET a JMP past the call.
+ * The program may grow to half as large again as the input, plus 32
+ * instructions. Functions that call are not inlined, which rules out
+ * recursion; once their callees are inlined they become candidates too.
+ * Returns the number of calls inlined, or -1 if out of memory.
+ */
+static int inline_calls(Optimizer *opt) {
+    const ParsedInstruction *program = opt->instructions;
+    int count = opt->instruction_count;
+    int allowance = opt->stats.instructions_before * 3 / 2 + 32 - count;
+    if (count == 0 || allowance <= 0) return 0;
+
+    int *end_of = (int*)malloc(count * sizeof(int));
+    bool *seen = (bool*)calloc(count, sizeof(bool));
+    int *stack = (int*)malloc(count * sizeof(int));
+    bool *inline_here = (bool*)calloc(count, sizeof(bool));
+    if (!end_of || !seen || !stack || !inline_here) {
+        free(end_of);
+        free(seen);
+        free(stack);
+        free(inline_here);
+        out_of_memory(opt);
+        return -1;
+    }
+
+    int sites = 0;
+    int copied = 0;
+    for (int i = 0; i < count; i++) end_of[i] = -2;     /* Not yet looked at */
+    for (int i = 0; i < count; i++) {
+        const ParsedInstruction *inst = &program[i];
+        if (inst->opcode != OP_CALL || inst->operand >= count) continue;
+        int f = inst->operand;
+        if (end_of[f] == -2) end_of[f] = inline_end(opt, f, seen, stack);
+        if (end_of[f] < 0) continue;
+
+        int size = end_of[f] - f;
+        if (size - 1 > allowance) continue;
+        allowance -= size - 1;
+        inline_here[i] = true;
+        copied += size;
+        sites++;
+    }
+
+    Rebuild rb;
+    bool ok = sites > 0 && rebuild_begin(opt, &rb, copied);
+    int base = 0;
+    for (int i = 0; i < count && ok; i++) {
+        rebuild_next(&rb, i);
+        if (!inline_here[i]) {
+            ok = rebuild_emit(opt, &rb, program[i]);
+            continue;
+        }
+
+        int f = program[i].operand;
+        for (int k = 0; f + k < end_of[f] && ok; k++) {
+            ParsedInstruction inst = program[f + k];
+            rebuild_mark(&rb, base + k);
+            if (inst.opcode == OP_RET) {
+                inst = make(&inst, OP_JMP, true, i + 1);
+            } else if (is_branch_opcode(inst.opcode)) {
+                inst.operand = count + 1 + base + (inst.operand - f);
+            }
+            ok = rebuild_emit(opt, &rb, inst);
+        }
+        base += end_of[f] - f;
+    }
+
+    if (ok && sites > 0) {
+        rebuild_finish(opt, &rb);
+        opt->stats.calls_inlined += sites;
+    } else if (sites > 0) {
+        if (rb.out) rebuild_abort(&rb);
+    }
+    free(end_of);
+    free(seen);
+    free(stack);
+    free(inline_here);
+    return ok || sites == 0 ? sites : -1;
+}
+
+/* ============================================
+ * Loops
+ * ============================================ */
+
+/* Predecessors of each block along fall-through and branch edges */
+typedef struct {
+    int *start;               /* Block -> first entry in list; block_count + 1 entries */
+    int *list;
+    bool *entered;            /* Block 0, and blocks a CALL enters */
+} Predecessors;
+
+static bool predecessors_build(Predecessors *preds, const ControlFlowGraph *cfg) {
+    int blocks = cfg->block_count;
+    preds->start = (int*)calloc(blocks + 1, sizeof(int));
+    preds->list = (int*)malloc((2 * blocks > 0 ? 2 * blocks : 1) * sizeof(int));
+    preds->entered = (bool*)calloc(blocks > 0 ? blocks : 1, sizeof(bool));
+    if (!preds->start || !preds->list || !preds->entered) {
+        free(preds->start);
+        free(preds->list);
+        free(preds->entered);
+        return false;
+    }
+
+    for (int b = 0; b < blocks; b++) {
+        for (int k = 0; k < cfg->blocks[b].succ_count; k++) preds->start[cfg->blocks[b].succ[k]]++;
+        if (cfg->blocks[b].callee >= 0) preds->entered[cfg->blocks[b].callee] = true;
+    }
+    if (blocks > 0) preds->entered[0] = true;
+
+    /* start[b] becomes the end of b's range, then is walked back to its beginning */
+    for (int b = 1; b <= blocks; b++) preds->start[b] += preds->start[b - 1];
+    for (int b = 0; b < blocks; b++) {
+        for (int k = 0; k < cfg->blocks[b].succ_count; k++) {
+            preds->list[--preds->start[cfg->blocks[b].succ[k]]] = b;
+        }
+    }
+    return true;
+}
+
+static void predecessors_free(Predecessors *preds) {
+    free(preds->start);
+    free(preds->list);
+    free(preds->entered);
+}
+
+/*
+ * A natural loop: the header, and the blocks that reach a back edge to it
+ * without passing through the header. Loops are only accepted when
+ * control enters them through the header alone, so code inserted before
+ * the header runs once on every entry.
+ */
+typedef struct {
+    int header;               /* Block */
+    bool *in_body;            /* Block -> member; cleared again by loop_release */
+    int *members;
+    int member_count;
+    bool has_call;
+    bool stored[MEMORY_SLOTS];  /* Slots some STORE in the loop names */
+} Loop;
+
+static void loop_release(Loop *loop) {
+    for (int i = 0; i < loop->member_count; i++) loop->in_body[loop->members[i]] = false;
+    loop->member_count = 0;
+}
+
+/* Fill loop with the natural loop headed by block h; false if there is none */
+static bool loop_find(Loop *loop, const Optimizer *opt, const ControlFlowGraph *cfg,
+                      const Predecessors *preds, int h) {
+    const BasicBlock *header = &cfg->blocks[h];
+    loop->header = h;
+    loop->member_count = 0;
+    loop->in_body[h] = true;
+    loop->members[loop->member_count++] = h;
+
+    /* Back edges: from h or a block after it, to h */
+    bool found = false;
+    int stack_base = loop->member_count;
+    for (int p = preds->start[h]; p < preds->start[h + 1]; p++) {
+        int from = preds->list[p];
+        if (cfg->blocks[from].start < header->start) continue;
+        found = true;
+        if (!loop->in_body[from]) {
+            loop->in_body[from] = true;
+            loop->members[loop->member_count++] = from;
+        }
+    }
+    if (!found) {
+        loop_release(loop);
+        return false;
+    }
+
+    /* Members double as the worklist: everything after stack_base is unvisited */
+    for (int w = stack_base; w < loop->member_count; w++) {
+        int b = loop->members[w];
+        for (int p = preds->start[b]; p < preds->start[b + 1]; p++) {
+            int from = preds->list[p];
+            if (!loop->in_body[from]) {
+                loop->in_body[from] = true;
+                loop->members[loop->member_count++] = from;
+            }
+        }
+    }
+
+    /* Single entry: only the header has predecessors outside the loop */
+    for (int m = 0; m < loop->member_count; m++) {
+        int b = loop->members[m];
+        if (b == h) continue;
+        bool outside = preds->entered[b];
+        for (int p = preds->start[b]; p < preds->start[b + 1] && !outside; p++) {
+            outside = !loop->in_body[preds->list[p]];
+        }
+        if (outside) {
+            loop_release(loop);
+            return false;
+        }
+    }
+    /* A member falling into the header would run the inserted code */
+    if (h > 0 && loop->in_body[h - 1]) {
+        const ParsedInstruction *last = &opt->instructions[header->start - 1];
+        if (last->opcode != OP_JMP && last->opcode != OP_RET && last->opcode != OP_HALT) {
+            loop_release(loop);
+            return false;
+        }
+    }
+
+    loop->has_call = false;
+    memset(loop->stored, 0, sizeof(loop->stored));
+    for (int m = 0; m < loop->member_count; m++) {
+        const BasicBlock *block = &cfg->blocks[loop->members[m]];
+        for (int i = block->start; i < block->end; i++) {
+            const ParsedInstruction *inst = &opt->instructions[i];
+            if (inst->opcode == OP_CALL) loop->has_call = true;
+            if (inst->opcode == OP_STORE && in_memory(inst->operand)) loop->stored[inst->operand] = true;
+        }
+    }
+    return true;
+}
+
+/*
+ * Changes the loop passes make, applied in one rebuild. Code may be
+ * inserted before an instruction, with the instructions that jump back
+ * to it from inside the loop retargeted past the insertion; and a run of
+ * instructions may be replaced. Both draw their instructions from code.
+ */
+typedef struct {
+    int insert_from;          /* Index into code */
+    int insert_count;
+    int mark;                 /* Extra index after the insertion, if insert_count > 0 */
+    int replace_length;       /* Input instructions replaced from here; 0 if none */
+    int replace_from;
+    int replace_count;
+    int retarget;             /* New branch operand, or -1 */
+} LoopEdit;
+
+typedef struct {
+    LoopEdit *edits;          /* One per input instruction */
+    ParsedInstruction *code;
+    int code_count;
+    int code_capacity;
+    int marks;
+} LoopEdits;
+
+static bool loop_edits_init(Optimizer *opt, LoopEdits *le) {
+    int count = opt->instruction_count;
+    le->edits = (LoopEdit*)calloc(count > 0 ? count : 1, sizeof(LoopEdit));
+    le->code_capacity = 16;
+    le->code_count = 0;
+    le->code = (ParsedInstruction*)malloc(le->code_capacity * sizeof(ParsedInstruction));
+    le->marks = 0;
+    if (!le->edits || !le->code) {
+        free(le->edits);
+        free(le->code);
+        return out_of_memory(opt);
+    }
+    for (int i = 0; i < count; i++) le->edits[i].retarget = -1;
+    return true;
+}
+
+static void loop_edits_free(LoopEdits *le) {
+    free(le->edits);
+    free(le->code);
+}
+
+static bool loop_code(Optimizer *opt, LoopEdits *le, ParsedInstruction inst) {
+    if (le->code_count == le->code_capacity) {
+        int capacity = le->code_capacity * 2;
+        ParsedInstruction *grown = (ParsedInstruction*)realloc(
+            le->code, capacity * sizeof(ParsedInstruction));
+        if (!grown) return out_of_memory(opt);
+        le->code = grown;
+        le->code_capacity = capacity;
+    }
+    le->code[le->code_count++] = inst;
+    return true;
+}
+
+/* Send the loop's back edges to its header past code inserted before it */
+static void loop_retarget(LoopEdits *le, const Optimizer *opt, const ControlFlowGraph *cfg,
+                          const Loop *loop, int mark) {
+    int target = cfg->blocks[loop->header].start;
+    for (int m = 0; m < loop->member_count; m++) {
+        const BasicBlock *block = &cfg->blocks[loop->members[m]];
+        const ParsedInstruction *last = &opt->instructions[block->end - 1];
+        if (is_branch_opcode(last->opcode) && last->operand == target) {
+            le->edits[block->end - 1].retarget = opt->instruction_count + 1 + mark;
+        }
+    }
+}
+
+static bool loop_edits_apply(Optimizer *opt, LoopEdits *le) {
+    Rebuild rb;
+    if (!rebuild_begin(opt, &rb, le->marks)) return false;
+
+    bool ok = true;
+    for (int i = 0; i < opt->instruction_count && ok; i++) {
+        const LoopEdit *edit = &le->edits[i];
+        rebuild_next(&rb, i);
+
+        if (edit->insert_count > 0) {
+            for (int k = 0; k < edit->insert_count && ok; k++) {
+                ok = rebuild_emit(opt, &rb, le->code[edit->insert_from + k]);
+            }
+            rebuild_mark(&rb, edit->mark);
+        }
+        if (edit->replace_length > 0) {
+            for (int k = 0; k < edit->replace_count && ok; k++) {
+                ok = rebuild_emit(opt, &rb, le->code[edit->replace_from + k]);
+            }
+            for (int k = 1; k < edit->replace_length; k++) rebuild_next(&rb, i + k);
+            i += edit->replace_length - 1;
+            continue;
+        }
+
+        ParsedInstruction inst = opt->instructions[i];
+        if (edit->retarget >= 0) inst.operand = edit->retarget;
+        if (ok) ok = rebuild_emit(opt, &rb, inst);
+    }
+
+    if (!ok) {
+        rebuild_abort(&rb);
+        return false;
+    }
+    rebuild_finish(opt, &rb);
+    return true;
+}
+
+/* Replace input[at .. at + length) by the last count instructions added to code */
+static void loop_replace(LoopEdits *le, int at, int length, int count) {
+    le->edits[at].replace_length = length;
+    le->edits[at].replace_from = le->code_count - count;
+    le->edits[at].replace_count = count;
+}
+
+/*
+ * An expression the loop does not change: PUSHes, LOADs of slots the loop
+ * never stores, and arithmetic on them, computing one value from nothing.
+ * DIV is allowed only by a nonzero constant, so the hoisted code cannot
+ * fail where the loop would not have.
+ */
+typedef struct {
+    int start;
+    int length;
+    bool loads;               /* Reads memory; constant expressions fold instead */
+} Invariant;
+
+static bool is_arithmetic(uint8_t opcode) {
+    return opcode == OP_ADD || opcode == OP_SUB || opcode == OP_MUL ||
+           opcode == OP_DIV || opcode == OP_CMP;
+}
+
+static bool same_code(const ParsedInstruction *a, const ParsedInstruction *b, int length) {
+    for (int i = 0; i < length; i++) {
+        if (a[i].opcode != b[i].opcode || a[i].operand != b[i].operand) return false;
+    }
+    return true;
+}
+
+/* Invariant expressions worth hoisting in [start, end), in order */
+static int find_invariants(const Optimizer *opt, const Loop *loop, const bool *claimed,
+                           int start, int end, Invariant *found, int capacity) {
+    Invariant open[TRACKED_DEPTH];
+    int depth = 0;
+    int count = 0;
+
+    for (int i = start; i <= end; i++) {
+        const ParsedInstruction *inst = i < end ? &opt->instructions[i] : NULL;
+        bool leaf = inst && !claimed[i] &&
+                    (inst->opcode == OP_PUSH ||
+                     (inst->opcode == OP_LOAD && in_memory(inst->operand) &&
+                      !loop->stored[inst->operand]));
+
+        if (leaf && depth < TRACKED_DEPTH) {
+            Invariant value = {i, 1, inst->opcode == OP_LOAD};
+            open[depth++] = value;
+            continue;
+        }
+        if (inst && !claimed[i] && is_arithmetic(inst->opcode) && depth >= 2) {
+            Invariant *a = &open[depth - 2];
+            Invariant *b = &open[depth - 1];
+            const ParsedInstruction *divisor = &opt->instructions[b->start];
+            bool safe = inst->opcode != OP_DIV ||
+                        (b->length == 1 && divisor->opcode == OP_PUSH && divisor->operand != 0);
+            if (a->start + a->length == b->start && b->start + b->length == i && safe) {
+                a->length += b->length + 1;
+                a->loads = a->loads || b->loads;
+                depth--;
+                continue;
+            }
+        }
+
+        /* Whatever is open is complete */
+        for (int k = 0; k < depth && count < capacity; k++) {
+            if (open[k].length >= 3 && open[k].loads) found[count++] = open[k];
+        }
+        depth = 0;
+        if (leaf) {
+            Invariant value = {i, 1, inst->opcode == OP_LOAD};
+            open[depth++] = value;
+        }
+    }
+    return count;
+}
+
+/*
+ * Move invariant expressions out of loops: each is computed once before
+ * the header into a memory slot no instruction names, and the loop LOADs
+ * it. Loops that CALL are left alone, since the callee may store.
+ * Returns the number of expressions hoisted, or -1 if out of memory.
+ */
+static int hoist_invariants(Optimizer *opt) {
+    ControlFlowGraph cfg;
+    Predecessors preds;
+    if (!cfg_build(&cfg, opt->instructions, opt->instruction_count)) {
+        out_of_memory(opt);
+        return -1;
+    }
+    if (!predecessors_build(&preds, &cfg)) {
+        cfg_free(&cfg);
+        out_of_memory(opt);
+        return -1;
+    }
+
+    int count = opt->instruction_count;
+    bool named[MEMORY_SLOTS] = {false};
+    for (int i = 0; i < count; i++) {
+        const ParsedInstruction *inst = &opt->instructions[i];
+        if ((inst->opcode == OP_LOAD || inst->opcode == OP_STORE) && in_memory(inst->operand)) {
+            named[inst->operand] = true;
+        }
+    }
+    int next_slot = MEMORY_SLOTS - 1;
+
+    Loop *loop = (Loop*)malloc(sizeof(Loop));
+    bool *in_body = (bool*)calloc(cfg.block_count > 0 ? cfg.block_count : 1, sizeof(bool));
+    int *members = (int*)malloc((cfg.block_count > 0 ? cfg.block_count : 1) * sizeof(int));
+    bool *claimed = (bool*)calloc(count > 0 ? count : 1, sizeof(bool));
+    Invariant *found = (Invariant*)malloc((count > 0 ? count : 1) * sizeof(Invariant));
+    int *slot_of = (int*)malloc((count > 0 ? count : 1) * sizeof(int));
+    LoopEdits le;
+    bool ok = loop && in_body && members && claimed && found && slot_of;
+    if (ok) ok = loop_edits_init(opt, &le);
+    else out_of_memory(opt);
+
+    int hoisted = 0;
+    bool have_edits = ok;
+    /* Later headers first, so an inner loop claims its expressions before the loop around it */
+    for (int h = cfg.block_count - 1; h >= 0 && ok && next_slot >= 0; h--) {
+        if (!cfg.blocks[h].reachable) continue;
+        loop->in_body = in_body;
+        loop->members = members;
+        if (!loop_find(loop, opt, &cfg, &preds, h)) continue;
+        if (loop->has_call) {
+            loop_release(loop);
+            continue;
+        }
+
+        int candidates = 0;
+        for (int m = 0; m < loop->member_count; m++) {
+            const BasicBlock *block = &cfg.blocks[loop->members[m]];
+            candidates += find_invariants(opt, loop, claimed, block->start, block->end,
+                                          found + candidates, count - candidates);
+        }
+
+        /* One slot per distinct expression, computed once in the preheader */
+        int insert_from = le.code_count;
+        int kept = 0;
+        for (int c = 0; c < candidates && ok; c++) {
+            int slot = -1;
+            for (int d = 0; d < kept && slot < 0; d++) {
+                if (found[d].length == found[c].length &&
+                    same_code(&opt->instructions[found[d].start],
+                              &opt->instructions[found[c].start], found[c].length)) {
+                    slot = slot_of[d];
+                }
+            }
+            if (slot < 0) {
+                while (next_slot >= 0 && named[next_slot]) next_slot--;
+                if (next_slot < 0) break;
+                slot = next_slot;
+                named[slot] = true;
+                for (int k = 0; k < found[c].length && ok; k++) {
+                    ok = loop_code(opt, &le, opt->instructions[found[c].start + k]);
+                }
+                if (ok) ok = loop_code(opt, &le, make(&opt->instructions[found[c].start],
+                                                       OP_STORE, true, slot));
+            }
+            found[kept] = found[c];
+            slot_of[kept] = slot;
+            kept++;
+        }
+        int insert_count = le.code_count - insert_from;
+
+        for (int c = 0; c < kept && ok; c++) {
+            ok = loop_code(opt, &le, make(&opt->instructions[found[c].start], OP_LOAD, true, slot_of[c]));
+            if (!ok) break;
+            loop_replace(&le, found[c].start, found[c].length, 1);
+            for (int k = 0; k < found[c].length; k++) claimed[found[c].start + k] = true;
+            opt->stats.invariants_hoisted++;
+            hoisted++;
+        }
+
+        if (ok && kept > 0) {
+            int at = cfg.blocks[h].start;
+            le.edits[at].insert_from = insert_from;
+            le.edits[at].insert_count = insert_count;
+            le.edits[at].mark = le.marks;
+            loop_retarget(&le, opt, &cfg, loop, le.marks);
+            le.marks++;
+        }
+        loop_release(loop);
+    }
+
+    if (ok && hoisted > 0) ok = loop_edits_apply(opt, &le);
+    if (have_edits) loop_edits_free(&le);
+    free(loop);
+    free(in_body);
+    free(members);
+    free(claimed);
+    free(found);
+    free(slot_of);
+    predecessors_free(&preds);
+    cfg_free(&cfg);
+    return ok ? hoisted : -1;
+}
+
+/*
+ * A loop that is a single block ending in a counter update and a branch
+ * back to its start, with a trip count known on entry:
+ *
+ *     LOAD c; PUSH s; ADD|SUB; DUP; STORE c; JNZ start                (until c is 0)
+ *     LOAD c; PUSH s; ADD|SUB; DUP; STORE c; PUSH b; CMP; JNZ start   (while c < b)
+ *
+ * The body is everything before the update.
+ */
+typedef struct {
+    int start;
+    int tail;                 /* The LOAD of the update */
+    int end;
+    int slot;
+    int32_t initial;
+    int64_t step;             /* Signed */
+    bool compare;
+    int32_t bound;
+    int64_t trips;
+} CountedLoop;
+
+static bool is_update(const ParsedInstruction *at, int slot) {
+    return at[0].opcode == OP_LOAD && at[0].operand == slot &&
+           at[1].opcode == OP_PUSH &&
+           (at[2].opcode == OP_ADD || at[2].opcode == OP_SUB) &&
+           at[3].opcode == OP_DUP &&
+           at[4].opcode == OP_STORE && at[4].operand == slot;
+}
+
+/* The value of slot on entry to block b, if every way in agrees on it */
+static bool entry_value(const Optimizer *opt, const ControlFlowGraph *cfg, const Predecessors *preds,
+                        const StackState *in, int b, int slot, StackState *scratch, int32_t *value) {
+    if (preds->entered[b]) return false;
+    bool seen = false;
+    for (int p = preds->start[b]; p < preds->start[b + 1]; p++) {
+        int from = preds->list[p];
+        if (from == b) continue;
+        if (!in[from].reached) continue;
+        *scratch = in[from];
+        for (int i = cfg->blocks[from].start; i < cfg->blocks[from].end; i++) {
+            transfer(scratch, &opt->instructions[i]);
+        }
+        Constant c = scratch->memory[slot];
+        if (!c.known || (seen && c.value != *value)) return false;
+        *value = c.value;
+        seen = true;
+    }
+    return seen;
+}
+
+static bool match_counted_loop(const Optimizer *opt, const ControlFlowGraph *cfg,
+                               const Predecessors *preds, const StackState *in, int b,
+                               StackState *scratch, CountedLoop *loop) {
+    const BasicBlock *block = &cfg->blocks[b];
+    const ParsedInstruction *program = opt->instructions;
+    const ParsedInstruction *last = &program[block->end - 1];
+    if (last->opcode != OP_JNZ || last->operand != block->start) return false;
+
+    loop->start = block->start;
+    loop->end = block->end;
+    loop->compare = block->end - block->start >= 8 &&
+                    program[block->end - 2].opcode == OP_CMP &&
+                    program[block->end - 3].opcode == OP_PUSH;
+    loop->tail = block->end - (loop->compare ? 8 : 6);
+    if (loop->tail < block->start) return false;
+    loop->slot = program[loop->tail].operand;
+    if (!in_memory(loop->slot) || !is_update(&program[loop->tail], loop->slot)) return false;
+
+    int64_t s = program[loop->tail + 1].operand;
+    loop->step = program[loop->tail + 2].opcode == OP_ADD ? s : -s;
+    loop->bound = loop->compare ? program[block->end - 3].operand : 0;
+
+    for (int i = loop->start; i < loop->tail; i++) {
+        if (program[i].opcode == OP_CALL) return false;
+    }
+    if (!entry_value(opt, cfg, preds, in, b, loop->slot, scratch, &loop->initial)) return false;
+
+    /* The counter must reach its limit without wrapping */
+    int64_t c0 = loop->initial;
+    if (loop->step == 0) return false;
+    if (loop->compare) {
+        if (loop->step < 0) return false;
+        int64_t remaining = (int64_t)loop->bound - c0 - loop->step;
+        loop->trips = remaining <= 0 ? 1 : 1 + (remaining + loop->step - 1) / loop->step;
+        if (c0 + loop->trips * loop->step > INT32_MAX) return false;
+    } else {
+        if (c0 == 0 || (-c0) % loop->step != 0 || (-c0) / loop->step <= 0) return false;
+        loop->trips = (-c0) / loop->step;
+    }
+    return true;
+}
+
+/* Whether input[i] is the start of LOAD slot; PUSH k; MUL, or PUSH k; LOAD slot; MUL */
+static bool is_scaled_use(const ParsedInstruction *at, int remaining, int slot, int32_t *k) {
+    if (remaining < 3 || at[2].opcode != OP_MUL) return false;
+    if (at[0].opcode == OP_LOAD && at[0].operand == slot && at[1].opcode == OP_PUSH) {
+        *k = at[1].operand;
+        return true;
+    }
+    if (at[0].opcode == OP_PUSH && at[1].opcode == OP_LOAD && at[1].operand == slot) {
+        *k = at[0].operand;
+        return true;
+    }
+    return false;
+}
+
+static bool fits_int32(int64_t value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+/*
+ * Strength reduction. When the body of a counted loop only ever reads the
+ * counter multiplied by the same constant k, the counter is kept scaled
+ * by k instead: the multiplies go, the step and bound are scaled, and the
+ * scaled starting value is stored before the header. A counter that runs
+ * down to 0 ends at 0 either way; one compared against a bound must not
+ * be read outside the loop. Returns the number of multiplies removed, or
+ * -1 if out of memory.
+ */
+static int reduce_inductions(Optimizer *opt, const ControlFlowGraph *cfg, const Predecessors *preds,
+                             const StackState *in, StackState *scratch) {
+    const ParsedInstruction *program = opt->instructions;
+    LoopEdits le;
+    if (!loop_edits_init(opt, &le)) return -1;
+
+    int reduced = 0;
+    bool ok = true;
+    for (int b = 0; b < cfg->block_count && ok; b++) {
+        CountedLoop loop;
+        if (!match_counted_loop(opt, cfg, preds, in, b, scratch, &loop)) continue;
+
+        int32_t k = 0;
+        int uses = 0;
+        bool only_scaled = true;
+        for (int i = loop.start; i < loop.tail && only_scaled; i++) {
+            int32_t factor;
+            if (is_scaled_use(&program[i], loop.tail - i, loop.slot, &factor) &&
+                (uses == 0 || factor == k)) {
+                k = factor;
+                uses++;
+                i += 2;
+            } else if ((program[i].opcode == OP_LOAD || program[i].opcode == OP_STORE) &&
+                       program[i].operand == loop.slot) {
+                only_scaled = false;
+            }
+        }
+        if (!only_scaled || uses == 0 || k == 0) continue;
+
+        int64_t scaled_step = (int64_t)program[loop.tail + 1].operand * k;
+        int64_t scaled_start = (int64_t)loop.initial * k;
+        if (!fits_int32(scaled_step) || !fits_int32(scaled_start)) continue;
+        if (loop.compare) {
+            int64_t final = (int64_t)loop.initial + loop.trips * loop.step;
+            if (k < 0 || !fits_int32(final * k) || !fits_int32((int64_t)loop.bound * k)) continue;
+            bool read_outside = false;
+            for (int i = 0; i < opt->instruction_count && !read_outside; i++) {
+                read_outside = (i < loop.start || i >= loop.end) &&
+                               program[i].opcode == OP_LOAD && program[i].operand == loop.slot;
+            }
+            if (read_outside) continue;
+        }
+
+        const ParsedInstruction *head = &program[loop.start];
+        int insert_from = le.code_count;
+        ok = loop_code(opt, &le, make(head, OP_PUSH, true, (int32_t)scaled_start)) &&
+             loop_code(opt, &le, make(head, OP_STORE, true, loop.slot));
+        for (int i = loop.start; i < loop.tail && ok; i++) {
+            int32_t factor;
+            if (is_scaled_use(&program[i], loop.tail - i, loop.slot, &factor)) {
+                ok = loop_code(opt, &le, make(&program[i], OP_LOAD, true, loop.slot));
+                if (ok) loop_replace(&le, i, 3, 1);
+                i += 2;
+            }
+        }
+        if (ok) ok = loop_code(opt, &le, make(&program[loop.tail + 1], OP_PUSH, true, (int32_t)scaled_step));
+        if (ok) loop_replace(&le, loop.tail + 1, 1, 1);
+        if (ok && loop.compare) {
+            ok = loop_code(opt, &le, make(&program[loop.end - 3], OP_PUSH, true, loop.bound * k));
+            if (ok) loop_replace(&le, loop.end - 3, 1, 1);
+        }
+        if (!ok) break;
+
+        le.edits[loop.start].insert_from = insert_from;
+        le.edits[loop.start].insert_count = 2;
+        le.edits[loop.start].mark = le.marks;
+        le.edits[loop.end - 1].retarget = opt->instruction_count + 1 + le.marks;
+        le.marks++;
+        opt->stats.multiplies_reduced += uses;
+        reduced += uses;
+    }
+
+    if (ok && reduced > 0) ok = loop_edits_apply(opt, &le);
+    loop_edits_free(&le);
+    return ok ? reduced : -1;
+}
+
+/*
+ * Unroll counted loops whose body does not read the counter: the body is
+ * repeated f times and the counter steps f times as far, for the largest
+ * f up to opt->unroll that divides the trip count and keeps the body
+ * within MAX_UNROLLED_BODY. Returns the number of loops unrolled, or -1
+ * if out of memory.
+ */
+static int unroll_loops(Optimizer *opt, const ControlFlowGraph *cfg, const Predecessors *preds,
+                        const StackState *in, StackState *scratch) {
+    const ParsedInstruction *program = opt->instructions;
+    LoopEdits le;
+    if (!loop_edits_init(opt, &le)) return -1;
+
+    int unrolled = 0;
+    bool ok = true;
+    for (int b = 0; b < cfg->block_count && ok; b++) {
+        CountedLoop loop;
+        if (!match_counted_loop(opt, cfg, preds, in, b, scratch, &loop)) continue;
+
+        bool reads_counter = false;
+        for (int i = loop.start; i < loop.tail && !reads_counter; i++) {
+            reads_counter = (program[i].opcode == OP_LOAD || program[i].opcode == OP_STORE) &&
+                            program[i].operand == loop.slot;
+        }
+        if (reads_counter) continue;
+
+        int body = loop.tail - loop.start;
+        int factor = 1;
+        for (int f = opt->unroll; f >= 2; f--) {
+            if (loop.trips % f == 0 && body * f <= MAX_UNROLLED_BODY &&
+                fits_int32((int64_t)program[loop.tail + 1].operand * f)) {
+                factor = f;
+                break;
+            }
+        }
+        if (factor == 1) continue;
+
+        if (body > 0) {
+            for (int copy = 0; copy < factor && ok; copy++) {
+                for (int i = loop.start; i < loop.tail && ok; i++) ok = loop_code(opt, &le, program[i]);
+            }
+            if (ok) loop_replace(&le, loop.start, body, body * factor);
+        }
+        if (ok) ok = loop_code(opt, &le, make(&program[loop.tail + 1], OP_PUSH, true,
+                                               program[loop.tail + 1].operand * factor));
+        if (!ok) break;
+        loop_replace(&le, loop.tail + 1, 1, 1);
+        opt->stats.loops_unrolled++;
+        unrolled++;
+    }
+
+    if (ok && unrolled > 0) ok = loop_edits_apply(opt, &le);
+    loop_edits_free(&le);
+    return ok ? unrolled : -1;
+}
+
+typedef int (*CountedLoopPass)(Optimizer *opt, const ControlFlowGraph *cfg, const Predecessors *preds,
+                               const StackState *in, StackState *scratch);
+
+/* Run pass with a fresh analysis of the program's counted loops */
+static int on_counted_loops(Optimizer *opt, CountedLoopPass pass) {
+    ControlFlowGraph cfg;
+    Predecessors preds;
+    if (!cfg_build(&cfg, opt->instructions, opt->instruction_count)) {
+        out_of_memory(opt);
+        return -1;
+    }
+    if (cfg.block_count > MAX_PROPAGATION_BLOCKS) {
+        cfg_free(&cfg);
+        return 0;
+    }
+    if (!predecessors_build(&preds, &cfg)) {
+        cfg_free(&cfg);
+        out_of_memory(opt);
+        return -1;
+    }
+
+    StackState *in = solve_constants(opt, &cfg);
+    StackState *scratch = (StackState*)malloc(sizeof(StackState));
+    int changes = -1;
+    if (in && scratch) {
+        changes = pass(opt, &cfg, &preds, in, scratch);
+    } else if (!opt->has_error) {
+        out_of_memory(opt);
+    }
+
+    free(in);
+    free(scratch);
+    predecessors_free(&preds);
+    cfg_free(&cfg);
+    return changes;
+}
+
+/* ============================================
+ * Profile-guided layout
+ * ============================================ */
+
+#define LAYOUT_END -2         /* Where control goes after the last block */
+
+/* A control-flow edge and how often the profile saw it followed */
+typedef struct {
+    int from;
+    int to;
+    uint64_t count;
+    bool fall_through;
+} LayoutEdge;
+
+/* A chain of blocks to be laid out one after another, by its first block */
+typedef struct {
+    int head;
+    bool hot;                 /* Some block ran, or the chain starts the program */
+    int function_rank;        /* Of the function the head belongs to; hot functions first */
+    bool entry;               /* Holds a function's entry */
+    uint64_t count;           /* Runs of its busiest block */
+} LayoutChain;
+
+/*
+ * The offset of each instruction, once branch operands are byte addresses
+ * again. False, with an error, unless the profile was recorded from
+ * exactly the bytecode the program encodes to now.
+ */
+static bool profile_matches(Optimizer *opt, int32_t *address) {
+    const ParsedInstruction *program = opt->instructions;
+    int count = opt->instruction_count;
+    int32_t pc = 0;
+    for (int i = 0; i < count; i++) {
+        address[i] = pc;
+        pc += instruction_size(&program[i]);
+    }
+    address[count] = pc;
+
+    uint32_t hash = PROFILE_HASH_SEED;
+    for (int i = 0; i < count; i++) {
+        int32_t operand = program[i].operand;
+        if (is_branch_opcode(program[i].opcode)) operand = address[operand];
+        uint8_t bytes[5] = {program[i].opcode, (uint8_t)operand, (uint8_t)(operand >> 8),
+                            (uint8_t)(operand >> 16), (uint8_t)((uint32_t)operand >> 24)};
+        hash = profile_hash(hash, bytes, instruction_size(&program[i]));
+    }
+
+    if (pc != opt->profile->code_size || hash != opt->profile->code_hash) {
+        snprintf(opt->error_msg, sizeof(opt->error_msg),
+                 "Profile was recorded from other bytecode (%d bytes, hash %08x); with the "
+                 "same options and no --profile this program is %d bytes, hash %08x",
+                 opt->profile->code_size, opt->profile->code_hash, pc, hash);
+        opt->has_error = true;
+        return false;
+    }
+    return true;
+}
+
+static int compare_edges(const void *a, const void *b) {
+    const LayoutEdge *x = (const LayoutEdge*)a;
+    const LayoutEdge *y = (const LayoutEdge*)b;
+    if (x->count != y->count) return x->count > y->count ? -1 : 1;
+    if (x->fall_through != y->fall_through) return x->fall_through ? -1 : 1;
+    if (x->from != y->from) return x->from - y->from;
+    return x->to - y->to;
+}
+
+static int compare_chains(const void *a, const void *b) {
+    const LayoutChain *x = (const LayoutChain*)a;
+    const LayoutChain *y = (const LayoutChain*)b;
+    if (x->hot != y->hot) return x->hot ? -1 : 1;
+    if (x->hot) {
+        if (x->function_rank != y->function_rank) return x->function_rank - y->function_rank;
+        if (x->entry != y->entry) return x->entry ? -1 : 1;
+        if (x->count != y->count) return x->count > y->count ? -1 : 1;
+    }
+    return x->head - y->head;
+}
+
+static int chain_of(int *chain, int block) {
+    while (chain[block] != block) {
+        chain[block] = chain[chain[block]];
+        block = chain[block];
+    }
+    return block;
+}
+
+/* Lay out to right after from, if both are free to join up */
+static void chain_link(int *chain, int *next, int *prev, int from, int to) {
+    if (to == 0 || next[from] >= 0 || prev[to] >= 0) return;
+    int a = chain_of(chain, from);
+    int b = chain_of(chain, to);
+    if (a == b) return;
+    next[from] = to;
+    prev[to] = from;
+    chain[b] = a;
+}
+
+typedef struct {
+    int index;
+    uint64_t executed;        /* Instructions run in it */
+} LayoutFunction;
+
+static int compare_functions(const void *a, const void *b) {
+    const LayoutFunction *x = (const LayoutFunction*)a;
+    const LayoutFunction *y = (const LayoutFunction*)b;
+    if (x->executed != y->executed) return x->executed > y->executed ? -1 : 1;
+    return x->index - y->index;
+}
+
+/*
+ * Functions: block 0 and each block a CALL enters, with the blocks
+ * reached from each without passing through a call. A block reached from
+ * two belongs to the first. rank orders them for layout: the program's
+ * own code, then the others by instructions executed in them.
+ */
+static bool rank_functions(const ControlFlowGraph *cfg, const uint64_t *runs, int *function,
+                           int *rank) {
+    int blocks = cfg->block_count;
+    int *entries = (int*)malloc(blocks * sizeof(int));
+    int *work = (int*)malloc(blocks * sizeof(int));
+    LayoutFunction *order = (LayoutFunction*)malloc(blocks * sizeof(LayoutFunction));
+    if (!entries || !work || !order) {
+        free(entries);
+        free(work);
+        free(order);
+        return false;
+    }
+
+    for (int b = 0; b < blocks; b++) function[b] = -1;
+    int functions = 0;
+    entries[functions++] = 0;
+    function[0] = 0;
+    for (int b = 0; b < blocks; b++) {
+        int callee = cfg->blocks[b].callee;
+        if (callee >= 0 && function[callee] < 0) {
+            function[callee] = functions;
+            entries[functions++] = callee;
+        }
+    }
+
+    for (int f = 0; f < functions; f++) {
+        int top = 0;
+        work[top++] = entries[f];
+        order[f].index = f;
+        order[f].executed = 0;
+        while (top > 0) {
+            int b = work[--top];
+            const BasicBlock *block = &cfg->blocks[b];
+            order[f].executed += runs[b] * (uint64_t)(block->end - block->start);
+            for (int s = 0; s < block->succ_count; s++) {
+                if (function[block->succ[s]] < 0) {
+                    function[block->succ[s]] = f;
+                    work[top++] = block->succ[s];
+                }
+            }
+        }
+    }
+    for (int b = 0; b < blocks; b++) {
+        if (function[b] < 0) function[b] = 0;
+    }
+
+    qsort(order + 1, functions - 1, sizeof(LayoutFunction), compare_functions);
+    for (int r = 0; r < functions; r++) rank[order[r].index] = r;
+
+    free(entries);
+    free(work);
+    free(order);
+    return true;
+}
+
+/*
+ * Reorder the blocks by the profile. Blocks are joined into chains along
+ * the most frequently followed edges first, so the common successor of
+ * each block is laid out right after it; a CALL always stays followed by
+ * its return point, and nothing is laid out before block 0. The chains
+ * that ran are then grouped by function, busiest function first, and the
+ * chains that never ran go last, in their old order.
+ *
+ * A JZ or JNZ whose taken successor now comes next is inverted, and a
+ * block whose fall-through successor moved away gets a JMP to it.
+ * Returns false if out of memory or the profile does not fit.
+ */
+static bool layout_blocks(Optimizer *opt) {
+    const ParsedInstruction *program = opt->instructions;
+    int count = opt->instruction_count;
+    if (count == 0) return true;
+
+    int32_t *address = (int32_t*)malloc((count + 1) * sizeof(int32_t));
+    if (!address) return out_of_memory(opt);
+    if (!profile_matches(opt, address)) {
+        free(address);
+        return false;
+    }
+    const uint64_t *executed = opt->profile->executed;
+    const uint64_t *taken = opt->profile->taken;
+
+    ControlFlowGraph cfg;
+    if (!cfg_build(&cfg, program, count)) {
+        free(address);
+        return out_of_memory(opt);
+    }
+    int blocks = cfg.block_count;
+    uint64_t *runs = (uint64_t*)malloc(blocks * sizeof(uint64_t));
+    int *chain = (int*)malloc(blocks * sizeof(int));
+    int *next = (int*)malloc(blocks * sizeof(int));
+    int *prev = (int*)malloc(blocks * sizeof(int));
+    int *function = (int*)malloc(blocks * sizeof(int));
+    int *rank = (int*)malloc(blocks * sizeof(int));
+    int *order = (int*)malloc(blocks * sizeof(int));
+    LayoutEdge *edges = (LayoutEdge*)malloc(2 * blocks * sizeof(LayoutEdge));
+    LayoutChain *chains = (LayoutChain*)malloc(blocks * sizeof(LayoutChain));
+    bool *is_entry = (bool*)calloc(blocks, sizeof(bool));
+    bool ok = runs && chain && next && prev && function && rank && order && edges && chains &&
+              is_entry;
+
+    int edge_count = 0;
+    for (int b = 0; ok && b < blocks; b++) {
+        const BasicBlock *block = &cfg.blocks[b];
+        const ParsedInstruction *last = &program[block->end - 1];
+        uint64_t last_runs = executed[address[block->end - 1]];
+        uint64_t last_taken = taken[address[block->end - 1]];
+        runs[b] = executed[address[block->start]];
+        if (block->callee >= 0) is_entry[block->callee] = true;
+        chain[b] = b;
+        next[b] = -1;
+        prev[b] = -1;
+
+        for (int s = 0; s < block->succ_count; s++) {
+            LayoutEdge *edge = &edges[edge_count++];
+            edge->from = b;
+            edge->to = block->succ[s];
+            edge->fall_through = s == 0 && block->end < count &&
+                                 block->succ[s] == cfg.block_of[block->end] &&
+                                 last->opcode != OP_JMP;
+            if (last->opcode == OP_JZ || last->opcode == OP_JNZ) {
+                edge->count = edge->fall_through ? last_runs - last_taken : last_taken;
+            } else {
+                edge->count = last_runs;
+            }
+        }
+    }
+
+    if (ok) ok = rank_functions(&cfg, runs, function, rank);
+    if (!ok) {
+        out_of_memory(opt);
+        goto done;
+    }
+    is_entry[0] = true;
+
+    /* A CALL's return point has to follow it; then hot edges, then cold fall-throughs */
+    for (int b = 0; b < blocks; b++) {
+        const BasicBlock *block = &cfg.blocks[b];
+        if (program[block->end - 1].opcode == OP_CALL && block->end < count) {
+            chain_link(chain, next, prev, b, cfg.block_of[block->end]);
+        }
+    }
+    qsort(edges, edge_count, sizeof(LayoutEdge), compare_edges);
+    for (int e = 0; e < edge_count && edges[e].count > 0; e++) {
+        chain_link(chain, next, prev, edges[e].from, edges[e].to);
+    }
+    for (int e = 0; e < edge_count; e++) {
+        const LayoutEdge *edge = &edges[e];
+        if (edge->fall_through && (runs[edge->from] > 0) == (runs[edge->to] > 0)) {
+            chain_link(chain, next, prev, edge->from, edge->to);
+        }
+    }
+
+    int chain_count = 0;
+    for (int b = 0; b < blocks; b++) {
+        if (prev[b] >= 0) continue;
+        LayoutChain *c = &chains[chain_count++];
+        c->head = b;
+        c->function_rank = rank[function[b]];
+        c->entry = false;
+        c->count = 0;
+        for (int m = b; m >= 0; m = next[m]) {
+            if (runs[m] > c->count) c->count = runs[m];
+            if (is_entry[m]) c->entry = true;
+        }
+        c->hot = c->count > 0 || b == 0;
+    }
+    qsort(chains, chain_count, sizeof(LayoutChain), compare_chains);
+
+    int placed = 0;
+    for (int c = 0; c < chain_count; c++) {
+        for (int m = chains[c].head; m >= 0; m = next[m]) order[placed++] = m;
+    }
+
+    Rebuild rb;
+    if (!rebuild_begin(opt, &rb, 0)) {
+        ok = false;
+        goto done;
+    }
+    for (int p = 0; p < blocks && ok; p++) {
+        const BasicBlock *block = &cfg.blocks[order[p]];
+        int after = p + 1 < blocks ? order[p + 1] : LAYOUT_END;
+        if (p > 0 && order[p - 1] != order[p] - 1) opt->stats.blocks_moved++;
+        if (runs[order[p]] == 0) opt->stats.cold_blocks++;
+
+        for (int i = block->start; i < block->end - 1 && ok; i++) {
+            rebuild_next(&rb, i);
+            ok = rebuild_emit(opt, &rb, program[i]);
+        }
+        if (!ok) break;
+
+        int last = block->end - 1;
+        const ParsedInstruction *inst = &program[last];
+        int fall = block->end < count ? cfg.block_of[block->end] : LAYOUT_END;
+        int target = -1;
+        if (is_branch_opcode(inst->opcode)) {
+            target = inst->operand < count ? cfg.block_of[inst->operand] : LAYOUT_END;
+        }
+        rebuild_next(&rb, last);
+
+        if (inst->opcode == OP_JMP) {
+            if (target != after) ok = rebuild_emit(opt, &rb, *inst);
+        } else if (inst->opcode == OP_RET || inst->opcode == OP_HALT || fall == after) {
+            ok = rebuild_emit(opt, &rb, *inst);
+        } else if ((inst->opcode == OP_JZ || inst->opcode == OP_JNZ) && target == after) {
+            uint8_t inverted = inst->opcode == OP_JZ ? OP_JNZ : OP_JZ;
+            ok = rebuild_emit(opt, &rb, make(inst, inverted, true, block->end));
+            opt->stats.branches_flipped++;
+        } else {
+            /* The fall-through successor moved away; jump to it */
+            ok = rebuild_emit(opt, &rb, *inst) &&
+                 rebuild_emit(opt, &rb, make(inst, OP_JMP, true, block->end));
+        }
+    }
+    if (ok) {
+        rebuild_finish(opt, &rb);
+    } else {
+        rebuild_abort(&rb);
+    }
+
+done:
+    free(address);
+    free(runs);
+    free(chain);
+    free(next);
+    free(prev);
+    free(function);
+    free(rank);
+    free(order);
+    free(edges);
+    free(chains);
+    free(is_entry);
+    cfg_free(&cfg);
+    return ok;
+}
+
+/* ============================================
+ * Driver
+ * ============================================ */
+
+/*
+ * Global passes, then the peephole rules, until a round changes nothing.
+ * Each feeds the others: a LOAD made a PUSH folds, a folded branch leaves
+ * code unreachable, and removing it lines up jumps to thread.
+ */
+static bool optimize_rounds(Optimizer *opt) {
+    for (int round = 0; round < MAX_ROUNDS; round++) {
+        int changes = 0;
+        int result;
+
+        if ((result = propagate_constants(opt)) < 0) return false;
+        changes += result;
+        if ((result = eliminate_dead_code(opt)) < 0) return false;
+        changes += result;
+        if ((result = thread_jumps(opt)) < 0) return false;
+        changes += result;
+
+        int rewrites = opt->stats.peephole_rewrites;
+        if (!peephole(opt)) return false;
+        changes += opt->stats.peephole_rewrites - rewrites;
+
+        if (changes == 0) break;
+    }
+    return true;
+}
+
+/* Inlining a function can leave its caller free of calls, and inlinable in turn */
+static bool inline_functions(Optimizer *opt) {
+    for (int round = 0; round < MAX_INLINE_ROUNDS; round++) {
+        int inlined = inline_calls(opt);
+        if (inlined < 0) return false;
+        if (inlined == 0) break;
+        if (!optimize_rounds(opt)) return false;
+    }
+    return true;
+}
+
+/*
+ * The loop passes run once, after the program has settled, since an
+ * unrolled loop would otherwise be unrolled again. Each is followed by
+ * the rounds above to clean up after it.
+ */
+static bool optimize_loops(Optimizer *opt) {
+    if (hoist_invariants(opt) < 0 || !optimize_rounds(opt)) return false;
+    if (on_counted_loops(opt, reduce_inductions) < 0) return false;
+    if (opt->unroll > 1 && on_counted_loops(opt, unroll_loops) < 0) return false;
+    return optimize_rounds(opt);
+}
+
+void optimizer_init(Optimizer *opt) {
+    opt->instructions = NULL;
+    opt->instruction_count = 0;
+    opt->instruction_capacity = 0;
+    opt->unroll = 1;
+    opt->profile = NULL;
+    memset(&opt->stats, 0, sizeof(opt->stats));
+    opt->has_error = false;
+    opt->error_msg[0] = '\0';
+}
+
+void optimizer_free(Optimizer *opt) {
+    free(opt->instructions);
+    opt->instructions = NULL;
+}
+
+bool optimizer_run(Optimizer *opt, const ParsedInstruction *instructions, int instruction_count) {
+    int capacity = instruction_count > 0 ? instruction_count : 1;
+    opt->instructions = (ParsedInstruction*)malloc(capacity * sizeof(ParsedInstruction));
+    if (!opt->instructions) return out_of_memory(opt);
+    if (instruction_count > 0) {
+        memcpy(opt->instructions, instructions, instruction_count * sizeof(ParsedInstruction));
+    }
+    opt->instruction_count = instruction_count;
+    opt->instruction_capacity = capacity;
+
+    opt->stats.instructions_before = instruction_count;
+    opt->stats.bytes_before = program_bytes(instructions, instruction_count);
+
+    if (targets_to_indices(opt, opt->instructions, opt->instruction_count)) {
+        if (!optimize_rounds(opt) || !inline_functions(opt) || !optimize_loops(opt)) return false;
+        if (opt->profile && !layout_blocks(opt)) return false;
+        if (!targets_to_addresses(opt, opt->instructions, opt->instruction_count)) return false;
+    } else if (opt->has_error) {
+        return false;
+    } else {
+        /* Unoptimizable: emit the program as written */
+        memcpy(opt->instructions, instructions, instruction_count * sizeof(ParsedInstruction));
+    }
+
+    opt->stats.instructions_after = opt->instruction_count;
+    opt->stats.bytes_after = program_bytes(opt->instructions, opt->instruction_count);
+    return true;
+}
@@ -0,0 +1,62 @@
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+
+#include <stdbool.h>
+#include "parser.h"
+#include "profile.h"
+
+/* What the optimizer did to one program */
+typedef struct {
+    int instructions_before;
+    int instructions_after;
+    int bytes_before;
+    int bytes_after;
+    int peephole_rewrites;    /* Rule applications, constant folds included */
+    int constants_folded;
+    int loads_replaced;       /* LOADs of a known value, now PUSHes */
+    int branches_folded;      /* JZ/JNZ on a known value */
+    int instructions_unreachable;
+    int stores_removed;       /* STOREs nothing reads, now POPs */
+    int jumps_threaded;
+    int calls_inlined;        /* CALLs replaced by a copy of the function */
+    int invariants_hoisted;   /* Loop-invariant expressions computed once per entry */
+    int multiplies_reduced;   /* Counter multiplies replaced by a scaled counter */
+    int loops_unrolled;
+    int blocks_moved;         /* Blocks placed after a different block than before */
+    int cold_blocks;          /* Blocks the profile never saw run, moved to the end */
+    int branches_flipped;     /* JZ/JNZ inverted so the likelier successor falls through */
+    bool skipped;             /* A jump target was not an instruction boundary */
+} OptimizerStats;
+
+/*
+ * Optimizes a program whose label references have been resolved to byte
+ * addresses. The optimizer works on its own copy: jump and call targets
+ * become instruction indices while the passes run, and byte addresses are
+ * recomputed from the new instruction sizes at the end.
+ *
+ * With a profile, the last pass reorders the blocks by it. The profile
+ * must come from running the program this optimizer would produce
+ * without one.
+ *
+ * The optimized program computes the same results as the original
+ * whenever the original runs without error. Division by zero is never
+ * folded away, but a program that relies on a stack underflow may run
+ * further than it used to.
+ */
+typedef struct {
+    ParsedInstruction *instructions;  /* Owned; the optimized program */
+    int instruction_count;
+    int instruction_capacity;
+    int unroll;               /* Unroll counted loops up to this many times; 1 = off */
+    const ExecutionProfile *profile;  /* Lay out blocks by these counts; NULL = off */
+
+    OptimizerStats stats;
+    char error_msg[256];
+    bool has_error;
+} Optimizer;
+
+void optimizer_init(Optimizer *opt);
+bool optimizer_run(Optimizer *opt, const ParsedInstruction *instructions, int instruction_count);
+void optimizer_free(Optimizer *opt);
+
+#endif
@@ -5,70 +5,88 @@
 #include "parser.h"
 #include "instructions.h"
 
-static const OpcodeEntry opcode_table[] = {
-    {"PUSH",  OP_PUSH,  true},
-    {"POP",   OP_POP,   false},
-    {"DUP",   OP_DUP,   false},
-
-    {"ADD",   OP_ADD,   false},
-    {"SUB",   OP_SUB,   false},
-    {"MUL",   OP_MUL,   false},
-    {"DIV",   OP_DIV,   false},
-    {"CMP",   OP_CMP,   false},
-
-    {"JMP",   OP_JMP,   true},
-    {"JZ",    OP_JZ,    true},
-    {"JNZ",   OP_JNZ,   true},
-
-    {"STORE", OP_STORE, true},
-    {"LOAD",  OP_LOAD,  true},
-
-    {"CALL",  OP_CALL,  true},
-    {"RET",   OP_RET,   false},
-
-    {"HALT",  OP_HALT,  false},
-
-    {NULL, 0, false}
+/*
+ * Mnemonics live in a perfect hash table: the slot comes from the length
+ * and the first, middle and last letters, upper-cased, and no two
+ * mnemonics share one. The compiler computes each slot, and -Wextra
+ * (-Woverride-init) warns if a new mnemonic collides with an old one;
+ * then pick new multipliers.
+ */
+#define MNEMONIC_SLOTS 64
+#define MNEMONIC_SLOT(length, first, middle, last) \
+    (((length) + (first) * 6 + (middle) * 9 + (last) * 7) & (MNEMONIC_SLOTS - 1))
+
+static const OpcodeEntry opcode_table[MNEMONIC_SLOTS] = {
+    [MNEMONIC_SLOT(4, 'P', 'S', 'H')] = {"PUSH",  OP_PUSH,  true},
+    [MNEMONIC_SLOT(3, 'P', 'O', 'P')] = {"POP",   OP_POP,   false},
+    [MNEMONIC_SLOT(3, 'D', 'U', 'P')] = {"DUP",   OP_DUP,   false},
+
+    [MNEMONIC_SLOT(3, 'A', 'D', 'D')] = {"ADD",   OP_ADD,   false},
+    [MNEMONIC_SLOT(3, 'S', 'U', 'B')] = {"SUB",   OP_SUB,   false},
+    [MNEMONIC_SLOT(3, 'M', 'U', 'L')] = {"MUL",   OP_MUL,   false},
+    [MNEMONIC_SLOT(3, 'D', 'I', 'V')] = {"DIV",   OP_DIV,   false},
+    [MNEMONIC_SLOT(3, 'C', 'M', 'P')] = {"CMP",   OP_CMP,   false},
+
+    [MNEMONIC_SLOT(3, 'J', 'M', 'P')] = {"JMP",   OP_JMP,   true},
+    [MNEMONIC_SLOT(2, 'J', 'Z', 'Z')] = {"JZ",    OP_JZ,    true},
+    [MNEMONIC_SLOT(3, 'J', 'N', 'Z')] = {"JNZ",   OP_JNZ,   true},
+
+    [MNEMONIC_SLOT(5, 'S', 'O', 'E')] = {"STORE", OP_STORE, true},
+    [MNEMONIC_SLOT(4, 'L', 'A', 'D')] = {"LOAD",  OP_LOAD,  true},
+
+    [MNEMONIC_SLOT(4, 'C', 'L', 'L')] = {"CALL",  OP_CALL,  true},
+    [MNEMONIC_SLOT(3, 'R', 'E', 'T')] = {"RET",   OP_RET,   false},
+
+    [MNEMONIC_SLOT(8, 'N', 'R', 'Y')] = {"NEWARRAY", OP_NEWARRAY, false},
+    [MNEMONIC_SLOT(8, 'N', 'Y', 'S')] = {"NEWBYTES", OP_NEWBYTES, false},
+    [MNEMONIC_SLOT(5, 'A', 'O', 'D')] = {"ALOAD",    OP_ALOAD,    false},
+    [MNEMONIC_SLOT(6, 'A', 'O', 'E')] = {"ASTORE",   OP_ASTORE,   false},
+    [MNEMONIC_SLOT(4, 'A', 'E', 'N')] = {"ALEN",     OP_ALEN,     false},
+    [MNEMONIC_SLOT(5, 'B', 'O', 'D')] = {"BLOAD",    OP_BLOAD,    false},
+    [MNEMONIC_SLOT(6, 'B', 'O', 'E')] = {"BSTORE",   OP_BSTORE,   false},
+    [MNEMONIC_SLOT(4, 'D', 'O', 'P')] = {"DROP",     OP_DROP,     false},
+    [MNEMONIC_SLOT(6, 'N', 'M', 'P')] = {"NEWMAP",   OP_NEWMAP,   false},
+    [MNEMONIC_SLOT(6, 'M', 'G', 'T')] = {"MAPGET",   OP_MAPGET,   false},
+    [MNEMONIC_SLOT(6, 'M', 'S', 'T')] = {"MAPSET",   OP_MAPSET,   false},
+    [MNEMONIC_SLOT(6, 'M', 'D', 'L')] = {"MAPDEL",   OP_MAPDEL,   false},
+
+    [MNEMONIC_SLOT(4, 'H', 'L', 'T')] = {"HALT",  OP_HALT,  false},
 };
 
-static int strcasecmp_local(const char *s1, const char *s2) {
-    while (*s1 && *s2) {
-        char c1 = toupper((unsigned char)*s1);
-        char c2 = toupper((unsigned char)*s2);
-        if (c1 != c2) return c1 - c2;
-        s1++;
-        s2++;
-    }
-    return toupper((unsigned char)*s1) - toupper((unsigned char)*s2);
-}
-
 static bool is_at_end(Parser *parser) {
-    return parser->pos >= parser->token_count ||
-           parser->tokens[parser->pos].type == TOKEN_EOF;
+    return parser->token.type == TOKEN_EOF;
 }
 
 static Token* current(Parser *parser) {
-    return &parser->tokens[parser->pos];
+    return &parser->token;
 }
 
-static void advance(Parser *parser) {
-    if (!is_at_end(parser)) {
-        parser->pos++;
-    }
+static bool advance(Parser *parser) {
+    if (is_at_end(parser)) return true;
+    return lexer_next(parser->lexer, &parser->token);
 }
 
-static void skip_newlines(Parser *parser) {
+static bool skip_newlines(Parser *parser) {
     while (!is_at_end(parser) && current(parser)->type == TOKEN_NEWLINE) {
-        advance(parser);
+        if (!advance(parser)) return false;
     }
+    return true;
+}
+
+static bool out_of_memory(Parser *parser) {
+    snprintf(parser->error_msg, sizeof(parser->error_msg), "Out of memory");
+    parser->has_error = true;
+    return false;
 }
 
 static bool add_instruction(Parser *parser, ParsedInstruction *inst) {
-    if (parser->instruction_count >= MAX_INSTRUCTIONS) {
-        snprintf(parser->error_msg, sizeof(parser->error_msg),
-                 "Too many instructions (max %d)", MAX_INSTRUCTIONS);
-        parser->has_error = true;
-        return false;
+    if (parser->instruction_count == parser->instruction_capacity) {
+        int capacity = parser->instruction_capacity ? parser->instruction_capacity * 2 : 1024;
+        ParsedInstruction *grown = (ParsedInstruction*)realloc(
+            parser->instructions, capacity * sizeof(ParsedInstruction));
+        if (!grown) return out_of_memory(parser);
+        parser->instructions = grown;
+        parser->instruction_capacity = capacity;
     }
 
     parser->instructions[parser->instruction_count] = *inst;
@@ -76,34 +94,110 @@ static bool add_instruction(Parser *parser, ParsedInstruction *inst) {
     return true;
 }
 
-const OpcodeEntry* lookup_opcode(const char *name) {
-    for (int i = 0; opcode_table[i].name != NULL; i++) {
-        if (strcasecmp_local(opcode_table[i].name, name) == 0) {
-            return &opcode_table[i];
-        }
+static bool add_label(Parser *parser, Token *token) {
+    if (parser->label_count == parser->label_capacity) {
+        int capacity = parser->label_capacity ? parser->label_capacity * 2 : 64;
+        ParsedLabel *grown = (ParsedLabel*)realloc(parser->labels, capacity * sizeof(ParsedLabel));
+        if (!grown) return out_of_memory(parser);
+        parser->labels = grown;
+        parser->label_capacity = capacity;
+    }
+
+    ParsedLabel *label = &parser->labels[parser->label_count];
+    label->name = intern_name(&parser->names, token->text, token->length, &label->hash);
+    if (!label->name) return out_of_memory(parser);
+    label->instruction = parser->instruction_count;
+    label->line = token->line;
+    parser->label_count++;
+    return true;
+}
+
+/* EXPORT or IMPORT, then the label name */
+static bool add_linkage(Parser *parser, Token *keyword, bool import) {
+    int line = keyword->line;
+    const char *what = import ? "IMPORT" : "EXPORT";
+    if (!advance(parser)) return false;
+
+    Token *name = current(parser);
+    if (name->type != TOKEN_INSTRUCTION) {
+        snprintf(parser->error_msg, sizeof(parser->error_msg),
+                 "Line %d: %s requires a label name", line, what);
+        parser->has_error = true;
+        return false;
+    }
+
+    if (parser->linkage_count == parser->linkage_capacity) {
+        int capacity = parser->linkage_capacity ? parser->linkage_capacity * 2 : 16;
+        ParsedLinkage *grown = (ParsedLinkage*)realloc(parser->linkage,
+                                                       capacity * sizeof(ParsedLinkage));
+        if (!grown) return out_of_memory(parser);
+        parser->linkage = grown;
+        parser->linkage_capacity = capacity;
+    }
+
+    ParsedLinkage *decl = &parser->linkage[parser->linkage_count];
+    decl->name = intern_name(&parser->names, name->text, name->length, &decl->hash);
+    if (!decl->name) return out_of_memory(parser);
+    decl->line = line;
+    decl->import = import;
+    parser->linkage_count++;
+    return advance(parser);
+}
+
+/* Any case; NULL if name[0 .. length) is not a mnemonic */
+const OpcodeEntry* lookup_opcode(const char *name, size_t length) {
+    if (length < 2) return NULL;
+    int slot = MNEMONIC_SLOT((int)length, toupper((unsigned char)name[0]),
+                             toupper((unsigned char)name[length / 2]),
+                             toupper((unsigned char)name[length - 1]));
+    const OpcodeEntry *entry = &opcode_table[slot];
+    if (entry->name && name_equal_span(entry->name, name, length)) {
+        return entry;
     }
     return NULL;
 }
 
-void parser_init(Parser *parser, Token *tokens, int token_count) {
-    parser->tokens = tokens;
-    parser->token_count = token_count;
-    parser->pos = 0;
+void parser_init(Parser *parser, Lexer *lexer, Arena *arena) {
+    parser->lexer = lexer;
+    intern_init(&parser->names, arena);
+    parser->token.type = TOKEN_NEWLINE;  /* Nothing read yet */
+    parser->instructions = NULL;
     parser->instruction_count = 0;
+    parser->instruction_capacity = 0;
+    parser->labels = NULL;
+    parser->label_count = 0;
+    parser->label_capacity = 0;
+    parser->linkage = NULL;
+    parser->linkage_count = 0;
+    parser->linkage_capacity = 0;
     parser->has_error = false;
     parser->error_msg[0] = '\0';
 }
 
+void parser_free(Parser *parser) {
+    free(parser->instructions);
+    free(parser->labels);
+    free(parser->linkage);
+    intern_free(&parser->names);
+    parser->instructions = NULL;
+    parser->labels = NULL;
+    parser->linkage = NULL;
+}
+
+/* False on a parse error, or a lexer error (then lexer->has_error is set) */
 bool parser_parse(Parser *parser) {
+    if (!advance(parser)) return false;
+
     while (!is_at_end(parser)) {
-        skip_newlines(parser);
+        if (!skip_newlines(parser)) return false;
 
         if (is_at_end(parser)) break;
 
         Token *token = current(parser);
 
         if (token->type == TOKEN_LABEL_DEF) {
-            advance(parser);
+            if (!add_label(parser, token)) return false;
+            if (!advance(parser)) return false;
             continue;
         }
 
@@ -115,11 +209,18 @@ bool parser_parse(Parser *parser) {
             return false;
         }
 
-        const OpcodeEntry *entry = lookup_opcode(token->text);
+        const OpcodeEntry *entry = lookup_opcode(token->text, token->length);
+        if (!entry && (name_equal_span("EXPORT", token->text, token->length) ||
+                       name_equal_span("IMPORT", token->text, token->length))) {
+            if (!add_linkage(parser, token, toupper((unsigned char)token->text[0]) == 'I')) {
+                return false;
+            }
+            continue;
+        }
         if (!entry) {
             snprintf(parser->error_msg, sizeof(parser->error_msg),
-                     "Line %d: Unknown instruction '%s'",
-                     token->line, token->text);
+                     "Line %d: Unknown instruction '%.*s'",
+                     token->line, token->length, token->text);
             parser->has_error = true;
             return false;
         }
@@ -129,10 +230,11 @@ bool parser_parse(Parser *parser) {
         inst.has_operand = entry->has_operand;
         inst.operand = 0;
         inst.is_label_ref = false;
-        inst.label_name[0] = '\0';
+        inst.label_name = NULL;
+        inst.label_hash = 0;
         inst.line = token->line;
 
-        advance(parser);
+        if (!advance(parser)) return false;
 
         if (entry->has_operand) {
             if (is_at_end(parser)) {
@@ -151,8 +253,9 @@ bool parser_parse(Parser *parser) {
             }
             else if (operand->type == TOKEN_INSTRUCTION) {
                 inst.is_label_ref = true;
-                strncpy(inst.label_name, operand->text, MAX_LABEL_LENGTH - 1);
-                inst.label_name[MAX_LABEL_LENGTH - 1] = '\0';
+                inst.label_name = intern_name(&parser->names, operand->text,
+                                              operand->length, &inst.label_hash);
+                if (!inst.label_name) return out_of_memory(parser);
             }
             else if (operand->type == TOKEN_NEWLINE || operand->type == TOKEN_EOF) {
                 snprintf(parser->error_msg, sizeof(parser->error_msg),
@@ -169,7 +272,7 @@ bool parser_parse(Parser *parser) {
                 return false;
             }
 
-            advance(parser);
+            if (!advance(parser)) return false;
         }
 
         if (!add_instruction(parser, &inst)) {
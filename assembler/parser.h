@@ -5,8 +5,8 @@
 #include <stdint.h>
 #include "lexer.h"
 
-#define MAX_INSTRUCTIONS 1024
-#define MAX_LABEL_LENGTH 64
+#include "arena.h"
+#include "intern.h"
 
 typedef struct {
     const char *name;
@@ -17,27 +17,62 @@ typedef struct {
 typedef struct {
     uint8_t opcode;
     bool has_operand;
-    int32_t operand;
     bool is_label_ref;
-    char label_name[MAX_LABEL_LENGTH];
+    int32_t operand;
     int line;
+    uint32_t label_hash;      /* name_hash of label_name */
+    const char *label_name;   /* Interned; NULL unless is_label_ref */
 } ParsedInstruction;
 
+/* A label definition: it marks the instruction at index instruction */
+typedef struct {
+    const char *name;         /* Interned */
+    uint32_t hash;            /* name_hash of name */
+    int instruction;
+    int line;
+} ParsedLabel;
+
+/*
+ * "EXPORT name" or "IMPORT name": how a label links to other object
+ * modules (asm -c). Without -c, declarations are ignored.
+ */
 typedef struct {
-    Token *tokens;
-    int token_count;
-    int pos;
+    const char *name;         /* Interned */
+    uint32_t hash;            /* name_hash of name */
+    int line;
+    bool import;              /* IMPORT: defined by another module; otherwise EXPORT */
+} ParsedLinkage;
+
+/*
+ * Pulls tokens from the lexer one at a time and appends to growable
+ * instruction and label arrays. Label names are interned into the arena,
+ * which must outlive both arrays.
+ */
+typedef struct {
+    Lexer *lexer;
+    InternTable names;
+    Token token;              /* Current token */
 
-    ParsedInstruction instructions[MAX_INSTRUCTIONS];
+    ParsedInstruction *instructions;
     int instruction_count;
+    int instruction_capacity;
+
+    ParsedLabel *labels;
+    int label_count;
+    int label_capacity;
+
+    ParsedLinkage *linkage;
+    int linkage_count;
+    int linkage_capacity;
 
     char error_msg[256];
     bool has_error;
 } Parser;
 
-void parser_init(Parser *parser, Token *tokens, int token_count);
+void parser_init(Parser *parser, Lexer *lexer, Arena *arena);
 bool parser_parse(Parser *parser);
-const OpcodeEntry* lookup_opcode(const char *name);
+void parser_free(Parser *parser);
+const OpcodeEntry* lookup_opcode(const char *name, size_t length);
 void parser_print_instructions(Parser *parser);
 
 #endif
@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "profile.h"
+
+#define PROFILE_LINE_MAX 128
+
+void profile_init(ExecutionProfile *profile) {
+    profile->code_size = 0;
+    profile->code_hash = 0;
+    profile->executed = NULL;
+    profile->taken = NULL;
+    profile->has_error = false;
+    profile->error_msg[0] = '\0';
+}
+
+void profile_free(ExecutionProfile *profile) {
+    free(profile->executed);
+    free(profile->taken);
+    profile->executed = NULL;
+    profile->taken = NULL;
+}
+
+uint32_t profile_hash(uint32_t hash, const uint8_t *bytes, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static bool profile_error(ExecutionProfile *profile, const char *path, int line, const char *what) {
+    if (line > 0) {
+        snprintf(profile->error_msg, sizeof(profile->error_msg), "%s:%d: %s", path, line, what);
+    } else {
+        snprintf(profile->error_msg, sizeof(profile->error_msg), "%s: %s", path, what);
+    }
+    profile->has_error = true;
+    return false;
+}
+
+/*
+ * The format, from the VM's exec_profile.c:
+ *
+ *     exec-profile 1
+ *     code <size> <hash, hex>
+ *     totals <executed> <taken>
+ *     <offset> <executed> <taken>      for each instruction that ran
+ */
+bool profile_load(ExecutionProfile *profile, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        snprintf(profile->error_msg, sizeof(profile->error_msg),
+                 "Cannot open profile file '%s'", path);
+        profile->has_error = true;
+        return false;
+    }
+
+    char text[PROFILE_LINE_MAX];
+    int version = 0;
+    bool ok = true;
+
+    if (!fgets(text, sizeof(text), file) || sscanf(text, "exec-profile %d", &version) != 1) {
+        ok = profile_error(profile, path, 0, "not an execution profile");
+    } else if (version != 1) {
+        ok = profile_error(profile, path, 1, "unsupported profile version");
+    }
+
+    unsigned int hash = 0;
+    if (ok && (!fgets(text, sizeof(text), file) ||
+               sscanf(text, "code %d %x", &profile->code_size, &hash) != 2 ||
+               profile->code_size < 0)) {
+        ok = profile_error(profile, path, 2, "expected 'code <size> <hash>'");
+    }
+    profile->code_hash = (uint32_t)hash;
+
+    if (ok) {
+        size_t slots = profile->code_size > 0 ? (size_t)profile->code_size : 1;
+        profile->executed = (uint64_t*)calloc(slots, sizeof(uint64_t));
+        profile->taken = (uint64_t*)calloc(slots, sizeof(uint64_t));
+        if (!profile->executed || !profile->taken) {
+            ok = profile_error(profile, path, 0, "out of memory");
+        }
+    }
+
+    int line = 2;
+    while (ok && fgets(text, sizeof(text), file)) {
+        line++;
+        if (strncmp(text, "totals ", 7) == 0) continue;
+
+        int offset;
+        unsigned long long executed, taken;
+        if (sscanf(text, "%d %llu %llu", &offset, &executed, &taken) != 3) {
+            ok = profile_error(profile, path, line, "expected '<offset> <executed> <taken>'");
+        } else if (offset < 0 || offset >= profile->code_size) {
+            ok = profile_error(profile, path, line, "offset outside the code");
+        } else if (taken > executed) {
+            ok = profile_error(profile, path, line, "taken more often than executed");
+        } else {
+            profile->executed[offset] = executed;
+            profile->taken[offset] = taken;
+        }
+    }
+
+    fclose(file);
+    return ok;
+}
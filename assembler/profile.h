@@ -0,0 +1,31 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PROFILE_HASH_SEED 2166136261u
+
+/*
+ * An execution profile written by the VM's --exec-profile option: for
+ * each code offset, how often the instruction there ran and how often it
+ * sent control somewhere other than the next instruction. The code size
+ * and hash identify the bytecode the counts belong to.
+ */
+typedef struct {
+    int code_size;
+    uint32_t code_hash;       /* profile_hash of the code bytes */
+    uint64_t *executed;       /* Code offset -> count; code_size entries */
+    uint64_t *taken;
+
+    char error_msg[256];
+    bool has_error;
+} ExecutionProfile;
+
+void profile_init(ExecutionProfile *profile);
+void profile_free(ExecutionProfile *profile);
+bool profile_load(ExecutionProfile *profile, const char *path);
+uint32_t profile_hash(uint32_t hash, const uint8_t *bytes, size_t length);  /* FNV-1a, as the VM */
+
+#endif
@@ -0,0 +1,67 @@
+; adds step(i) for i = 10000 down to 1, where step is usually 1 but 7
+; for multiples of 100 and 50 for multiples of 1000; the common case of
+; each test is the branch taken, and a check on the sum never fires
+; result: 9900 * 1 + 90 * 7 + 10 * 50 = 11030
+
+PUSH 0
+STORE 1
+
+PUSH 10000
+STORE 0
+
+loop:
+LOAD 1
+PUSH 0
+CMP
+JNZ negative
+
+LOAD 0
+CALL step
+LOAD 1
+ADD
+STORE 1
+
+LOAD 0
+PUSH 1
+SUB
+DUP
+STORE 0
+JNZ loop
+
+LOAD 1
+HALT
+
+negative:
+PUSH -1
+HALT
+
+step:
+STORE 3
+LOAD 3
+PUSH 100
+DIV
+PUSH 100
+MUL
+LOAD 3
+SUB
+JNZ usual
+
+LOAD 3
+PUSH 1000
+DIV
+PUSH 1000
+MUL
+LOAD 3
+SUB
+JNZ hundreds
+
+PUSH 50
+RET
+
+hundreds:
+PUSH 7
+RET
+
+usual:
+PUSH 1
+RET
@@ -0,0 +1,67 @@
+#!/bin/bash
+# optimizer_report.sh - Report what `asm -O` removes from each benchmark and
+# test program, statically and in instructions executed, and check that the
+# optimized program computes the same result
+#
+# Usage: ./benchmarks/optimizer_report.sh [path_to_vm] [path_to_asm] [asm_flags]
+
+VM="${1:-./vm/vm}"
+ASM="${2:-./assembler/asm}"
+FLAGS="${3:--O}"
+PROGRAMS="benchmarks/*.asm tests/*.asm"
+
+if [ ! -f "$VM" ] || [ ! -f "$ASM" ]; then
+    echo "Error: VM or assembler not found (run 'make' first)"
+    echo "Usage: $0 [path_to_vm] [path_to_asm] [asm_flags]"
+    exit 1
+fi
+
+TMP_DIR=$(mktemp -d)
+trap 'rm -rf "$TMP_DIR"' EXIT
+
+echo "========================================="
+echo "  Optimizer Report (asm $FLAGS)"
+echo "========================================="
+echo ""
+printf "%-22s %14s %14s %20s  %s\n" "Program" "Instructions" "Bytes" "Executed" "Result"
+
+mismatches=0
+for source in $PROGRAMS; do
+    name=$(basename "$source" .asm)
+    plain="$TMP_DIR/$name.bc"
+    optimized="$TMP_DIR/$name.opt.bc"
+
+    "$ASM" "$source" -o "$plain" > /dev/null 2>&1 || continue
+    stats=$("$ASM" $FLAGS "$source" -o "$optimized" 2>&1 | grep "Optimized:")
+
+    # "Optimized:    24 -> 14 instructions, 84 -> 54 bytes (...)"
+    read -r before after bytes_before bytes_after <<< \
+        "$(echo "$stats" | sed -E 's/.* ([0-9]+) -> ([0-9]+) instructions, ([0-9]+) -> ([0-9]+) bytes.*/\1 \2 \3 \4/')"
+
+    plain_run=$("$VM" "$plain" 2>&1)
+    optimized_run=$("$VM" "$optimized" 2>&1)
+    expected=$(echo "$plain_run" | grep -E "^(Error|Result)")
+    actual=$(echo "$optimized_run" | grep -E "^(Error|Result)")
+    executed_before=$(echo "$plain_run" | grep -oE "Instructions Executed: [0-9]+" | grep -oE "[0-9]+$")
+    executed_after=$(echo "$optimized_run" | grep -oE "Instructions Executed: [0-9]+" | grep -oE "[0-9]+$")
+    if [ "$expected" == "$actual" ]; then
+        result="same ($(echo "$actual" | grep -oE '[0-9-]+$'))"
+    else
+        result="MISMATCH"
+        ((mismatches++))
+    fi
+
+    printf "%-22s %6s -> %-5s %6s -> %-5s %9s -> %-8s  %s\n" "$name" "$before" "$after" \
+        "$bytes_before" "$bytes_after" "$executed_before" "$executed_after" "$result"
+done
+
+echo ""
+echo "========================================="
+if [ $mismatches -gt 0 ]; then
+    echo "  $mismatches program(s) changed result"
+    echo "========================================="
+    exit 1
+fi
+echo "  All results unchanged"
+echo "========================================="
+exit 0
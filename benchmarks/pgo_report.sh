@@ -0,0 +1,76 @@
+#!/bin/bash
+# pgo_report.sh - Profile each benchmark and test program built with
+# `asm -O`, rebuild it with the profile (`asm -O --profile`), and report
+# how many control transfers (jumps, calls, returns and branches taken)
+# each build made; check that the laid-out program computes the same result
+#
+# Usage: ./benchmarks/pgo_report.sh [path_to_vm] [path_to_asm] [asm_flags]
+
+VM="${1:-./vm/vm}"
+ASM="${2:-./assembler/asm}"
+FLAGS="${3:--O}"
+PROGRAMS="benchmarks/*.asm tests/*.asm"
+
+if [ ! -f "$VM" ] || [ ! -f "$ASM" ]; then
+    echo "Error: VM or assembler not found (run 'make' first)"
+    echo "Usage: $0 [path_to_vm] [path_to_asm] [asm_flags]"
+    exit 1
+fi
+
+TMP_DIR=$(mktemp -d)
+trap 'rm -rf "$TMP_DIR"' EXIT
+
+echo "========================================="
+echo "  Profile-Guided Layout Report (asm $FLAGS --profile)"
+echo "========================================="
+echo ""
+printf "%-22s %20s %20s %8s %8s  %s\n" "Program" "Taken" "Executed" "Moved" "Flipped" "Result"
+
+mismatches=0
+for source in $PROGRAMS; do
+    name=$(basename "$source" .asm)
+    optimized="$TMP_DIR/$name.bc"
+    profile="$TMP_DIR/$name.profile"
+    laid_out="$TMP_DIR/$name.pgo.bc"
+
+    "$ASM" $FLAGS "$source" -o "$optimized" > /dev/null 2>&1 || continue
+    optimized_run=$("$VM" --exec-profile="$profile" "$optimized" 2>&1)
+    stats=$("$ASM" $FLAGS --profile="$profile" "$source" -o "$laid_out" 2>&1)
+    if [ $? -ne 0 ]; then
+        printf "%-22s %s\n" "$name" "FAILED: $(echo "$stats" | tail -1)"
+        ((mismatches++))
+        continue
+    fi
+    laid_out_run=$("$VM" --exec-profile="$profile.after" "$laid_out" 2>&1)
+
+    # "totals <executed> <taken>" is the third line of a profile
+    read -r _ executed_before taken_before <<< "$(sed -n 3p "$profile")"
+    read -r _ executed_after taken_after <<< "$(sed -n 3p "$profile.after")"
+
+    # "Layout:       6 blocks moved, 1 cold; 2 branches flipped"
+    read -r moved flipped <<< \
+        "$(echo "$stats" | grep "Layout:" | sed -E 's/.* ([0-9]+) blocks moved.* ([0-9]+) branches flipped.*/\1 \2/')"
+
+    expected=$(echo "$optimized_run" | grep -E "^(Error|Result)")
+    actual=$(echo "$laid_out_run" | grep -E "^(Error|Result)")
+    if [ "$expected" == "$actual" ]; then
+        result="same ($(echo "$actual" | grep -oE '[0-9-]+$'))"
+    else
+        result="MISMATCH"
+        ((mismatches++))
+    fi
+
+    printf "%-22s %8s -> %-8s %8s -> %-8s %8s %8s  %s\n" "$name" "$taken_before" "$taken_after" \
+        "$executed_before" "$executed_after" "$moved" "$flipped" "$result"
+done
+
+echo ""
+echo "========================================="
+if [ $mismatches -gt 0 ]; then
+    echo "  $mismatches program(s) changed result"
+    echo "========================================="
+    exit 1
+fi
+echo "  All results unchanged"
+echo "========================================="
+exit 0
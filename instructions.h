@@ -21,6 +21,20 @@
 #define OP_CALL  0x40
 #define OP_RET   0x41
 
+/* Heap objects: the array, byte string or map operand is on top of the object stack */
+#define OP_NEWARRAY 0x50
+#define OP_NEWBYTES 0x51
+#define OP_ALOAD    0x52
+#define OP_ASTORE   0x53
+#define OP_ALEN     0x54
+#define OP_BLOAD    0x55
+#define OP_BSTORE   0x56
+#define OP_DROP     0x57
+#define OP_NEWMAP   0x58
+#define OP_MAPGET   0x59
+#define OP_MAPSET   0x5A
+#define OP_MAPDEL   0x5B
+
 #define OP_HALT  0xFF
 
 #endif
@@ -74,8 +74,162 @@ else
 fi
 echo ""
 
+# Test 7: Generational mode
+echo "Running Test: Generational Mode..."
+./tests/gc_test_generational
+if [ $? -eq 0 ]; then
+    echo "✓ Generational Mode PASSED"
+else
+    echo "✗ Generational Mode FAILED"
+    exit 1
+fi
+echo ""
+
+# Test 8: Incremental mode
+echo "Running Test: Incremental Mode..."
+./tests/gc_test_incremental
+if [ $? -eq 0 ]; then
+    echo "✓ Incremental Mode PASSED"
+else
+    echo "✗ Incremental Mode FAILED"
+    exit 1
+fi
+echo ""
+
+# Test 9: Parallel marking
+echo "Running Test: Parallel Marking..."
+./tests/gc_test_parallel
+if [ $? -eq 0 ]; then
+    echo "✓ Parallel Marking PASSED"
+else
+    echo "✗ Parallel Marking FAILED"
+    exit 1
+fi
+echo ""
+
+# Test 10: Background sweep
+echo "Running Test: Background Sweep..."
+./tests/gc_test_background_sweep
+if [ $? -eq 0 ]; then
+    echo "✓ Background Sweep PASSED"
+else
+    echo "✗ Background Sweep FAILED"
+    exit 1
+fi
+echo ""
+
+# Test 11: Compaction
+echo "Running Test: Compaction..."
+./tests/gc_test_compact
+if [ $? -eq 0 ]; then
+    echo "✓ Compaction PASSED"
+else
+    echo "✗ Compaction FAILED"
+    exit 1
+fi
+echo ""
+
+# Test 12: Heap pacing
+echo "Running Test: Heap Pacing..."
+./tests/gc_test_pacing
+if [ $? -eq 0 ]; then
+    echo "✓ Heap Pacing PASSED"
+else
+    echo "✗ Heap Pacing FAILED"
+    exit 1
+fi
+echo ""
+
+# Test 13: Telemetry
+echo "Running Test: GC Telemetry..."
+./tests/gc_test_stats
+if [ $? -eq 0 ]; then
+    echo "✓ GC Telemetry PASSED"
+else
+    echo "✗ GC Telemetry FAILED"
+    exit 1
+fi
+echo ""
+
+# Test 14: Arrays and byte strings
+echo "Running Test: Arrays and Byte Strings..."
+./tests/gc_test_array
+if [ $? -eq 0 ]; then
+    echo "✓ Arrays and Byte Strings PASSED"
+else
+    echo "✗ Arrays and Byte Strings FAILED"
+    exit 1
+fi
+echo ""
+
+# Test 15: Maps
+echo "Running Test: Maps..."
+./tests/gc_test_map
+if [ $? -eq 0 ]; then
+    echo "✓ Maps PASSED"
+else
+    echo "✗ Maps FAILED"
+    exit 1
+fi
+echo ""
+
+# Test 16: Weak references and ephemerons
+echo "Running Test: Weak References..."
+./tests/gc_test_weak
+if [ $? -eq 0 ]; then
+    echo "✓ Weak References PASSED"
+else
+    echo "✗ Weak References FAILED"
+    exit 1
+fi
+echo ""
+
+# Test 17: Heap snapshots
+echo "Running Test: Heap Snapshots..."
+./tests/gc_test_snapshot
+if [ $? -eq 0 ]; then
+    echo "✓ Heap Snapshots PASSED"
+else
+    echo "✗ Heap Snapshots FAILED"
+    exit 1
+fi
+echo ""
+
+# Test 18: Allocation profiling
+echo "Running Test: Allocation Profiling..."
+./tests/gc_test_profile
+if [ $? -eq 0 ]; then
+    echo "✓ Allocation Profiling PASSED"
+else
+    echo "✗ Allocation Profiling FAILED"
+    exit 1
+fi
+echo ""
+
+# Test 19: Shared heaps
+echo "Running Test: Shared Heaps..."
+./tests/gc_test_shared_heap
+if [ $? -eq 0 ]; then
+    echo "✓ Shared Heaps PASSED"
+else
+    echo "✗ Shared Heaps FAILED"
+    exit 1
+fi
+echo ""
+
+# Test 20: Frozen segments
+echo "Running Test: Frozen Segments..."
+./tests/gc_test_frozen
+if [ $? -eq 0 ]; then
+    echo "✓ Frozen Segments PASSED"
+else
+    echo "✗ Frozen Segments FAILED"
+    exit 1
+fi
+echo ""
+
 echo "========================================="
-echo "  All GC Tests PASSED (6/6)"
+echo "  All GC Tests PASSED (20/20)"
 echo "========================================="
 echo ""
 echo "Spec Test Cases Covered:"
@@ -86,4 +240,18 @@ echo "  ✓ 1.6.4: Cyclic References"
 echo "  ✓ 1.6.5: Deep Object Graph"
 echo "  ✓ 1.6.6: Closure Capture"
 echo "  ✓ 1.6.7: Stress Allocation"
+echo "  ✓ Generational: Nursery, Promotion, Write Barrier"
+echo "  ✓ Incremental: Tri-Color Slices, Dijkstra Barrier, Pause Histogram"
+echo "  ✓ Parallel Mark: Work Stealing, Atomic Mark Bits"
+echo "  ✓ Background Sweep: Swept Chunks, Reuse, Concurrent Mutation"
+echo "  ✓ Compaction: Forwarding, Root Updates, Contiguous Layout"
+echo "  ✓ Heap Pacing: Byte Triggers, Survival Growth, Soft/Hard Limits"
+echo "  ✓ Telemetry: Stats Counters, Event Callback, JSON Dump"
+echo "  ✓ Arrays: Element Tracing, Size Classes, Large-Object Space"
+echo "  ✓ Maps: Identity Keys, Incremental Rehash, Key/Value Tracing"
+echo "  ✓ Weak References: Clearing, Ephemeron Fixpoint, All Collector Modes"
+echo "  ✓ Heap Snapshots: Records, Dominators, Retained Sizes, Retainer Paths"
+echo "  ✓ Allocation Profiling: Sites and Call Stacks, Byte Estimates, Survival"
+echo "  ✓ Shared Heaps: TLABs, Safepoints, Concurrent Mutators, Weak Handoff"
+echo "  ✓ Frozen Segments: Read-Only Pages, Shared Roots, Write Rejection"
 echo ""
@@ -14,11 +14,12 @@ if [ ! -f "$VM" ]; then
 fi
 
 # Benchmark list and expected results (compatible with bash 3.2)
-BENCHMARKS="bench_arithmetic bench_loops bench_functions bench_memory"
+BENCHMARKS="bench_arithmetic bench_loops bench_functions bench_memory bench_branches"
 EXPECTED_bench_arithmetic=1000
 EXPECTED_bench_loops=10000
 EXPECTED_bench_functions=2000
 EXPECTED_bench_memory=1
+EXPECTED_bench_branches=11030
 
 echo "========================================="
 echo "  Running Benchmarks"
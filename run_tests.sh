@@ -1,20 +1,21 @@
 #!/bin/bash
 # run_tests.sh - Run all test programs and verify results
 #
-# Usage: ./run_tests.sh [path_to_vm]
+# Usage: ./run_tests.sh [path_to_vm] [path_to_asm]
 
 VM="${1:-./vm/vm}"
+ASM="${2:-./assembler/asm}"
 TESTS_DIR="tests"
 
 # Check if VM exists
 if [ ! -f "$VM" ]; then
     echo "Error: VM not found at $VM"
-    echo "Usage: $0 [path_to_vm]"
+    echo "Usage: $0 [path_to_vm] [path_to_asm]"
     exit 1
 fi
 
 # Test list and expected results (compatible with bash 3.2)
-TESTS="test_arithmetic test_stack test_comparison test_jump test_conditional test_loop test_memory test_function test_nested_calls factorial fibonacci"
+TESTS="test_arithmetic test_stack test_comparison test_jump test_conditional test_loop test_memory test_function test_nested_calls factorial fibonacci test_array test_bytes test_map test_induction test_link"
 EXPECTED_test_arithmetic=42
 EXPECTED_test_stack=10
 EXPECTED_test_comparison=1
@@ -26,6 +27,11 @@ EXPECTED_test_function=20
 EXPECTED_test_nested_calls=40
 EXPECTED_factorial=120
 EXPECTED_fibonacci=55
+EXPECTED_test_array=285
+EXPECTED_test_bytes=48
+EXPECTED_test_map=3650
+EXPECTED_test_induction=265
+EXPECTED_test_link=208
 
 echo "========================================="
 echo "  Running Test Suite"
@@ -59,6 +65,18 @@ for test in $TESTS; do
     fi
 done
 
+# One file named two ways in one batch must be refused, not written twice
+if [ -f "$ASM" ]; then
+    output=$($ASM "$TESTS_DIR/test_loop.asm" "./$TESTS_DIR/test_loop.asm" 2>&1)
+    if [ $? -ne 0 ] && echo "$output" | grep -q "would both write"; then
+        echo "PASS: duplicate_output (refused)"
+        ((passed++))
+    else
+        echo "FAIL: duplicate_output (expected a 'would both write' error)"
+        ((failed++))
+    fi
+fi
+
 echo ""
 echo "========================================="
 echo "  Results: $passed passed, $failed failed"
@@ -0,0 +1,16 @@
+; Linked with link_math.asm into test_link.bc (see 'make tests')
+IMPORT square
+IMPORT sum_to
+
+PUSH 7
+CALL square     ; 49
+PUSH 10
+CALL sum_to     ; 55
+ADD
+CALL twice      ; 208
+HALT
+
+twice:
+DUP
+ADD
+RET
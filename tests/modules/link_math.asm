@@ -0,0 +1,36 @@
+; Functions for link_main.asm. Nothing calls cube, so bclink strips it.
+EXPORT square
+EXPORT cube
+EXPORT sum_to
+
+square:
+DUP
+MUL
+RET
+
+cube:
+DUP
+DUP
+MUL
+MUL
+RET
+
+sum_to:         ; n -> 1 + 2 + ... + n, in memory slots 0 and 1
+STORE 0
+PUSH 0
+STORE 1
+loop:
+LOAD 0
+JZ done
+LOAD 1
+LOAD 0
+ADD
+STORE 1
+LOAD 0
+PUSH 1
+SUB
+STORE 0
+JMP loop
+done:
+LOAD 1
+RET
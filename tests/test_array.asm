@@ -0,0 +1,49 @@
+; arr[i] = i * i for i = 0..9, then sum the elements
+; memory[0] = i, memory[1] = sum
+
+PUSH 10
+NEWARRAY
+
+PUSH 0
+STORE 0
+
+fill:
+LOAD 0        ; index
+LOAD 0
+LOAD 0
+MUL           ; value
+ASTORE
+
+LOAD 0
+PUSH 1
+ADD
+DUP
+STORE 0
+ALEN
+CMP           ; i < length
+JNZ fill
+
+PUSH 0
+STORE 1
+PUSH 0
+STORE 0
+
+sum:
+LOAD 0
+ALOAD
+LOAD 1
+ADD
+STORE 1
+
+LOAD 0
+PUSH 1
+ADD
+DUP
+STORE 0
+ALEN
+CMP
+JNZ sum
+
+DROP
+LOAD 1
+HALT
@@ -0,0 +1,16 @@
+; byte strings keep the low 8 bits of a store: 300 -> 44
+
+PUSH 4
+NEWBYTES
+
+PUSH 2        ; index
+PUSH 300
+BSTORE
+
+PUSH 2
+BLOAD
+ALEN
+ADD           ; 44 + length 4
+
+DROP
+HALT
@@ -0,0 +1,42 @@
+; Test: loop with an induction variable and an invariant expression
+; sum = (10*3 + 9*3 + ... + 1*3) + 10 * (2 * 5) = 165 + 100 = 265
+; Expected result: 265
+
+PUSH 2
+NEWARRAY
+ALEN
+STORE 3             ; base = 2, read back as an array length
+PUSH 5
+NEWARRAY
+ALEN
+STORE 4             ; scale = 5, likewise
+DROP
+DROP
+
+PUSH 0
+STORE 2             ; sum = 0
+PUSH 10
+STORE 0             ; i = 10
+
+loop:
+LOAD 2
+LOAD 0
+PUSH 3
+MUL                 ; i * 3
+ADD
+LOAD 3
+LOAD 4
+MUL                 ; base * scale
+ADD
+STORE 2             ; sum += i * 3 + base * scale
+
+LOAD 0
+PUSH 1
+SUB
+DUP
+STORE 0             ; i = i - 1
+JNZ loop
+
+LOAD 2
+HALT
+
@@ -0,0 +1,56 @@
+; map[i * 7] = i * i for i = 0..99, delete the first 50 keys,
+; then count + map[420] + map[70] = 50 + 3600 + 0
+; memory[0] = i
+
+NEWMAP
+
+PUSH 0
+STORE 0
+
+fill:
+LOAD 0        ; key
+PUSH 7
+MUL
+LOAD 0        ; value
+LOAD 0
+MUL
+MAPSET
+
+LOAD 0
+PUSH 1
+ADD
+DUP
+STORE 0
+PUSH 100
+CMP           ; i < 100
+JNZ fill
+
+PUSH 0
+STORE 0
+
+remove:
+LOAD 0
+PUSH 7
+MUL
+MAPDEL
+POP           ; 1 = removed
+
+LOAD 0
+PUSH 1
+ADD
+DUP
+STORE 0
+PUSH 50
+CMP
+JNZ remove
+
+ALEN          ; 50 entries left
+PUSH 420
+MAPGET        ; 60 * 60
+ADD
+PUSH 70
+MAPGET        ; deleted: 0
+ADD
+
+DROP
+HALT
@@ -96,6 +96,7 @@ VMError vm_load_bytecode_file(VM *vm, const char *filename) {
     vm->rsp = 0;
     vm->running = false;
     vm->error = VM_OK;
+    vm->instructions_executed = 0;
 
     memset(vm->memory, 0, MEMORY_SIZE * sizeof(int32_t));
 
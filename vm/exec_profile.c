@@ -0,0 +1,91 @@
+/*
+ * Execution profiler.
+ *
+ * While a profile is running, vm_run counts for every code offset how
+ * often an instruction started there and how often it sent control
+ * somewhere other than the next instruction (a JMP, CALL or RET every
+ * time, a JZ or JNZ when it branched). The basic-block and branch counts
+ * the assembler's profile-guided layout needs follow from these: a block
+ * ran as often as its first instruction, and a conditional branch fell
+ * through executed - taken times.
+ *
+ * The profile is a text file:
+ *
+ *     exec-profile 1
+ *     code <size> <fnv-1a hash of the code bytes, hex>
+ *     totals <instructions executed> <transfers taken>
+ *     <offset> <executed> <taken>      one line per instruction that ran
+ *
+ * The hash lets the assembler refuse a profile of a different program.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "vm.h"
+
+uint32_t vm_code_hash(const uint8_t *code, int size) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < size; i++) {
+        hash ^= code[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+bool vm_exec_profile_start(VM *vm) {
+    vm_exec_profile_stop(vm);
+
+    ExecProfile *profile = (ExecProfile*)calloc(1, sizeof(ExecProfile));
+    size_t slots = vm->code_size > 0 ? (size_t)vm->code_size : 1;
+    if (profile) {
+        profile->executed = (uint64_t*)calloc(slots, sizeof(uint64_t));
+        profile->taken = (uint64_t*)calloc(slots, sizeof(uint64_t));
+    }
+    if (!profile || !profile->executed || !profile->taken) {
+        if (profile) {
+            free(profile->executed);
+            free(profile->taken);
+            free(profile);
+        }
+        fprintf(stderr, "Error: Out of memory for the execution profiler\n");
+        return false;
+    }
+    profile->code_size = vm->code_size;
+    vm->exec_profile = profile;
+    return true;
+}
+
+void vm_exec_profile_stop(VM *vm) {
+    ExecProfile *profile = vm->exec_profile;
+    if (!profile) return;
+
+    free(profile->executed);
+    free(profile->taken);
+    free(profile);
+    vm->exec_profile = NULL;
+}
+
+bool vm_exec_profile_write(VM *vm, FILE *out) {
+    ExecProfile *profile = vm->exec_profile;
+    if (!profile || profile->code_size != vm->code_size) {
+        fprintf(stderr, "Error: No execution profile for this program\n");
+        return false;
+    }
+
+    uint64_t executed = 0;
+    uint64_t taken = 0;
+    for (int at = 0; at < profile->code_size; at++) {
+        executed += profile->executed[at];
+        taken += profile->taken[at];
+    }
+
+    fprintf(out, "exec-profile 1\n");
+    fprintf(out, "code %d %08x\n", vm->code_size, vm_code_hash(vm->code, vm->code_size));
+    fprintf(out, "totals %llu %llu\n", (unsigned long long)executed, (unsigned long long)taken);
+    for (int at = 0; at < profile->code_size; at++) {
+        if (profile->executed[at] == 0) continue;
+        fprintf(out, "%d %llu %llu\n", at, (unsigned long long)profile->executed[at],
+                (unsigned long long)profile->taken[at]);
+    }
+    return true;
+}
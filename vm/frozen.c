@@ -0,0 +1,226 @@
+/*
+ * Frozen segments: constant object graphs shared by every VM.
+ *
+ * gc_freeze copies everything reachable from a root into one block of
+ * pages and makes the pages read-only. The copies carry OBJ_FLAG_FROZEN
+ * and a mark bit that is never cleared, so every collector in every VM
+ * stops at them: markers see them as already marked, sweepers never find
+ * them (they are in no chunk or large-object list), and the compactor and
+ * nursery leave them where they are. Nothing in the segment can point back
+ * into a heap, so it needs no tracing of its own.
+ *
+ * A heap object may point into a segment; a frozen object must not be
+ * written. The field setters and the VM's store instructions check the
+ * flag, and the page protection catches anything that does not. Each
+ * frozen object is given its identity hash before the pages are sealed,
+ * so using it as a map key never writes its header.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "vm.h"  /* Includes gc.h automatically */
+
+/* Open-addressed set of the objects being frozen, with each one's copy */
+typedef struct {
+    Object *from;
+    Object *to;
+} FreezeEntry;
+
+typedef struct {
+    FreezeEntry *entries;
+    size_t capacity;     /* Power of two */
+    size_t count;
+    Object **order;      /* Objects in the order they are laid out */
+} FreezeTable;
+
+static size_t pointer_slot(FreezeTable *table, Object *obj) {
+    size_t mask = table->capacity - 1;
+    size_t i = ((uintptr_t)obj >> 3) * 0x9E3779B97F4A7C15ULL & mask;
+    while (table->entries[i].from && table->entries[i].from != obj) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static bool table_grow(FreezeTable *table) {
+    size_t capacity = table->capacity ? table->capacity * 2 : 256;
+    FreezeEntry *entries = calloc(capacity, sizeof(FreezeEntry));
+    Object **order = realloc(table->order, capacity / 2 * sizeof(Object*));
+    if (!entries || !order) {
+        free(entries);
+        if (order) table->order = order;
+        return false;
+    }
+
+    FreezeEntry *old = table->entries;
+    size_t old_capacity = table->capacity;
+    table->entries = entries;
+    table->capacity = capacity;
+    table->order = order;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i].from) table->entries[pointer_slot(table, old[i].from)] = old[i];
+    }
+    free(old);
+    return true;
+}
+
+/* Add obj if it is new; false if it cannot be frozen or memory ran out */
+static bool visit(FreezeTable *table, Object *obj) {
+    if (obj == NULL || (obj->flags & OBJ_FLAG_FROZEN)) return true;  /* Shared as is */
+
+    if (obj->type == OBJ_WEAK || (obj->type == OBJ_MAP && obj->map.weak_keys)) {
+        fprintf(stderr, "Error: Weak objects cannot be frozen\n");
+        return false;
+    }
+    if ((table->count + 1) * 2 > table->capacity && !table_grow(table)) {
+        fprintf(stderr, "Error: Out of memory freezing object graph\n");
+        return false;
+    }
+
+    size_t i = pointer_slot(table, obj);
+    if (table->entries[i].from) return true;
+    table->entries[i].from = obj;
+    table->order[table->count++] = obj;
+    return true;
+}
+
+static Object* copy_of(FreezeTable *table, Object *obj) {
+    if (obj == NULL || (obj->flags & OBJ_FLAG_FROZEN)) return obj;
+    return table->entries[pointer_slot(table, obj)].to;
+}
+
+/* Visit the objects a copied object points to, or point them at their copies */
+static bool each_field(FreezeTable *table, Object *obj, bool relink) {
+    Object **fields[2] = {NULL, NULL};
+    switch (obj->type) {
+        case OBJ_PAIR:
+            fields[0] = &obj->pair.left;
+            fields[1] = &obj->pair.right;
+            break;
+        case OBJ_CLOSURE:
+            fields[0] = &obj->closure.fn;
+            fields[1] = &obj->closure.env;
+            break;
+        case OBJ_MAP:
+            fields[0] = &obj->map.table;
+            fields[1] = &obj->map.old_table;
+            break;
+        case OBJ_ARRAY:
+            for (uint32_t i = 0; i < obj->array.length; i++) {
+                Value *item = &obj->array.items[i];
+                if (item->type != VAL_OBJ) continue;
+                if (relink) {
+                    item->obj_val = copy_of(table, item->obj_val);
+                } else if (!visit(table, item->obj_val)) {
+                    return false;
+                }
+            }
+            return true;
+        case OBJ_FUNCTION:
+        case OBJ_WEAK:
+        case OBJ_BYTES:
+            return true;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (relink) {
+            *fields[i] = copy_of(table, *fields[i]);
+        } else if (!visit(table, *fields[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void table_free(FreezeTable *table) {
+    free(table->entries);
+    free(table->order);
+}
+
+GCFrozenSegment* gc_freeze(VM *vm, Object *root) {
+    if (root == NULL) {
+        fprintf(stderr, "Error: Cannot freeze NULL\n");
+        return NULL;
+    }
+    if (root->flags & OBJ_FLAG_FROZEN) {
+        fprintf(stderr, "Error: Object is already frozen\n");
+        return NULL;
+    }
+
+    /* Chunks still waiting for the background sweeper may hold dead neighbours */
+    gc_finish_sweep(vm);
+
+    /* Breadth-first over the graph; order doubles as the queue */
+    FreezeTable table = {NULL, 0, 0, NULL};
+    bool ok = visit(&table, root);
+    size_t bytes = 0;
+    for (size_t i = 0; ok && i < table.count; i++) {
+        bytes += gc_object_size(table.order[i]);
+        ok = each_field(&table, table.order[i], false);
+    }
+    if (!ok) {
+        table_free(&table);
+        return NULL;
+    }
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t mapped = (bytes + page - 1) / page * page;
+    GCFrozenSegment *segment = malloc(sizeof(GCFrozenSegment));
+    void *memory = NULL;
+    if (!segment || posix_memalign(&memory, page, mapped) != 0) {
+        fprintf(stderr, "Error: Out of memory freezing object graph\n");
+        free(segment);
+        table_free(&table);
+        return NULL;
+    }
+    memset(memory, 0, mapped);
+
+    /* Lay the objects out in visit order, then point every copy at copies */
+    unsigned char *top = memory;
+    for (size_t i = 0; i < table.count; i++) {
+        Object *obj = table.order[i];
+        size_t size = gc_object_size(obj);
+        Object *copy = (Object*)top;
+        memcpy(copy, obj, size);
+        copy->marked = true;
+        copy->flags = OBJ_FLAG_FROZEN;
+        gc_identity_hash(vm, copy);
+        table.entries[pointer_slot(&table, obj)].to = copy;
+        top += size;
+    }
+    for (size_t i = 0; i < table.count; i++) {
+        each_field(&table, table.entries[pointer_slot(&table, table.order[i])].to, true);
+    }
+
+    segment->memory = memory;
+    segment->size = mapped;
+    segment->root = (Object*)memory;
+    segment->objects = (long)table.count;
+    segment->bytes = bytes;
+    table_free(&table);
+
+    if (mprotect(memory, mapped, PROT_READ) != 0) {
+        fprintf(stderr, "Error: Failed to seal frozen segment\n");
+        free(memory);
+        free(segment);
+        return NULL;
+    }
+    return segment;
+}
+
+/* Every VM that can reach the segment must have dropped its references */
+void gc_frozen_destroy(GCFrozenSegment *segment) {
+    if (segment == NULL) return;
+    mprotect(segment->memory, segment->size, PROT_READ | PROT_WRITE);
+    free(segment->memory);
+    free(segment);
+}
+
+bool gc_is_frozen(Object *obj) {
+    return obj != NULL && (obj->flags & OBJ_FLAG_FROZEN);
+}
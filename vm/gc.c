@@ -1,23 +1,607 @@
 /* Complete GC implementation with closure support */
+#define _POSIX_C_SOURCE 200809L  /* clock_gettime, pthreads */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <limits.h>
 #include "vm.h"  /* Includes gc.h automatically */
 
-Object* gc_alloc_object(VM *vm, ObjectType type) {
-    /* Trigger GC if threshold reached and auto_gc is enabled */
-    if (vm->auto_gc && vm->num_objects >= vm->max_objects) {
-        gc_collect(vm);
+/* Header type of a slot on a chunk's free list */
+#define FREE_SLOT 0xFF
+
+/* Bytes before a large object, keeping it 16-byte aligned */
+#define LARGE_HEADER ((sizeof(LargeObject) + 15) & ~(size_t)15)
+
+struct BackgroundSweep {
+    pthread_t thread;
+    bool done;                 /* Set (atomically) by the sweeper when finished */
+
+    /* Each chunk is owned by the sweeper until it is marked swept */
+    HeapChunk *chunks[GC_SIZE_CLASSES];
+    long freed;
+    size_t freed_bytes;
+    long large_freed;          /* Swept by the mutator before the thread started */
+    size_t large_freed_bytes;
+    size_t before_bytes;
+    GCCycleStats cycle;        /* Completed when the sweeper reports back */
+
+    /* Next chunk of each class for the mutator to take back */
+    HeapChunk *adopt[GC_SIZE_CLASSES];
+};
+
+/*
+ * `lock` protects everything here. The chunks handed out as TLABs are in
+ * the size classes, but only their VM allocates from them until the next
+ * collection takes them back.
+ */
+struct GCSharedHeap {
+    pthread_mutex_t lock;
+    pthread_cond_t parked_cond;    /* Signalled when a mutator parks or detaches */
+    pthread_cond_t resume_cond;    /* Broadcast when a collection is over */
+    int stopping;                  /* Collection waiting or running (atomic) */
+    int parked;                    /* Mutators waiting at a safepoint */
+
+    struct VM **vms;               /* Attached VMs */
+    int vm_count;
+    int vm_capacity;
+    bool tlabs;
+
+    SizeClass size_classes[GC_SIZE_CLASSES];
+    LargeObject *large_objects;
+    ObjectStack weak_objects;      /* Weak objects of VMs that have detached */
+
+    GCHeapPolicy policy;
+    long num_objects;              /* Published by the VMs, less what sweeps freed */
+    size_t bytes_allocated;
+    size_t next_gc_bytes;
+    GCSharedHeapStats stats;
+};
+
+static void object_stack_push(ObjectStack *stack, Object *obj) {
+    if (stack->count >= stack->capacity) {
+        int capacity = stack->capacity < 64 ? 64 : stack->capacity * 2;
+        Object **items = (Object**)realloc(stack->items, capacity * sizeof(Object*));
+        if (!items) {
+            fprintf(stderr, "Error: Out of memory in GC work list\n");
+            exit(1);
+        }
+        stack->items = items;
+        stack->capacity = capacity;
+    }
+    stack->items[stack->count++] = obj;
+}
+
+static void object_stack_free(ObjectStack *stack) {
+    free(stack->items);
+    stack->items = NULL;
+    stack->count = 0;
+    stack->capacity = 0;
+}
+
+static double gc_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void record_pause(VM *vm, double us) {
+    GCPauseHistogram *h = &vm->gc_stats.pauses;
+    int bucket = 0;
+    double bound = 1.0;
+
+    while (us >= bound && bucket < GC_PAUSE_BUCKETS - 1) {
+        bucket++;
+        bound *= 2.0;
+    }
+
+    h->buckets[bucket]++;
+    h->count++;
+    h->total_us += us;
+    if (us > h->max_us) h->max_us = us;
+}
+
+static size_t array_size(size_t length) {
+    return offsetof(Object, array.items) + length * sizeof(Value);
+}
+
+/* Byte strings are padded so every object stays 8-byte aligned */
+static size_t bytes_size(size_t length) {
+    return (offsetof(Object, bytes.data) + length + 7) & ~(size_t)7;
+}
+
+/* Header plus the union member the type uses (empty for arrays and byte strings) */
+size_t gc_type_size(ObjectType type) {
+    switch (type) {
+        case OBJ_PAIR:     return offsetof(Object, pair) + sizeof(((Object*)0)->pair);
+        case OBJ_FUNCTION: return offsetof(Object, function) + sizeof(((Object*)0)->function);
+        case OBJ_CLOSURE:  return offsetof(Object, closure) + sizeof(((Object*)0)->closure);
+        case OBJ_MAP:      return offsetof(Object, map) + sizeof(((Object*)0)->map);
+        case OBJ_WEAK:     return offsetof(Object, weak) + sizeof(((Object*)0)->weak);
+        case OBJ_ARRAY:    return array_size(0);
+        case OBJ_BYTES:    return bytes_size(0);
+    }
+    return sizeof(Object);
+}
+
+size_t gc_object_size(Object *obj) {
+    switch (obj->type) {
+        case OBJ_ARRAY: return array_size(obj->array.length);
+        case OBJ_BYTES: return bytes_size(obj->bytes.length);
+        default:        return gc_type_size((ObjectType)obj->type);
+    }
+}
+
+/* Large objects live outside the chunks; only arrays and byte strings get that big */
+bool gc_is_large(Object *obj) {
+    return gc_object_size(obj) > GC_LARGE_OBJECT_BYTES;
+}
+
+/*
+ * Fixed-size types have a class each. Arrays and byte strings share
+ * power-of-two classes from 16 to GC_LARGE_OBJECT_BYTES bytes.
+ */
+static int size_class_of(ObjectType type, size_t size) {
+    if (type < GC_FIXED_CLASSES) return type;
+
+    int size_class = GC_FIXED_CLASSES;
+    size_t slot = 16;
+    while (slot < size) {
+        slot *= 2;
+        size_class++;
+    }
+    return size_class;
+}
+
+/*
+ * Byte pacing: the next collection triggers once the heap has grown by
+ * growth_factor over the bytes that survived. When most of the heap
+ * survives, a collection frees little, so the factor is raised (up to
+ * 1.5x) to collect less often. min_heap is a floor, so small heaps do not
+ * thrash. The soft limit caps the trigger, keeping some headroom above
+ * the live bytes so a heap over the limit does not collect on every
+ * allocation.
+ */
+static size_t policy_trigger(const GCHeapPolicy *policy, size_t live, size_t before,
+                             double *survival_out) {
+    double survival = before > 0 ? (double)live / before : 0.0;
+    double growth = policy->growth_factor;
+
+    if (survival > 0.5) {
+        growth *= 1.0 + (survival - 0.5);
+    }
+    *survival_out = survival;
+
+    size_t headroom = live / 8 > GC_MIN_HEADROOM ? live / 8 : GC_MIN_HEADROOM;
+    size_t trigger = (size_t)(live * growth);
+
+    if (trigger < policy->min_heap) trigger = policy->min_heap;
+    if (policy->soft_limit > 0 && trigger > policy->soft_limit) {
+        trigger = policy->soft_limit;
+    }
+    if (policy->max_heap > 0 && trigger > policy->max_heap) {
+        trigger = policy->max_heap;
+    }
+    if (trigger < live + headroom) trigger = live + headroom;
+    return trigger;
+}
+
+static size_t next_trigger(VM *vm, size_t live, size_t before) {
+    return policy_trigger(&vm->heap_policy, live, before, &vm->last_survival);
+}
+
+/* Trigger before the first collection: the target size, within the limits */
+static size_t first_trigger(const GCHeapPolicy *policy) {
+    size_t trigger = policy->target_heap > policy->min_heap ? policy->target_heap : policy->min_heap;
+    if (policy->soft_limit > 0 && trigger > policy->soft_limit) trigger = policy->soft_limit;
+    return trigger;
+}
+
+/* Recompute both triggers after a collection that started at before_bytes */
+static void update_threshold(VM *vm, size_t before_bytes) {
+    vm->max_objects = vm->num_objects * 2;
+    if (vm->max_objects < 8) {
+        vm->max_objects = 8;
+    }
+    vm->next_gc_bytes = next_trigger(vm, vm->bytes_allocated, before_bytes);
+}
+
+/*
+ * Chunked heap
+ *
+ * Old objects live in chunks of GC_CHUNK_BYTES, one list of chunks per size
+ * class. A chunk hands out slots from its free list first, then by bumping
+ * `used`. Sweeping walks the slots of each chunk, so objects need no list
+ * link; a chunk left with no live objects is freed.
+ */
+
+static Object* chunk_slot(HeapChunk *chunk, int index) {
+    return (Object*)(chunk->slots + (size_t)index * chunk->slot_size);
+}
+
+static int slot_index(HeapChunk *chunk, Object *obj) {
+    return (int)(((unsigned char*)obj - chunk->slots) / chunk->slot_size);
+}
+
+/* Append a chunk to its class; it becomes the allocation chunk if all others are full */
+static void link_chunk(SizeClass *sc, HeapChunk *chunk) {
+    chunk->next = NULL;
+    if (sc->tail) {
+        sc->tail->next = chunk;
+    } else {
+        sc->chunks = chunk;
+    }
+    sc->tail = chunk;
+    if (!sc->alloc) sc->alloc = chunk;
+    sc->chunk_count++;
+}
+
+static HeapChunk* new_chunk(SizeClass *sc) {
+    size_t header = (sizeof(HeapChunk) + 15) & ~(size_t)15;
+    HeapChunk *chunk = (HeapChunk*)malloc(header + GC_CHUNK_BYTES);
+    if (!chunk) return NULL;
+
+    chunk->slots = (unsigned char*)chunk + header;
+    chunk->slot_size = sc->slot_size;
+    chunk->capacity = GC_CHUNK_BYTES / sc->slot_size;
+    chunk->used = 0;
+    chunk->live = 0;
+    chunk->free_list = NULL;
+    chunk->swept = 1;  /* Nothing for a sweep in progress to do here */
+    link_chunk(sc, chunk);
+    return chunk;
+}
+
+/* Unlink and free the chunk at *link; the link then points at its successor */
+static void release_chunk(SizeClass *sc, HeapChunk **link) {
+    HeapChunk *chunk = *link;
+
+    *link = chunk->next;
+    if (sc->tail == chunk) {
+        sc->tail = link == &sc->chunks
+                 ? NULL
+                 : (HeapChunk*)((unsigned char*)link - offsetof(HeapChunk, next));
+    }
+    if (sc->alloc == chunk) sc->alloc = chunk->next;
+    sc->chunk_count--;
+    free(chunk);
+}
+
+static void free_chunks(SizeClass *sc) {
+    while (sc->chunks) {
+        release_chunk(sc, &sc->chunks);
+    }
+}
+
+static Object* chunk_take(HeapChunk *chunk) {
+    Object *obj = chunk->free_list;
+    if (obj) {
+        chunk->free_list = obj->forward;
+    } else if (chunk->used < chunk->capacity) {
+        obj = chunk_slot(chunk, chunk->used++);
+    } else {
+        return NULL;
+    }
+    chunk->live++;
+    return obj;
+}
+
+/* Put a dead object's slot on its chunk's free list */
+static void free_slot(HeapChunk *chunk, Object *obj) {
+    obj->type = FREE_SLOT;
+    obj->forward = chunk->free_list;
+    chunk->free_list = obj;
+    chunk->live--;
+}
+
+/* Sweep one slot: free it if unmarked, otherwise clear the mark */
+static void sweep_slot(HeapChunk *chunk, Object *obj, long *freed, size_t *freed_bytes) {
+    if (obj->type == FREE_SLOT) return;
+    if (obj->marked) {
+        obj->marked = false;
+        return;
+    }
+    *freed_bytes += gc_object_size(obj);
+    (*freed)++;
+    free_slot(chunk, obj);
+}
+
+/*
+ * Sweep every slot of a chunk. Only the chunk itself is touched, so the
+ * background sweeper can run this while the mutator allocates elsewhere.
+ */
+static void sweep_chunk(HeapChunk *chunk, long *freed, size_t *freed_bytes) {
+    for (int i = 0; i < chunk->used; i++) {
+        sweep_slot(chunk, chunk_slot(chunk, i), freed, freed_bytes);
+    }
+}
+
+/* Sweep every chunk of every class, freeing chunks left empty */
+static void sweep_classes(SizeClass *classes, long *freed, size_t *freed_bytes) {
+    for (int i = 0; i < GC_SIZE_CLASSES; i++) {
+        SizeClass *sc = &classes[i];
+        HeapChunk **link = &sc->chunks;
+
+        while (*link) {
+            sweep_chunk(*link, freed, freed_bytes);
+            if ((*link)->live == 0) {
+                release_chunk(sc, link);
+            } else {
+                link = &(*link)->next;
+            }
+        }
+        sc->alloc = sc->chunks;
+    }
+}
+
+/* Remove objects found dead by a sweep from the heap totals */
+static void account_freed(VM *vm, long objects, size_t bytes) {
+    vm->num_objects -= objects;
+    vm->bytes_allocated -= bytes;
+    vm->gc_stats.objects_freed += objects;
+    vm->gc_stats.bytes_freed += bytes;
+}
+
+/*
+ * Large-object space
+ *
+ * Objects over GC_LARGE_OBJECT_BYTES get a malloc block of their own, on
+ * one list. They are allocated directly in the old generation and never
+ * copied: promotion and compaction leave them in place. Byte strings hold
+ * no pointers and are never scanned.
+ */
+
+static Object* large_object(LargeObject *large) {
+    return (Object*)((unsigned char*)large + LARGE_HEADER);
+}
+
+static Object* alloc_large_object(LargeObject **list, size_t size) {
+    LargeObject *large = (LargeObject*)malloc(LARGE_HEADER + size);
+    if (!large) return NULL;
+
+    large->size = size;
+    large->next = *list;
+    *list = large;
+    return large_object(large);
+}
+
+/* Free unmarked large objects; survivors' marks are cleared unless keep_marks */
+static void sweep_large(LargeObject **list, bool keep_marks, long *freed, size_t *freed_bytes) {
+    LargeObject **link = list;
+
+    while (*link) {
+        LargeObject *large = *link;
+        Object *obj = large_object(large);
+        if (obj->marked) {
+            if (!keep_marks) obj->marked = false;
+            link = &large->next;
+        } else {
+            *link = large->next;
+            *freed_bytes += large->size;
+            (*freed)++;
+            free(large);
+        }
+    }
+}
+
+static const char* event_name(GCEventKind kind) {
+    switch (kind) {
+        case GC_EVENT_FULL:        return "full";
+        case GC_EVENT_MINOR:       return "minor";
+        case GC_EVENT_INCREMENTAL: return "incremental";
+        default:                   return "unknown";
+    }
+}
+
+/* Fold a finished cycle into the totals, then log and report it */
+static void finish_cycle(VM *vm, GCCycleStats *cycle) {
+    GCStats *stats = &vm->gc_stats;
+
+    cycle->objects_surviving = vm->num_objects;
+    cycle->bytes_surviving = vm->bytes_allocated;
+
+    switch (cycle->kind) {
+        case GC_EVENT_FULL:        stats->collections++; break;
+        case GC_EVENT_MINOR:       stats->minor_collections++; break;
+        case GC_EVENT_INCREMENTAL: stats->incremental_cycles++; break;
+    }
+    stats->objects_surviving = cycle->objects_surviving;
+    stats->bytes_surviving = cycle->bytes_surviving;
+    stats->roots_us += cycle->roots_us;
+    stats->mark_us += cycle->mark_us;
+    stats->sweep_us += cycle->sweep_us;
+    stats->last = *cycle;
+
+    if (vm->gc_verbose) {
+        fprintf(stderr, "[GC] %s: %ld objects freed, %ld surviving, %.1f us\n",
+                event_name(cycle->kind), cycle->objects_freed,
+                cycle->objects_surviving, cycle->pause_us);
+    }
+    if (vm->gc_callback) {
+        vm->gc_callback(vm, cycle, vm->gc_callback_data);
+    }
+}
+
+static void minor_collect(VM *vm);
+static void full_collect(VM *vm, bool compact);
+static void shade_roots(VM *vm);
+static void blacken(VM *vm, Object *obj);
+static void mark_weak_tables(Object *map);
+static void after_mark(VM *vm);
+static void drain_gray(VM *vm);
+static void incremental_slice(VM *vm, double budget_us);
+static bool sweep_adopt(VM *vm, int size_class);
+static void sweep_poll(VM *vm);
+static Object* alloc_shared_object(VM *vm, ObjectType type, size_t size);
+static void shared_collect(VM *vm);
+
+/* Threshold check; deferred while a background sweep has not reported back */
+static bool collection_due(VM *vm) {
+    if (!vm->auto_gc) return false;
+    if (vm->sweep != NULL) return false;
+    if (vm->heap_policy.pacing == GC_PACING_OBJECTS) {
+        return vm->num_objects >= vm->max_objects;
+    }
+    return vm->bytes_allocated >= vm->next_gc_bytes;
+}
+
+bool gc_in_nursery(VM *vm, Object *obj) {
+    unsigned char *addr = (unsigned char*)obj;
+    return vm->nursery != NULL &&
+           addr >= vm->nursery &&
+           addr < vm->nursery + vm->nursery_capacity;
+}
+
+/* Take a slot from the first chunk of the class with room, adding a chunk if none has */
+static Object* alloc_old_object(VM *vm, int size_class) {
+    SizeClass *sc = &vm->size_classes[size_class];
+
+    for (;;) {
+        while (sc->alloc) {
+            Object *obj = chunk_take(sc->alloc);
+            if (obj) return obj;
+            sc->alloc = sc->alloc->next;
+        }
+
+        /* Every chunk is full: take back chunks the sweeper is done with */
+        if (!vm->sweep || !sweep_adopt(vm, size_class)) break;
+    }
+
+    HeapChunk *chunk = new_chunk(sc);
+    if (!chunk) {
+        return NULL;
+    }
+    return chunk_take(chunk);
+}
+
+/* Allocate in the old generation: a chunk slot, or the large-object space */
+static Object* alloc_tenured(VM *vm, ObjectType type, size_t size) {
+    if (size > GC_LARGE_OBJECT_BYTES) {
+        return alloc_large_object(&vm->large_objects, size);
+    }
+    return alloc_old_object(vm, size_class_of(type, size));
+}
+
+static Object* alloc_nursery_object(VM *vm, ObjectType type, size_t size) {
+    /* Never fits, even in an empty nursery */
+    if (size > vm->nursery_capacity) {
+        return alloc_tenured(vm, type, size);
+    }
+
+    if (!vm->nursery) {
+        vm->nursery = (unsigned char*)malloc(vm->nursery_capacity);
+        if (!vm->nursery) {
+            return NULL;
+        }
+        vm->nursery_top = 0;
+        vm->nursery_objects = 0;
+    }
+
+    if (vm->nursery_top + size > vm->nursery_capacity) {
+        if (!vm->auto_gc) {
+            /* Collections are off: tenure directly instead of evacuating */
+            return alloc_tenured(vm, type, size);
+        }
+
+        double start = gc_now_us();
+        minor_collect(vm);
+
+        /* Major collections run on their own threshold over the old generation */
+        if (collection_due(vm)) {
+            full_collect(vm, false);
+        }
+        record_pause(vm, gc_now_us() - start);
+    }
+
+    Object *obj = (Object*)(vm->nursery + vm->nursery_top);
+    vm->nursery_top += size;
+    vm->nursery_objects++;
+    return obj;
+}
+
+/* Whether the incremental sweep has yet to reach this slot */
+static bool sweep_pending(VM *vm, HeapChunk *chunk, Object *obj) {
+    if (chunk->swept) return false;
+    if (vm->sweep_link && *vm->sweep_link == chunk) {
+        return slot_index(chunk, obj) >= vm->sweep_slot;
+    }
+    return true;
+}
+
+static Object* alloc_incremental_object(VM *vm, ObjectType type, size_t size) {
+    if (vm->gc_phase == GC_PHASE_IDLE) {
+        if (collection_due(vm)) {
+            gc_incremental_step(vm);
+        }
+    } else if (++vm->alloc_since_step >= GC_INCREMENTAL_STEP) {
+        gc_incremental_step(vm);
+    }
+
+    Object *obj = alloc_tenured(vm, type, size);
+    if (!obj) return NULL;
+
+    if (vm->gc_phase == GC_PHASE_MARK) {
+        /* Allocate black: new objects survive the cycle in progress */
+        obj->marked = true;
+    } else if (vm->gc_phase == GC_PHASE_SWEEP && size <= GC_LARGE_OBJECT_BYTES) {
+        /* Keep the sweeper off (white) objects in slots it has not reached */
+        obj->marked = sweep_pending(vm, vm->size_classes[size_class_of(type, size)].alloc, obj);
+    } else {
+        /* Large objects were swept when the sweep phase began */
+        obj->marked = false;
+    }
+    return obj;
+}
+
+/* Allocate size bytes for an object of the given type, collecting first if due */
+static Object* alloc_object(VM *vm, ObjectType type, size_t size) {
+    Object *obj;
+
+    if (vm->sweep != NULL) {
+        sweep_poll(vm);
+    }
+
+    /* Hard heap limit: collect once, then refuse the allocation */
+    size_t max_heap = vm->heap_policy.max_heap;
+    if (max_heap > 0 && vm->bytes_allocated + size > max_heap) {
+        if (vm->auto_gc) {
+            gc_collect(vm);
+            gc_finish_sweep(vm);
+        }
+        if (vm->bytes_allocated + size > max_heap) {
+            fprintf(stderr, "Error: Heap limit of %zu bytes exceeded\n", max_heap);
+            return NULL;
+        }
+    }
+
+    if (vm->shared_heap) {
+        obj = alloc_shared_object(vm, type, size);
+    } else if (vm->gc_mode == GC_MODE_GENERATIONAL && size <= GC_LARGE_OBJECT_BYTES) {
+        obj = alloc_nursery_object(vm, type, size);
+    } else if (vm->gc_mode == GC_MODE_INCREMENTAL) {
+        obj = alloc_incremental_object(vm, type, size);
+    } else {
+        /* Trigger GC if threshold reached and auto_gc is enabled */
+        if (collection_due(vm)) {
+            gc_collect(vm);
+        }
+        obj = alloc_tenured(vm, type, size);
     }
 
-    Object *obj = (Object*)malloc(sizeof(Object));
     if (!obj) {
         fprintf(stderr, "Error: Failed to allocate object\n");
         return NULL;
     }
 
-    obj->marked = false;
-    obj->type = type;
+    if (vm->gc_mode != GC_MODE_INCREMENTAL) {
+        obj->marked = false;
+    }
+    obj->flags = 0;
+    obj->hash = 0;
+    obj->type = (uint8_t)type;
 
     switch (type) {
         case OBJ_PAIR:
@@ -31,39 +615,199 @@ Object* gc_alloc_object(VM *vm, ObjectType type) {
             obj->closure.fn = NULL;
             obj->closure.env = NULL;
             break;
+        case OBJ_MAP:
+            obj->map.table = NULL;
+            obj->map.old_table = NULL;
+            obj->map.count = 0;
+            obj->map.tombstones = 0;
+            obj->map.migrated = 0;
+            obj->map.weak_keys = false;
+            break;
+        case OBJ_WEAK:
+            obj->weak.target = NULL;
+            break;
+        case OBJ_ARRAY:
+            obj->array.length = 0;
+            break;
+        case OBJ_BYTES:
+            obj->bytes.length = 0;
+            break;
     }
 
-    obj->next = vm->first_object;
-    vm->first_object = obj;
     vm->num_objects++;
+    vm->bytes_allocated += size;
+    vm->gc_stats.objects_allocated++;
+    vm->gc_stats.bytes_allocated += size;
+    if (vm->bytes_allocated > vm->peak_bytes) {
+        vm->peak_bytes = vm->bytes_allocated;
+    }
+
+    /* The only cost of profiling on allocations that are not sampled */
+    if ((vm->sample_countdown -= (long)size) <= 0) {
+        gc_profile_sample(vm, obj, size);
+    }
 
     return obj;
 }
 
+Object* gc_alloc_object(VM *vm, ObjectType type) {
+    return alloc_object(vm, type, gc_type_size(type));
+}
+
+static void init_size_classes(SizeClass *classes) {
+    memset(classes, 0, GC_SIZE_CLASSES * sizeof(SizeClass));
+    for (int i = 0; i < GC_FIXED_CLASSES; i++) {
+        classes[i].slot_size = (int)gc_type_size((ObjectType)i);
+    }
+    for (int i = 0; i < GC_VARIABLE_CLASSES; i++) {
+        classes[GC_FIXED_CLASSES + i].slot_size = 16 << i;
+    }
+}
+
 void gc_init(VM *vm) {
-    vm->first_object = NULL;
+    init_size_classes(vm->size_classes);
+    vm->large_objects = NULL;
     vm->num_objects = 0;
     vm->max_objects = 8;
     vm->stack_count = 0;
     vm->auto_gc = true;  /* Enable automatic GC by default */
+    vm->identity_hashes = 0;
+
+    vm->gc_mode = GC_MODE_MARK_SWEEP;
+    vm->nursery = NULL;
+    vm->nursery_top = 0;
+    vm->nursery_capacity = GC_NURSERY_SIZE * gc_type_size(OBJ_PAIR);
+    vm->nursery_objects = 0;
+    memset(&vm->weak_objects, 0, sizeof(ObjectStack));
+    memset(&vm->remembered_set, 0, sizeof(ObjectStack));
+
+    vm->gc_phase = GC_PHASE_IDLE;
+    memset(&vm->gray_stack, 0, sizeof(ObjectStack));
+    vm->sweep_class = 0;
+    vm->sweep_link = NULL;
+    vm->sweep_slot = 0;
+    vm->alloc_since_step = 0;
+    vm->pause_target_us = GC_DEFAULT_PAUSE_TARGET_US;
+    vm->slice_work = 0;
+
+    vm->mark_threads = 1;
+
+    vm->background_sweep = false;
+    vm->sweep = NULL;
+
+    vm->shared_heap = NULL;
+    memset(vm->tlab, 0, sizeof(vm->tlab));
+
+    vm->compact_interval = 0;
+    vm->collections_since_compact = 0;
+
+    gc_default_heap_policy(&vm->heap_policy);
+    vm->bytes_allocated = 0;
+    vm->peak_bytes = 0;
+    vm->next_gc_bytes = vm->heap_policy.target_heap;
+    vm->cycle_start_bytes = 0;
+    vm->last_survival = 0.0;
+
+    memset(&vm->gc_stats, 0, sizeof(GCStats));
+    memset(&vm->cycle, 0, sizeof(GCCycleStats));
+    vm->gc_callback = NULL;
+    vm->gc_callback_data = NULL;
+    vm->gc_verbose = false;
+    vm->profile = NULL;
+    vm->sample_countdown = LONG_MAX;
 }
 
 void gc_cleanup(VM *vm) {
-    Object *obj = vm->first_object;
-    while (obj) {
-        Object *next = obj->next;
-        free(obj);
-        obj = next;
+    gc_shared_heap_detach(vm);
+    gc_finish_sweep(vm);
+
+    for (int i = 0; i < GC_SIZE_CLASSES; i++) {
+        free_chunks(&vm->size_classes[i]);
+    }
+    while (vm->large_objects) {
+        LargeObject *next = vm->large_objects->next;
+        free(vm->large_objects);
+        vm->large_objects = next;
     }
-    vm->first_object = NULL;
     vm->num_objects = 0;
+    vm->bytes_allocated = 0;
+
+    free(vm->nursery);
+    vm->nursery = NULL;
+    vm->nursery_top = 0;
+    vm->nursery_objects = 0;
+    object_stack_free(&vm->weak_objects);
+    object_stack_free(&vm->remembered_set);
+
+    vm->gc_phase = GC_PHASE_IDLE;
+    object_stack_free(&vm->gray_stack);
+    vm->sweep_link = NULL;
+    gc_profile_stop(vm);
+}
+
+/*
+ * Walk every object in the old generation, size class by size class, then
+ * the large-object space. Nursery objects are not included. A background
+ * sweep is finished first.
+ */
+Object* gc_heap_first(VM *vm, HeapIterator *it) {
+    gc_finish_sweep(vm);
+
+    it->vm = vm;
+    it->size_class = 0;
+    it->chunk = vm->size_classes[0].chunks;
+    it->slot = 0;
+    it->large = vm->large_objects;
+    return gc_heap_next(it);
+}
+
+Object* gc_heap_next(HeapIterator *it) {
+    while (it->size_class < GC_SIZE_CLASSES) {
+        while (it->chunk) {
+            while (it->slot < it->chunk->used) {
+                Object *obj = chunk_slot(it->chunk, it->slot++);
+                if (obj->type != FREE_SLOT) return obj;
+            }
+            it->chunk = it->chunk->next;
+            it->slot = 0;
+        }
+        if (++it->size_class < GC_SIZE_CLASSES) {
+            it->chunk = it->vm->size_classes[it->size_class].chunks;
+        }
+    }
+
+    if (!it->large) return NULL;
+    Object *obj = large_object(it->large);
+    it->large = it->large->next;
+    return obj;
+}
+
+/*
+ * Allocation may collect, and in generational mode a collection moves
+ * nursery objects. The field values are parked on the value stack across
+ * the allocation so they stay alive and are read back at their new address.
+ */
+static Object* alloc_with_fields(VM *vm, ObjectType type, Object **a, Object **b) {
+    if (vm->stack_count + 2 > VM_STACK_MAX) {
+        fprintf(stderr, "Error: Stack overflow\n");
+        return NULL;
+    }
+
+    vm->value_stack[vm->stack_count++] = VAL_OBJ(*a);
+    vm->value_stack[vm->stack_count++] = VAL_OBJ(*b);
+
+    Object *obj = gc_alloc_object(vm, type);
+
+    *b = vm->value_stack[--vm->stack_count].obj_val;
+    *a = vm->value_stack[--vm->stack_count].obj_val;
+    return obj;
 }
 
 Object* new_pair(VM *vm, Object *left, Object *right) {
-    Object *pair = gc_alloc_object(vm, OBJ_PAIR);
+    Object *pair = alloc_with_fields(vm, OBJ_PAIR, &left, &right);
     if (!pair) return NULL;
-    pair->pair.left = left;
-    pair->pair.right = right;
+    pair_set_left(vm, pair, left);
+    pair_set_right(vm, pair, right);
     return pair;
 }
 
@@ -75,71 +819,1554 @@ Object* new_function(VM *vm) {
 
 /* Create closure object */
 Object* new_closure(VM *vm, Object *fn, Object *env) {
-    Object *closure = gc_alloc_object(vm, OBJ_CLOSURE);
+    Object *closure = alloc_with_fields(vm, OBJ_CLOSURE, &fn, &env);
     if (!closure) return NULL;
-    closure->closure.fn = fn;
-    closure->closure.env = env;
+    closure_set_fn(vm, closure, fn);
+    closure_set_env(vm, closure, env);
     return closure;
 }
 
-void gc_mark_object(Object *obj) {
-    if (obj == NULL) return;
-    if (obj->marked) return;
-
-    obj->marked = true;
+/* Array of length Values, all VAL_INT(0) */
+Object* new_array(VM *vm, int length) {
+    if (length < 0) {
+        fprintf(stderr, "Error: Negative array length %d\n", length);
+        return NULL;
+    }
 
-    switch (obj->type) {
-        case OBJ_PAIR:
-            gc_mark_object(obj->pair.left);
-            gc_mark_object(obj->pair.right);
-            break;
-        case OBJ_CLOSURE:
-            gc_mark_object(obj->closure.fn);
-            gc_mark_object(obj->closure.env);
-            break;
-        case OBJ_FUNCTION:
-            break;
+    Object *array = alloc_object(vm, OBJ_ARRAY, array_size((size_t)length));
+    if (!array) return NULL;
+    array->array.length = (uint32_t)length;
+    for (int i = 0; i < length; i++) {
+        array->array.items[i] = VAL_INT(0);
     }
+    return array;
 }
 
-void gc_mark_roots(VM *vm) {
-    for (int i = 0; i < vm->stack_count; i++) {
-        Value *val = &vm->value_stack[i];
-        if (val->type == VAL_OBJ) {
-            gc_mark_object(val->obj_val);
-        }
+/* Byte string of length zero bytes */
+Object* new_bytes(VM *vm, int length) {
+    if (length < 0) {
+        fprintf(stderr, "Error: Negative byte string length %d\n", length);
+        return NULL;
     }
+
+    Object *bytes = alloc_object(vm, OBJ_BYTES, bytes_size((size_t)length));
+    if (!bytes) return NULL;
+    bytes->bytes.length = (uint32_t)length;
+    memset(bytes->bytes.data, 0, (size_t)length);
+    return bytes;
 }
 
-void gc_sweep(VM *vm) {
-    Object **obj_ptr = &vm->first_object;
-
-    while (*obj_ptr) {
-        if (!(*obj_ptr)->marked) {
-            Object *unreached = *obj_ptr;
-            *obj_ptr = unreached->next;
-            free(unreached);
-            vm->num_objects--;
-        } else {
-            (*obj_ptr)->marked = false;
-            obj_ptr = &(*obj_ptr)->next;
-        }
-    }
+/* Weak reference to target (which may be NULL) */
+Object* new_weak_ref(VM *vm, Object *target) {
+    Object *unused = NULL;
+    Object *weak = alloc_with_fields(vm, OBJ_WEAK, &target, &unused);
+    if (!weak) return NULL;
+    weak->weak.target = target;
+    object_stack_push(&vm->weak_objects, weak);
+    return weak;
 }
 
-void gc_collect(VM *vm) {
-    int before_count = vm->num_objects;
+/* Target of a weak reference, or NULL if it has been collected */
+Object* weak_get(Object *weak) {
+    return weak->weak.target;
+}
 
-    gc_mark_roots(vm);
-    gc_sweep(vm);
+/* Map whose object keys are weak: see mark_ephemerons */
+Object* new_weak_map(VM *vm) {
+    Object *map = new_map(vm);
+    if (!map) return NULL;
+    map->map.weak_keys = true;
+    object_stack_push(&vm->weak_objects, map);
+    return map;
+}
 
-    vm->max_objects = vm->num_objects * 2;
-    if (vm->max_objects < 8) {
-        vm->max_objects = 8;
+/* Mark an object gray: reached, but its fields are still to be scanned */
+static void shade(VM *vm, Object *obj) {
+    if (obj == NULL || obj->marked) return;
+    obj->marked = true;
+    object_stack_push(&vm->gray_stack, obj);
+}
+
+/*
+ * Generational mode: record old objects that gain a pointer into the nursery.
+ * Incremental mode: Dijkstra insertion barrier - a store into an already
+ * marked object shades the stored value, so no black object ever points to
+ * a white one.
+ */
+void gc_write_barrier(VM *vm, Object *owner, Object *value) {
+    if (owner == NULL || value == NULL) return;
+
+    if (vm->gc_mode == GC_MODE_INCREMENTAL) {
+        if (vm->gc_phase == GC_PHASE_MARK && owner->marked) {
+            shade(vm, value);
+        }
+        return;
+    }
+
+    if (vm->gc_mode != GC_MODE_GENERATIONAL) return;
+    if (owner->flags & OBJ_FLAG_REMEMBERED) return;
+    if (gc_in_nursery(vm, owner) || !gc_in_nursery(vm, value)) return;
+
+    owner->flags |= OBJ_FLAG_REMEMBERED;
+    object_stack_push(&vm->remembered_set, owner);
+}
+
+static bool writable(Object *obj) {
+    if (obj->flags & OBJ_FLAG_FROZEN) {
+        fprintf(stderr, "Error: Write to frozen object\n");
+        return false;
+    }
+    return true;
+}
+
+bool pair_set_left(VM *vm, Object *pair, Object *value) {
+    if (!writable(pair)) return false;
+    gc_write_barrier(vm, pair, value);
+    pair->pair.left = value;
+    return true;
+}
+
+bool pair_set_right(VM *vm, Object *pair, Object *value) {
+    if (!writable(pair)) return false;
+    gc_write_barrier(vm, pair, value);
+    pair->pair.right = value;
+    return true;
+}
+
+bool closure_set_fn(VM *vm, Object *closure, Object *fn) {
+    if (!writable(closure)) return false;
+    gc_write_barrier(vm, closure, fn);
+    closure->closure.fn = fn;
+    return true;
+}
+
+bool closure_set_env(VM *vm, Object *closure, Object *env) {
+    if (!writable(closure)) return false;
+    gc_write_barrier(vm, closure, env);
+    closure->closure.env = env;
+    return true;
+}
+
+/* Store into an array element; the index must be below the length */
+bool array_set(VM *vm, Object *array, uint32_t index, Value value) {
+    if (!writable(array)) return false;
+    if (value.type == VAL_OBJ) {
+        gc_write_barrier(vm, array, value.obj_val);
+    }
+    array->array.items[index] = value;
+    return true;
+}
+
+void gc_mark_object(Object *obj) {
+    if (obj == NULL) return;
+    if (obj->marked) return;
+
+    obj->marked = true;
+
+    switch (obj->type) {
+        case OBJ_PAIR:
+            gc_mark_object(obj->pair.left);
+            gc_mark_object(obj->pair.right);
+            break;
+        case OBJ_CLOSURE:
+            gc_mark_object(obj->closure.fn);
+            gc_mark_object(obj->closure.env);
+            break;
+        case OBJ_MAP:
+            if (obj->map.weak_keys) {
+                mark_weak_tables(obj);
+            } else {
+                gc_mark_object(obj->map.table);
+                gc_mark_object(obj->map.old_table);
+            }
+            break;
+        case OBJ_ARRAY:
+            for (uint32_t i = 0; i < obj->array.length; i++) {
+                if (obj->array.items[i].type == VAL_OBJ) {
+                    gc_mark_object(obj->array.items[i].obj_val);
+                }
+            }
+            break;
+        case OBJ_FUNCTION:
+        case OBJ_WEAK:
+        case OBJ_BYTES:
+            break;
+    }
+}
+
+/* Mark everything reachable from the value stack, without recursion */
+void gc_mark_roots(VM *vm) {
+    shade_roots(vm);
+    drain_gray(vm);
+}
+
+/*
+ * Weak references and weak-keyed maps
+ *
+ * Markers never follow a weak reference, and they mark a weak map's tables
+ * without scanning them. Every weak object is on vm->weak_objects. Once
+ * marking is done, and before anything is freed, process_weak finishes the
+ * job: an entry's value is marked only if its key has been (ephemeron
+ * semantics, so a value that refers to its own key does not keep it
+ * alive), then dead targets and entries are cleared.
+ */
+
+static void mark_weak_tables(Object *map) {
+    if (map->map.table) map->map.table->marked = true;
+    if (map->map.old_table) map->map.old_table->marked = true;
+}
+
+/* Values of weak-map entries with a live key; false if none was newly shaded */
+static bool shade_ephemeron_values(VM *vm, Object *table) {
+    bool shaded = false;
+    if (table == NULL) return false;
+
+    for (uint32_t i = 0; i < table->array.length; i += 2) {
+        Value key = table->array.items[i];
+        Value value = table->array.items[i + 1];
+        if (key.type == VAL_OBJ && (key.obj_val == NULL || !key.obj_val->marked)) continue;
+        if (value.type == VAL_OBJ && value.obj_val && !value.obj_val->marked) {
+            shade(vm, value.obj_val);
+            shaded = true;
+        }
+    }
+    return shaded;
+}
+
+/*
+ * Marking a value can make keys in other maps live: repeat until nothing
+ * changes. Returns whether anything was marked.
+ */
+static bool mark_ephemerons(VM *vm, ObjectStack *weak) {
+    bool shaded, any = false;
+    do {
+        shaded = false;
+        for (int i = 0; i < weak->count; i++) {
+            Object *obj = weak->items[i];
+            if (obj->type != OBJ_MAP || !obj->marked) continue;
+            shaded |= shade_ephemeron_values(vm, obj->map.table);
+            shaded |= shade_ephemeron_values(vm, obj->map.old_table);
+        }
+        drain_gray(vm);
+        any |= shaded;
+    } while (shaded);
+    return any;
+}
+
+/* Clear what died and drop dead weak objects from the list */
+static void clear_weak(VM *vm, ObjectStack *weak) {
+    int kept = 0;
+    for (int i = 0; i < weak->count; i++) {
+        Object *obj = weak->items[i];
+        if (!obj->marked) continue;
+
+        if (obj->type == OBJ_WEAK) {
+            Object *target = obj->weak.target;
+            if (target && !target->marked) obj->weak.target = NULL;
+        } else {
+            map_drop_dead_keys(vm, obj);
+        }
+        weak->items[kept++] = obj;
+    }
+    weak->count = kept;
+}
+
+/* After marking: finish the weak maps' values, then clear */
+static void process_weak(VM *vm) {
+    if (vm->weak_objects.count == 0) return;
+    mark_ephemerons(vm, &vm->weak_objects);
+    clear_weak(vm, &vm->weak_objects);
+}
+
+/* After a minor collection: follow promoted objects, clear dead young targets */
+static void update_weak_after_minor(VM *vm) {
+    int kept = 0;
+    for (int i = 0; i < vm->weak_objects.count; i++) {
+        Object *obj = vm->weak_objects.items[i];
+        if (gc_in_nursery(vm, obj)) {
+            if (!(obj->flags & OBJ_FLAG_FORWARDED)) continue;
+            obj = obj->forward;
+        }
+
+        Object *target = obj->type == OBJ_WEAK ? obj->weak.target : NULL;
+        if (target && gc_in_nursery(vm, target)) {
+            obj->weak.target = (target->flags & OBJ_FLAG_FORWARDED) ? target->forward : NULL;
+        }
+        vm->weak_objects.items[kept++] = obj;
+    }
+    vm->weak_objects.count = kept;
+}
+
+/* Marking is complete and nothing has been freed yet */
+static void after_mark(VM *vm) {
+    process_weak(vm);
+    if (vm->profile) gc_profile_after_mark(vm);
+}
+
+void gc_sweep(VM *vm) {
+    after_mark(vm);
+
+    long large_freed = 0;
+    size_t large_freed_bytes = 0;
+    sweep_large(&vm->large_objects, false, &large_freed, &large_freed_bytes);
+    account_freed(vm, large_freed, large_freed_bytes);
+
+    long freed = 0;
+    size_t freed_bytes = 0;
+    sweep_classes(vm->size_classes, &freed, &freed_bytes);
+    account_freed(vm, freed, freed_bytes);
+}
+
+/*
+ * Parallel marking
+ *
+ * Each worker owns a private mark stack it uses without locking, plus a
+ * small shared stack that other workers may steal from. When a worker's
+ * shared stack runs dry it donates the older half of its private stack;
+ * an idle worker steals half of a victim's shared stack. Mark bits are set
+ * with an atomic exchange so every object is claimed by exactly one worker.
+ *
+ * Termination: a worker only goes idle once its private and shared stacks
+ * are both empty, and only the owner ever adds to a shared stack, so when
+ * every worker is idle no work is left anywhere.
+ */
+
+/* Private stack depth a worker keeps before donating to its shared stack */
+#define MARK_DONATE_MIN 16
+
+typedef struct MarkContext MarkContext;
+
+typedef struct {
+    MarkContext *ctx;
+    int id;
+    ObjectStack local;
+    ObjectStack shared;
+    int shared_count;          /* Atomic copy of shared.count for thieves */
+    pthread_mutex_t lock;      /* Protects shared */
+    pthread_t thread;
+    bool started;
+    long marked;
+} MarkWorker;
+
+struct MarkContext {
+    MarkWorker *workers;
+    int num_workers;
+    int idle;                  /* Atomic count of workers without work */
+};
+
+/* Claim an object for marking; false if another worker got there first */
+static bool try_mark(Object *obj) {
+    if (obj == NULL) return false;
+    if (__atomic_load_n(&obj->marked, __ATOMIC_RELAXED)) return false;
+    return !__atomic_exchange_n(&obj->marked, true, __ATOMIC_RELAXED);
+}
+
+static void mark_push(MarkWorker *w, Object *obj) {
+    if (try_mark(obj)) {
+        object_stack_push(&w->local, obj);
+    }
+}
+
+/* Move the bottom (oldest) half of the private stack to the shared stack */
+static void donate(MarkWorker *w) {
+    int half = w->local.count / 2;
+
+    pthread_mutex_lock(&w->lock);
+    for (int i = 0; i < half; i++) {
+        object_stack_push(&w->shared, w->local.items[i]);
+    }
+    __atomic_store_n(&w->shared_count, w->shared.count, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&w->lock);
+
+    memmove(w->local.items, w->local.items + half,
+            (w->local.count - half) * sizeof(Object*));
+    w->local.count -= half;
+}
+
+/* Take up to half (at least one) of a shared stack into a private one */
+static bool take_shared(MarkWorker *victim, MarkWorker *w) {
+    if (__atomic_load_n(&victim->shared_count, __ATOMIC_ACQUIRE) == 0) return false;
+
+    pthread_mutex_lock(&victim->lock);
+    int take = victim == w ? victim->shared.count : (victim->shared.count + 1) / 2;
+    for (int i = 0; i < take; i++) {
+        object_stack_push(&w->local, victim->shared.items[--victim->shared.count]);
+    }
+    __atomic_store_n(&victim->shared_count, victim->shared.count, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&victim->lock);
+
+    return take > 0;
+}
+
+static bool steal(MarkWorker *w) {
+    MarkContext *ctx = w->ctx;
+    for (int i = 1; i < ctx->num_workers; i++) {
+        if (take_shared(&ctx->workers[(w->id + i) % ctx->num_workers], w)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool any_shared_work(MarkContext *ctx) {
+    for (int i = 0; i < ctx->num_workers; i++) {
+        if (__atomic_load_n(&ctx->workers[i].shared_count, __ATOMIC_ACQUIRE) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void drain(MarkWorker *w) {
+    while (w->local.count > 0) {
+        Object *obj = w->local.items[--w->local.count];
+        w->marked++;
+
+        switch (obj->type) {
+            case OBJ_PAIR:
+                mark_push(w, obj->pair.left);
+                mark_push(w, obj->pair.right);
+                break;
+            case OBJ_CLOSURE:
+                mark_push(w, obj->closure.fn);
+                mark_push(w, obj->closure.env);
+                break;
+            case OBJ_MAP:
+                if (obj->map.weak_keys) {
+                    try_mark(obj->map.table);
+                    try_mark(obj->map.old_table);
+                } else {
+                    mark_push(w, obj->map.table);
+                    mark_push(w, obj->map.old_table);
+                }
+                break;
+            case OBJ_ARRAY:
+                for (uint32_t i = 0; i < obj->array.length; i++) {
+                    if (obj->array.items[i].type == VAL_OBJ) {
+                        mark_push(w, obj->array.items[i].obj_val);
+                    }
+                }
+                break;
+            case OBJ_FUNCTION:
+            case OBJ_WEAK:
+            case OBJ_BYTES:
+                break;
+        }
+
+        if (w->local.count >= MARK_DONATE_MIN &&
+            __atomic_load_n(&w->shared_count, __ATOMIC_RELAXED) == 0) {
+            donate(w);
+        }
+    }
+}
+
+static void* mark_worker_run(void *arg) {
+    MarkWorker *w = (MarkWorker*)arg;
+    MarkContext *ctx = w->ctx;
+
+    for (;;) {
+        drain(w);
+        if (take_shared(w, w) || steal(w)) continue;
+
+        __atomic_add_fetch(&ctx->idle, 1, __ATOMIC_ACQ_REL);
+        for (;;) {
+            if (__atomic_load_n(&ctx->idle, __ATOMIC_ACQUIRE) == ctx->num_workers) {
+                return NULL;
+            }
+            if (any_shared_work(ctx)) {
+                __atomic_sub_fetch(&ctx->idle, 1, __ATOMIC_ACQ_REL);
+                if (steal(w)) break;
+                __atomic_add_fetch(&ctx->idle, 1, __ATOMIC_ACQ_REL);
+            }
+            sched_yield();
+        }
+    }
+}
+
+/*
+ * Mark everything reachable from the value stack using the given number of
+ * threads (the calling thread is one of them). Returns the number of
+ * objects marked.
+ */
+long gc_parallel_mark(VM *vm, int threads) {
+    if (threads < 1) threads = 1;
+
+    MarkContext ctx;
+    ctx.num_workers = threads;
+    ctx.idle = 0;
+    ctx.workers = (MarkWorker*)calloc(threads, sizeof(MarkWorker));
+    if (!ctx.workers) {
+        fprintf(stderr, "Error: Out of memory in parallel mark\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < threads; i++) {
+        ctx.workers[i].ctx = &ctx;
+        ctx.workers[i].id = i;
+        pthread_mutex_init(&ctx.workers[i].lock, NULL);
+    }
+
+    /* Deal the roots out round-robin */
+    int next = 0;
+    for (int i = 0; i < vm->stack_count; i++) {
+        Value *val = &vm->value_stack[i];
+        if (val->type == VAL_OBJ && try_mark(val->obj_val)) {
+            object_stack_push(&ctx.workers[next].local, val->obj_val);
+            next = (next + 1) % threads;
+        }
     }
 
-    printf("[GC] Collected %d objects, %d remaining\n",
-           before_count - vm->num_objects, vm->num_objects);
+    for (int i = 1; i < threads; i++) {
+        if (pthread_create(&ctx.workers[i].thread, NULL, mark_worker_run, &ctx.workers[i]) != 0) {
+            /* Fewer threads still terminates: unstarted workers count as idle */
+            fprintf(stderr, "Warning: Could not start mark thread %d\n", i);
+            while (ctx.workers[i].local.count > 0) {
+                object_stack_push(&ctx.workers[0].local,
+                                  ctx.workers[i].local.items[--ctx.workers[i].local.count]);
+            }
+            __atomic_add_fetch(&ctx.idle, 1, __ATOMIC_ACQ_REL);
+            continue;
+        }
+        ctx.workers[i].started = true;
+    }
+
+    mark_worker_run(&ctx.workers[0]);
+
+    long marked = 0;
+    for (int i = 0; i < threads; i++) {
+        MarkWorker *w = &ctx.workers[i];
+        if (w->started) {
+            pthread_join(w->thread, NULL);
+        }
+        marked += w->marked;
+        object_stack_free(&w->local);
+        object_stack_free(&w->shared);
+        pthread_mutex_destroy(&w->lock);
+    }
+    free(ctx.workers);
+
+    return marked;
+}
+
+/* Copy a nursery object into the old generation, leaving a forwarding pointer */
+static Object* promote(VM *vm, Object *obj, ObjectStack *scan) {
+    if (obj == NULL || !gc_in_nursery(vm, obj)) return obj;
+    if (obj->flags & OBJ_FLAG_FORWARDED) return obj->forward;
+
+    size_t size = gc_object_size(obj);
+    Object *copy = alloc_old_object(vm, size_class_of((ObjectType)obj->type, size));
+    if (!copy) {
+        fprintf(stderr, "Error: Out of memory promoting nursery object\n");
+        exit(1);
+    }
+    memcpy(copy, obj, size);
+    copy->marked = false;
+    copy->flags = 0;
+
+    obj->flags |= OBJ_FLAG_FORWARDED;
+    obj->forward = copy;
+
+    object_stack_push(scan, copy);
+    return copy;
+}
+
+static void promote_fields(VM *vm, Object *obj, ObjectStack *scan) {
+    switch (obj->type) {
+        case OBJ_PAIR:
+            obj->pair.left = promote(vm, obj->pair.left, scan);
+            obj->pair.right = promote(vm, obj->pair.right, scan);
+            break;
+        case OBJ_CLOSURE:
+            obj->closure.fn = promote(vm, obj->closure.fn, scan);
+            obj->closure.env = promote(vm, obj->closure.env, scan);
+            break;
+        case OBJ_MAP:
+            obj->map.table = promote(vm, obj->map.table, scan);
+            obj->map.old_table = promote(vm, obj->map.old_table, scan);
+            break;
+        case OBJ_ARRAY:
+            for (uint32_t i = 0; i < obj->array.length; i++) {
+                Value *item = &obj->array.items[i];
+                if (item->type == VAL_OBJ) {
+                    item->obj_val = promote(vm, item->obj_val, scan);
+                }
+            }
+            break;
+        case OBJ_FUNCTION:
+        case OBJ_WEAK:      /* Target fixed up by update_weak_after_minor */
+        case OBJ_BYTES:
+            break;
+    }
+}
+
+/*
+ * Minor collection: evacuate live nursery objects into the old generation.
+ * Only the value stack and the remembered set are scanned; the old
+ * generation is not traversed. Every survivor is promoted, so the nursery
+ * is empty afterwards and can be bump-allocated from the start again.
+ */
+static void minor_collect(VM *vm) {
+    double start = gc_now_us();
+    ObjectStack scan = {NULL, 0, 0};
+    long promoted = 0;
+    size_t promoted_bytes = 0;
+
+    for (int i = 0; i < vm->stack_count; i++) {
+        Value *val = &vm->value_stack[i];
+        if (val->type == VAL_OBJ) {
+            val->obj_val = promote(vm, val->obj_val, &scan);
+        }
+    }
+
+    for (int i = 0; i < vm->remembered_set.count; i++) {
+        Object *owner = vm->remembered_set.items[i];
+        owner->flags &= ~OBJ_FLAG_REMEMBERED;
+        promote_fields(vm, owner, &scan);
+    }
+    vm->remembered_set.count = 0;
+    double roots_done = gc_now_us();
+
+    /* Cheney-style scan: fix up fields of everything promoted so far */
+    for (int i = 0; i < scan.count; i++) {
+        promote_fields(vm, scan.items[i], &scan);
+        promoted++;
+        promoted_bytes += gc_object_size(scan.items[i]);
+    }
+    object_stack_free(&scan);
+    update_weak_after_minor(vm);
+    if (vm->profile) gc_profile_after_minor(vm);
+
+    long dead = vm->nursery_objects - promoted;
+    size_t dead_bytes = vm->nursery_top - promoted_bytes;
+    vm->nursery_top = 0;
+    vm->nursery_objects = 0;
+    account_freed(vm, dead, dead_bytes);
+
+    /* Copying has no separate sweep: evacuation is reported as marking */
+    GCCycleStats cycle = {0};
+    cycle.kind = GC_EVENT_MINOR;
+    cycle.roots_us = roots_done - start;
+    cycle.mark_us = gc_now_us() - roots_done;
+    cycle.pause_us = cycle.roots_us + cycle.mark_us;
+    cycle.objects_freed = dead;
+    cycle.bytes_freed = dead_bytes;
+    finish_cycle(vm, &cycle);
+}
+
+void gc_minor_collect(VM *vm) {
+    double start = gc_now_us();
+    minor_collect(vm);
+    record_pause(vm, gc_now_us() - start);
+}
+
+/*
+ * Background sweeping
+ *
+ * After marking, every heap chunk is handed to a sweeper thread and the
+ * mutator resumes at once, allocating into fresh chunks. The sweeper frees
+ * dead slots and resets survivors' marks chunk by chunk, in list order, and
+ * publishes each chunk with a release store of its swept flag. The mutator
+ * takes swept chunks back when it runs out of room, or all at once when
+ * the sweeper reports back. Each chunk's next link is read by the sweeper
+ * before publishing, so the mutator may relink it afterwards.
+ */
+
+static void* sweeper_run(void *arg) {
+    BackgroundSweep *sweep = (BackgroundSweep*)arg;
+
+    for (int i = 0; i < GC_SIZE_CLASSES; i++) {
+        HeapChunk *chunk = sweep->chunks[i];
+        while (chunk) {
+            HeapChunk *next = chunk->next;
+            sweep_chunk(chunk, &sweep->freed, &sweep->freed_bytes);
+            __atomic_store_n(&chunk->swept, 1, __ATOMIC_RELEASE);
+            chunk = next;
+        }
+    }
+
+    __atomic_store_n(&sweep->done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* Hand the marked heap to a new sweeper thread; false to sweep inline */
+static bool sweep_start(VM *vm) {
+    BackgroundSweep *sweep = (BackgroundSweep*)calloc(1, sizeof(BackgroundSweep));
+    if (!sweep) return false;
+
+    /* Weak targets are cleared before the sweeper can free them */
+    after_mark(vm);
+
+    for (int i = 0; i < GC_SIZE_CLASSES; i++) {
+        HeapChunk *list = vm->size_classes[i].chunks;
+        for (HeapChunk *chunk = list; chunk; chunk = chunk->next) {
+            chunk->swept = 0;
+        }
+        sweep->chunks[i] = list;
+        sweep->adopt[i] = list;
+    }
+    sweep->before_bytes = vm->bytes_allocated;
+
+    if (pthread_create(&sweep->thread, NULL, sweeper_run, sweep) != 0) {
+        free(sweep);
+        return false;
+    }
+
+    /* Large objects are few: the mutator sweeps them right away */
+    sweep_large(&vm->large_objects, false, &sweep->large_freed, &sweep->large_freed_bytes);
+
+    /* The chunks now belong to the sweeper until it publishes them */
+    for (int i = 0; i < GC_SIZE_CLASSES; i++) {
+        SizeClass *sc = &vm->size_classes[i];
+        sc->chunks = NULL;
+        sc->tail = NULL;
+        sc->alloc = NULL;
+        sc->chunk_count = 0;
+    }
+    vm->sweep = sweep;
+    return true;
+}
+
+/* Take back the swept chunks of a class; empty ones are freed. True if any kept */
+static bool sweep_adopt(VM *vm, int size_class) {
+    BackgroundSweep *sweep = vm->sweep;
+    SizeClass *sc = &vm->size_classes[size_class];
+    HeapChunk *chunk = sweep->adopt[size_class];
+    bool adopted = false;
+
+    while (chunk && __atomic_load_n(&chunk->swept, __ATOMIC_ACQUIRE)) {
+        HeapChunk *next = chunk->next;
+        if (chunk->live == 0) {
+            free(chunk);
+        } else {
+            link_chunk(sc, chunk);
+            adopted = true;
+        }
+        chunk = next;
+    }
+    sweep->adopt[size_class] = chunk;
+    return adopted;
+}
+
+/* Join a sweeper that is done and take back the rest of the heap */
+static void sweep_settle(VM *vm) {
+    BackgroundSweep *sweep = vm->sweep;
+
+    pthread_join(sweep->thread, NULL);
+
+    for (int i = 0; i < GC_SIZE_CLASSES; i++) {
+        sweep_adopt(vm, i);
+        vm->size_classes[i].alloc = vm->size_classes[i].chunks;
+    }
+    long freed = sweep->freed + sweep->large_freed;
+    size_t freed_bytes = sweep->freed_bytes + sweep->large_freed_bytes;
+    account_freed(vm, freed, freed_bytes);
+    update_threshold(vm, sweep->before_bytes);
+
+    GCCycleStats cycle = sweep->cycle;
+    cycle.objects_freed = freed;
+    cycle.bytes_freed = freed_bytes;
+    free(sweep);
+    vm->sweep = NULL;
+
+    finish_cycle(vm, &cycle);
+}
+
+static void sweep_poll(VM *vm) {
+    if (__atomic_load_n(&vm->sweep->done, __ATOMIC_ACQUIRE)) {
+        sweep_settle(vm);
+    }
+}
+
+/* Wait for the background sweeper, if any, and take back the whole heap */
+void gc_finish_sweep(VM *vm) {
+    if (vm->sweep) {
+        sweep_settle(vm);
+    }
+}
+
+/* True while a background sweep started by the last collection is running */
+bool gc_sweep_in_progress(VM *vm) {
+    if (!vm->sweep) return false;
+    sweep_poll(vm);
+    return vm->sweep != NULL;
+}
+
+/*
+ * Compaction
+ *
+ * Live objects are copied into fresh chunks in depth-first order from the
+ * roots, so within each size class an object's fields are laid out right
+ * after it and a list's cells end up adjacent. Each old object is left
+ * with a forwarding pointer while its referrers are fixed up; then the old
+ * chunks are freed whole. Large objects stay where they are: their mark is
+ * cleared on the first visit so their fields are fixed up once.
+ */
+
+static Object* evacuate(SizeClass *to, Object *obj, ObjectStack *scan) {
+    if (obj == NULL || (obj->flags & OBJ_FLAG_FROZEN)) return obj;  /* Frozen: read-only, stays */
+    if (obj->flags & OBJ_FLAG_FORWARDED) return obj->forward;
+
+    size_t size = gc_object_size(obj);
+    if (size > GC_LARGE_OBJECT_BYTES) {
+        if (obj->marked) {
+            obj->marked = false;
+            object_stack_push(scan, obj);
+        }
+        return obj;
+    }
+
+    SizeClass *sc = &to[size_class_of((ObjectType)obj->type, size)];
+    Object *copy = chunk_take(sc->alloc);
+    if (!copy) {
+        sc->alloc = sc->alloc->next;  /* Reserved up front, so the next one has room */
+        copy = chunk_take(sc->alloc);
+    }
+    memcpy(copy, obj, size);
+    copy->marked = false;
+    copy->flags = 0;
+
+    obj->flags |= OBJ_FLAG_FORWARDED;
+    obj->forward = copy;
+
+    object_stack_push(scan, copy);
+    return copy;
+}
+
+/* Copy the marked (live) objects into new chunks; false if out of memory */
+static bool compact_heap(VM *vm) {
+    SizeClass to[GC_SIZE_CLASSES];
+    memset(to, 0, sizeof(to));
+
+    /* Reserve exactly the chunks the survivors need before moving anything */
+    for (int i = 0; i < GC_SIZE_CLASSES; i++) {
+        SizeClass *from = &vm->size_classes[i];
+        long live = 0;
+        for (HeapChunk *chunk = from->chunks; chunk; chunk = chunk->next) {
+            for (int j = 0; j < chunk->used; j++) {
+                Object *obj = chunk_slot(chunk, j);
+                if (obj->type != FREE_SLOT && obj->marked) live++;
+            }
+        }
+
+        to[i].slot_size = from->slot_size;
+        long per_chunk = GC_CHUNK_BYTES / from->slot_size;
+        for (long reserved = 0; reserved < live; reserved += per_chunk) {
+            if (!new_chunk(&to[i])) {
+                for (int k = 0; k <= i; k++) free_chunks(&to[k]);
+                return false;
+            }
+        }
+        to[i].alloc = to[i].chunks;
+    }
+
+    /*
+     * Only now is compaction certain: if a reservation fails, the sweep that
+     * runs instead calls after_mark itself. Dead weak targets are cleared so
+     * they are not copied.
+     */
+    after_mark(vm);
+
+    /* Dead large objects go now; live ones keep their marks until visited */
+    long large_freed = 0;
+    size_t large_freed_bytes = 0;
+    sweep_large(&vm->large_objects, true, &large_freed, &large_freed_bytes);
+
+    ObjectStack scan = {NULL, 0, 0};
+    for (int i = 0; i < vm->stack_count; i++) {
+        Value *val = &vm->value_stack[i];
+        if (val->type == VAL_OBJ) {
+            val->obj_val = evacuate(to, val->obj_val, &scan);
+        }
+    }
+
+    while (scan.count > 0) {
+        Object *obj = scan.items[--scan.count];
+        switch (obj->type) {
+            case OBJ_PAIR:
+                obj->pair.left = evacuate(to, obj->pair.left, &scan);
+                obj->pair.right = evacuate(to, obj->pair.right, &scan);
+                break;
+            case OBJ_CLOSURE:
+                obj->closure.fn = evacuate(to, obj->closure.fn, &scan);
+                obj->closure.env = evacuate(to, obj->closure.env, &scan);
+                break;
+            case OBJ_MAP:
+                obj->map.table = evacuate(to, obj->map.table, &scan);
+                obj->map.old_table = evacuate(to, obj->map.old_table, &scan);
+                break;
+            case OBJ_ARRAY:
+                for (uint32_t i = 0; i < obj->array.length; i++) {
+                    Value *item = &obj->array.items[i];
+                    if (item->type == VAL_OBJ) {
+                        item->obj_val = evacuate(to, item->obj_val, &scan);
+                    }
+                }
+                break;
+            case OBJ_WEAK:
+                obj->weak.target = evacuate(to, obj->weak.target, &scan);
+                break;
+            case OBJ_FUNCTION:
+            case OBJ_BYTES:
+                break;
+        }
+    }
+    object_stack_free(&scan);
+
+    /* Weak objects are never large, so every one on the list has moved */
+    for (int i = 0; i < vm->weak_objects.count; i++) {
+        vm->weak_objects.items[i] = vm->weak_objects.items[i]->forward;
+    }
+    if (vm->profile) gc_profile_after_compact(vm);
+
+    /* Every old object is now either garbage or forwarded */
+    long live_objects = 0;
+    size_t live_bytes = 0;
+    for (LargeObject *large = vm->large_objects; large; large = large->next) {
+        live_objects++;
+        live_bytes += large->size;
+    }
+    for (int i = 0; i < GC_SIZE_CLASSES; i++) {
+        free_chunks(&vm->size_classes[i]);
+        for (HeapChunk *chunk = to[i].chunks; chunk; chunk = chunk->next) {
+            for (int j = 0; j < chunk->used; j++) {
+                live_bytes += gc_object_size(chunk_slot(chunk, j));
+            }
+            live_objects += chunk->live;
+        }
+        to[i].alloc = to[i].chunks;
+        vm->size_classes[i] = to[i];
+    }
+    account_freed(vm, vm->num_objects - live_objects, vm->bytes_allocated - live_bytes);
+    return true;
+}
+
+/* Iteratively mark everything on the gray stack */
+static void drain_gray(VM *vm) {
+    while (vm->gray_stack.count > 0) {
+        blacken(vm, vm->gray_stack.items[--vm->gray_stack.count]);
+    }
+}
+
+static void full_collect(VM *vm, bool compact) {
+    if (vm->shared_heap) {
+        shared_collect(vm);
+        return;
+    }
+
+    double start = gc_now_us();
+    GCCycleStats cycle = {0};
+    cycle.kind = GC_EVENT_FULL;
+
+    /* Finish an interrupted incremental cycle before starting over */
+    if (vm->gc_phase != GC_PHASE_IDLE) {
+        incremental_slice(vm, 0);
+    }
+
+    /* The previous cycle's sweep must be complete before marking again */
+    gc_finish_sweep(vm);
+
+    /* A major collection starts by emptying the nursery */
+    if (vm->nursery_top > 0) {
+        minor_collect(vm);
+    }
+
+    size_t before_bytes = vm->bytes_allocated;
+    long freed_before = vm->gc_stats.objects_freed;
+    size_t freed_bytes_before = vm->gc_stats.bytes_freed;
+
+    if (vm->compact_interval > 0 &&
+        ++vm->collections_since_compact >= vm->compact_interval) {
+        compact = true;
+    }
+
+    double phase = gc_now_us();
+    if (vm->mark_threads > 1) {
+        /* Roots are dealt to the workers inside the parallel marker */
+        gc_parallel_mark(vm, vm->mark_threads);
+    } else {
+        shade_roots(vm);
+        double roots_done = gc_now_us();
+        cycle.roots_us = roots_done - phase;
+        phase = roots_done;
+        drain_gray(vm);
+    }
+    double mark_done = gc_now_us();
+    cycle.mark_us = mark_done - phase;
+
+    if (compact && compact_heap(vm)) {
+        vm->collections_since_compact = 0;
+        cycle.compacted = true;
+    } else if (!compact && vm->background_sweep &&
+               vm->gc_mode != GC_MODE_INCREMENTAL && sweep_start(vm)) {
+        /* Reported when the sweeper is done; only the handoff is a pause */
+        cycle.background_sweep = true;
+        cycle.sweep_us = gc_now_us() - mark_done;
+        cycle.pause_us = gc_now_us() - start;
+        vm->sweep->cycle = cycle;
+        return;
+    } else {
+        gc_sweep(vm);
+    }
+    cycle.sweep_us = gc_now_us() - mark_done;
+
+    update_threshold(vm, before_bytes);
+
+    cycle.objects_freed = vm->gc_stats.objects_freed - freed_before;
+    cycle.bytes_freed = vm->gc_stats.bytes_freed - freed_bytes_before;
+    cycle.pause_us = gc_now_us() - start;
+    finish_cycle(vm, &cycle);
+}
+
+void gc_collect(VM *vm) {
+    double start = gc_now_us();
+    full_collect(vm, false);
+    record_pause(vm, gc_now_us() - start);
+}
+
+/*
+ * Full collection that also compacts the surviving objects into as few
+ * chunks as possible. Objects move: re-read them from the value stack.
+ */
+void gc_compact(VM *vm) {
+    double start = gc_now_us();
+    full_collect(vm, true);
+    record_pause(vm, gc_now_us() - start);
+}
+
+static void shade_roots(VM *vm) {
+    for (int i = 0; i < vm->stack_count; i++) {
+        Value *val = &vm->value_stack[i];
+        if (val->type == VAL_OBJ) {
+            shade(vm, val->obj_val);
+        }
+    }
+}
+
+static void blacken(VM *vm, Object *obj) {
+    switch (obj->type) {
+        case OBJ_PAIR:
+            shade(vm, obj->pair.left);
+            shade(vm, obj->pair.right);
+            break;
+        case OBJ_CLOSURE:
+            shade(vm, obj->closure.fn);
+            shade(vm, obj->closure.env);
+            break;
+        case OBJ_MAP:
+            if (obj->map.weak_keys) {
+                mark_weak_tables(obj);
+            } else {
+                shade(vm, obj->map.table);
+                shade(vm, obj->map.old_table);
+            }
+            break;
+        case OBJ_ARRAY:
+            for (uint32_t i = 0; i < obj->array.length; i++) {
+                if (obj->array.items[i].type == VAL_OBJ) {
+                    shade(vm, obj->array.items[i].obj_val);
+                }
+            }
+            break;
+        case OBJ_FUNCTION:
+        case OBJ_WEAK:
+        case OBJ_BYTES:
+            break;
+    }
+}
+
+/* The clock is only read every this many objects of work */
+#define SLICE_CHECK_INTERVAL 64
+
+static bool slice_expired(VM *vm, double start, double budget_us, int work) {
+    if (budget_us <= 0) return false;
+    if (vm->slice_work > 0 && work >= vm->slice_work) return true;
+    return work % SLICE_CHECK_INTERVAL == 0 && gc_now_us() - start >= budget_us;
+}
+
+/*
+ * Run the current incremental cycle until it finishes or the slice budget
+ * (time, and optionally objects processed) is spent. A time budget of 0
+ * runs the cycle to completion.
+ */
+static void incremental_slice(VM *vm, double budget_us) {
+    double start = gc_now_us();
+    int work = 0;
+
+    if (vm->gc_phase == GC_PHASE_MARK) {
+        for (;;) {
+            while (vm->gray_stack.count > 0) {
+                blacken(vm, vm->gray_stack.items[--vm->gray_stack.count]);
+
+                if (slice_expired(vm, start, budget_us, ++work)) {
+                    vm->cycle.mark_us += gc_now_us() - start;
+                    return;
+                }
+            }
+
+            /* Stack writes have no barrier: rescan the roots before finishing */
+            shade_roots(vm);
+            if (vm->gray_stack.count == 0) break;
+        }
+
+        after_mark(vm);
+        double mark_done = gc_now_us();
+        vm->cycle.mark_us += mark_done - start;
+        start = mark_done;
+
+        /* Large objects are swept in one go; later ones are allocated white */
+        long large_freed = 0;
+        size_t large_freed_bytes = 0;
+        sweep_large(&vm->large_objects, false, &large_freed, &large_freed_bytes);
+        account_freed(vm, large_freed, large_freed_bytes);
+
+        /* Chunks added from here on are allocated into behind the sweep */
+        for (int i = 0; i < GC_SIZE_CLASSES; i++) {
+            for (HeapChunk *chunk = vm->size_classes[i].chunks; chunk; chunk = chunk->next) {
+                chunk->swept = 0;
+            }
+        }
+        vm->gc_phase = GC_PHASE_SWEEP;
+        vm->sweep_class = 0;
+        vm->sweep_link = &vm->size_classes[0].chunks;
+        vm->sweep_slot = 0;
+    }
+
+    if (vm->gc_phase == GC_PHASE_SWEEP) {
+        while (vm->sweep_class < GC_SIZE_CLASSES) {
+            SizeClass *sc = &vm->size_classes[vm->sweep_class];
+
+            while (*vm->sweep_link) {
+                HeapChunk *chunk = *vm->sweep_link;
+                if (chunk->swept) {
+                    vm->sweep_link = &chunk->next;
+                    continue;
+                }
+
+                while (vm->sweep_slot < chunk->used) {
+                    long freed = 0;
+                    size_t freed_bytes = 0;
+                    sweep_slot(chunk, chunk_slot(chunk, vm->sweep_slot++), &freed, &freed_bytes);
+                    account_freed(vm, freed, freed_bytes);
+
+                    if (slice_expired(vm, start, budget_us, ++work)) {
+                        vm->cycle.sweep_us += gc_now_us() - start;
+                        return;
+                    }
+                }
+
+                chunk->swept = 1;
+                vm->sweep_slot = 0;
+                if (chunk->live == 0) {
+                    release_chunk(sc, vm->sweep_link);
+                } else {
+                    vm->sweep_link = &chunk->next;
+                }
+            }
+
+            sc->alloc = sc->chunks;
+            if (++vm->sweep_class < GC_SIZE_CLASSES) {
+                vm->sweep_link = &vm->size_classes[vm->sweep_class].chunks;
+            }
+        }
+
+        vm->cycle.sweep_us += gc_now_us() - start;
+        vm->sweep_link = NULL;
+        vm->gc_phase = GC_PHASE_IDLE;
+        update_threshold(vm, vm->cycle_start_bytes);
+
+        /* The freed counters held the totals at cycle start */
+        vm->cycle.objects_freed = vm->gc_stats.objects_freed - vm->cycle.objects_freed;
+        vm->cycle.bytes_freed = vm->gc_stats.bytes_freed - vm->cycle.bytes_freed;
+        vm->cycle.pause_us = vm->cycle.roots_us + vm->cycle.mark_us + vm->cycle.sweep_us;
+        finish_cycle(vm, &vm->cycle);
+    }
+}
+
+static void incremental_start(VM *vm) {
+    double start = gc_now_us();
+
+    vm->gc_phase = GC_PHASE_MARK;
+    vm->cycle_start_bytes = vm->bytes_allocated;
+
+    memset(&vm->cycle, 0, sizeof(GCCycleStats));
+    vm->cycle.kind = GC_EVENT_INCREMENTAL;
+    vm->cycle.objects_freed = vm->gc_stats.objects_freed;
+    vm->cycle.bytes_freed = vm->gc_stats.bytes_freed;
+
+    shade_roots(vm);
+    vm->cycle.roots_us = gc_now_us() - start;
+}
+
+/*
+ * Perform one bounded slice of incremental marking or sweeping, starting a
+ * new cycle if none is in progress.
+ */
+void gc_incremental_step(VM *vm) {
+    double start = gc_now_us();
+
+    if (vm->gc_phase == GC_PHASE_IDLE) {
+        incremental_start(vm);
+    }
+    vm->alloc_since_step = 0;
+    incremental_slice(vm, vm->pause_target_us);
+    record_pause(vm, gc_now_us() - start);
+}
+
+/*
+ * Shared heap
+ *
+ * VMs on different threads allocate from one set of chunks. Each attached
+ * VM owns at most one chunk per size class at a time, its thread-local
+ * allocation buffer (TLAB), and takes slots from it exactly as from a
+ * private chunk, with no locking. Only taking a new chunk, allocating a
+ * large object and collecting take the heap lock. A VM counts what it
+ * allocates in its own num_objects and bytes_allocated and moves the counts
+ * to the heap whenever it takes the lock, which is also when the collection
+ * trigger is checked.
+ *
+ * Collections stop the world. The collecting thread sets `stopping` and
+ * waits until every other attached VM has parked at a safepoint. It then
+ * marks from all their value stacks, sweeps the shared chunks and takes
+ * every TLAB back, so chunks left empty can be freed; each VM takes a fresh
+ * one at its next allocation.
+ */
+
+/* Move a VM's allocation counts to the heap; lock held */
+static void publish_counts(GCSharedHeap *heap, VM *vm) {
+    heap->num_objects += vm->num_objects;
+    heap->bytes_allocated += vm->bytes_allocated;
+    heap->stats.bytes_allocated += vm->bytes_allocated;
+    vm->num_objects = 0;
+    vm->bytes_allocated = 0;
+}
+
+/* Wait at a safepoint until the collection in progress is over; lock held */
+static void park(GCSharedHeap *heap) {
+    heap->parked++;
+    pthread_cond_signal(&heap->parked_cond);
+    while (__atomic_load_n(&heap->stopping, __ATOMIC_RELAXED)) {
+        pthread_cond_wait(&heap->resume_cond, &heap->lock);
+    }
+    heap->parked--;
+}
+
+/* Mark from every attached VM, then finish weak objects of all of them */
+static void shared_mark(VM *vm, GCSharedHeap *heap) {
+    for (int i = 0; i < heap->vm_count; i++) {
+        VM *other = heap->vms[i];
+        for (int j = 0; j < other->stack_count; j++) {
+            if (other->value_stack[j].type == VAL_OBJ) {
+                shade(vm, other->value_stack[j].obj_val);
+            }
+        }
+    }
+    drain_gray(vm);
+
+    /* A weak map of one VM may hold the key that makes another's value live */
+    bool shaded;
+    do {
+        shaded = mark_ephemerons(vm, &heap->weak_objects);
+        for (int i = 0; i < heap->vm_count; i++) {
+            shaded |= mark_ephemerons(vm, &heap->vms[i]->weak_objects);
+        }
+    } while (shaded);
+
+    clear_weak(vm, &heap->weak_objects);
+    for (int i = 0; i < heap->vm_count; i++) {
+        clear_weak(vm, &heap->vms[i]->weak_objects);
+        if (heap->vms[i]->profile) gc_profile_after_mark(heap->vms[i]);
+    }
+}
+
+/*
+ * Stop every other mutator, then collect; lock held. If another thread is
+ * already collecting, park until it is done instead.
+ */
+static void shared_collect_locked(VM *vm) {
+    GCSharedHeap *heap = vm->shared_heap;
+
+    if (__atomic_load_n(&heap->stopping, __ATOMIC_RELAXED)) {
+        park(heap);
+        return;
+    }
+
+    double start = gc_now_us();
+    __atomic_store_n(&heap->stopping, 1, __ATOMIC_RELEASE);
+    while (heap->parked < heap->vm_count - 1) {
+        pthread_cond_wait(&heap->parked_cond, &heap->lock);
+    }
+    double stopped = gc_now_us();
+
+    for (int i = 0; i < heap->vm_count; i++) {
+        publish_counts(heap, heap->vms[i]);
+        memset(heap->vms[i]->tlab, 0, sizeof(heap->vms[i]->tlab));
+    }
+    size_t before_bytes = heap->bytes_allocated;
+
+    shared_mark(vm, heap);
+
+    long freed = 0;
+    size_t freed_bytes = 0;
+    sweep_large(&heap->large_objects, false, &freed, &freed_bytes);
+    sweep_classes(heap->size_classes, &freed, &freed_bytes);
+    heap->num_objects -= freed;
+    heap->bytes_allocated -= freed_bytes;
+
+    double survival;
+    heap->next_gc_bytes = policy_trigger(&heap->policy, heap->bytes_allocated,
+                                         before_bytes, &survival);
+
+    GCSharedHeapStats *stats = &heap->stats;
+    double pause = gc_now_us() - start;
+    stats->collections++;
+    stats->objects_surviving = heap->num_objects;
+    stats->bytes_surviving = heap->bytes_allocated;
+    stats->stop_us += stopped - start;
+    stats->pause_us += pause;
+    if (pause > stats->max_pause_us) stats->max_pause_us = pause;
+
+    if (vm->gc_verbose) {
+        fprintf(stderr, "[GC] shared: %ld objects freed, %ld surviving, "
+                "%d threads stopped in %.1f us, %.1f us\n",
+                freed, heap->num_objects, heap->vm_count - 1, stopped - start, pause);
+    }
+
+    __atomic_store_n(&heap->stopping, 0, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&heap->resume_cond);
+}
+
+static void shared_collect(VM *vm) {
+    GCSharedHeap *heap = vm->shared_heap;
+    pthread_mutex_lock(&heap->lock);
+    shared_collect_locked(vm);
+    pthread_mutex_unlock(&heap->lock);
+}
+
+/* Next chunk with a free slot; the caller owns it until the next collection */
+static HeapChunk* take_chunk(SizeClass *sc) {
+    while (sc->alloc) {
+        HeapChunk *chunk = sc->alloc;
+        sc->alloc = chunk->next;
+        if (chunk->free_list || chunk->used < chunk->capacity) return chunk;
+    }
+
+    HeapChunk *chunk = new_chunk(sc);
+    if (chunk) sc->alloc = NULL;
+    return chunk;
+}
+
+/* First free slot of the class, for allocation without TLABs */
+static Object* class_take(SizeClass *sc) {
+    while (sc->alloc) {
+        Object *obj = chunk_take(sc->alloc);
+        if (obj) return obj;
+        sc->alloc = sc->alloc->next;
+    }
+
+    HeapChunk *chunk = new_chunk(sc);
+    return chunk ? chunk_take(chunk) : NULL;
+}
+
+/* Everything that needs the heap lock: a new TLAB, a large object, or any allocation without TLABs */
+static Object* alloc_shared_locked(VM *vm, ObjectType type, size_t size) {
+    GCSharedHeap *heap = vm->shared_heap;
+    Object *obj = NULL;
+
+    pthread_mutex_lock(&heap->lock);
+    heap->stats.lock_acquisitions++;
+    publish_counts(heap, vm);
+
+    /* Safepoint */
+    if (__atomic_load_n(&heap->stopping, __ATOMIC_RELAXED)) {
+        park(heap);
+    } else if (vm->auto_gc && heap->bytes_allocated + size >= heap->next_gc_bytes) {
+        shared_collect_locked(vm);
+    }
+
+    if (size > GC_LARGE_OBJECT_BYTES) {
+        obj = alloc_large_object(&heap->large_objects, size);
+    } else {
+        int size_class = size_class_of(type, size);
+        SizeClass *sc = &heap->size_classes[size_class];
+        if (heap->tlabs) {
+            HeapChunk *chunk = take_chunk(sc);
+            vm->tlab[size_class] = chunk;
+            heap->stats.tlab_refills++;
+            if (chunk) obj = chunk_take(chunk);
+        } else {
+            obj = class_take(sc);
+        }
+    }
+
+    pthread_mutex_unlock(&heap->lock);
+    return obj;
+}
+
+static Object* alloc_shared_object(VM *vm, ObjectType type, size_t size) {
+    if (size <= GC_LARGE_OBJECT_BYTES) {
+        HeapChunk *tlab = vm->tlab[size_class_of(type, size)];
+        if (tlab) {
+            Object *obj = chunk_take(tlab);
+            if (obj) return obj;
+        }
+    }
+    return alloc_shared_locked(vm, type, size);
+}
+
+/*
+ * Create a heap for VMs on several threads. Pacing is by bytes; there is no
+ * hard limit, since VMs only report what they allocate when they take a
+ * new buffer.
+ */
+GCSharedHeap* gc_shared_heap_create(const GCHeapPolicy *policy) {
+    GCHeapPolicy defaults;
+    if (policy == NULL) {
+        gc_default_heap_policy(&defaults);
+        policy = &defaults;
+    }
+    if (policy->pacing != GC_PACING_BYTES || policy->max_heap > 0) {
+        fprintf(stderr, "Error: A shared heap paces by bytes and has no maximum size\n");
+        return NULL;
+    }
+    if (policy->growth_factor <= 1.0) {
+        fprintf(stderr, "Error: GC growth factor must be greater than 1\n");
+        return NULL;
+    }
+
+    GCSharedHeap *heap = (GCSharedHeap*)calloc(1, sizeof(GCSharedHeap));
+    if (!heap) {
+        fprintf(stderr, "Error: Out of memory for shared heap\n");
+        return NULL;
+    }
+    pthread_mutex_init(&heap->lock, NULL);
+    pthread_cond_init(&heap->parked_cond, NULL);
+    pthread_cond_init(&heap->resume_cond, NULL);
+    heap->tlabs = true;
+    init_size_classes(heap->size_classes);
+    heap->policy = *policy;
+    heap->next_gc_bytes = first_trigger(policy);
+    return heap;
+}
+
+/* Free the heap and every object in it; all VMs must have detached */
+void gc_shared_heap_destroy(GCSharedHeap *heap) {
+    if (heap == NULL) return;
+    if (heap->vm_count > 0) {
+        fprintf(stderr, "Error: %d VMs are still attached to the shared heap\n", heap->vm_count);
+        return;
+    }
+
+    for (int i = 0; i < GC_SIZE_CLASSES; i++) {
+        free_chunks(&heap->size_classes[i]);
+    }
+    while (heap->large_objects) {
+        LargeObject *next = heap->large_objects->next;
+        free(heap->large_objects);
+        heap->large_objects = next;
+    }
+    object_stack_free(&heap->weak_objects);
+    free(heap->vms);
+    pthread_mutex_destroy(&heap->lock);
+    pthread_cond_destroy(&heap->parked_cond);
+    pthread_cond_destroy(&heap->resume_cond);
+    free(heap);
+}
+
+/* With TLABs off every allocation takes the heap lock; for comparison only */
+bool gc_shared_heap_set_tlabs(GCSharedHeap *heap, bool enabled) {
+    pthread_mutex_lock(&heap->lock);
+    bool ok = heap->vm_count == 0;
+    if (ok) {
+        heap->tlabs = enabled;
+    } else {
+        fprintf(stderr, "Error: Set TLABs before any VM attaches\n");
+    }
+    pthread_mutex_unlock(&heap->lock);
+    return ok;
+}
+
+/* Allocate from the shared heap from now on; the VM must not have allocated yet */
+bool gc_shared_heap_attach(VM *vm, GCSharedHeap *heap) {
+    if (vm->shared_heap) {
+        fprintf(stderr, "Error: VM is already attached to a shared heap\n");
+        return false;
+    }
+    if (vm->num_objects > 0 || vm->gc_mode != GC_MODE_MARK_SWEEP) {
+        fprintf(stderr, "Error: Only an empty mark-sweep VM can attach to a shared heap\n");
+        return false;
+    }
+
+    pthread_mutex_lock(&heap->lock);
+
+    /* A collection that is waiting for the others to park does not wait for this one */
+    while (__atomic_load_n(&heap->stopping, __ATOMIC_RELAXED)) {
+        pthread_cond_wait(&heap->resume_cond, &heap->lock);
+    }
+    if (heap->vm_count == heap->vm_capacity) {
+        int capacity = heap->vm_capacity < 8 ? 8 : heap->vm_capacity * 2;
+        VM **vms = (VM**)realloc(heap->vms, capacity * sizeof(VM*));
+        if (!vms) {
+            pthread_mutex_unlock(&heap->lock);
+            fprintf(stderr, "Error: Out of memory attaching to shared heap\n");
+            return false;
+        }
+        heap->vms = vms;
+        heap->vm_capacity = capacity;
+    }
+    heap->vms[heap->vm_count++] = vm;
+    vm->shared_heap = heap;
+    memset(vm->tlab, 0, sizeof(vm->tlab));
+    pthread_mutex_unlock(&heap->lock);
+    return true;
+}
+
+/*
+ * Leave the shared heap. The VM's value stack stops being a root, its weak
+ * objects are handed to the heap, and its sampled objects (if profiling)
+ * are no longer followed. Objects stay in the shared heap.
+ */
+void gc_shared_heap_detach(VM *vm) {
+    GCSharedHeap *heap = vm->shared_heap;
+    if (heap == NULL) return;
+
+    pthread_mutex_lock(&heap->lock);
+    publish_counts(heap, vm);
+    for (int i = 0; i < vm->weak_objects.count; i++) {
+        object_stack_push(&heap->weak_objects, vm->weak_objects.items[i]);
+    }
+    vm->weak_objects.count = 0;
+    if (vm->profile) vm->profile->sample_count = 0;
+
+    for (int i = 0; i < heap->vm_count; i++) {
+        if (heap->vms[i] == vm) {
+            heap->vms[i] = heap->vms[--heap->vm_count];
+            break;
+        }
+    }
+    vm->shared_heap = NULL;
+    memset(vm->tlab, 0, sizeof(vm->tlab));
+
+    /* A collection waiting for this VM to park can go ahead */
+    pthread_cond_signal(&heap->parked_cond);
+    pthread_mutex_unlock(&heap->lock);
+}
+
+void gc_shared_heap_stats(GCSharedHeap *heap, GCSharedHeapStats *out) {
+    pthread_mutex_lock(&heap->lock);
+    *out = heap->stats;
+    pthread_mutex_unlock(&heap->lock);
+}
+
+/* Park here if another thread is waiting to collect; cheap otherwise */
+void gc_safepoint(VM *vm) {
+    GCSharedHeap *heap = vm->shared_heap;
+    if (heap == NULL || !__atomic_load_n(&heap->stopping, __ATOMIC_ACQUIRE)) return;
+
+    pthread_mutex_lock(&heap->lock);
+    if (__atomic_load_n(&heap->stopping, __ATOMIC_RELAXED)) {
+        park(heap);
+    }
+    pthread_mutex_unlock(&heap->lock);
 }
 
 void push(VM *vm, Value val) {
@@ -166,3 +2393,206 @@ void gc(VM *vm) {
 void gc_set_auto_collect(VM *vm, bool enabled) {
     vm->auto_gc = enabled;
 }
+
+/*
+ * Switch collector strategy. An incremental cycle in progress is finished
+ * first; leaving generational mode evacuates the nursery.
+ */
+void gc_set_mode(VM *vm, GCMode mode) {
+    if (vm->shared_heap && mode != GC_MODE_MARK_SWEEP) {
+        fprintf(stderr, "Error: A VM on a shared heap only supports mark-sweep\n");
+        return;
+    }
+    if (vm->gc_phase != GC_PHASE_IDLE) {
+        incremental_slice(vm, 0);
+    }
+    gc_finish_sweep(vm);
+    if (vm->gc_mode == GC_MODE_GENERATIONAL && mode != GC_MODE_GENERATIONAL) {
+        minor_collect(vm);
+        free(vm->nursery);
+        vm->nursery = NULL;
+    }
+    vm->gc_mode = mode;
+}
+
+/* Resize the nursery; live young objects are promoted first */
+void gc_set_nursery_size(VM *vm, int objects) {
+    if (objects < 1) objects = 1;
+    if (vm->nursery_top > 0) {
+        minor_collect(vm);
+    }
+    free(vm->nursery);
+    vm->nursery = NULL;
+    vm->nursery_capacity = (size_t)objects * gc_type_size(OBJ_PAIR);
+}
+
+/* Maximum time a single incremental slice may run */
+void gc_set_pause_target(VM *vm, double max_pause_us) {
+    if (max_pause_us < 1.0) max_pause_us = 1.0;
+    vm->pause_target_us = max_pause_us;
+}
+
+/*
+ * Sweep full collections on a background thread. Ignored in incremental
+ * mode, which sweeps in slices.
+ */
+void gc_set_background_sweep(VM *vm, bool enabled) {
+    if (!enabled) {
+        gc_finish_sweep(vm);
+    }
+    vm->background_sweep = enabled;
+}
+
+void gc_default_heap_policy(GCHeapPolicy *policy) {
+    policy->pacing = GC_PACING_BYTES;
+    policy->min_heap = GC_DEFAULT_MIN_HEAP;
+    policy->max_heap = 0;
+    policy->target_heap = GC_DEFAULT_TARGET_HEAP;
+    policy->soft_limit = 0;
+    policy->growth_factor = GC_DEFAULT_GROWTH_FACTOR;
+}
+
+/*
+ * Install a heap policy. Invalid settings are rejected with an error and
+ * leave the current policy in place.
+ */
+bool gc_set_heap_policy(VM *vm, const GCHeapPolicy *policy) {
+    if (policy->growth_factor <= 1.0) {
+        fprintf(stderr, "Error: GC growth factor must be greater than 1\n");
+        return false;
+    }
+    if (policy->max_heap > 0 && policy->min_heap > policy->max_heap) {
+        fprintf(stderr, "Error: Minimum heap exceeds maximum heap\n");
+        return false;
+    }
+    if (policy->max_heap > 0 && policy->target_heap > policy->max_heap) {
+        fprintf(stderr, "Error: Target heap exceeds maximum heap\n");
+        return false;
+    }
+
+    vm->heap_policy = *policy;
+
+    /* Until a collection measures survival, aim for the target size */
+    size_t trigger = first_trigger(policy);
+    if (trigger < vm->bytes_allocated) trigger = vm->bytes_allocated;
+    vm->next_gc_bytes = trigger;
+    return true;
+}
+
+/* Switch only the trigger policy, keeping the other settings */
+void gc_set_pacing(VM *vm, GCPacing pacing) {
+    vm->heap_policy.pacing = pacing;
+}
+
+/* Compact on every n-th full collection (0 = only through gc_compact) */
+void gc_set_compact_interval(VM *vm, int collections) {
+    vm->compact_interval = collections < 0 ? 0 : collections;
+    vm->collections_since_compact = 0;
+}
+
+/* Threads used by the mark phase of full collections (1 = serial) */
+void gc_set_mark_threads(VM *vm, int threads) {
+    if (threads < 1) threads = 1;
+    if (threads > GC_MAX_MARK_THREADS) threads = GC_MAX_MARK_THREADS;
+    vm->mark_threads = threads;
+}
+
+/* Optional cap on objects marked or swept per slice (0 = time budget only) */
+void gc_set_slice_work(VM *vm, int objects) {
+    vm->slice_work = objects < 0 ? 0 : objects;
+}
+
+/* Upper bound of the histogram bucket holding the given percentile */
+double gc_pause_percentile(VM *vm, double percentile) {
+    GCPauseHistogram *h = &vm->gc_stats.pauses;
+    if (h->count == 0) return 0.0;
+
+    long rank = (long)(h->count * percentile / 100.0 + 0.5);
+    if (rank < 1) rank = 1;
+
+    long seen = 0;
+    double bound = 1.0;
+    for (int i = 0; i < GC_PAUSE_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            return bound < h->max_us ? bound : h->max_us;
+        }
+        bound *= 2.0;
+    }
+    return h->max_us;
+}
+
+void gc_print_pause_histogram(VM *vm, FILE *out) {
+    GCPauseHistogram *h = &vm->gc_stats.pauses;
+    double bound = 1.0;
+
+    fprintf(out, "GC pauses: %ld, total %.1f us, max %.1f us\n",
+            h->count, h->total_us, h->max_us);
+    for (int i = 0; i < GC_PAUSE_BUCKETS; i++) {
+        if (h->buckets[i] > 0) {
+            fprintf(out, "  < %10.0f us: %ld\n", bound, h->buckets[i]);
+        }
+        bound *= 2.0;
+    }
+    fprintf(out, "  p50 <= %.0f us, p99 <= %.0f us\n",
+            gc_pause_percentile(vm, 50.0), gc_pause_percentile(vm, 99.0));
+}
+
+const GCStats* gc_get_stats(VM *vm) {
+    return &vm->gc_stats;
+}
+
+void gc_reset_stats(VM *vm) {
+    memset(&vm->gc_stats, 0, sizeof(GCStats));
+}
+
+/* Called after every full, minor and incremental cycle (NULL to disable) */
+void gc_set_event_callback(VM *vm, GCEventCallback callback, void *user_data) {
+    vm->gc_callback = callback;
+    vm->gc_callback_data = user_data;
+}
+
+/* Log one line per cycle to stderr; off by default */
+void gc_set_verbose(VM *vm, bool enabled) {
+    vm->gc_verbose = enabled;
+}
+
+void gc_write_stats_json(VM *vm, FILE *out) {
+    const GCStats *stats = &vm->gc_stats;
+    const GCPauseHistogram *h = &stats->pauses;
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"collections\": %ld,\n", stats->collections);
+    fprintf(out, "  \"minor_collections\": %ld,\n", stats->minor_collections);
+    fprintf(out, "  \"incremental_cycles\": %ld,\n", stats->incremental_cycles);
+    fprintf(out, "  \"allocated\": {\"objects\": %ld, \"bytes\": %zu},\n",
+            stats->objects_allocated, stats->bytes_allocated);
+    fprintf(out, "  \"freed\": {\"objects\": %ld, \"bytes\": %zu},\n",
+            stats->objects_freed, stats->bytes_freed);
+    fprintf(out, "  \"surviving\": {\"objects\": %ld, \"bytes\": %zu},\n",
+            stats->objects_surviving, stats->bytes_surviving);
+    fprintf(out, "  \"heap\": {\"bytes\": %zu, \"peak_bytes\": %zu, \"next_gc_bytes\": %zu},\n",
+            vm->bytes_allocated, vm->peak_bytes, vm->next_gc_bytes);
+    fprintf(out, "  \"phase_us\": {\"roots\": %.1f, \"mark\": %.1f, \"sweep\": %.1f},\n",
+            stats->roots_us, stats->mark_us, stats->sweep_us);
+    fprintf(out, "  \"pauses\": {\n");
+    fprintf(out, "    \"count\": %ld, \"total_us\": %.1f, \"max_us\": %.1f,\n",
+            h->count, h->total_us, h->max_us);
+    fprintf(out, "    \"p50_us\": %.0f, \"p99_us\": %.0f,\n",
+            gc_pause_percentile(vm, 50.0), gc_pause_percentile(vm, 99.0));
+    fprintf(out, "    \"histogram\": [");
+
+    bool first = true;
+    double bound = 1.0;
+    for (int i = 0; i < GC_PAUSE_BUCKETS; i++) {
+        if (h->buckets[i] > 0) {
+            fprintf(out, "%s{\"below_us\": %.0f, \"count\": %ld}",
+                    first ? "" : ", ", bound, h->buckets[i]);
+            first = false;
+        }
+        bound *= 2.0;
+    }
+    fprintf(out, "]\n");
+    fprintf(out, "  }\n");
+    fprintf(out, "}\n");
+}
@@ -1,6 +1,8 @@
 #ifndef GC_H
 #define GC_H
 
+#include <stdio.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -10,13 +12,76 @@ struct VM;
 typedef enum {
     OBJ_PAIR,
     OBJ_FUNCTION,
-    OBJ_CLOSURE
+    OBJ_CLOSURE,
+    OBJ_MAP,                /* Hash table; entries live in OBJ_ARRAY tables */
+    OBJ_WEAK,               /* Weak reference: does not keep its target alive */
+    OBJ_ARRAY,              /* Variable length: Values stored inline */
+    OBJ_BYTES               /* Variable length: raw bytes, never traced */
 } ObjectType;
 
+#define GC_FIXED_CLASSES 5                 /* One size class per fixed-size type */
+#define GC_VARIABLE_CLASSES 8              /* Arrays and byte strings: 16 .. 2048-byte slots */
+#define GC_SIZE_CLASSES (GC_FIXED_CLASSES + GC_VARIABLE_CLASSES)
+#define GC_LARGE_OBJECT_BYTES 2048         /* Bigger objects go to the large-object space */
+
+/* Collector strategies selectable per VM with gc_set_mode() */
+typedef enum {
+    GC_MODE_MARK_SWEEP,     /* Stop-the-world mark-sweep of the whole heap */
+    GC_MODE_GENERATIONAL,   /* Bump-allocated nursery + promoted old generation */
+    GC_MODE_INCREMENTAL     /* Tri-color marking and sweeping in bounded slices */
+} GCMode;
+
+/* Progress of an incremental collection cycle */
+typedef enum {
+    GC_PHASE_IDLE,
+    GC_PHASE_MARK,
+    GC_PHASE_SWEEP
+} GCPhase;
+
+#define GC_NURSERY_SIZE 4096               /* Default nursery capacity, in pairs */
+#define GC_INCREMENTAL_STEP 256            /* Allocations between incremental slices */
+#define GC_DEFAULT_PAUSE_TARGET_US 1000.0  /* Default maximum incremental pause */
+#define GC_PAUSE_BUCKETS 32
+#define GC_MAX_MARK_THREADS 64             /* Upper bound for gc_set_mark_threads */
+#define GC_CHUNK_BYTES (32 * 1024)        /* Slot space in each heap chunk */
+
+/* Heap pacing defaults */
+#define GC_DEFAULT_MIN_HEAP (256 * 1024)      /* Never trigger below this many bytes */
+#define GC_DEFAULT_TARGET_HEAP (1024 * 1024)  /* Heap size before the first collection */
+#define GC_DEFAULT_GROWTH_FACTOR 2.0
+#define GC_MIN_HEADROOM (4 * 1024)            /* Minimum bytes between live heap and trigger */
+
+/* Object flag bits */
+#define OBJ_FLAG_REMEMBERED 0x01  /* Old object recorded in the remembered set */
+#define OBJ_FLAG_FORWARDED  0x02  /* Object promoted or compacted; see forward */
+#define OBJ_FLAG_FROZEN     0x04  /* In a read-only frozen segment; see gc_freeze */
+
+typedef enum {
+    VAL_INT,
+    VAL_OBJ
+} ValueType;
+
+typedef struct Value {
+    ValueType type;
+    union {
+        int32_t int_val;
+        struct Object *obj_val;
+    };
+} Value;
+
+/*
+ * Every object starts with a one-word header: type, mark and flag bytes and
+ * the identity hash used when the object is a map key (0 until first used).
+ * Objects are allocated at the exact size of their type, or of their
+ * contents for arrays and byte strings (gc_object_size, rounded up to 8
+ * bytes), so only the union member for obj->type may be accessed, and
+ * objects must never be copied with a struct assignment.
+ */
 typedef struct Object {
+    uint8_t type;           /* ObjectType */
     bool marked;
-    ObjectType type;
-    struct Object *next;
+    uint8_t flags;
+    uint32_t hash;          /* Identity hash; survives promotion and compaction */
 
     union {
         struct {
@@ -32,21 +97,236 @@ typedef struct Object {
             struct Object *fn;
             struct Object *env;
         } closure;
+
+        /*
+         * Open-addressed table of key/value pairs. While the table grows,
+         * entries move from old_table to table a few slots per update.
+         * Free slots have the key VAL_OBJ(NULL).
+         */
+        struct {
+            struct Object *table;      /* OBJ_ARRAY: key, value, key, value ... */
+            struct Object *old_table;  /* Table being drained; NULL when not resizing */
+            uint32_t count;            /* Live entries in both tables */
+            uint32_t tombstones;       /* Deleted slots in table */
+            uint32_t migrated;         /* Slots of old_table already moved */
+            bool weak_keys;            /* Ephemeron table; see new_weak_map */
+        } map;
+
+        struct {
+            struct Object *target;     /* NULL once the target has been collected */
+        } weak;
+
+        struct {
+            uint32_t length;
+            Value items[];
+        } array;
+
+        struct {
+            uint32_t length;
+            unsigned char data[];
+        } bytes;
+
+        /* New location of an object that has been moved by the collector */
+        struct Object *forward;
     };
 } Object;
 
+/* Growable stack of object pointers (remembered set, gray stack, scan queues) */
+typedef struct {
+    Object **items;
+    int count;
+    int capacity;
+} ObjectStack;
+
+/* What triggers a collection */
 typedef enum {
-    VAL_INT,
-    VAL_OBJ
-} ValueType;
+    GC_PACING_OBJECTS,      /* Legacy: num_objects >= max_objects, doubled after each GC */
+    GC_PACING_BYTES         /* bytes_allocated >= next_gc_bytes, from GCHeapPolicy */
+} GCPacing;
 
-typedef struct Value {
-    ValueType type;
-    union {
-        int32_t int_val;
-        Object *obj_val;
-    };
-} Value;
+/* Heap growth policy; sizes in bytes, 0 = no limit for max_heap/soft_limit */
+typedef struct {
+    GCPacing pacing;
+    size_t min_heap;        /* Lowest trigger, so small heaps do not thrash */
+    size_t max_heap;        /* Hard limit: allocation fails beyond it */
+    size_t target_heap;     /* Trigger before the first collection */
+    size_t soft_limit;      /* Trigger never set above this (heap may still exceed it) */
+    double growth_factor;   /* Trigger = live bytes * growth, adjusted for survival */
+} GCHeapPolicy;
+
+/*
+ * Slab of equally sized slots for one size class. Slots below `used` hold
+ * an object or sit on the free list; the rest have never been handed out.
+ */
+typedef struct HeapChunk {
+    struct HeapChunk *next;
+    unsigned char *slots;
+    int slot_size;
+    int capacity;              /* Slots in the chunk */
+    int used;                  /* Bump index of the first never-used slot */
+    int live;                  /* Slots holding objects */
+    Object *free_list;         /* Dead slots, linked through forward */
+    int swept;                 /* Current sweep has passed this chunk (atomic) */
+} HeapChunk;
+
+/* All chunks of one size class */
+typedef struct {
+    HeapChunk *chunks;
+    HeapChunk *tail;
+    HeapChunk *alloc;          /* Chunks before this one are full */
+    int slot_size;
+    int chunk_count;
+} SizeClass;
+
+/*
+ * Object bigger than GC_LARGE_OBJECT_BYTES, allocated on its own. Large
+ * objects are never placed in the nursery and never moved by promotion or
+ * compaction; the object follows this header.
+ */
+typedef struct LargeObject {
+    struct LargeObject *next;
+    size_t size;               /* gc_object_size of the object */
+} LargeObject;
+
+/* Position of a walk over the heap; see gc_heap_first */
+typedef struct {
+    struct VM *vm;
+    int size_class;            /* GC_SIZE_CLASSES once in the large-object space */
+    HeapChunk *chunk;
+    int slot;
+    LargeObject *large;
+} HeapIterator;
+
+/* Log2 histogram of collector pauses; bucket i counts pauses below 2^i us */
+typedef struct {
+    long count;
+    double total_us;
+    double max_us;
+    long buckets[GC_PAUSE_BUCKETS];
+} GCPauseHistogram;
+
+/* State shared between the mutator and one background sweeper thread */
+typedef struct BackgroundSweep BackgroundSweep;
+
+/* Heap that VMs on several threads allocate from; see gc_shared_heap_create */
+typedef struct GCSharedHeap GCSharedHeap;
+
+/* Kind of collection reported to the stats and the event callback */
+typedef enum {
+    GC_EVENT_FULL,          /* Full mark-sweep (or compacting) collection */
+    GC_EVENT_MINOR,         /* Nursery evacuation */
+    GC_EVENT_INCREMENTAL    /* Completed incremental cycle (many slices) */
+} GCEventKind;
+
+/* One finished collection */
+typedef struct {
+    GCEventKind kind;
+    double roots_us;        /* Scanning the value stack (and remembered set) */
+    double mark_us;
+    double sweep_us;        /* Sweep, or copy for compaction; handoff only if background */
+    double pause_us;        /* Mutator-visible time, summed over slices if incremental */
+    long objects_freed;
+    size_t bytes_freed;
+    long objects_surviving;
+    size_t bytes_surviving;
+    bool compacted;
+    bool background_sweep;
+} GCCycleStats;
+
+/* Running totals since the VM was created (or gc_reset_stats) */
+typedef struct {
+    long collections;           /* Full collections */
+    long minor_collections;
+    long incremental_cycles;
+    long objects_allocated;
+    size_t bytes_allocated;
+    long objects_freed;
+    size_t bytes_freed;
+    long objects_surviving;     /* After the latest collection */
+    size_t bytes_surviving;
+    double roots_us;            /* Time per phase, summed over all cycles */
+    double mark_us;
+    double sweep_us;
+    GCCycleStats last;
+    GCPauseHistogram pauses;    /* Every pause, including incremental slices */
+} GCStats;
+
+/* Running totals of a shared heap */
+typedef struct {
+    long collections;
+    long tlab_refills;          /* Chunks handed to a VM to allocate from */
+    long lock_acquisitions;     /* Allocations that took the heap lock */
+    long objects_surviving;     /* After the latest collection */
+    size_t bytes_allocated;     /* As published by the VMs */
+    size_t bytes_surviving;
+    double stop_us;             /* Waiting for every mutator to reach a safepoint */
+    double pause_us;            /* Whole collections, including stop_us */
+    double max_pause_us;
+} GCSharedHeapStats;
+
+/* Read-only copy of a constant object graph, shared by any number of VMs */
+typedef struct {
+    void *memory;              /* Page-aligned, read-only */
+    size_t size;               /* Bytes mapped (whole pages) */
+    Object *root;              /* Copy of the object passed to gc_freeze */
+    long objects;
+    size_t bytes;              /* Bytes in objects */
+} GCFrozenSegment;
+
+typedef void (*GCEventCallback)(struct VM *vm, const GCCycleStats *cycle, void *user_data);
+
+/* What the allocation profiler counts between samples */
+typedef enum {
+    GC_SAMPLE_BYTES,        /* One sample per interval bytes on average, randomized */
+    GC_SAMPLE_OBJECTS       /* Every interval-th object; each allocation calls the profiler */
+} GCSampleUnit;
+
+#define GC_PROFILE_DEFAULT_INTERVAL (64 * 1024)  /* Bytes between samples */
+#define GC_PROFILE_MAX_FRAMES 8                  /* Callers kept per site */
+
+/*
+ * Allocation site: the instruction that allocated (-1 outside vm_run), the
+ * CALL instructions it was reached through, innermost first, and the type
+ * allocated. Object and byte counts are estimates scaled up from samples.
+ */
+typedef struct {
+    int32_t pc;
+    int32_t callers[GC_PROFILE_MAX_FRAMES];
+    int depth;                 /* Callers recorded */
+    uint8_t type;              /* ObjectType */
+    long samples;
+    uint64_t objects;          /* Estimated objects allocated */
+    uint64_t bytes;            /* Estimated bytes allocated */
+    long survived;             /* Samples that outlived the first collection after them */
+    long died;                 /* Samples freed by that collection */
+    long live;                 /* Samples still in the heap */
+    uint64_t live_bytes;       /* Estimated bytes those stand for */
+} GCAllocSite;
+
+/* A sampled object, followed until it is freed */
+typedef struct {
+    Object *obj;
+    uint32_t site;
+    uint8_t state;             /* Collections seen; see profile.c */
+    uint64_t weight;           /* Estimated bytes it stands for */
+} GCSample;
+
+/* Sampling allocation profiler; see gc_profile_start */
+typedef struct {
+    GCSampleUnit unit;
+    size_t interval;
+    long objects_left;         /* Object mode: allocations before the next sample */
+    uint64_t rng;
+    GCAllocSite *sites;
+    int site_count;
+    int site_capacity;
+    uint32_t *site_index;      /* Open-addressed: site number + 1, 0 if free */
+    uint32_t index_capacity;
+    GCSample *samples;         /* Sampled objects still in the heap */
+    int sample_count;
+    int sample_capacity;
+    long total_samples;
+} GCProfile;
 
 #define VAL_OBJ(obj) ((Value){.type = VAL_OBJ, .obj_val = (obj)})
 #define VAL_INT(val) ((Value){.type = VAL_INT, .int_val = (val)})
@@ -58,15 +338,143 @@ void gc_cleanup(struct VM *vm);
 Object* new_pair(struct VM *vm, Object *left, Object *right);
 Object* new_function(struct VM *vm);
 Object* new_closure(struct VM *vm, Object *fn, Object *env);
+Object* new_array(struct VM *vm, int length);
+Object* new_bytes(struct VM *vm, int length);
 void gc_mark_object(Object *obj);
 void gc_mark_roots(struct VM *vm);
 void gc_sweep(struct VM *vm);
+long gc_parallel_mark(struct VM *vm, int threads);
 void gc_collect(struct VM *vm);
+void gc_minor_collect(struct VM *vm);
+void gc_compact(struct VM *vm);
+void gc_incremental_step(struct VM *vm);
 void push(struct VM *vm, Value val);
 Value pop(struct VM *vm);
 void gc(struct VM *vm);
 
+/*
+ * Field stores. Code that updates a field of an existing object must go
+ * through these so the generational collector sees old->young pointers
+ * and the incremental marker never hides a white object behind a black one.
+ * They return false, and store nothing, when the object is frozen.
+ */
+void gc_write_barrier(struct VM *vm, Object *owner, Object *value);
+bool pair_set_left(struct VM *vm, Object *pair, Object *value);
+bool pair_set_right(struct VM *vm, Object *pair, Object *value);
+bool closure_set_fn(struct VM *vm, Object *closure, Object *fn);
+bool closure_set_env(struct VM *vm, Object *closure, Object *env);
+bool array_set(struct VM *vm, Object *array, uint32_t index, Value value);
+
+/*
+ * Maps. Keys are integers or objects compared by identity (not NULL).
+ * map_set may allocate a bigger table, so in generational mode the map
+ * must be rooted on the value stack and re-read afterwards.
+ */
+Object* new_map(struct VM *vm);
+bool map_get(Object *map, Value key, Value *value);
+bool map_set(struct VM *vm, Object *map, Value key, Value value);
+bool map_delete(struct VM *vm, Object *map, Value key);
+uint32_t gc_identity_hash(struct VM *vm, Object *obj);
+void map_drop_dead_keys(struct VM *vm, Object *map);  /* Collector: unmarked keys */
+
+/*
+ * Weak references and weak-keyed maps. A weak reference does not keep its
+ * target alive; the collector sets it to NULL when the target dies. In a
+ * weak-keyed map an entry's value is kept alive only while its object key
+ * is reachable from elsewhere, and entries whose key dies are removed
+ * (integer keys are held strongly). Minor collections treat weak-map
+ * entries as strong; full collections clear them.
+ */
+Object* new_weak_ref(struct VM *vm, Object *target);
+Object* weak_get(Object *weak);
+Object* new_weak_map(struct VM *vm);
+
 /* Control automatic GC triggering */
 void gc_set_auto_collect(struct VM *vm, bool enabled);
 
+/* Collector strategy */
+void gc_set_mode(struct VM *vm, GCMode mode);
+void gc_set_nursery_size(struct VM *vm, int objects);
+bool gc_in_nursery(struct VM *vm, Object *obj);
+void gc_set_pause_target(struct VM *vm, double max_pause_us);
+void gc_set_slice_work(struct VM *vm, int objects);
+void gc_set_mark_threads(struct VM *vm, int threads);
+void gc_set_background_sweep(struct VM *vm, bool enabled);
+bool gc_sweep_in_progress(struct VM *vm);
+void gc_finish_sweep(struct VM *vm);
+void gc_set_compact_interval(struct VM *vm, int collections);
+
+/* Heap layout */
+size_t gc_object_size(Object *obj);
+size_t gc_type_size(ObjectType type);
+bool gc_is_large(Object *obj);
+Object* gc_heap_first(struct VM *vm, HeapIterator *it);
+Object* gc_heap_next(HeapIterator *it);
+
+/* Heap pacing */
+void gc_default_heap_policy(GCHeapPolicy *policy);
+bool gc_set_heap_policy(struct VM *vm, const GCHeapPolicy *policy);
+void gc_set_pacing(struct VM *vm, GCPacing pacing);
+
+/* Statistics and reporting */
+double gc_pause_percentile(struct VM *vm, double percentile);
+void gc_print_pause_histogram(struct VM *vm, FILE *out);
+const GCStats* gc_get_stats(struct VM *vm);
+void gc_reset_stats(struct VM *vm);
+void gc_set_event_callback(struct VM *vm, GCEventCallback callback, void *user_data);
+void gc_set_verbose(struct VM *vm, bool enabled);
+void gc_write_stats_json(struct VM *vm, FILE *out);
+
+/*
+ * Shared heap. Each VM is driven by one thread, and each thread attaches at
+ * most one VM. An attached VM allocates from chunks it owns (thread-local
+ * allocation buffers) without locking; collection is stop-the-world
+ * mark-sweep over every attached VM's value stack, run by whichever thread
+ * triggers it once all others have parked at a safepoint: an allocation
+ * that needs a new buffer, gc_safepoint, or a jump or call in vm_run. A
+ * thread that stops running its VM for a while must detach it (its stack
+ * then no longer keeps objects alive). The VM's own mode, pacing and
+ * compaction settings do not apply while it is attached, and gc_heap_first
+ * and snapshots see only its private heap.
+ */
+GCSharedHeap* gc_shared_heap_create(const GCHeapPolicy *policy);  /* NULL = defaults */
+void gc_shared_heap_destroy(GCSharedHeap *heap);
+bool gc_shared_heap_set_tlabs(GCSharedHeap *heap, bool enabled);  /* false: lock every allocation */
+bool gc_shared_heap_attach(struct VM *vm, GCSharedHeap *heap);
+void gc_shared_heap_detach(struct VM *vm);
+void gc_shared_heap_stats(GCSharedHeap *heap, GCSharedHeapStats *out);
+void gc_safepoint(struct VM *vm);
+
+/*
+ * Frozen segments. gc_freeze copies the graph reachable from root into
+ * read-only pages; the copies can be pushed on any VM's value stack, from
+ * any thread, and are never marked, swept or moved. The original graph is
+ * left in vm's heap. Weak references and weak maps cannot be frozen;
+ * objects already frozen are shared, not copied. A segment must outlive
+ * every heap object that points into it.
+ */
+GCFrozenSegment* gc_freeze(struct VM *vm, Object *root);
+void gc_frozen_destroy(GCFrozenSegment *segment);
+bool gc_is_frozen(Object *obj);
+
+/* Heap snapshot for offline analysis; format in snapshot.h */
+bool gc_write_snapshot(struct VM *vm, const char *path);
+
+/*
+ * Allocation profiler. Samples allocations every interval bytes or objects
+ * (0 = GC_PROFILE_DEFAULT_INTERVAL bytes) and records for each the
+ * allocating pc and call stack; the report lists sites by estimated bytes
+ * allocated, with the share of sampled objects that survived a collection.
+ * Starting again discards earlier samples.
+ */
+bool gc_profile_start(struct VM *vm, GCSampleUnit unit, size_t interval);
+void gc_profile_stop(struct VM *vm);
+void gc_profile_report(struct VM *vm, FILE *out, int max_sites);  /* max_sites 0 = all */
+
+/* Collector hooks, in profile.c */
+void gc_profile_sample(struct VM *vm, Object *obj, size_t size);
+void gc_profile_after_mark(struct VM *vm);
+void gc_profile_after_minor(struct VM *vm);
+void gc_profile_after_compact(struct VM *vm);
+
 #endif
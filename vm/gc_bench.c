@@ -0,0 +1,760 @@
+/*
+ * GC Benchmarks
+ *
+ * Purpose: Compare collector strategies on allocation-heavy workloads.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "vm.h"  /* Includes gc.h automatically */
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static const char* mode_name(GCMode mode) {
+    switch (mode) {
+        case GC_MODE_MARK_SWEEP:   return "mark-sweep";
+        case GC_MODE_GENERATIONAL: return "generational";
+        case GC_MODE_INCREMENTAL:  return "incremental";
+        default:                   return "unknown";
+    }
+}
+
+/* Build a complete binary tree of pairs; partial results are kept rooted */
+static Object* make_tree(VM *vm, int depth) {
+    if (depth == 0) return new_pair(vm, NULL, NULL);
+    push(vm, VAL_OBJ(make_tree(vm, depth - 1)));
+    Object *right = make_tree(vm, depth - 1);
+    Object *left = pop(vm).obj_val;
+    return new_pair(vm, left, right);
+}
+
+/*
+ * Churn: a 10000-cell long-lived list plus 2M short-lived pairs built as
+ * 10-cell temporary lists. Almost everything dies young.
+ */
+static void churn_workload(VM *vm) {
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < 10000; i++) {
+        vm->value_stack[0] = VAL_OBJ(new_pair(vm, NULL, vm->value_stack[0].obj_val));
+    }
+
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < 2000000; i++) {
+        if (i % 10 == 0) {
+            vm->value_stack[1] = VAL_OBJ(NULL);
+        }
+        vm->value_stack[1] = VAL_OBJ(new_pair(vm, NULL, vm->value_stack[1].obj_val));
+    }
+}
+
+static double bench_churn(GCMode mode) {
+    VM *vm = vm_create();
+    gc_set_mode(vm, mode);
+
+    double start = now_ms();
+    churn_workload(vm);
+    double elapsed = now_ms() - start;
+
+    vm_destroy(vm);
+    return elapsed;
+}
+
+/*
+ * Trees: one long-lived depth-16 tree (65535 pairs) while 500 short-lived
+ * depth-10 trees are built and dropped.
+ */
+static double bench_trees(GCMode mode) {
+    VM *vm = vm_create();
+    gc_set_mode(vm, mode);
+
+    double start = now_ms();
+
+    push(vm, VAL_OBJ(make_tree(vm, 16)));
+    for (int i = 0; i < 500; i++) {
+        make_tree(vm, 10);
+    }
+
+    double elapsed = now_ms() - start;
+    vm_destroy(vm);
+    return elapsed;
+}
+
+/*
+ * Latency: a large live heap (depth-17 tree, 131071 pairs) while 1M
+ * short-lived pairs are allocated. Reports the pause distribution.
+ */
+static void latency_workload(VM *vm) {
+    push(vm, VAL_OBJ(make_tree(vm, 17)));
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < 1000000; i++) {
+        if (i % 10 == 0) {
+            vm->value_stack[1] = VAL_OBJ(NULL);
+        }
+        vm->value_stack[1] = VAL_OBJ(new_pair(vm, NULL, vm->value_stack[1].obj_val));
+    }
+}
+
+static void bench_pauses(const char *name, GCMode mode, bool background_sweep) {
+    VM *vm = vm_create();
+    gc_set_mode(vm, mode);
+    gc_set_background_sweep(vm, background_sweep);
+
+    latency_workload(vm);
+
+    printf("%-14s %8ld %10.0f %10.0f %10.0f %12.1f\n", name,
+            vm->gc_stats.pauses.count, gc_pause_percentile(vm, 50.0),
+            gc_pause_percentile(vm, 99.0), vm->gc_stats.pauses.max_us,
+            vm->gc_stats.pauses.total_us / 1000.0);
+    vm_destroy(vm);
+}
+
+/* Phases: where the collector spends its time on the latency workload */
+static void bench_phases(GCMode mode) {
+    VM *vm = vm_create();
+    gc_set_mode(vm, mode);
+
+    latency_workload(vm);
+
+    const GCStats *stats = gc_get_stats(vm);
+    printf("%-14s %8ld %8ld %8ld %10.1f %10.1f %10.1f\n", mode_name(mode),
+           stats->collections, stats->minor_collections, stats->incremental_cycles,
+           stats->roots_us / 1000.0, stats->mark_us / 1000.0, stats->sweep_us / 1000.0);
+    vm_destroy(vm);
+}
+
+/*
+ * Mark scaling: time gc_parallel_mark over a large heap with 1..8 threads.
+ * Marks are reset by a sweep (untimed) between runs.
+ */
+static double time_mark(VM *vm, int threads) {
+    const int runs = 5;
+    double total = 0.0;
+    for (int i = 0; i < runs; i++) {
+        double start = now_ms();
+        gc_parallel_mark(vm, threads);
+        total += now_ms() - start;
+        gc_sweep(vm);
+    }
+    return total / runs;
+}
+
+static void bench_mark_scaling(const char *name, VM *vm) {
+    double base = 0.0;
+    for (int threads = 1; threads <= 8; threads *= 2) {
+        double ms = time_mark(vm, threads);
+        if (threads == 1) base = ms;
+        printf("%-22s %8d %10.1f %8.2fx\n", name, threads, ms, base / ms);
+    }
+}
+
+static void bench_parallel_mark(void) {
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    /* Pair graph: depth-20 tree, 1048575 pairs */
+    push(vm, VAL_OBJ(make_tree(vm, 20)));
+    bench_mark_scaling("pairs (1M, tree)", vm);
+    pop(vm);
+    gc_collect(vm);
+
+    /* Wide closures: 250000 closures with their own environments on a list */
+    Object *fn = new_function(vm);
+    push(vm, VAL_OBJ(fn));
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < 250000; i++) {
+        Object *env = new_pair(vm, NULL, NULL);
+        Object *cl = new_closure(vm, fn, env);
+        vm->value_stack[1] = VAL_OBJ(new_pair(vm, cl, vm->value_stack[1].obj_val));
+    }
+    bench_mark_scaling("closures (750K)", vm);
+
+    vm_destroy(vm);
+}
+
+/* Walk a list through pair.right; returns cells visited */
+static long walk_list(Object *cell) {
+    long length = 0;
+    while (cell) {
+        length++;
+        cell = cell->pair.right;
+    }
+    return length;
+}
+
+static double time_walk(VM *vm, int runs) {
+    double start = now_ms();
+    long cells = 0;
+    for (int i = 0; i < runs; i++) {
+        cells += walk_list(vm->value_stack[0].obj_val);
+    }
+    return (now_ms() - start) * 1e6 / cells;
+}
+
+/*
+ * Locality: a 500000-cell list linked in random order, each cell next to a
+ * dead object, so consecutive cells are scattered over the malloc heap as
+ * after a long run. Traversal time per cell is measured before and after
+ * gc_compact.
+ */
+static void bench_compaction(void) {
+    const int cells = 500000;
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    Object **all = (Object**)malloc(cells * sizeof(Object*));
+    for (int i = 0; i < cells; i++) {
+        all[i] = new_pair(vm, NULL, NULL);
+        new_pair(vm, NULL, NULL);  /* dead neighbour of every cell */
+    }
+    srand(1);
+    for (int i = cells - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        Object *tmp = all[i];
+        all[i] = all[j];
+        all[j] = tmp;
+    }
+    for (int i = 0; i + 1 < cells; i++) {
+        pair_set_right(vm, all[i], all[i + 1]);
+    }
+    push(vm, VAL_OBJ(all[0]));
+    free(all);
+
+    double before = time_walk(vm, 10);
+    double start = now_ms();
+    gc_compact(vm);
+    double compact_ms = now_ms() - start;
+    double after = time_walk(vm, 10);
+
+    printf("%-22s %12.2f %12.2f %8.1fx %12.1f\n", "list (500K, shuffled)",
+            before, after, before / after, compact_ms);
+    vm_destroy(vm);
+}
+
+/*
+ * Pacing: total GC time under the legacy object-count trigger and the
+ * byte-based policy, on a small heap with heavy churn, a mid-size steady
+ * heap (100 / 10000 live cells, 2M short-lived pairs each) and a heap
+ * that grows to a depth-18 tree.
+ */
+static void churn_with_live_list(VM *vm, int live, int garbage) {
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < live; i++) {
+        vm->value_stack[0] = VAL_OBJ(new_pair(vm, NULL, vm->value_stack[0].obj_val));
+    }
+    for (int i = 0; i < garbage; i++) {
+        new_pair(vm, NULL, NULL);
+    }
+}
+
+static void bench_pacing_run(int workload, GCPacing pacing) {
+    static const char *names[] = {"small", "steady", "growing"};
+    VM *vm = vm_create();
+    gc_set_pacing(vm, pacing);
+
+    switch (workload) {
+        case 0: churn_with_live_list(vm, 100, 2000000); break;
+        case 1: churn_with_live_list(vm, 10000, 2000000); break;
+        default: push(vm, VAL_OBJ(make_tree(vm, 18))); break;
+    }
+
+    printf("%-10s %-8s %8ld %12.1f %12zu\n", names[workload],
+            pacing == GC_PACING_OBJECTS ? "objects" : "bytes",
+            vm->gc_stats.pauses.count, vm->gc_stats.pauses.total_us / 1000.0, vm->peak_bytes / 1024);
+    vm_destroy(vm);
+}
+
+static void bench_pacing(void) {
+    for (int i = 0; i < 3; i++) {
+        bench_pacing_run(i, GC_PACING_OBJECTS);
+        bench_pacing_run(i, GC_PACING_BYTES);
+    }
+}
+
+/*
+ * Arrays vs pair lists: the same 1M integers held in one array, and in a
+ * list of pairs whose cells each point to the integer boxed in a 4-byte
+ * byte string (pairs hold only objects). Times building, summing (10
+ * passes) and reads at random indexes.
+ */
+#define SEQ_LENGTH 1000000
+#define SEQ_LOOKUPS 200
+
+static int32_t box_value(Object *box) {
+    int32_t value;
+    memcpy(&value, box->bytes.data, sizeof(value));
+    return value;
+}
+
+static int64_t sum_list(Object *cell) {
+    int64_t sum = 0;
+    for (; cell; cell = cell->pair.right) {
+        sum += box_value(cell->pair.left);
+    }
+    return sum;
+}
+
+static int32_t list_get(Object *cell, int index) {
+    while (index-- > 0) cell = cell->pair.right;
+    return box_value(cell->pair.left);
+}
+
+static int64_t sum_array(Object *array) {
+    int64_t sum = 0;
+    for (uint32_t i = 0; i < array->array.length; i++) {
+        sum += array->array.items[i].int_val;
+    }
+    return sum;
+}
+
+static void bench_sequence(bool use_array) {
+    VM *vm = vm_create();
+    int64_t sum = 0;
+
+    double start = now_ms();
+    if (use_array) {
+        push(vm, VAL_OBJ(new_array(vm, SEQ_LENGTH)));
+        Object *array = vm->value_stack[0].obj_val;
+        for (int i = 0; i < SEQ_LENGTH; i++) {
+            array_set(vm, array, i, VAL_INT(i % 1000));
+        }
+    } else {
+        /* Built back to front so cell i holds value i */
+        push(vm, VAL_OBJ(NULL));
+        for (int i = SEQ_LENGTH - 1; i >= 0; i--) {
+            int32_t value = i % 1000;
+            Object *box = new_bytes(vm, sizeof(value));
+            memcpy(box->bytes.data, &value, sizeof(value));
+            vm->value_stack[0] = VAL_OBJ(new_pair(vm, box, vm->value_stack[0].obj_val));
+        }
+    }
+    double build_ms = now_ms() - start;
+
+    Object *seq = vm->value_stack[0].obj_val;
+    start = now_ms();
+    for (int pass = 0; pass < 10; pass++) {
+        sum += use_array ? sum_array(seq) : sum_list(seq);
+    }
+    double sum_ms = now_ms() - start;
+
+    srand(1);
+    start = now_ms();
+    for (int i = 0; i < SEQ_LOOKUPS; i++) {
+        int index = rand() % SEQ_LENGTH;
+        sum += use_array ? seq->array.items[index].int_val : list_get(seq, index);
+    }
+    double lookup_us = (now_ms() - start) * 1000.0 / SEQ_LOOKUPS;
+
+    printf("%-12s %10.1f %10.1f %12.3f %10d %10zu   (checksum %lld)\n",
+            use_array ? "array" : "pair list", build_ms, sum_ms, lookup_us,
+            vm->num_objects, vm->bytes_allocated / 1024, (long long)sum);
+    vm_destroy(vm);
+}
+
+/*
+ * Maps: insert n integer keys, look up n random keys, delete half of them.
+ * The slowest single map_set shows the cost of growing the table, which is
+ * spread over later updates rather than paid in one rehash. At 1K entries
+ * an association list (pairs of boxed key and value) is timed for
+ * comparison.
+ */
+static Object* box_int(VM *vm, int32_t value) {
+    Object *box = new_bytes(vm, sizeof(value));
+    memcpy(box->bytes.data, &value, sizeof(value));
+    return box;
+}
+
+static void bench_map(int entries) {
+    VM *vm = vm_create();
+    int64_t sum = 0;
+    double worst_us = 0;
+
+    double start = now_ms();
+    push(vm, VAL_OBJ(new_map(vm)));
+    for (int i = 0; i < entries; i++) {
+        double op = now_ms();
+        map_set(vm, vm->value_stack[0].obj_val, VAL_INT(i), VAL_INT(i % 1000));
+        double us = (now_ms() - op) * 1000.0;
+        if (us > worst_us) worst_us = us;
+    }
+    double insert_ns = (now_ms() - start) * 1e6 / entries;
+
+    Object *map = vm->value_stack[0].obj_val;
+    srand(1);
+    start = now_ms();
+    for (int i = 0; i < entries; i++) {
+        Value value;
+        if (map_get(map, VAL_INT(rand() % entries), &value)) sum += value.int_val;
+    }
+    double lookup_ns = (now_ms() - start) * 1e6 / entries;
+
+    start = now_ms();
+    for (int i = 0; i < entries; i += 2) {
+        map_delete(vm, map, VAL_INT(i));
+    }
+    double delete_ns = (now_ms() - start) * 1e6 / (entries / 2);
+
+    printf("%-10s %9d %10.1f %10.1f %10.1f %12.1f %10zu   (checksum %lld)\n",
+            "map", entries, insert_ns, lookup_ns, delete_ns, worst_us,
+            vm->bytes_allocated / 1024, (long long)sum);
+    vm_destroy(vm);
+}
+
+static void bench_assoc_list(int entries) {
+    VM *vm = vm_create();
+    int64_t sum = 0;
+
+    /* Each cell: left = (key box . value box), right = next cell */
+    double start = now_ms();
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < entries; i++) {
+        push(vm, VAL_OBJ(box_int(vm, i)));
+        Object *value = box_int(vm, i % 1000);
+        Object *entry = new_pair(vm, pop(vm).obj_val, value);
+        vm->value_stack[0] = VAL_OBJ(new_pair(vm, entry, vm->value_stack[0].obj_val));
+    }
+    double insert_ns = (now_ms() - start) * 1e6 / entries;
+
+    srand(1);
+    start = now_ms();
+    for (int i = 0; i < entries; i++) {
+        int32_t key = rand() % entries;
+        for (Object *cell = vm->value_stack[0].obj_val; cell; cell = cell->pair.right) {
+            if (box_value(cell->pair.left->pair.left) == key) {
+                sum += box_value(cell->pair.left->pair.right);
+                break;
+            }
+        }
+    }
+    double lookup_ns = (now_ms() - start) * 1e6 / entries;
+
+    printf("%-10s %9d %10.1f %10.1f %10s %12s %10zu   (checksum %lld)\n",
+            "assoc list", entries, insert_ns, lookup_ns, "-", "-",
+            vm->bytes_allocated / 1024, (long long)sum);
+    vm_destroy(vm);
+}
+
+/*
+ * Memoization cache under load: a stream of requests, each with its own key
+ * object that stays in use for the next WINDOW requests, caches a 128-byte
+ * result keyed by that object. With a strong map the cache (and the heap)
+ * grows with every request; with a weak-keyed map entries go once their
+ * key is dropped. Reports the peak heap, the heap after a final full
+ * collection and the entries left in the cache.
+ */
+#define MEMO_REQUESTS 500000
+#define MEMO_WINDOW 1000
+#define MEMO_RESULT_BYTES 128
+
+static void bench_memo_cache(bool weak, GCMode mode) {
+    VM *vm = vm_create();
+    gc_set_mode(vm, mode);
+
+    /* value_stack[0]: cache, [1]: ring of keys in use */
+    double start = now_ms();
+    push(vm, VAL_OBJ(weak ? new_weak_map(vm) : new_map(vm)));
+    push(vm, VAL_OBJ(new_array(vm, MEMO_WINDOW)));
+    for (int i = 0; i < MEMO_REQUESTS; i++) {
+        Object *key = new_pair(vm, NULL, NULL);
+        array_set(vm, vm->value_stack[1].obj_val, i % MEMO_WINDOW, VAL_OBJ(key));
+        Object *result = new_bytes(vm, MEMO_RESULT_BYTES);
+        Value moved = vm->value_stack[1].obj_val->array.items[i % MEMO_WINDOW];  /* May have been promoted */
+        map_set(vm, vm->value_stack[0].obj_val, moved, VAL_OBJ(result));
+    }
+    double elapsed = now_ms() - start;
+
+    gc(vm);
+    printf("%-8s %-14s %10.1f %8ld %10zu %10zu %9u\n",
+            weak ? "weak" : "strong", mode_name(mode), elapsed,
+            vm->gc_stats.pauses.count, vm->peak_bytes / 1024,
+            vm->bytes_allocated / 1024, vm->value_stack[0].obj_val->map.count);
+    vm_destroy(vm);
+}
+
+/*
+ * Allocation profiler overhead: the churn workload with the profiler off,
+ * at the default interval and at a dense one. Runs are interleaved and the
+ * best of PROFILE_RUNS is kept, so machine noise hits all three alike.
+ */
+#define PROFILE_RUNS 11
+
+static double time_profiled_churn(GCMode mode, size_t interval, long *samples) {
+    VM *vm = vm_create();
+    gc_set_mode(vm, mode);
+    if (interval > 0) {
+        gc_profile_start(vm, GC_SAMPLE_BYTES, interval);
+    }
+
+    double start = now_ms();
+    churn_workload(vm);
+    double elapsed = now_ms() - start;
+
+    *samples = vm->profile ? vm->profile->total_samples : 0;
+    vm_destroy(vm);
+    return elapsed;
+}
+
+static void bench_profiler(GCMode mode) {
+    size_t intervals[] = {0, GC_PROFILE_DEFAULT_INTERVAL, 4096};
+    double best[3] = {1e30, 1e30, 1e30};
+    long samples[3];
+
+    for (int run = 0; run < PROFILE_RUNS; run++) {
+        for (int i = 0; i < 3; i++) {
+            double ms = time_profiled_churn(mode, intervals[i], &samples[i]);
+            if (ms < best[i]) best[i] = ms;
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        char interval[32];
+        if (intervals[i] == 0) {
+            snprintf(interval, sizeof(interval), "off");
+        } else {
+            snprintf(interval, sizeof(interval), "%zu KB", intervals[i] / 1024);
+        }
+        printf("%-14s %10s %10.1f %9.1f%% %9ld\n", mode_name(mode), interval, best[i],
+               100.0 * (best[i] - best[0]) / best[0], samples[i]);
+    }
+}
+
+/*
+ * Shared heap allocation throughput: SHARED_ALLOCS pairs split evenly over
+ * 1 to 32 threads, each with its own VM on one shared heap. The threads
+ * keep 1000 cells between them and drop the rest in 10-cell lists.
+ * With TLABs off every allocation takes the heap lock.
+ */
+#define SHARED_ALLOCS 4000000
+
+typedef struct {
+    GCSharedHeap *heap;
+    int allocs;
+} SharedWorker;
+
+static void* shared_worker_run(void *arg) {
+    SharedWorker *w = (SharedWorker*)arg;
+    VM *vm = vm_create();
+    gc_shared_heap_attach(vm, w->heap);
+
+    push(vm, VAL_OBJ(NULL));
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < w->allocs; i++) {
+        int slot = i % (SHARED_ALLOCS / 1000) == 0 ? 0 : 1;
+        if (i % 10 == 0) vm->value_stack[1] = VAL_OBJ(NULL);
+        vm->value_stack[slot] = VAL_OBJ(new_pair(vm, NULL, vm->value_stack[slot].obj_val));
+    }
+
+    vm_destroy(vm);
+    return NULL;
+}
+
+static double time_shared_heap(int threads, bool tlabs, GCSharedHeapStats *stats) {
+    GCSharedHeap *heap = gc_shared_heap_create(NULL);
+    gc_shared_heap_set_tlabs(heap, tlabs);
+
+    pthread_t ids[32];
+    SharedWorker workers[32];
+    double start = now_ms();
+    for (int i = 0; i < threads; i++) {
+        workers[i] = (SharedWorker){heap, SHARED_ALLOCS / threads};
+        pthread_create(&ids[i], NULL, shared_worker_run, &workers[i]);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(ids[i], NULL);
+    }
+    double elapsed = now_ms() - start;
+
+    gc_shared_heap_stats(heap, stats);
+    gc_shared_heap_destroy(heap);
+    return elapsed;
+}
+
+static void bench_shared_heap(void) {
+    for (int threads = 1; threads <= 32; threads *= 2) {
+        GCSharedHeapStats with, without;
+        double tlab_ms = time_shared_heap(threads, true, &with);
+        double locked_ms = time_shared_heap(threads, false, &without);
+        printf("%8d %12.1f %12.1f %8.2fx %8ld %10.2f %10.1f\n", threads,
+               SHARED_ALLOCS / tlab_ms / 1000.0, SHARED_ALLOCS / locked_ms / 1000.0,
+               locked_ms / tlab_ms, with.collections,
+               1000.0 * with.lock_acquisitions / SHARED_ALLOCS,
+               with.collections > 0 ? with.stop_us / with.collections : 0.0);
+    }
+}
+
+/*
+ * Frozen constants: each of FROZEN_VMS VMs needs the same table of
+ * FROZEN_ENTRIES records (a map from id to a 4-element array). Built
+ * privately, every VM pays for it at startup and traces it in every full
+ * collection of the churn workload (the live table also raises the heap
+ * trigger, so there are fewer of them); frozen once, a VM only pushes the
+ * root.
+ */
+#define FROZEN_VMS 8
+#define FROZEN_ENTRIES 20000
+
+static Object* build_table(VM *vm) {
+    Object *map = new_map(vm);
+    push(vm, VAL_OBJ(map));
+    for (int i = 0; i < FROZEN_ENTRIES; i++) {
+        Object *record = new_array(vm, 4);
+        for (int j = 0; j < 4; j++) {
+            record->array.items[j] = VAL_INT(i * 4 + j);
+        }
+        map_set(vm, vm->value_stack[vm->stack_count - 1].obj_val, VAL_INT(i), VAL_OBJ(record));
+    }
+    return pop(vm).obj_val;
+}
+
+typedef struct {
+    double startup_ms;
+    size_t heap_bytes;       /* After startup */
+    double collections;      /* Full collections during the churn workload */
+    double mark_us;          /* Mark time per collection */
+} FrozenRun;
+
+static FrozenRun run_with_table(GCFrozenSegment *seg) {
+    FrozenRun run;
+    VM *vm = vm_create();
+
+    double start = now_ms();
+    push(vm, VAL_OBJ(seg ? seg->root : build_table(vm)));
+    run.startup_ms = now_ms() - start;
+    run.heap_bytes = vm->bytes_allocated;
+
+    churn_workload(vm);
+    const GCStats *stats = gc_get_stats(vm);
+    run.collections = stats->collections;
+    run.mark_us = stats->collections > 0 ? stats->mark_us / stats->collections : 0.0;
+    vm_destroy(vm);
+    return run;
+}
+
+static void bench_frozen(void) {
+    FrozenRun private_runs = {0, 0, 0, 0};
+    FrozenRun frozen_runs = {0, 0, 0, 0};
+
+    VM *builder = vm_create();
+    double start = now_ms();
+    Object *table = build_table(builder);
+    double build_ms = now_ms() - start;
+    start = now_ms();
+    GCFrozenSegment *seg = gc_freeze(builder, table);
+    double freeze_ms = now_ms() - start;
+    vm_destroy(builder);
+
+    for (int i = 0; i < FROZEN_VMS; i++) {
+        FrozenRun p = run_with_table(NULL);
+        FrozenRun f = run_with_table(seg);
+        private_runs.startup_ms += p.startup_ms / FROZEN_VMS;
+        private_runs.heap_bytes += p.heap_bytes / FROZEN_VMS;
+        private_runs.collections += p.collections / FROZEN_VMS;
+        private_runs.mark_us += p.mark_us / FROZEN_VMS;
+        frozen_runs.startup_ms += f.startup_ms / FROZEN_VMS;
+        frozen_runs.heap_bytes += f.heap_bytes / FROZEN_VMS;
+        frozen_runs.collections += f.collections / FROZEN_VMS;
+        frozen_runs.mark_us += f.mark_us / FROZEN_VMS;
+    }
+
+    printf("%-10s %12s %12s %8s %12s\n", "per VM", "startup ms", "heap KB", "GCs", "mark us/GC");
+    printf("%-10s %12.2f %12zu %8.0f %12.1f\n", "private", private_runs.startup_ms,
+           private_runs.heap_bytes / 1024, private_runs.collections, private_runs.mark_us);
+    printf("%-10s %12.4f %12zu %8.0f %12.1f\n", "frozen", frozen_runs.startup_ms,
+           frozen_runs.heap_bytes / 1024, frozen_runs.collections, frozen_runs.mark_us);
+    printf("One-time: build %.2f ms, freeze %.2f ms, segment %zu KB (%ld objects)\n",
+           build_ms, freeze_ms, seg->size / 1024, seg->objects);
+    gc_frozen_destroy(seg);
+}
+
+int main() {
+    GCMode modes[] = {GC_MODE_MARK_SWEEP, GC_MODE_GENERATIONAL, GC_MODE_INCREMENTAL};
+    int num_modes = sizeof(modes) / sizeof(modes[0]);
+
+    printf("=======================================\n");
+    printf("  GC Benchmarks\n");
+    printf("=======================================\n\n");
+
+    printf("%-14s %12s %12s\n", "mode", "churn (ms)", "trees (ms)");
+    for (int i = 0; i < num_modes; i++) {
+        double churn = bench_churn(modes[i]);
+        double trees = bench_trees(modes[i]);
+        printf("%-14s %12.1f %12.1f\n", mode_name(modes[i]), churn, trees);
+    }
+
+    printf("\nPauses with 131071 live pairs (us):\n");
+    printf("%-14s %8s %10s %10s %10s %12s\n",
+            "mode", "pauses", "p50", "p99", "max", "total (ms)");
+    for (int i = 0; i < num_modes; i++) {
+        bench_pauses(mode_name(modes[i]), modes[i], false);
+    }
+    bench_pauses("mark-sweep+bg", GC_MODE_MARK_SWEEP, true);
+
+    printf("\nTime per phase, same workload (ms):\n");
+    printf("%-14s %8s %8s %8s %10s %10s %10s\n",
+           "mode", "full", "minor", "incr", "roots", "mark", "sweep");
+    for (int i = 0; i < num_modes; i++) {
+        bench_phases(modes[i]);
+    }
+
+    printf("\nParallel mark scaling:\n");
+    printf("%-22s %8s %10s %9s\n", "heap", "threads", "mark (ms)", "speedup");
+    bench_parallel_mark();
+
+    printf("\nTraversal before/after compaction:\n");
+    printf("%-22s %12s %12s %9s %12s\n",
+            "heap", "before ns", "after ns", "speedup", "compact ms");
+    bench_compaction();
+
+    printf("\nPacing policies (mark-sweep):\n");
+    printf("%-10s %-8s %8s %12s %12s\n",
+            "workload", "policy", "GCs", "GC time ms", "peak KB");
+    bench_pacing();
+
+    printf("\nArray vs pair list, 1M integers:\n");
+    printf("%-12s %10s %10s %12s %10s %10s\n",
+            "layout", "build ms", "sum ms", "us/lookup", "objects", "heap KB");
+    bench_sequence(true);
+    bench_sequence(false);
+
+    printf("\nMaps with integer keys:\n");
+    printf("%-10s %9s %10s %10s %10s %12s %10s\n",
+            "layout", "entries", "set ns", "get ns", "del ns", "worst set us", "heap KB");
+    bench_assoc_list(1000);
+    bench_map(1000);
+    bench_map(1000000);
+    bench_map(10000000);
+
+    printf("\nMemoization cache, %d requests, %d keys in use:\n", MEMO_REQUESTS, MEMO_WINDOW);
+    printf("%-8s %-14s %10s %8s %10s %10s %9s\n",
+            "cache", "mode", "total ms", "GCs", "peak KB", "live KB", "entries");
+    bench_memo_cache(false, GC_MODE_MARK_SWEEP);
+    bench_memo_cache(true, GC_MODE_MARK_SWEEP);
+    bench_memo_cache(true, GC_MODE_GENERATIONAL);
+    bench_memo_cache(true, GC_MODE_INCREMENTAL);
+
+    printf("\nAllocation profiler on the churn workload (best of %d):\n", PROFILE_RUNS);
+    printf("%-14s %10s %10s %10s %9s\n", "mode", "interval", "ms", "overhead", "samples");
+    for (int i = 0; i < num_modes; i++) {
+        bench_profiler(modes[i]);
+    }
+
+    printf("\nShared heap, %d pairs over N threads (%ld CPUs):\n",
+           SHARED_ALLOCS, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%8s %12s %12s %9s %8s %10s %10s\n", "threads", "TLAB M/s", "locked M/s",
+           "speedup", "GCs", "locks/1K", "stop us");
+    bench_shared_heap();
+
+    printf("\nFrozen constant table, %d records shared by %d VMs:\n",
+           FROZEN_ENTRIES, FROZEN_VMS);
+    bench_frozen();
+
+    return 0;
+}
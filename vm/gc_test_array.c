@@ -0,0 +1,314 @@
+/*
+ * Array and Byte String Tests
+ *
+ * Purpose: Verify variable-length objects: sizes and size classes, tracing
+ * of array elements, the large-object space (never in the nursery, never
+ * moved by compaction), and array elements under the generational and
+ * incremental collectors.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "vm.h"  /* Includes gc.h automatically */
+
+static int count_large(VM *vm) {
+    int count = 0;
+    for (LargeObject *large = vm->large_objects; large; large = large->next) {
+        count++;
+    }
+    return count;
+}
+
+void test_sizes_and_classes() {
+    printf("Test: Object Sizes and Size Classes\n");
+    printf("-----------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    Object *array = new_array(vm, 3);
+    assert(array->type == OBJ_ARRAY && array->array.length == 3);
+    assert(gc_object_size(array) == gc_type_size(OBJ_ARRAY) + 3 * sizeof(Value));
+    for (int i = 0; i < 3; i++) {
+        assert(array->array.items[i].type == VAL_INT && array->array.items[i].int_val == 0);
+    }
+    printf("Array of 3: %zu bytes, elements start as 0\n", gc_object_size(array));
+
+    Object *bytes = new_bytes(vm, 5);
+    assert(bytes->type == OBJ_BYTES && bytes->bytes.length == 5);
+    assert(gc_object_size(bytes) % 8 == 0);
+    assert(gc_object_size(bytes) >= gc_type_size(OBJ_BYTES) + 5);
+    printf("Byte string of 5: %zu bytes\n", gc_object_size(bytes));
+
+    /* Small objects share power-of-two classes after the fixed ones */
+    int used = 0;
+    for (int i = GC_FIXED_CLASSES; i < GC_SIZE_CLASSES; i++) {
+        used += vm->size_classes[i].chunk_count;
+    }
+    assert(used == 2);
+    assert(vm->size_classes[OBJ_PAIR].chunk_count == 0);
+    assert(!gc_is_large(array) && !gc_is_large(bytes));
+    assert(vm->large_objects == NULL);
+    assert(new_array(vm, -1) == NULL);
+    printf("Both in variable size classes; negative length refused\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_elements_traced() {
+    printf("Test: Array Elements Keep Objects Alive\n");
+    printf("---------------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    push(vm, VAL_OBJ(new_array(vm, 10)));
+    for (int i = 0; i < 10; i++) {
+        Object *array = vm->value_stack[0].obj_val;
+        Object *cell = new_pair(vm, NULL, NULL);
+        array_set(vm, array, i, i % 2 ? VAL_OBJ(cell) : VAL_INT(i));
+    }
+    new_bytes(vm, 100);  /* garbage */
+    assert(vm->num_objects == 12);
+
+    gc(vm);
+    assert(vm->num_objects == 6);
+    Object *array = vm->value_stack[0].obj_val;
+    for (int i = 0; i < 10; i++) {
+        Value item = array->array.items[i];
+        if (i % 2) {
+            assert(item.type == VAL_OBJ && item.obj_val->type == OBJ_PAIR);
+        } else {
+            assert(item.type == VAL_INT && item.int_val == i);
+        }
+    }
+    printf("Array and its 5 pair elements survive; 5 pairs and the bytes freed\n");
+
+    pop(vm);
+    gc(vm);
+    assert(vm->num_objects == 0);
+    assert(vm->bytes_allocated == 0);
+    printf("Dropping the array frees everything\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_large_object_space() {
+    printf("Test: Large Objects Allocated and Freed Alone\n");
+    printf("---------------------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    push(vm, VAL_OBJ(new_array(vm, 1000)));
+    new_bytes(vm, 10000);  /* garbage */
+    Object *array = vm->value_stack[0].obj_val;
+    assert(gc_is_large(array));
+    assert(count_large(vm) == 2);
+    assert(vm->bytes_allocated == gc_object_size(array) + gc_type_size(OBJ_BYTES) + 10000);
+    printf("1000-element array and 10000-byte string in the large-object space\n");
+
+    int seen = 0;
+    HeapIterator it;
+    for (Object *obj = gc_heap_first(vm, &it); obj; obj = gc_heap_next(&it)) {
+        seen++;
+    }
+    assert(seen == 2);
+
+    gc(vm);
+    assert(count_large(vm) == 1);
+    assert(vm->num_objects == 1);
+    assert(array->marked == false);
+    printf("Dead byte string freed, array kept with its mark cleared\n");
+
+    pop(vm);
+    gc(vm);
+    assert(vm->large_objects == NULL);
+    assert(vm->bytes_allocated == 0);
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_compaction_leaves_large_in_place() {
+    printf("Test: Compaction Does Not Move Large Objects\n");
+    printf("--------------------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    /* Large array of pairs, with garbage between the pairs */
+    push(vm, VAL_OBJ(new_array(vm, 500)));
+    for (int i = 0; i < 500; i++) {
+        new_pair(vm, NULL, NULL);
+        Object *cell = new_pair(vm, NULL, NULL);
+        array_set(vm, vm->value_stack[0].obj_val, i, VAL_OBJ(cell));
+    }
+    Object *array = vm->value_stack[0].obj_val;
+
+    gc_compact(vm);
+    assert(vm->value_stack[0].obj_val == array);
+    assert(vm->num_objects == 501);
+    assert(vm->size_classes[OBJ_PAIR].chunks->live == 500);
+
+    /* Elements were forwarded to the packed copies */
+    Object *first = array->array.items[0].obj_val;
+    for (int i = 1; i < 500; i++) {
+        Object *cell = array->array.items[i].obj_val;
+        assert(cell->type == OBJ_PAIR && cell->marked == false);
+        assert((char*)cell == (char*)first + i * gc_type_size(OBJ_PAIR));
+    }
+    assert(array->marked == false);
+    printf("Array stays put; its 500 pairs packed back to back\n");
+
+    gc(vm);
+    assert(vm->num_objects == 501);
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_generational_arrays() {
+    printf("Test: Arrays in Generational Mode\n");
+    printf("---------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_mode(vm, GC_MODE_GENERATIONAL);
+
+    /* Small arrays start in the nursery and are promoted with their elements */
+    push(vm, VAL_OBJ(new_array(vm, 4)));
+    assert(gc_in_nursery(vm, vm->value_stack[0].obj_val));
+    array_set(vm, vm->value_stack[0].obj_val, 2, VAL_OBJ(new_pair(vm, NULL, NULL)));
+    gc_minor_collect(vm);
+    Object *small = vm->value_stack[0].obj_val;
+    assert(!gc_in_nursery(vm, small));
+    assert(small->array.items[2].obj_val->type == OBJ_PAIR);
+    assert(!gc_in_nursery(vm, small->array.items[2].obj_val));
+    printf("Small array promoted, element followed\n");
+
+    /* Large arrays go straight to the old generation */
+    push(vm, VAL_OBJ(new_array(vm, 1000)));
+    Object *large = vm->value_stack[1].obj_val;
+    assert(!gc_in_nursery(vm, large));
+
+    /* An old array holding a young object is remembered */
+    Object *young = new_pair(vm, NULL, NULL);
+    assert(gc_in_nursery(vm, young));
+    array_set(vm, large, 999, VAL_OBJ(young));
+    assert(large->flags & OBJ_FLAG_REMEMBERED);
+
+    gc_minor_collect(vm);
+    assert(vm->value_stack[1].obj_val == large);
+    Object *promoted = large->array.items[999].obj_val;
+    assert(promoted != young && !gc_in_nursery(vm, promoted));
+    assert(promoted->type == OBJ_PAIR);
+    printf("Large array stays in place; young element promoted through it\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_incremental_arrays() {
+    printf("Test: Arrays in Incremental Mode\n");
+    printf("--------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+    gc_set_mode(vm, GC_MODE_INCREMENTAL);
+    gc_set_slice_work(vm, 10);
+
+    /* A 100-cell list keeps the mark phase going for several slices */
+    push(vm, VAL_OBJ(new_array(vm, 300)));
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < 100; i++) {
+        vm->value_stack[1] = VAL_OBJ(new_pair(vm, NULL, vm->value_stack[1].obj_val));
+    }
+
+    /* Start marking, then store fresh objects into the (black) array */
+    gc_incremental_step(vm);
+    assert(vm->gc_phase == GC_PHASE_MARK);
+    Object *array = vm->value_stack[0].obj_val;
+    for (int i = 0; i < 300; i++) {
+        array_set(vm, array, i, VAL_OBJ(new_pair(vm, NULL, NULL)));
+    }
+    Object *late = new_array(vm, 1000);  /* large garbage allocated black */
+
+    while (vm->gc_phase != GC_PHASE_IDLE) {
+        gc_incremental_step(vm);
+    }
+    assert(vm->num_objects == 1 + 100 + 300 + 1);
+    assert(late->marked == false);
+    printf("300 stored elements survive the cycle\n");
+
+    gc_incremental_step(vm);
+    while (vm->gc_phase != GC_PHASE_IDLE) {
+        gc_incremental_step(vm);
+    }
+    assert(vm->num_objects == 401);
+    assert(count_large(vm) == 1);
+    printf("Next cycle frees the unreachable large array\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_background_sweep_large() {
+    printf("Test: Large Objects with Background Sweep\n");
+    printf("-----------------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+    gc_set_background_sweep(vm, true);
+
+    push(vm, VAL_OBJ(new_bytes(vm, 4096)));
+    for (int i = 0; i < 20; i++) {
+        new_array(vm, 200);
+    }
+
+    gc(vm);
+    gc_finish_sweep(vm);
+    assert(vm->num_objects == 1);
+    assert(count_large(vm) == 1);
+    assert(gc_get_stats(vm)->last.objects_freed == 20);
+    printf("20 large arrays freed and reported by the sweep\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+int main() {
+    printf("=======================================\n");
+    printf("  GC Array and Byte String Tests\n");
+    printf("=======================================\n\n");
+
+    test_sizes_and_classes();
+    test_elements_traced();
+    test_large_object_space();
+    test_compaction_leaves_large_in_place();
+    test_generational_arrays();
+    test_incremental_arrays();
+    test_background_sweep_large();
+
+    printf("=======================================\n");
+    printf("  All Tests PASSED\n");
+    printf("=======================================\n");
+
+    return 0;
+}
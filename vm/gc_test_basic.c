@@ -24,15 +24,16 @@ void test_basic_allocation() {
     gc_set_auto_collect(vm, false);
 
     /* Verify initial state */
+    HeapIterator it;
     assert(vm->num_objects == 0);
-    assert(vm->first_object == NULL);
+    assert(gc_heap_first(vm, &it) == NULL);
     printf("Initial state: 0 objects\n");
 
     /* Allocate a single pair */
     Object *a = new_pair(vm, NULL, NULL);
     assert(a != NULL);
     assert(vm->num_objects == 1);
-    assert(vm->first_object == a);
+    assert(gc_heap_first(vm, &it) == a);
     printf("After new_pair(NULL, NULL): 1 object\n");
 
     /* Allocate another pair */
@@ -49,20 +50,20 @@ void test_basic_allocation() {
     assert(vm->num_objects == 3);
     printf("After new_pair(a, b): 3 objects\n");
 
-    /* Verify the linked list */
+    /* Verify the heap walk */
     int count = 0;
-    Object *obj = vm->first_object;
+    Object *obj = gc_heap_first(vm, &it);
     while (obj) {
         count++;
-        obj = obj->next;
+        obj = gc_heap_next(&it);
     }
     assert(count == 3);
-    printf("Linked list verification: 3 objects found\n");
+    printf("Heap walk verification: 3 objects found\n");
 
     /* Cleanup */
     gc_cleanup(vm);
     assert(vm->num_objects == 0);
-    assert(vm->first_object == NULL);
+    assert(gc_heap_first(vm, &it) == NULL);
     printf("After cleanup: 0 objects\n");
 
     vm_destroy(vm);
@@ -89,15 +90,16 @@ void test_multiple_allocations() {
     assert(vm->num_objects == num_objects);
     printf("Allocated %d objects successfully\n", num_objects);
 
-    /* Verify all objects are in the linked list */
+    /* Verify all objects are found by a heap walk */
+    HeapIterator it;
     int count = 0;
-    Object *obj = vm->first_object;
+    Object *obj = gc_heap_first(vm, &it);
     while (obj) {
         count++;
-        obj = obj->next;
+        obj = gc_heap_next(&it);
     }
     assert(count == num_objects);
-    printf("Linked list contains all %d objects\n", count);
+    printf("Heap walk finds all %d objects\n", count);
 
     gc_cleanup(vm);
     vm_destroy(vm);
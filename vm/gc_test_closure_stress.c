@@ -1,6 +1,7 @@
 /*
  * Test 1.6.6: Closure Capture
  * Test 1.6.7: Stress Allocation
+ * Closure heap footprint with per-type object layouts
  */
 
 #include <stdio.h>
@@ -75,6 +76,48 @@ void test_stress_allocation() {
     printf("PASS Test 1.6.7\n\n");
 }
 
+/* Bytes per object before per-type layouts (header + next + largest member) */
+#define LEGACY_OBJECT_BYTES 32
+
+void test_closure_heap_footprint() {
+    printf("Test: Closure Heap Footprint\n");
+    printf("----------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    /* 333334 closures, each with its own function and environment pair;
+     * each environment points back at the previous closure */
+    const int closures = 333334;
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < closures; i++) {
+        Object *env = new_pair(vm, NULL, vm->value_stack[0].obj_val);
+        Object *fn = new_function(vm);
+        vm->value_stack[0] = VAL_OBJ(new_closure(vm, fn, env));
+    }
+
+    gc(vm);
+    long objects = vm->num_objects;
+    assert(objects == 3L * closures);
+
+    size_t expected = (size_t)closures * (gc_type_size(OBJ_CLOSURE) +
+                                          gc_type_size(OBJ_FUNCTION) +
+                                          gc_type_size(OBJ_PAIR));
+    assert(vm->bytes_allocated == expected);
+    assert(gc_type_size(OBJ_FUNCTION) < gc_type_size(OBJ_PAIR));
+
+    size_t legacy = (size_t)objects * LEGACY_OBJECT_BYTES;
+    printf("%ld objects: %zu bytes (%.1f per object), legacy layout %zu bytes\n",
+           objects, vm->bytes_allocated, (double)vm->bytes_allocated / objects, legacy);
+    printf("Saved per million objects: %.1f MB\n",
+           (legacy - vm->bytes_allocated) * (1000000.0 / objects) / 1e6);
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
 int main() {
     printf("=======================================\n");
     printf("  GC Closure & Stress Tests\n");
@@ -82,6 +125,7 @@ int main() {
 
     test_closure_capture();
     test_stress_allocation();
+    test_closure_heap_footprint();
 
     printf("=======================================\n");
     printf("  All Tests PASSED\n");
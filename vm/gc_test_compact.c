@@ -0,0 +1,296 @@
+/*
+ * Compaction Tests
+ *
+ * Purpose: Verify that compaction keeps every reachable object, updates
+ * roots and fields through forwarding pointers, lays related objects of
+ * each size class out next to each other, and packs survivors into as few
+ * chunks as possible, and that a collection which cannot reserve space
+ * to copy into sweeps in place instead.
+ *
+ * Note: compaction moves objects, so live objects are re-read from the
+ * value stack afterwards.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "vm.h"  /* Includes gc.h automatically */
+
+/*
+ * Lets a test make chunk allocations fail. This malloc replaces the C
+ * library's for the collector linked into this program; calloc is left
+ * alone and does the real work.
+ */
+static bool fail_chunks = false;
+
+void* malloc(size_t size) {
+    if (fail_chunks && size >= GC_CHUNK_BYTES) return NULL;
+    return calloc(1, size);
+}
+
+/* The object stored right after obj in its chunk */
+static Object* next_slot(Object *obj) {
+    return (Object*)((char*)obj + gc_object_size(obj));
+}
+
+void test_list_made_contiguous() {
+    printf("Test: Compaction Makes a List Contiguous\n");
+    printf("----------------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    /* 1000-cell list with garbage between the cells */
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < 1000; i++) {
+        new_pair(vm, NULL, NULL);
+        vm->value_stack[0] = VAL_OBJ(new_pair(vm, NULL, vm->value_stack[0].obj_val));
+        new_pair(vm, NULL, NULL);
+    }
+    assert(vm->num_objects == 3000);
+
+    gc_compact(vm);
+    assert(vm->num_objects == 1000);
+    assert(vm->size_classes[OBJ_PAIR].chunk_count == 1);
+    assert(vm->size_classes[OBJ_PAIR].chunks->live == 1000);
+
+    HeapIterator it;
+    Object *cell = vm->value_stack[0].obj_val;
+    assert(cell == gc_heap_first(vm, &it));
+    int length = 0;
+    while (cell) {
+        assert(cell->marked == false);
+        assert(cell->pair.right == NULL || cell->pair.right == next_slot(cell));
+        cell = cell->pair.right;
+        length++;
+    }
+    assert(length == 1000);
+    printf("1000 cells laid out back to back, 2000 garbage freed\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_fields_follow_owner() {
+    printf("Test: Fields Placed After Their Owner\n");
+    printf("-------------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    /* Closures over a 3-cell environment list, with garbage in between */
+    Object *fn = new_function(vm);
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < 10; i++) {
+        Object *env = NULL;
+        for (int j = 0; j < 3; j++) {
+            new_pair(vm, NULL, NULL);  /* garbage */
+            env = new_pair(vm, NULL, env);
+        }
+        Object *cl = new_closure(vm, fn, env);
+        vm->value_stack[0] = VAL_OBJ(new_pair(vm, cl, vm->value_stack[0].obj_val));
+    }
+
+    gc_compact(vm);
+    assert(vm->num_objects == 1 + 10 * 5);
+
+    /* The spine and every environment list are each contiguous */
+    Object *spine = vm->value_stack[0].obj_val;
+    Object *cl = spine->pair.left;
+    assert(cl->type == OBJ_CLOSURE);
+    assert(cl->closure.fn->type == OBJ_FUNCTION);
+    for (Object *cell = spine; cell->pair.right; cell = cell->pair.right) {
+        assert(cell->pair.right == next_slot(cell));
+        Object *env = cell->pair.left->closure.env;
+        assert(env->pair.right == next_slot(env));
+        assert(env->pair.right->pair.right == next_slot(env->pair.right));
+    }
+    printf("Spine and environment cells each laid out back to back\n");
+
+    /* Each type keeps its own chunks, sized to the type */
+    assert(gc_object_size(cl->closure.fn) < gc_object_size(cl));
+    assert(vm->size_classes[OBJ_FUNCTION].chunks->live == 1);
+    assert(vm->size_classes[OBJ_CLOSURE].chunks->live == 10);
+    printf("Function and closures packed in their own size classes\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_shared_and_cyclic() {
+    printf("Test: Shared and Cyclic References Forwarded\n");
+    printf("--------------------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    /* 100-cell ring, referenced from two roots */
+    Object *first = new_pair(vm, NULL, NULL);
+    Object *cell = first;
+    for (int i = 1; i < 100; i++) {
+        Object *next = new_pair(vm, NULL, NULL);
+        pair_set_right(vm, cell, next);
+        cell = next;
+    }
+    pair_set_right(vm, cell, first);
+    push(vm, VAL_OBJ(first));
+    push(vm, VAL_OBJ(cell));
+
+    gc_compact(vm);
+    assert(vm->num_objects == 100);
+
+    Object *head = vm->value_stack[0].obj_val;
+    Object *last = vm->value_stack[1].obj_val;
+    assert(last->pair.right == head);
+
+    int length = 1;
+    for (cell = head->pair.right; cell != head; cell = cell->pair.right) {
+        length++;
+    }
+    assert(length == 100);
+    printf("Ring of 100 intact, both roots updated\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_chunk_released() {
+    printf("Test: Chunk Released When Empty\n");
+    printf("-------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    push(vm, VAL_OBJ(new_pair(vm, NULL, NULL)));
+    push(vm, VAL_OBJ(new_pair(vm, NULL, NULL)));
+    gc_compact(vm);
+    SizeClass *pairs = &vm->size_classes[OBJ_PAIR];
+    assert(pairs->chunk_count == 1 && pairs->chunks->live == 2);
+
+    pop(vm);
+    gc(vm);
+    assert(vm->num_objects == 1);
+    assert(pairs->chunk_count == 1 && pairs->chunks->live == 1);
+    printf("Sweep released one slot of the chunk\n");
+
+    pop(vm);
+    gc(vm);
+    assert(vm->num_objects == 0);
+    assert(pairs->chunk_count == 0 && pairs->chunks == NULL);
+    printf("Chunk freed with its last object\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_compact_interval_stress() {
+    printf("Test: Periodic Compaction with Auto GC\n");
+    printf("--------------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_compact_interval(vm, 2);
+
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < 2000; i++) {
+        for (int j = 0; j < 50; j++) {
+            new_pair(vm, NULL, NULL);
+        }
+        Object *cell = new_pair(vm, NULL, NULL);
+        pair_set_right(vm, cell, vm->value_stack[0].obj_val);
+        vm->value_stack[0] = VAL_OBJ(cell);
+    }
+
+    int length = 0;
+    for (Object *cell = vm->value_stack[0].obj_val; cell; cell = cell->pair.right) {
+        length++;
+    }
+    assert(length == 2000);
+    printf("List of 2000 cells intact after 102000 allocations\n");
+
+    gc_compact(vm);
+    assert(vm->num_objects == 2000);
+    SizeClass *pairs = &vm->size_classes[OBJ_PAIR];
+    int per_chunk = pairs->chunks->capacity;
+    assert(pairs->chunk_count == (2000 + per_chunk - 1) / per_chunk);
+    printf("Final compaction leaves %d full chunk(s)\n", pairs->chunk_count);
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_fallback_sweep() {
+    printf("Test: Sweep When To-Space Cannot Be Reserved\n");
+    printf("--------------------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+    assert(gc_profile_start(vm, GC_SAMPLE_OBJECTS, 1));
+
+    /* 10 kept pairs, 10 garbage, and a weak reference to more garbage */
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < 10; i++) {
+        vm->value_stack[0] = VAL_OBJ(new_pair(vm, NULL, vm->value_stack[0].obj_val));
+        new_pair(vm, NULL, NULL);
+    }
+    Object *weak = new_weak_ref(vm, new_pair(vm, NULL, NULL));
+    push(vm, VAL_OBJ(weak));
+    Object *head = vm->value_stack[0].obj_val;
+
+    fail_chunks = true;
+    gc_compact(vm);
+    fail_chunks = false;
+    assert(!vm->gc_stats.last.compacted);
+    assert(vm->value_stack[0].obj_val == head);
+    assert(vm->num_objects == 11);
+    assert(weak_get(weak) == NULL);
+    printf("Nothing moved; garbage swept and the weak reference cleared\n");
+
+    /* Marking is judged once: each kept pair survived one collection */
+    GCAllocSite *pairs = NULL;
+    for (int i = 0; i < vm->profile->site_count; i++) {
+        if (vm->profile->sites[i].type == OBJ_PAIR) pairs = &vm->profile->sites[i];
+    }
+    assert(pairs && pairs->survived == 10 && pairs->died == 11 && pairs->live == 10);
+    assert(vm->profile->sample_count == 11);
+    printf("Profile: 10 survived, 11 died, counted once\n");
+
+    gc_compact(vm);
+    assert(vm->gc_stats.last.compacted);
+    assert(vm->num_objects == 11);
+    assert(pairs->survived == 10 && pairs->died == 11);
+    printf("Next compaction succeeds\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+int main() {
+    printf("=======================================\n");
+    printf("  GC Compaction Tests\n");
+    printf("=======================================\n\n");
+
+    test_list_made_contiguous();
+    test_fields_follow_owner();
+    test_shared_and_cyclic();
+    test_chunk_released();
+    test_compact_interval_stress();
+    test_fallback_sweep();
+
+    printf("=======================================\n");
+    printf("  All Tests PASSED\n");
+    printf("=======================================\n");
+
+    return 0;
+}
@@ -0,0 +1,275 @@
+/*
+ * Frozen Segment Tests
+ *
+ * Purpose: Verify that a frozen object graph is an exact read-only copy,
+ * that any number of VMs can hold it while their collectors (mark-sweep,
+ * generational, incremental, parallel, compacting) leave it untouched,
+ * that every way of writing to it is refused, and that graphs holding
+ * weak objects cannot be frozen.
+ *
+ * Test case:
+ *   Object *root = <100-cell list of arrays, a map, a large byte string>;
+ *   GCFrozenSegment *seg = gc_freeze(vm, root);
+ *   push(a, VAL_OBJ(seg->root)); push(b, VAL_OBJ(seg->root));
+ *   gc(a); gc(b);
+ *   Expected: both see the same intact graph, neither counts it as heap
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "vm.h"  /* Includes gc.h automatically */
+#include "instructions.h"
+
+#define CELLS 100
+
+/* root = (list, (map, bytes)); list cell i holds the array [i, "i"] */
+static Object* build_constants(VM *vm) {
+    gc_set_auto_collect(vm, false);
+    push(vm, VAL_OBJ(NULL));
+    for (int i = CELLS - 1; i >= 0; i--) {
+        Object *name = new_bytes(vm, 1);
+        name->bytes.data[0] = (unsigned char)i;
+        Object *array = new_array(vm, 2);
+        array->array.items[0] = VAL_INT(i);
+        array->array.items[1] = VAL_OBJ(name);
+        vm->value_stack[vm->stack_count - 1] =
+            VAL_OBJ(new_pair(vm, array, vm->value_stack[vm->stack_count - 1].obj_val));
+    }
+
+    Object *map = new_map(vm);
+    push(vm, VAL_OBJ(map));
+    for (int i = 0; i < CELLS; i++) {
+        assert(map_set(vm, map, VAL_INT(i), VAL_INT(i * i)));
+    }
+    Object *large = new_bytes(vm, 3000);
+    large->bytes.data[2999] = 42;
+
+    Object *rest = new_pair(vm, map, large);
+    Object *root = new_pair(vm, vm->value_stack[vm->stack_count - 2].obj_val, rest);
+    pop(vm);
+    pop(vm);
+    return root;
+}
+
+static void check_constants(Object *root) {
+    int i = 0;
+    for (Object *cell = root->pair.left; cell; cell = cell->pair.right, i++) {
+        Object *array = cell->pair.left;
+        assert(array->array.items[0].int_val == i);
+        assert(array->array.items[1].obj_val->bytes.data[0] == i);
+    }
+    assert(i == CELLS);
+
+    Object *map = root->pair.right->pair.left;
+    Value value;
+    assert(map->map.count == CELLS);
+    assert(map_get(map, VAL_INT(7), &value) && value.int_val == 49);
+    assert(root->pair.right->pair.right->bytes.data[2999] == 42);
+}
+
+void test_freeze_copies_graph() {
+    printf("Test: Freezing Copies the Graph\n");
+    printf("-------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+    Object *root = build_constants(vm);
+    push(vm, VAL_OBJ(root));
+
+    GCFrozenSegment *seg = gc_freeze(vm, root);
+    assert(seg);
+    assert(seg->root != root && gc_is_frozen(seg->root) && !gc_is_frozen(root));
+    assert(seg->root == seg->memory);
+    assert(seg->size >= seg->bytes && seg->size % 4096 == 0);
+    /* 100 cells + 100 arrays + 100 names + map, table, large, 2 pairs */
+    assert(seg->objects == 3 * CELLS + 5);
+    check_constants(seg->root);
+    check_constants(root);
+    printf("%ld objects, %zu bytes in %zu mapped; original left in the heap\n",
+           seg->objects, seg->bytes, seg->size);
+
+    /* An object already frozen is shared, not copied again */
+    Object *outer = new_pair(vm, seg->root, NULL);
+    GCFrozenSegment *seg2 = gc_freeze(vm, outer);
+    assert(seg2->objects == 1);
+    assert(seg2->root->pair.left == seg->root);
+    assert(gc_freeze(vm, seg->root) == NULL);
+    printf("Freezing a graph that reaches a segment copies only the new part\n");
+
+    gc_frozen_destroy(seg2);
+    gc_frozen_destroy(seg);
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_shared_by_vms() {
+    printf("Test: Two VMs Share One Segment\n");
+    printf("-------------------------------\n");
+
+    VM *builder = vm_create();
+    GCFrozenSegment *seg = gc_freeze(builder, build_constants(builder));
+    vm_destroy(builder);  /* The segment does not depend on the VM that built it */
+
+    VM *a = vm_create();
+    VM *b = vm_create();
+    push(a, VAL_OBJ(seg->root));
+    push(b, VAL_OBJ(seg->root));
+
+    /* Heap objects may point into the segment and use frozen keys */
+    Object *first = seg->root->pair.left->pair.left;
+    push(a, VAL_OBJ(new_pair(a, first, NULL)));
+    push(b, VAL_OBJ(new_map(b)));
+    assert(map_set(b, b->value_stack[1].obj_val, VAL_OBJ(first), VAL_INT(1)));
+    for (int i = 0; i < 50; i++) {
+        new_pair(a, NULL, NULL);
+        new_pair(b, NULL, NULL);
+    }
+
+    gc(a);
+    gc(b);
+    gc(a);
+    assert(a->num_objects == 1);
+    assert(b->num_objects == 2);  /* Map and its table */
+    check_constants(seg->root);
+    Value value;
+    assert(map_get(b->value_stack[1].obj_val, VAL_OBJ(first), &value) && value.int_val == 1);
+    printf("After 3 collections: each VM holds only its own objects, graph intact\n");
+
+    vm_destroy(a);
+    vm_destroy(b);
+    gc_frozen_destroy(seg);
+
+    printf("PASS Test\n\n");
+}
+
+void test_collectors_leave_it() {
+    printf("Test: Every Collector Leaves the Segment in Place\n");
+    printf("-------------------------------------------------\n");
+
+    VM *builder = vm_create();
+    GCFrozenSegment *seg = gc_freeze(builder, build_constants(builder));
+    vm_destroy(builder);
+
+    GCMode modes[] = {GC_MODE_GENERATIONAL, GC_MODE_INCREMENTAL, GC_MODE_MARK_SWEEP};
+    const char *names[] = {"generational", "incremental", "compacting, parallel"};
+    for (int m = 0; m < 3; m++) {
+        VM *vm = vm_create();
+        gc_set_mode(vm, modes[m]);
+        if (modes[m] == GC_MODE_INCREMENTAL) gc_set_slice_work(vm, 10);
+        if (modes[m] == GC_MODE_MARK_SWEEP) {
+            gc_set_compact_interval(vm, 1);
+            gc_set_mark_threads(vm, 4);
+        }
+
+        push(vm, VAL_OBJ(seg->root));
+        push(vm, VAL_OBJ(NULL));
+        for (int i = 0; i < 20000; i++) {
+            Object *cell = new_pair(vm, seg->root->pair.left, NULL);
+            if (i % 100 == 0) {
+                vm->value_stack[1] = VAL_OBJ(new_pair(vm, cell, vm->value_stack[1].obj_val));
+            }
+        }
+        gc(vm);
+
+        assert(vm->value_stack[0].obj_val == seg->root);
+        for (Object *cell = vm->value_stack[1].obj_val; cell; cell = cell->pair.right) {
+            assert(cell->pair.left->pair.left == seg->root->pair.left);
+        }
+        check_constants(seg->root);
+        printf("%s: %ld collections, segment not moved\n",
+               names[m], gc_get_stats(vm)->collections);
+
+        vm_destroy(vm);
+    }
+    gc_frozen_destroy(seg);
+
+    printf("PASS Test\n\n");
+}
+
+void test_writes_rejected() {
+    printf("Test: Writes to Frozen Objects Are Refused\n");
+    printf("------------------------------------------\n");
+
+    VM *vm = vm_create();
+    GCFrozenSegment *seg = gc_freeze(vm, build_constants(vm));
+    Object *cell = seg->root->pair.left;
+    Object *array = cell->pair.left;
+    Object *map = seg->root->pair.right->pair.left;
+
+    assert(!pair_set_left(vm, cell, NULL));
+    assert(!pair_set_right(vm, cell, NULL));
+    assert(!array_set(vm, array, 0, VAL_INT(5)));
+    assert(!map_set(vm, map, VAL_INT(1), VAL_INT(5)));
+    assert(!map_delete(vm, map, VAL_INT(1)));
+    check_constants(seg->root);
+    printf("Setters and map updates return false\n");
+
+    /* Bytecode stores: index, value, ASTORE on the object at the top of the value stack */
+    uint8_t astore[] = {
+        OP_PUSH, 0, 0, 0, 0,
+        OP_PUSH, 5, 0, 0, 0,
+        OP_ASTORE,
+        OP_HALT
+    };
+    push(vm, VAL_OBJ(array));
+    vm_load_program(vm, astore, sizeof(astore));
+    assert(vm_run(vm) == VM_ERROR_READ_ONLY);
+
+    uint8_t mapset[] = {
+        OP_PUSH, 1, 0, 0, 0,
+        OP_PUSH, 5, 0, 0, 0,
+        OP_MAPSET,
+        OP_HALT
+    };
+    vm->value_stack[0] = VAL_OBJ(map);
+    vm_load_program(vm, mapset, sizeof(mapset));
+    assert(vm_run(vm) == VM_ERROR_READ_ONLY);
+    check_constants(seg->root);
+    printf("ASTORE and MAPSET fail with \"%s\"\n", vm_error_string(VM_ERROR_READ_ONLY));
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+    gc_frozen_destroy(seg);
+
+    printf("PASS Test\n\n");
+}
+
+void test_weak_rejected() {
+    printf("Test: Weak Objects Cannot Be Frozen\n");
+    printf("-----------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+    Object *target = new_pair(vm, NULL, NULL);
+    Object *weak = new_pair(vm, NULL, new_weak_ref(vm, target));
+    assert(gc_freeze(vm, weak) == NULL);
+    assert(gc_freeze(vm, new_pair(vm, new_weak_map(vm), NULL)) == NULL);
+    assert(gc_freeze(vm, NULL) == NULL);
+    printf("Graphs with a weak reference or weak map refused\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+int main() {
+    printf("=======================================\n");
+    printf("  GC Frozen Segment Tests\n");
+    printf("=======================================\n\n");
+
+    test_freeze_copies_graph();
+    test_shared_by_vms();
+    test_collectors_leave_it();
+    test_writes_rejected();
+    test_weak_rejected();
+
+    printf("=======================================\n");
+    printf("  All Tests PASSED\n");
+    printf("=======================================\n");
+
+    return 0;
+}
@@ -0,0 +1,206 @@
+/*
+ * Generational Mode Tests
+ *
+ * Purpose: Verify nursery allocation, promotion of survivors into the old
+ * generation, and the remembered-set write barrier.
+ *
+ * Note: minor collections move objects, so after a collection objects are
+ * re-read from the value stack instead of using stale C pointers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "vm.h"  /* Includes gc.h automatically */
+
+void test_nursery_allocation() {
+    printf("Test: Nursery Allocation\n");
+    printf("------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_mode(vm, GC_MODE_GENERATIONAL);
+
+    Object *a = new_pair(vm, NULL, NULL);
+    Object *b = new_pair(vm, a, NULL);
+
+    assert(gc_in_nursery(vm, a));
+    assert(gc_in_nursery(vm, b));
+    assert((char*)b == (char*)a + gc_type_size(OBJ_PAIR));  /* Bump allocated */
+    assert(vm->num_objects == 2);
+    HeapIterator it;
+    assert(gc_heap_first(vm, &it) == NULL);  /* Old generation still empty */
+    printf("Two pairs bump-allocated in the nursery\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_minor_promotes_survivors() {
+    printf("Test: Minor Collection Promotes Survivors\n");
+    printf("-----------------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_mode(vm, GC_MODE_GENERATIONAL);
+
+    Object *a = new_pair(vm, NULL, NULL);
+    Object *b = new_pair(vm, a, NULL);
+    new_pair(vm, NULL, NULL);  /* garbage */
+    new_pair(vm, NULL, NULL);  /* garbage */
+    push(vm, VAL_OBJ(b));
+
+    gc_minor_collect(vm);
+
+    assert(vm->num_objects == 2);
+    assert(vm->nursery_top == 0);
+
+    Object *b2 = vm->value_stack[0].obj_val;
+    assert(b2 != b);
+    assert(!gc_in_nursery(vm, b2));
+    assert(!gc_in_nursery(vm, b2->pair.left));
+    assert(b2->pair.left->pair.left == NULL);
+    printf("b and a promoted, 2 garbage objects dropped\n");
+
+    /* Promoted objects are in the old generation heap */
+    HeapIterator it;
+    int count = 0;
+    for (Object *obj = gc_heap_first(vm, &it); obj; obj = gc_heap_next(&it)) count++;
+    assert(count == 2);
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_write_barrier() {
+    printf("Test: Write Barrier Keeps Young Objects Alive\n");
+    printf("---------------------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_mode(vm, GC_MODE_GENERATIONAL);
+
+    /* Make an old object */
+    push(vm, VAL_OBJ(new_pair(vm, NULL, NULL)));
+    gc_minor_collect(vm);
+    Object *old = vm->value_stack[0].obj_val;
+    assert(!gc_in_nursery(vm, old));
+
+    /* Store a young object into it; only the barrier keeps it alive */
+    Object *young = new_pair(vm, NULL, NULL);
+    pair_set_right(vm, old, young);
+    assert(vm->remembered_set.count == 1);
+    assert(old->flags & OBJ_FLAG_REMEMBERED);
+
+    /* A second store into the same owner is not recorded twice */
+    pair_set_left(vm, old, young);
+    assert(vm->remembered_set.count == 1);
+
+    gc_minor_collect(vm);
+
+    assert(vm->remembered_set.count == 0);
+    assert(!(old->flags & OBJ_FLAG_REMEMBERED));
+    assert(old->pair.right != NULL);
+    assert(!gc_in_nursery(vm, old->pair.right));
+    assert(old->pair.left == old->pair.right);
+    assert(vm->num_objects == 2);
+    printf("Young object reached only from old object survived\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_closure_promotion() {
+    printf("Test: Closure Promotion\n");
+    printf("-----------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_mode(vm, GC_MODE_GENERATIONAL);
+
+    Object *env = new_pair(vm, NULL, NULL);
+    Object *fn = new_function(vm);
+    Object *cl = new_closure(vm, fn, env);
+    push(vm, VAL_OBJ(cl));
+
+    gc(vm);
+
+    cl = vm->value_stack[0].obj_val;
+    assert(vm->num_objects == 3);
+    assert(cl->type == OBJ_CLOSURE);
+    assert(cl->closure.fn->type == OBJ_FUNCTION);
+    assert(cl->closure.env->type == OBJ_PAIR);
+    assert(!gc_in_nursery(vm, cl->closure.fn));
+    printf("Closure, function and environment promoted together\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_generational_stress() {
+    printf("Test: Generational Stress\n");
+    printf("-------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_mode(vm, GC_MODE_GENERATIONAL);
+    gc_set_nursery_size(vm, 64);
+
+    /* The size is in objects: 64 pairs fit before the first minor collection */
+    for (int i = 0; i < 64; i++) {
+        assert(gc_in_nursery(vm, new_pair(vm, NULL, NULL)));
+    }
+    assert(vm->gc_stats.minor_collections == 0);
+
+    /* Long-lived list built one cell at a time amid short-lived garbage */
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < 1000; i++) {
+        for (int j = 0; j < 50; j++) {
+            new_pair(vm, NULL, NULL);
+        }
+        Object *head = vm->value_stack[0].obj_val;
+        vm->value_stack[0] = VAL_OBJ(new_pair(vm, NULL, head));
+    }
+
+    int length = 0;
+    for (Object *cell = vm->value_stack[0].obj_val; cell; cell = cell->pair.right) {
+        length++;
+    }
+    assert(length == 1000);
+    printf("List of 1000 cells intact after 51000 allocations\n");
+
+    gc(vm);
+    assert(vm->num_objects == 1000);
+    printf("Only the list survives a full collection\n");
+
+    pop(vm);
+    gc(vm);
+    assert(vm->num_objects == 0);
+    printf("Heap empty after dropping the root\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+int main() {
+    printf("=======================================\n");
+    printf("  GC Generational Mode Tests\n");
+    printf("=======================================\n\n");
+
+    test_nursery_allocation();
+    test_minor_promotes_survivors();
+    test_write_barrier();
+    test_closure_promotion();
+    test_generational_stress();
+
+    printf("=======================================\n");
+    printf("  All Tests PASSED\n");
+    printf("=======================================\n");
+
+    return 0;
+}
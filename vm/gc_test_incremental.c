@@ -0,0 +1,196 @@
+/*
+ * Incremental Mode Tests
+ *
+ * Purpose: Verify tri-color marking in bounded slices, the Dijkstra write
+ * barrier, allocation during marking and sweeping, and pause reporting.
+ *
+ * Slices are capped by work (objects per slice) so the tests do not depend
+ * on timing.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "vm.h"  /* Includes gc.h automatically */
+
+static int run_cycle(VM *vm) {
+    int steps = 0;
+    do {
+        gc_incremental_step(vm);
+        steps++;
+    } while (vm->gc_phase != GC_PHASE_IDLE);
+    return steps;
+}
+
+void test_cycle_in_slices() {
+    printf("Test: Cycle Runs in Bounded Slices\n");
+    printf("----------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+    gc_set_mode(vm, GC_MODE_INCREMENTAL);
+    gc_set_slice_work(vm, 100);
+
+    /* 1000-cell live list and 500 garbage pairs */
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < 1000; i++) {
+        vm->value_stack[0] = VAL_OBJ(new_pair(vm, NULL, vm->value_stack[0].obj_val));
+        if (i % 2 == 0) new_pair(vm, NULL, NULL);
+    }
+    assert(vm->num_objects == 1500);
+
+    int steps = run_cycle(vm);
+    printf("Cycle finished in %d slices\n", steps);
+
+    /* 1000 objects to mark + 1500 to sweep, at most 100 per slice */
+    assert(steps >= 25);
+    assert(vm->num_objects == 1000);
+
+    HeapIterator it;
+    for (Object *obj = gc_heap_first(vm, &it); obj; obj = gc_heap_next(&it)) {
+        assert(obj->marked == false);
+    }
+    printf("Garbage freed, marks reset\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_write_barrier() {
+    printf("Test: Write Barrier Shades Moved Reference\n");
+    printf("------------------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+    gc_set_mode(vm, GC_MODE_INCREMENTAL);
+    gc_set_slice_work(vm, 1);
+
+    Object *b = new_pair(vm, NULL, NULL);
+    Object *c = new_pair(vm, b, NULL);
+    Object *a = new_pair(vm, NULL, NULL);
+    push(vm, VAL_OBJ(c));
+    push(vm, VAL_OBJ(a));
+
+    /* One object of work: a is scanned (black), c stays gray, b white */
+    gc_incremental_step(vm);
+    assert(vm->gc_phase == GC_PHASE_MARK);
+    assert(a->marked == true);
+    assert(b->marked == false);
+    printf("a black, c gray, b white\n");
+
+    /* Move b from the gray object into the black one */
+    pair_set_left(vm, a, b);
+    pair_set_left(vm, c, NULL);
+    assert(b->marked == true);
+    printf("Barrier shaded b on store into black a\n");
+
+    run_cycle(vm);
+    assert(vm->num_objects == 3);
+    assert(a->pair.left == b);
+    printf("b survived the cycle\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_allocation_during_cycle() {
+    printf("Test: Allocation During Mark and Sweep\n");
+    printf("--------------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+    gc_set_mode(vm, GC_MODE_INCREMENTAL);
+    gc_set_slice_work(vm, 1);
+
+    for (int i = 0; i < 10; i++) new_pair(vm, NULL, NULL);
+    push(vm, VAL_OBJ(new_pair(vm, NULL, NULL)));
+
+    gc_incremental_step(vm);
+    assert(vm->gc_phase == GC_PHASE_MARK);
+
+    /* Objects allocated while marking are black */
+    Object *during_mark = new_pair(vm, NULL, NULL);
+    assert(during_mark->marked == true);
+    push(vm, VAL_OBJ(during_mark));
+    printf("Object allocated during marking is black\n");
+
+    while (vm->gc_phase == GC_PHASE_MARK) gc_incremental_step(vm);
+    gc_incremental_step(vm);
+    assert(vm->gc_phase == GC_PHASE_SWEEP);
+
+    /* Objects allocated while sweeping are white but never swept */
+    Object *during_sweep = new_pair(vm, NULL, NULL);
+    assert(during_sweep->marked == false);
+    push(vm, VAL_OBJ(during_sweep));
+    printf("Object allocated during sweeping is white\n");
+
+    run_cycle(vm);
+    assert(vm->num_objects == 3);
+    printf("Roots and both new objects survived, 10 garbage freed\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_incremental_stress() {
+    printf("Test: Incremental Stress with Auto GC\n");
+    printf("-------------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_mode(vm, GC_MODE_INCREMENTAL);
+    gc_set_slice_work(vm, 50);
+
+    /* Long-lived list mutated through the barrier amid garbage */
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < 2000; i++) {
+        for (int j = 0; j < 50; j++) {
+            new_pair(vm, NULL, NULL);
+        }
+        Object *cell = new_pair(vm, NULL, NULL);
+        pair_set_right(vm, cell, vm->value_stack[0].obj_val);
+        vm->value_stack[0] = VAL_OBJ(cell);
+    }
+
+    int length = 0;
+    for (Object *cell = vm->value_stack[0].obj_val; cell; cell = cell->pair.right) {
+        length++;
+    }
+    assert(length == 2000);
+    printf("List of 2000 cells intact after 102000 allocations\n");
+
+    gc(vm);
+    assert(vm->num_objects == 2000);
+    printf("Only the list survives a full collection\n");
+
+    assert(vm->gc_stats.pauses.count > 0);
+    assert(gc_pause_percentile(vm, 99.0) <= vm->gc_stats.pauses.max_us);
+    gc_print_pause_histogram(vm, stdout);
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+int main() {
+    printf("=======================================\n");
+    printf("  GC Incremental Mode Tests\n");
+    printf("=======================================\n\n");
+
+    test_cycle_in_slices();
+    test_write_barrier();
+    test_allocation_during_cycle();
+    test_incremental_stress();
+
+    printf("=======================================\n");
+    printf("  All Tests PASSED\n");
+    printf("=======================================\n");
+
+    return 0;
+}
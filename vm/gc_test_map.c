@@ -0,0 +1,287 @@
+/*
+ * Map Tests
+ *
+ * Purpose: Verify map objects: integer and identity keys, replacement and
+ * deletion, incremental growth (entries readable while they migrate), and
+ * tracing of keys and values under the mark-sweep, compacting,
+ * generational and incremental collectors.
+ *
+ * Note: map_set may allocate and collections move objects, so maps and
+ * object keys are re-read from the value stack afterwards.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "vm.h"  /* Includes gc.h automatically */
+
+static Object* root(VM *vm, int index) {
+    return vm->value_stack[index].obj_val;
+}
+
+static int32_t get_int(Object *map, int32_t key) {
+    Value value;
+    assert(map_get(map, VAL_INT(key), &value));
+    assert(value.type == VAL_INT);
+    return value.int_val;
+}
+
+void test_integer_keys() {
+    printf("Test: Integer Keys\n");
+    printf("------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    push(vm, VAL_OBJ(new_map(vm)));
+    assert(root(vm, 0)->type == OBJ_MAP);
+    assert(!map_get(root(vm, 0), VAL_INT(1), NULL));
+
+    for (int i = 0; i < 1000; i++) {
+        assert(map_set(vm, root(vm, 0), VAL_INT(i * 31), VAL_INT(i)));
+    }
+    Object *map = root(vm, 0);
+    assert(map->map.count == 1000);
+    for (int i = 0; i < 1000; i++) {
+        assert(get_int(map, i * 31) == i);
+    }
+    assert(!map_get(map, VAL_INT(1), NULL));
+    printf("1000 entries stored and found\n");
+
+    assert(map_set(vm, map, VAL_INT(31), VAL_INT(-5)));
+    assert(map->map.count == 1000);
+    assert(get_int(map, 31) == -5);
+    printf("Setting an existing key replaces its value\n");
+
+    for (int i = 0; i < 1000; i += 2) {
+        assert(map_delete(vm, map, VAL_INT(i * 31)));
+    }
+    assert(!map_delete(vm, map, VAL_INT(0)));
+    assert(map->map.count == 500);
+    for (int i = 0; i < 1000; i++) {
+        assert(map_get(map, VAL_INT(i * 31), NULL) == (i % 2 == 1));
+    }
+    printf("500 deleted, the other 500 still found past the tombstones\n");
+
+    assert(!map_set(vm, map, VAL_OBJ(NULL), VAL_INT(0)));
+    printf("NULL key refused\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_incremental_growth() {
+    printf("Test: Growth Spread over Later Updates\n");
+    printf("--------------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    push(vm, VAL_OBJ(new_map(vm)));
+    int resizes = 0;
+    int checked = 0;
+    for (int i = 0; i < 20000; i++) {
+        Object *before = root(vm, 0)->map.table;
+        assert(map_set(vm, root(vm, 0), VAL_INT(i), VAL_INT(i + 1)));
+        Object *map = root(vm, 0);
+        if (map->map.table == before) continue;
+        resizes++;
+
+        /* Big tables are not drained by the update that grew them */
+        Object *old = map->map.old_table;
+        if (old && old->array.length > 2 * 64) {
+            assert(map->map.migrated < old->array.length / 2);
+            for (int k = 0; k <= i; k++) {
+                assert(get_int(map, k) == k + 1);
+            }
+            checked++;
+        }
+    }
+    assert(resizes >= 10 && checked > 0);
+    printf("%d resizes; all keys readable mid-migration in %d of them\n", resizes, checked);
+
+    /* Updates (here, deletes of absent keys) finish the migration */
+    Object *map = root(vm, 0);
+    while (map->map.old_table) {
+        assert(!map_delete(vm, map, VAL_INT(-1)));
+    }
+    assert(map->map.count == 20000);
+    assert(map->map.count * 4 <= map->map.table->array.length / 2 * 3);
+    for (int i = 0; i < 20000; i++) {
+        assert(get_int(map, i) == i + 1);
+    }
+    printf("Old table drained; 20000 entries in the new one\n");
+
+    gc(vm);
+    assert(vm->num_objects == 2);
+    printf("After a collection only the map and its table remain\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_identity_keys_and_tracing() {
+    printf("Test: Identity Keys, Values Traced\n");
+    printf("----------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    /* value_stack[0]: map, [1]: array of 100 key pairs */
+    push(vm, VAL_OBJ(new_map(vm)));
+    push(vm, VAL_OBJ(new_array(vm, 100)));
+    for (int i = 0; i < 100; i++) {
+        Object *key = new_pair(vm, NULL, NULL);
+        array_set(vm, root(vm, 1), i, VAL_OBJ(key));
+        Object *value = new_pair(vm, NULL, NULL);
+        assert(map_set(vm, root(vm, 0), VAL_OBJ(key), VAL_OBJ(value)));
+        new_pair(vm, NULL, NULL);  /* garbage */
+    }
+    assert(map_set(vm, root(vm, 0), VAL_INT(7), VAL_INT(70)));
+
+    /* A different pair is a different key */
+    Object *stranger = new_pair(vm, NULL, NULL);
+    assert(!map_get(root(vm, 0), VAL_OBJ(stranger), NULL));
+    assert(stranger->hash == 0);
+    printf("Keys compare by identity; lookups do not hash new objects\n");
+
+    gc_compact(vm);
+    Object *map = root(vm, 0);
+    int tables = map->map.old_table ? 2 : 1;
+    assert(vm->num_objects == 2 + 100 + 100 + tables);
+
+    /* Compaction moved every pair; identity hashes moved with them */
+    Object *keys = root(vm, 1);
+    for (int i = 0; i < 100; i++) {
+        Value value;
+        assert(map_get(map, keys->array.items[i], &value));
+        assert(value.type == VAL_OBJ && value.obj_val->type == OBJ_PAIR);
+        assert(value.obj_val->marked == false);
+    }
+    assert(get_int(map, 7) == 70);
+    printf("After compaction: 100 keys found, values kept alive\n");
+
+    /* Deleted entries stop keeping their value alive */
+    for (int i = 0; i < 50; i++) {
+        assert(map_delete(vm, map, keys->array.items[i]));
+    }
+    tables = map->map.old_table ? 2 : 1;
+    gc(vm);
+    assert(vm->num_objects == 2 + 100 + 50 + tables);
+    printf("50 deleted values freed; keys still held by the array\n");
+
+    pop(vm);
+    pop(vm);
+    gc(vm);
+    assert(vm->num_objects == 0);
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_generational_maps() {
+    printf("Test: Maps in Generational Mode\n");
+    printf("-------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_mode(vm, GC_MODE_GENERATIONAL);
+
+    push(vm, VAL_OBJ(new_map(vm)));
+    push(vm, VAL_OBJ(new_pair(vm, NULL, NULL)));  /* key */
+    assert(map_set(vm, root(vm, 0), VAL_OBJ(root(vm, 1)), VAL_INT(1)));
+    uint32_t hash = root(vm, 1)->hash;
+    assert(gc_in_nursery(vm, root(vm, 0)) && gc_in_nursery(vm, root(vm, 1)));
+
+    gc_minor_collect(vm);
+    Object *map = root(vm, 0);
+    Object *key = root(vm, 1);
+    assert(!gc_in_nursery(vm, map) && !gc_in_nursery(vm, key));
+    assert(key->hash == hash);
+    Value value;
+    assert(map_get(map, VAL_OBJ(key), &value) && value.int_val == 1);
+    printf("Map, table and key promoted; key keeps its hash\n");
+
+    /* Young values stored into the promoted table survive minor collections */
+    for (int i = 0; i < 5000; i++) {
+        Object *young = new_pair(vm, NULL, NULL);
+        assert(map_set(vm, root(vm, 0), VAL_INT(i), VAL_OBJ(young)));
+    }
+    gc_minor_collect(vm);
+    map = root(vm, 0);
+    for (int i = 0; i < 5000; i++) {
+        assert(map_get(map, VAL_INT(i), &value));
+        assert(value.obj_val->type == OBJ_PAIR && !gc_in_nursery(vm, value.obj_val));
+    }
+    printf("5000 young values reachable only through the map promoted\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_incremental_maps() {
+    printf("Test: Maps in Incremental Mode\n");
+    printf("------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+    gc_set_mode(vm, GC_MODE_INCREMENTAL);
+    gc_set_slice_work(vm, 10);
+
+    /* A 100-cell list keeps the mark phase going for several slices */
+    push(vm, VAL_OBJ(new_map(vm)));
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < 100; i++) {
+        vm->value_stack[1] = VAL_OBJ(new_pair(vm, NULL, vm->value_stack[1].obj_val));
+    }
+    assert(map_set(vm, root(vm, 0), VAL_INT(-1), VAL_INT(0)));
+
+    /* Insert (and grow) while marking is under way */
+    gc_incremental_step(vm);
+    assert(vm->gc_phase == GC_PHASE_MARK);
+    for (int i = 0; i < 300; i++) {
+        Object *cell = new_pair(vm, NULL, NULL);
+        assert(map_set(vm, root(vm, 0), VAL_INT(i), VAL_OBJ(cell)));
+    }
+    while (vm->gc_phase != GC_PHASE_IDLE) {
+        gc_incremental_step(vm);
+    }
+
+    Object *map = root(vm, 0);
+    for (int i = 0; i < 300; i++) {
+        Value value;
+        assert(map_get(map, VAL_INT(i), &value));
+        assert(value.obj_val->type == OBJ_PAIR);
+    }
+    printf("300 values stored during marking survive the cycle\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+int main() {
+    printf("=======================================\n");
+    printf("  GC Map Tests\n");
+    printf("=======================================\n\n");
+
+    test_integer_keys();
+    test_incremental_growth();
+    test_identity_keys_and_tracing();
+    test_generational_maps();
+    test_incremental_maps();
+
+    printf("=======================================\n");
+    printf("  All Tests PASSED\n");
+    printf("=======================================\n");
+
+    return 0;
+}
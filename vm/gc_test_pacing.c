@@ -0,0 +1,197 @@
+/*
+ * Heap Pacing Tests
+ *
+ * Purpose: Verify byte-based collection triggers: the minimum heap floor,
+ * growth by survival rate, the soft limit, the hard maximum heap, policy
+ * validation, and that the legacy object-count policy is still selectable.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "vm.h"  /* Includes gc.h automatically */
+
+#define PAIR_BYTES (gc_type_size(OBJ_PAIR))
+
+/* Build a rooted list of n cells in value_stack[0] */
+static void build_live_list(VM *vm, int n) {
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < n; i++) {
+        vm->value_stack[0] = VAL_OBJ(new_pair(vm, NULL, vm->value_stack[0].obj_val));
+    }
+}
+
+void test_small_heap_no_thrash() {
+    printf("Test: Small Heap Does Not Thrash\n");
+    printf("--------------------------------\n");
+
+    long collections[2];
+    GCPacing pacing[2] = {GC_PACING_OBJECTS, GC_PACING_BYTES};
+
+    for (int run = 0; run < 2; run++) {
+        VM *vm = vm_create();
+        gc_set_pacing(vm, pacing[run]);
+
+        /* 10 live cells and 100000 short-lived pairs */
+        build_live_list(vm, 10);
+        for (int i = 0; i < 100000; i++) {
+            new_pair(vm, NULL, NULL);
+        }
+        collections[run] = vm->gc_stats.collections;
+
+        gc_cleanup(vm);
+        vm_destroy(vm);
+    }
+
+    printf("Object pacing: %ld collections, byte pacing: %ld\n",
+           collections[0], collections[1]);
+    assert(collections[0] > 1000);
+    assert(collections[1] <= (long)(100000 * PAIR_BYTES / GC_DEFAULT_MIN_HEAP) + 1);
+
+    printf("PASS Test\n\n");
+}
+
+void test_growth_follows_survival() {
+    printf("Test: Trigger Grows with Survival Rate\n");
+    printf("--------------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    /* 20000 live pairs, no garbage: survival 1.0, growth 2.0 * 1.5 */
+    build_live_list(vm, 20000);
+    size_t live = 20000 * PAIR_BYTES;
+    gc(vm);
+    assert(vm->bytes_allocated == live);
+    assert(vm->last_survival == 1.0);
+    assert(vm->next_gc_bytes == (size_t)(live * 3.0));
+    printf("All live: trigger = 3.0 x live\n");
+
+    /* Same live data plus as much garbage: survival 0.5, plain growth */
+    for (int i = 0; i < 20000; i++) {
+        new_pair(vm, NULL, NULL);
+    }
+    gc(vm);
+    assert(vm->bytes_allocated == live);
+    assert(vm->last_survival == 0.5);
+    assert(vm->next_gc_bytes == (size_t)(live * 2.0));
+    printf("Half live: trigger = 2.0 x live\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_soft_limit_caps_trigger() {
+    printf("Test: Soft Limit Caps the Trigger\n");
+    printf("---------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    GCHeapPolicy policy;
+    gc_default_heap_policy(&policy);
+    policy.soft_limit = 800000;
+    assert(gc_set_heap_policy(vm, &policy));
+
+    build_live_list(vm, 20000);
+    gc(vm);
+    assert(vm->next_gc_bytes == 800000);
+    printf("Trigger held at the 800000-byte soft limit\n");
+
+    /* Live data above the limit still leaves headroom */
+    for (int i = 0; i < 10000; i++) {
+        vm->value_stack[0] = VAL_OBJ(new_pair(vm, NULL, vm->value_stack[0].obj_val));
+    }
+    gc(vm);
+    size_t live = 30000 * PAIR_BYTES;
+    assert(vm->bytes_allocated == live);
+    assert(vm->next_gc_bytes == live + live / 8);
+    printf("Over the limit: trigger = live + 1/8 headroom\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_max_heap_enforced() {
+    printf("Test: Maximum Heap Enforced\n");
+    printf("---------------------------\n");
+
+    VM *vm = vm_create();
+
+    GCHeapPolicy policy;
+    gc_default_heap_policy(&policy);
+    policy.min_heap = 16 * 1024;
+    policy.target_heap = 16 * 1024;
+    policy.max_heap = 64 * 1024;
+    assert(gc_set_heap_policy(vm, &policy));
+
+    /* Garbage never hits the limit: collections free it */
+    for (int i = 0; i < 50000; i++) {
+        assert(new_pair(vm, NULL, NULL) != NULL);
+    }
+    printf("50000 garbage pairs fit in a 64 KB heap\n");
+
+    /* Live data does */
+    push(vm, VAL_OBJ(NULL));
+    int cells = 0;
+    for (;;) {
+        Object *cell = new_pair(vm, NULL, vm->value_stack[0].obj_val);
+        if (!cell) break;
+        vm->value_stack[0] = VAL_OBJ(cell);
+        cells++;
+    }
+    assert(cells == (int)(64 * 1024 / PAIR_BYTES));
+    assert(vm->bytes_allocated <= 64 * 1024);
+    printf("Allocation refused after %d live pairs\n", cells);
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_invalid_policy_rejected() {
+    printf("Test: Invalid Policy Rejected\n");
+    printf("-----------------------------\n");
+
+    VM *vm = vm_create();
+    GCHeapPolicy policy;
+
+    gc_default_heap_policy(&policy);
+    policy.growth_factor = 1.0;
+    assert(!gc_set_heap_policy(vm, &policy));
+
+    gc_default_heap_policy(&policy);
+    policy.max_heap = 1024;
+    assert(!gc_set_heap_policy(vm, &policy));
+
+    assert(vm->heap_policy.growth_factor == GC_DEFAULT_GROWTH_FACTOR);
+    assert(vm->heap_policy.max_heap == 0);
+    printf("Bad growth factor and min > max refused; policy unchanged\n");
+
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+int main() {
+    printf("=======================================\n");
+    printf("  GC Heap Pacing Tests\n");
+    printf("=======================================\n\n");
+
+    test_small_heap_no_thrash();
+    test_growth_follows_survival();
+    test_soft_limit_caps_trigger();
+    test_max_heap_enforced();
+    test_invalid_policy_rejected();
+
+    printf("=======================================\n");
+    printf("  All Tests PASSED\n");
+    printf("=======================================\n");
+
+    return 0;
+}
@@ -0,0 +1,192 @@
+/*
+ * Parallel Marking Tests
+ *
+ * Purpose: Verify that marking with several threads reaches exactly the
+ * objects the serial marker reaches, and that shared or cyclic structure is
+ * marked once (no object is claimed by two workers).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "vm.h"  /* Includes gc.h automatically */
+
+static Object* make_tree(VM *vm, int depth) {
+    if (depth == 0) return new_pair(vm, NULL, NULL);
+    Object *left = make_tree(vm, depth - 1);
+    Object *right = make_tree(vm, depth - 1);
+    return new_pair(vm, left, right);
+}
+
+static int count_marked(VM *vm) {
+    HeapIterator it;
+    int marked = 0;
+    for (Object *obj = gc_heap_first(vm, &it); obj; obj = gc_heap_next(&it)) {
+        if (obj->marked) marked++;
+    }
+    return marked;
+}
+
+static void clear_marks(VM *vm) {
+    HeapIterator it;
+    for (Object *obj = gc_heap_first(vm, &it); obj; obj = gc_heap_next(&it)) {
+        obj->marked = false;
+    }
+}
+
+void test_tree_marking() {
+    printf("Test: Parallel Mark of a Tree\n");
+    printf("-----------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    /* Depth-12 tree (8191 pairs) plus a depth-8 garbage tree (511 pairs) */
+    push(vm, VAL_OBJ(make_tree(vm, 12)));
+    make_tree(vm, 8);
+    assert(vm->num_objects == 8191 + 511);
+
+    for (int threads = 1; threads <= 8; threads *= 2) {
+        long marked = gc_parallel_mark(vm, threads);
+        assert(marked == 8191);
+        assert(count_marked(vm) == 8191);
+        printf("%d thread(s): marked 8191 objects\n", threads);
+        clear_marks(vm);
+    }
+
+    gc_set_mark_threads(vm, 4);
+    gc(vm);
+    assert(vm->num_objects == 8191);
+    printf("Full collection with 4 mark threads freed the garbage tree\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_shared_and_cyclic() {
+    printf("Test: Shared and Cyclic Structure Marked Once\n");
+    printf("---------------------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    /* A 1000-cell ring: every cell reachable from every other */
+    Object *first = new_pair(vm, NULL, NULL);
+    Object *cell = first;
+    for (int i = 1; i < 1000; i++) {
+        Object *next = new_pair(vm, NULL, NULL);
+        pair_set_right(vm, cell, next);
+        cell = next;
+    }
+    pair_set_right(vm, cell, first);
+
+    /* 100 roots, each pointing at a different cell of the same ring */
+    cell = first;
+    for (int i = 0; i < 100; i++) {
+        push(vm, VAL_OBJ(new_pair(vm, cell, first)));
+        for (int j = 0; j < 10; j++) cell = cell->pair.right;
+    }
+
+    long marked = gc_parallel_mark(vm, 8);
+    assert(marked == 1100);
+    assert(count_marked(vm) == 1100);
+    printf("Ring shared by 100 roots marked exactly once (1100 objects)\n");
+    clear_marks(vm);
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_wide_closures() {
+    printf("Test: Wide Closure Graph\n");
+    printf("------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    /* 5000 closures sharing one function, each with its own environment */
+    Object *fn = new_function(vm);
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < 5000; i++) {
+        Object *env = new_pair(vm, NULL, NULL);
+        Object *cl = new_closure(vm, fn, env);
+        vm->value_stack[0] = VAL_OBJ(new_pair(vm, cl, vm->value_stack[0].obj_val));
+        new_closure(vm, fn, NULL);  /* garbage */
+    }
+
+    long marked = gc_parallel_mark(vm, 4);
+    assert(marked == 1 + 5000 * 3);
+    printf("Marked %ld objects: function, closures, environments, spine\n", marked);
+    clear_marks(vm);
+
+    gc_set_mark_threads(vm, 4);
+    gc(vm);
+    assert(vm->num_objects == 1 + 5000 * 3);
+    printf("5000 garbage closures freed\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_matches_serial() {
+    printf("Test: Parallel Result Matches Serial\n");
+    printf("------------------------------------\n");
+
+    int survivors[2];
+
+    for (int run = 0; run < 2; run++) {
+        VM *vm = vm_create();
+        gc_set_auto_collect(vm, false);
+        gc_set_mark_threads(vm, run == 0 ? 1 : 8);
+
+        /* Random graph: 20000 pairs with random edges, 20 random roots */
+        srand(42);
+        Object **all = (Object**)malloc(20000 * sizeof(Object*));
+        for (int i = 0; i < 20000; i++) {
+            all[i] = new_pair(vm, NULL, NULL);
+        }
+        for (int i = 0; i < 20000; i++) {
+            if (rand() % 3 != 0) pair_set_left(vm, all[i], all[rand() % 20000]);
+            if (rand() % 3 == 0) pair_set_right(vm, all[i], all[rand() % 20000]);
+        }
+        for (int i = 0; i < 20; i++) {
+            push(vm, VAL_OBJ(all[rand() % 20000]));
+        }
+        free(all);
+
+        gc(vm);
+        survivors[run] = vm->num_objects;
+
+        gc_cleanup(vm);
+        vm_destroy(vm);
+    }
+
+    printf("Serial kept %d objects, parallel kept %d\n", survivors[0], survivors[1]);
+    assert(survivors[0] == survivors[1]);
+    assert(survivors[0] > 0 && survivors[0] < 20000);
+
+    printf("PASS Test\n\n");
+}
+
+int main() {
+    printf("=======================================\n");
+    printf("  GC Parallel Marking Tests\n");
+    printf("=======================================\n\n");
+
+    test_tree_marking();
+    test_shared_and_cyclic();
+    test_wide_closures();
+    test_matches_serial();
+
+    printf("=======================================\n");
+    printf("  All Tests PASSED\n");
+    printf("=======================================\n");
+
+    return 0;
+}
@@ -0,0 +1,312 @@
+/*
+ * Allocation Profiler Tests
+ *
+ * Purpose: Verify that sampled allocations are attributed to the right
+ * site (pc, callers and type), that byte sampling estimates what was
+ * really allocated, that sampled objects are followed through every kind
+ * of collection to give per-site survival, and that the report lists
+ * sites by bytes allocated.
+ *
+ * Test case:
+ *   gc_profile_start(vm, GC_SAMPLE_OBJECTS, 1);
+ *   10 pairs kept on the value stack, 30 dropped, then gc(vm)
+ *   Expected: pair site has 40 samples, 10 survived, 30 died
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "vm.h"  /* Includes gc.h automatically */
+#include "instructions.h"
+
+static GCAllocSite* site_at(VM *vm, int32_t pc, ObjectType type) {
+    for (int i = 0; i < vm->profile->site_count; i++) {
+        GCAllocSite *site = &vm->profile->sites[i];
+        if (site->pc == pc && site->type == type) return site;
+    }
+    return NULL;
+}
+
+/* Every listed sample must be one of the list cells on value_stack[slot] */
+static bool samples_in_list(VM *vm, int slot) {
+    for (int i = 0; i < vm->profile->sample_count; i++) {
+        Object *cell = vm->value_stack[slot].obj_val;
+        while (cell && cell != vm->profile->samples[i].obj) {
+            cell = cell->pair.right;
+        }
+        if (!cell) return false;
+    }
+    return true;
+}
+
+static void build_list(VM *vm, int slot, int cells) {
+    for (int i = 0; i < cells; i++) {
+        vm->value_stack[slot] = VAL_OBJ(new_pair(vm, NULL, vm->value_stack[slot].obj_val));
+    }
+}
+
+void test_survival() {
+    printf("Test: Every Object Sampled, Survival per Site\n");
+    printf("---------------------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+    assert(gc_profile_start(vm, GC_SAMPLE_OBJECTS, 1));
+
+    push(vm, VAL_OBJ(NULL));
+    build_list(vm, 0, 10);
+    for (int i = 0; i < 30; i++) {
+        new_pair(vm, NULL, NULL);
+    }
+    push(vm, VAL_OBJ(new_function(vm)));
+
+    GCAllocSite *pairs = site_at(vm, -1, OBJ_PAIR);
+    assert(pairs && pairs->samples == 40 && pairs->objects == 40);
+    assert(pairs->bytes == 40 * gc_type_size(OBJ_PAIR));
+    assert(site_at(vm, -1, OBJ_FUNCTION)->samples == 1);
+    assert(vm->profile->site_count == 2);
+    printf("40 pairs and 1 function at 2 sites, outside vm_run\n");
+
+    gc(vm);
+    pairs = site_at(vm, -1, OBJ_PAIR);
+    assert(pairs->survived == 10 && pairs->died == 30 && pairs->live == 10);
+    assert(pairs->live_bytes == 10 * gc_type_size(OBJ_PAIR));
+    assert(vm->profile->sample_count == 11);
+    printf("After gc: 10 survived, 30 died\n");
+
+    /* Survivors are judged once: dying later does not count as dying young */
+    gc(vm);
+    vm->value_stack[0] = VAL_OBJ(NULL);
+    gc(vm);
+    assert(pairs->survived == 10 && pairs->died == 30 && pairs->live == 0);
+    assert(vm->profile->sample_count == 1);
+    printf("Later collections: survivors counted once, list freed\n");
+
+    gc_profile_stop(vm);
+    assert(vm->profile == NULL);
+    assert(!gc_profile_start(vm, GC_SAMPLE_OBJECTS, 0));
+    assert(gc_profile_start(vm, GC_SAMPLE_BYTES, 0));
+    assert(vm->profile->interval == GC_PROFILE_DEFAULT_INTERVAL);
+
+    gc_cleanup(vm);
+    assert(vm->profile == NULL);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_byte_estimates() {
+    printf("Test: Byte Sampling Estimates and Report Order\n");
+    printf("----------------------------------------------\n");
+
+    VM *vm = vm_create();
+    assert(gc_profile_start(vm, GC_SAMPLE_BYTES, 0));
+
+    /* About 24 MB of pairs, then 12 MB of small and 10 MB of large byte strings */
+    size_t actual[2] = {0, 0};
+    for (int i = 0; i < 1000000; i++) {
+        actual[0] += gc_object_size(new_pair(vm, NULL, NULL));
+    }
+    for (int i = 0; i < 12 * 1024; i++) {
+        actual[1] += gc_object_size(new_bytes(vm, 1000));
+    }
+    for (int i = 0; i < 50; i++) {
+        actual[1] += gc_object_size(new_bytes(vm, 200 * 1024));
+    }
+
+    assert(vm->profile->site_count == 2);
+    for (int i = 0; i < 2; i++) {
+        GCAllocSite *site = site_at(vm, -1, i == 0 ? OBJ_PAIR : OBJ_BYTES);
+        double error = ((double)site->bytes - actual[i]) / actual[i];
+        printf("%s: estimated %llu of %zu bytes (%+.1f%%)\n", i == 0 ? "Pairs" : "Bytes",
+               (unsigned long long)site->bytes, actual[i], 100.0 * error);
+        assert(error > -0.1 && error < 0.1);
+    }
+    uint64_t total = site_at(vm, -1, OBJ_PAIR)->bytes + site_at(vm, -1, OBJ_BYTES)->bytes;
+    double error = ((double)total - vm->gc_stats.bytes_allocated) / vm->gc_stats.bytes_allocated;
+    assert(error > -0.05 && error < 0.05);
+    printf("%ld samples; total within %.1f%% of bytes allocated\n",
+           vm->profile->total_samples, 100.0 * (error < 0 ? -error : error));
+
+    FILE *out = tmpfile();
+    assert(out);
+    gc_profile_report(vm, out, 1);
+    rewind(out);
+    char line[256];
+    int lines = 0;
+    bool pair_first = false;
+    while (fgets(line, sizeof(line), out)) {
+        if (++lines == 5) pair_first = strstr(line, "pair") != NULL;
+    }
+    fclose(out);
+    assert(pair_first);
+    printf("Report lists the pair site first (most bytes)\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_pc_and_callers() {
+    printf("Test: Allocating pc and Call Stack\n");
+    printf("----------------------------------\n");
+
+    /*
+     *  0: CALL 12
+     *  5: PUSH 4
+     * 10: NEWARRAY
+     * 11: HALT
+     * 12: CALL 18      ; f
+     * 17: RET
+     * 18: NEWMAP       ; g
+     * 19: RET
+     */
+    uint8_t code[] = {
+        OP_CALL, 12, 0, 0, 0,
+        OP_PUSH, 4, 0, 0, 0,
+        OP_NEWARRAY,
+        OP_HALT,
+        OP_CALL, 18, 0, 0, 0,
+        OP_RET,
+        OP_NEWMAP,
+        OP_RET
+    };
+
+    VM *vm = vm_create();
+    assert(gc_profile_start(vm, GC_SAMPLE_OBJECTS, 1));
+    assert(vm_load_program(vm, code, sizeof(code)) == VM_OK);
+    assert(vm_run(vm) == VM_OK);
+
+    GCAllocSite *map = site_at(vm, 18, OBJ_MAP);
+    assert(map && map->samples == 1);
+    assert(map->depth == 2 && map->callers[0] == 12 && map->callers[1] == 0);
+    printf("NEWMAP at pc 18, called from 12, called from 0\n");
+
+    GCAllocSite *array = site_at(vm, 10, OBJ_ARRAY);
+    assert(array && array->depth == 0);
+    assert(array->bytes == gc_object_size(vm->value_stack[1].obj_val));
+    printf("NEWARRAY at pc 10, top level\n");
+
+    FILE *out = tmpfile();
+    assert(out);
+    gc_profile_report(vm, out, 0);
+    rewind(out);
+    char line[256];
+    bool found = false;
+    while (fgets(line, sizeof(line), out)) {
+        if (strstr(line, "pc 18 <- 12 <- 0")) found = true;
+    }
+    fclose(out);
+    assert(found);
+    printf("Report shows the call chain\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_moving_collectors() {
+    printf("Test: Samples Followed Through Every Collector\n");
+    printf("----------------------------------------------\n");
+
+    /* Minor collection: promoted samples move, dead young ones are dropped */
+    VM *vm = vm_create();
+    gc_set_mode(vm, GC_MODE_GENERATIONAL);
+    assert(gc_profile_start(vm, GC_SAMPLE_OBJECTS, 1));
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < 100; i++) {
+        build_list(vm, 0, 1);
+        new_pair(vm, NULL, NULL);
+    }
+    gc_minor_collect(vm);
+    GCAllocSite *pairs = site_at(vm, -1, OBJ_PAIR);
+    assert(pairs->survived == 100 && pairs->died == 100);
+    for (int i = 0; i < vm->profile->sample_count; i++) {
+        assert(!gc_in_nursery(vm, vm->profile->samples[i].obj));
+    }
+    assert(samples_in_list(vm, 0));
+    printf("Generational: 100 promoted and followed, 100 died young\n");
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    /* Compaction: every sample points to the object's new copy */
+    vm = vm_create();
+    gc_set_auto_collect(vm, false);
+    assert(gc_profile_start(vm, GC_SAMPLE_OBJECTS, 1));
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < 50; i++) {
+        build_list(vm, 0, 1);
+        new_pair(vm, NULL, NULL);
+    }
+    gc_compact(vm);
+    assert(vm->profile->sample_count == 50);
+    assert(samples_in_list(vm, 0));
+    assert(site_at(vm, -1, OBJ_PAIR)->died == 50);
+    printf("Compaction: 50 samples forwarded\n");
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    /* Incremental: an object allocated black is judged by the next cycle */
+    vm = vm_create();
+    gc_set_auto_collect(vm, false);
+    gc_set_mode(vm, GC_MODE_INCREMENTAL);
+    gc_set_slice_work(vm, 10);
+    assert(gc_profile_start(vm, GC_SAMPLE_OBJECTS, 1));
+    push(vm, VAL_OBJ(NULL));
+    build_list(vm, 0, 100);
+    new_pair(vm, NULL, NULL);
+    gc_incremental_step(vm);
+    assert(vm->gc_phase == GC_PHASE_MARK);
+    new_pair(vm, NULL, NULL);  /* Garbage, but allocated black */
+    while (vm->gc_phase != GC_PHASE_IDLE) {
+        gc_incremental_step(vm);
+    }
+    pairs = site_at(vm, -1, OBJ_PAIR);
+    assert(pairs->survived == 100 && pairs->died == 1 && pairs->live == 101);
+    gc(vm);
+    assert(pairs->survived == 100 && pairs->died == 2 && pairs->live == 100);
+    printf("Incremental: object allocated mid-mark not counted as a survivor\n");
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    /* Background sweep: judged before the sweeper frees anything */
+    vm = vm_create();
+    gc_set_auto_collect(vm, false);
+    gc_set_background_sweep(vm, true);
+    assert(gc_profile_start(vm, GC_SAMPLE_OBJECTS, 1));
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < 5; i++) {
+        build_list(vm, 0, 1);
+        new_pair(vm, NULL, NULL);
+    }
+    gc(vm);
+    pairs = site_at(vm, -1, OBJ_PAIR);
+    assert(pairs->survived == 5 && pairs->died == 5);
+    gc_finish_sweep(vm);
+    assert(samples_in_list(vm, 0));
+    printf("Background sweep: 5 survived, 5 died\n");
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+int main() {
+    printf("=======================================\n");
+    printf("  GC Allocation Profiler Tests\n");
+    printf("=======================================\n\n");
+
+    test_survival();
+    test_byte_estimates();
+    test_pc_and_callers();
+    test_moving_collectors();
+
+    printf("=======================================\n");
+    printf("  All Tests PASSED\n");
+    printf("=======================================\n");
+
+    return 0;
+}
@@ -0,0 +1,276 @@
+/*
+ * Shared Heap Tests
+ *
+ * Purpose: Verify that VMs on several threads can allocate from one heap
+ * through thread-local allocation buffers, that a collection started by
+ * any thread stops the others at a safepoint and keeps what every VM's
+ * value stack reaches, and that weak objects and large objects are
+ * collected in the shared heap as in a private one.
+ *
+ * Test case:
+ *   12 threads, each with its own VM attached to one heap
+ *   Each keeps a 200-element list while allocating garbage
+ *   Expected: many collections, every list intact
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include "vm.h"  /* Includes gc.h automatically */
+#include "instructions.h"
+
+#define WORKERS 12  /* More than the 8 VMs the heap first has room for */
+#define ROUNDS 200
+
+static GCSharedHeap* small_heap(void) {
+    GCHeapPolicy policy;
+    gc_default_heap_policy(&policy);
+    policy.min_heap = 64 * 1024;
+    policy.target_heap = 64 * 1024;
+    return gc_shared_heap_create(&policy);
+}
+
+void test_single_vm() {
+    printf("Test: One VM on a Shared Heap\n");
+    printf("-----------------------------\n");
+
+    GCSharedHeap *heap = gc_shared_heap_create(NULL);
+    assert(heap);
+    VM *vm = vm_create();
+    assert(gc_shared_heap_attach(vm, heap));
+    assert(!gc_shared_heap_attach(vm, heap));
+    gc_set_mode(vm, GC_MODE_GENERATIONAL);
+    assert(vm->gc_mode == GC_MODE_MARK_SWEEP);
+
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < 100; i++) {
+        vm->value_stack[0] = VAL_OBJ(new_pair(vm, NULL, vm->value_stack[0].obj_val));
+        new_pair(vm, NULL, NULL);
+    }
+    push(vm, VAL_OBJ(new_bytes(vm, 10000)));
+    new_bytes(vm, 10000);
+    assert(vm->size_classes[OBJ_PAIR].chunks == NULL && vm->large_objects == NULL);
+    printf("200 pairs and 2 large byte strings allocated in the shared heap\n");
+
+    gc(vm);
+    GCSharedHeapStats stats;
+    gc_shared_heap_stats(heap, &stats);
+    assert(stats.collections == 1);
+    assert(stats.objects_surviving == 101);
+    assert(stats.tlab_refills == 1);
+    printf("After gc: 101 objects survive, 1 TLAB refill\n");
+
+    /* A VM that has allocated privately cannot move to the shared heap */
+    VM *other = vm_create();
+    new_pair(other, NULL, NULL);
+    assert(!gc_shared_heap_attach(other, heap));
+    vm_destroy(other);
+
+    gc_shared_heap_destroy(heap);  /* Refused: vm is still attached */
+    gc_shared_heap_detach(vm);
+    assert(vm->shared_heap == NULL);
+    vm_destroy(vm);
+    gc_shared_heap_destroy(heap);
+
+    printf("PASS Test\n\n");
+}
+
+typedef struct {
+    GCSharedHeap *heap;
+    int id;
+    long checked;
+} Worker;
+
+/* Keep a list of arrays holding the worker's id and round; drop 500 pairs a round */
+static void* worker_run(void *arg) {
+    Worker *w = (Worker*)arg;
+    VM *vm = vm_create();
+    assert(gc_shared_heap_attach(vm, w->heap));
+
+    push(vm, VAL_OBJ(NULL));
+    for (int round = 0; round < ROUNDS; round++) {
+        Object *array = new_array(vm, 4);
+        array->array.items[0] = VAL_INT(w->id);
+        array->array.items[1] = VAL_INT(round);
+        vm->value_stack[0] = VAL_OBJ(new_pair(vm, array, vm->value_stack[0].obj_val));
+        for (int i = 0; i < 500; i++) {
+            new_pair(vm, NULL, NULL);
+        }
+    }
+
+    int round = ROUNDS;
+    for (Object *cell = vm->value_stack[0].obj_val; cell; cell = cell->pair.right) {
+        Object *array = cell->pair.left;
+        assert(array->array.items[0].int_val == w->id);
+        assert(array->array.items[1].int_val == --round);
+        w->checked++;
+    }
+    assert(round == 0);
+
+    vm_destroy(vm);  /* Detaches */
+    return NULL;
+}
+
+static void run_workers(bool tlabs) {
+    GCSharedHeap *heap = small_heap();
+    assert(gc_shared_heap_set_tlabs(heap, tlabs));
+
+    pthread_t threads[WORKERS];
+    Worker workers[WORKERS];
+    for (int i = 0; i < WORKERS; i++) {
+        workers[i] = (Worker){heap, i, 0};
+        assert(pthread_create(&threads[i], NULL, worker_run, &workers[i]) == 0);
+    }
+    for (int i = 0; i < WORKERS; i++) {
+        pthread_join(threads[i], NULL);
+        assert(workers[i].checked == ROUNDS);
+    }
+
+    GCSharedHeapStats stats;
+    gc_shared_heap_stats(heap, &stats);
+    assert(stats.collections > 0);
+    printf("TLABs %s: %ld collections, %ld of %d allocations took the lock, lists intact\n",
+           tlabs ? "on" : "off", stats.collections, stats.lock_acquisitions,
+           WORKERS * ROUNDS * 502);
+    if (tlabs) {
+        assert(stats.lock_acquisitions < WORKERS * ROUNDS * 502 / 100);
+    } else {
+        assert(stats.lock_acquisitions == WORKERS * ROUNDS * 502);
+    }
+
+    /* Every worker has detached: nothing is reachable any more */
+    VM *vm = vm_create();
+    assert(gc_shared_heap_attach(vm, heap));
+    gc(vm);
+    gc_shared_heap_stats(heap, &stats);
+    assert(stats.objects_surviving == 0 && stats.bytes_surviving == 0);
+    vm_destroy(vm);
+    gc_shared_heap_destroy(heap);
+}
+
+void test_threads() {
+    printf("Test: %d Threads Allocating Concurrently\n", WORKERS);
+    printf("----------------------------------------\n");
+
+    run_workers(true);
+    run_workers(false);
+
+    printf("PASS Test\n\n");
+}
+
+typedef struct {
+    GCSharedHeap *heap;
+    VM *vm;
+    int running;   /* Atomic */
+    int done;      /* Atomic */
+} LoopWorker;
+
+/* Count down from 20 million in bytecode, allocating nothing */
+static void* loop_run(void *arg) {
+    static uint8_t code[] = {
+        OP_PUSH, 0x00, 0x2D, 0x31, 0x01,   /*  0: PUSH 20000000 */
+        OP_PUSH, 1, 0, 0, 0,               /*  5: PUSH 1 */
+        OP_SUB,                            /* 10 */
+        OP_DUP,                            /* 11 */
+        OP_JNZ, 5, 0, 0, 0,                /* 12: JNZ 5 */
+        OP_HALT                            /* 17 */
+    };
+    LoopWorker *w = (LoopWorker*)arg;
+
+    vm_load_program(w->vm, code, sizeof(code));
+    __atomic_store_n(&w->running, 1, __ATOMIC_RELEASE);
+    assert(vm_run(w->vm) == VM_OK);
+    __atomic_store_n(&w->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+void test_safepoint_in_vm_run() {
+    printf("Test: Collection Stops a Thread Running Bytecode\n");
+    printf("------------------------------------------------\n");
+
+    GCSharedHeap *heap = gc_shared_heap_create(NULL);
+    VM *vm = vm_create();
+    assert(gc_shared_heap_attach(vm, heap));
+
+    LoopWorker w = {heap, vm_create(), 0, 0};
+    assert(gc_shared_heap_attach(w.vm, heap));
+    push(w.vm, VAL_OBJ(new_pair(w.vm, NULL, NULL)));  /* Root held by the looping VM */
+    new_pair(vm, NULL, NULL);
+
+    pthread_t thread;
+    assert(pthread_create(&thread, NULL, loop_run, &w) == 0);
+    while (!__atomic_load_n(&w.running, __ATOMIC_ACQUIRE)) {
+        sched_yield();
+    }
+
+    gc(vm);
+    assert(!__atomic_load_n(&w.done, __ATOMIC_ACQUIRE));
+    GCSharedHeapStats stats;
+    gc_shared_heap_stats(heap, &stats);
+    assert(stats.collections == 1 && stats.objects_surviving == 1);
+    printf("Collected while the loop ran: its VM parked at a jump, its root survived\n");
+
+    pthread_join(thread, NULL);
+    assert(w.vm->stack[0] == 0);
+    vm_destroy(w.vm);
+    vm_destroy(vm);
+    gc_shared_heap_destroy(heap);
+
+    printf("PASS Test\n\n");
+}
+
+void test_weak_after_detach() {
+    printf("Test: Weak References Outlive Their VM\n");
+    printf("--------------------------------------\n");
+
+    GCSharedHeap *heap = gc_shared_heap_create(NULL);
+
+    /* a creates both weak references, then detaches */
+    VM *a = vm_create();
+    assert(gc_shared_heap_attach(a, heap));
+    push(a, VAL_OBJ(new_pair(a, NULL, NULL)));
+    push(a, VAL_OBJ(new_pair(a, NULL, NULL)));
+    Object *dies = new_weak_ref(a, a->value_stack[0].obj_val);
+    Object *lives = new_weak_ref(a, a->value_stack[1].obj_val);
+    Object *kept = a->value_stack[1].obj_val;
+    gc_shared_heap_detach(a);
+    assert(a->weak_objects.count == 0);
+
+    /* b holds the weak references and one target */
+    VM *b = vm_create();
+    assert(gc_shared_heap_attach(b, heap));
+    push(b, VAL_OBJ(dies));
+    push(b, VAL_OBJ(lives));
+    push(b, VAL_OBJ(kept));
+    gc(b);
+    assert(weak_get(dies) == NULL);
+    assert(weak_get(lives) == kept);
+    printf("Target only a detached VM held was cleared; the other kept\n");
+
+    vm_destroy(b);
+    vm_destroy(a);
+    gc_shared_heap_destroy(heap);
+
+    printf("PASS Test\n\n");
+}
+
+int main() {
+    printf("=======================================\n");
+    printf("  GC Shared Heap Tests\n");
+    printf("=======================================\n\n");
+
+    test_single_vm();
+    test_threads();
+    test_safepoint_in_vm_run();
+    test_weak_after_detach();
+
+    printf("=======================================\n");
+    printf("  All Tests PASSED\n");
+    printf("=======================================\n");
+
+    return 0;
+}
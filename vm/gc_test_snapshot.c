@@ -0,0 +1,269 @@
+/*
+ * Heap Snapshot Tests
+ *
+ * Purpose: Verify that gc_write_snapshot records every live object with
+ * its type, size and strong references, leaves the heap as it was (marks
+ * clear, nothing moved), and that the offline analysis computes correct
+ * dominators, retained sizes and retainer paths.
+ *
+ * Test case:
+ *   root -> A (array) -> B, C (pairs) -> D (shared pair)
+ *   Expected: A retains A + B + C + D; B and C retain only themselves;
+ *             D's idom is A
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "vm.h"  /* Includes gc.h automatically */
+#include "snapshot.h"
+
+#define SNAPSHOT_PATH "gc_test_snapshot.snap"
+
+static uint64_t id_of(Object *obj) {
+    return (uint64_t)(uintptr_t)obj >> 3;
+}
+
+static uint32_t node_of(HeapGraph *graph, Object *obj) {
+    for (uint32_t i = 1; i < graph->count; i++) {
+        if (graph->id[i] == id_of(obj)) return i;
+    }
+    assert(!"object not in snapshot");
+    return 0;
+}
+
+static bool all_unmarked(VM *vm) {
+    HeapIterator it;
+    for (Object *obj = gc_heap_first(vm, &it); obj; obj = gc_heap_next(&it)) {
+        if (obj->marked) return false;
+    }
+    return true;
+}
+
+void test_records() {
+    printf("Test: Objects, Sizes and Edges Recorded\n");
+    printf("---------------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    /* value_stack: [0] list of 3 pairs, [1] integer, [2] closure */
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < 3; i++) {
+        vm->value_stack[0] = VAL_OBJ(new_pair(vm, NULL, vm->value_stack[0].obj_val));
+    }
+    push(vm, VAL_INT(42));
+    Object *fn = new_function(vm);
+    push(vm, VAL_OBJ(new_closure(vm, fn, vm->value_stack[0].obj_val)));
+    new_pair(vm, NULL, NULL);  /* garbage */
+
+    assert(gc_write_snapshot(vm, SNAPSHOT_PATH));
+    assert(vm->num_objects == 5);
+    assert(all_unmarked(vm));
+    printf("Garbage collected first; marks left clear\n");
+
+    SnapshotReader reader;
+    SnapshotRecord record;
+    assert(snapshot_open(&reader, SNAPSHOT_PATH));
+    assert(reader.root_count == 2);
+    assert(reader.root_slots[0] == 0 && reader.root_slots[1] == 2);
+    assert(reader.roots[0] == id_of(vm->value_stack[0].obj_val));
+
+    int records = 0;
+    uint64_t bytes = 0;
+    while (snapshot_next(&reader, &record)) {
+        records++;
+        bytes += record.size;
+        if (record.id == id_of(vm->value_stack[0].obj_val)) {
+            assert(record.type == OBJ_PAIR && record.size == gc_type_size(OBJ_PAIR));
+            assert(record.edge_count == 1);
+            assert(record.edges[0] == id_of(vm->value_stack[0].obj_val->pair.right));
+        }
+        if (record.id == id_of(vm->value_stack[2].obj_val)) {
+            assert(record.type == OBJ_CLOSURE && record.edge_count == 2);
+        }
+    }
+    assert(reader.complete);
+    assert(records == 5 && reader.object_count == 5);
+    assert(bytes == vm->bytes_allocated && reader.total_bytes == bytes);
+    assert(strcmp(reader.type_names[OBJ_CLOSURE], "closure") == 0);
+    snapshot_close(&reader);
+    printf("5 records; sizes add up to bytes_allocated; roots keep stack slots\n");
+
+    gc(vm);
+    assert(vm->num_objects == 5);
+    printf("Heap unchanged by the snapshot\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+    remove(SNAPSHOT_PATH);
+
+    printf("PASS Test\n\n");
+}
+
+void test_dominators() {
+    printf("Test: Dominators and Retained Sizes\n");
+    printf("-----------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    /* [0]: A = array [B, C]; B and C both point to D. [1]: E, alone */
+    push(vm, VAL_OBJ(new_array(vm, 2)));
+    Object *d = new_pair(vm, NULL, NULL);
+    Object *b = new_pair(vm, d, NULL);
+    Object *c = new_pair(vm, NULL, d);
+    Object *a = vm->value_stack[0].obj_val;
+    array_set(vm, a, 0, VAL_OBJ(b));
+    array_set(vm, a, 1, VAL_OBJ(c));
+    push(vm, VAL_OBJ(new_bytes(vm, 100)));
+    Object *e = vm->value_stack[1].obj_val;
+
+    assert(gc_write_snapshot(vm, SNAPSHOT_PATH));
+
+    HeapGraph graph;
+    assert(heap_graph_load(&graph, SNAPSHOT_PATH));
+    assert(heap_graph_analyze(&graph));
+    assert(graph.count == 1 + 5);
+    assert(graph.unreachable == 0);
+
+    uint32_t na = node_of(&graph, a), nb = node_of(&graph, b);
+    uint32_t nc = node_of(&graph, c), nd = node_of(&graph, d), ne = node_of(&graph, e);
+    assert(graph.idom[na] == 0 && graph.idom[ne] == 0);
+    assert(graph.idom[nb] == na && graph.idom[nc] == na);
+    assert(graph.idom[nd] == na);
+    printf("Shared D dominated by A, not by B or C\n");
+
+    size_t pair = gc_type_size(OBJ_PAIR);
+    assert(graph.retained[na] == gc_object_size(a) + 3 * pair);
+    assert(graph.dominated[na] == 4);
+    assert(graph.retained[nb] == pair && graph.retained[nd] == pair);
+    assert(graph.retained[ne] == gc_object_size(e));
+    printf("A retains %llu bytes (4 objects); B retains only itself\n",
+           (unsigned long long)graph.retained[na]);
+
+    /* Shortest path: stack[0] -> A -> B -> D */
+    assert(graph.parent[nd] == nb);
+    assert(graph.parent[nb] == na && graph.parent[na] == 0);
+    assert(graph.root_slot[na] == 0 && graph.root_slot[ne] == 1);
+    assert(graph.reached == graph.count);
+    printf("Retainer path to D: stack[0] -> A -> B -> D\n");
+
+    heap_graph_free(&graph);
+    gc_cleanup(vm);
+    vm_destroy(vm);
+    remove(SNAPSHOT_PATH);
+
+    printf("PASS Test\n\n");
+}
+
+void test_weak_edges_left_out() {
+    printf("Test: Weak References Are Not Edges\n");
+    printf("-----------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    /* [0]: key, [1]: weak ref to key, [2]: weak map {key: value} */
+    push(vm, VAL_OBJ(new_pair(vm, NULL, NULL)));
+    push(vm, VAL_OBJ(new_weak_ref(vm, vm->value_stack[0].obj_val)));
+    push(vm, VAL_OBJ(new_weak_map(vm)));
+    Object *value = new_pair(vm, NULL, NULL);
+    assert(map_set(vm, vm->value_stack[2].obj_val, vm->value_stack[0], VAL_OBJ(value)));
+
+    assert(gc_write_snapshot(vm, SNAPSHOT_PATH));
+    assert(all_unmarked(vm));
+
+    HeapGraph graph;
+    assert(heap_graph_load(&graph, SNAPSHOT_PATH));
+    assert(heap_graph_analyze(&graph));
+    assert(graph.count == 1 + (uint32_t)vm->num_objects);
+
+    uint32_t weak = node_of(&graph, vm->value_stack[1].obj_val);
+    uint32_t table = node_of(&graph, vm->value_stack[2].obj_val->map.table);
+    assert(graph.edge_start[weak + 1] == graph.edge_start[weak]);
+    assert(graph.edge_start[table + 1] - graph.edge_start[table] == 1);
+    assert(graph.edges[graph.edge_start[table]] == node_of(&graph, value));
+    assert(graph.idom[node_of(&graph, vm->value_stack[0].obj_val)] == 0);
+    printf("Weak reference has no edges; weak map table points to values only\n");
+
+    heap_graph_free(&graph);
+    gc_cleanup(vm);
+    vm_destroy(vm);
+    remove(SNAPSHOT_PATH);
+
+    printf("PASS Test\n\n");
+}
+
+void test_large_heap_and_errors() {
+    printf("Test: Compact Output, Generational Mode, Bad Files\n");
+    printf("--------------------------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_mode(vm, GC_MODE_GENERATIONAL);
+
+    /* 100000-cell list, partly still in the nursery */
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < 100000; i++) {
+        vm->value_stack[0] = VAL_OBJ(new_pair(vm, NULL, vm->value_stack[0].obj_val));
+    }
+    size_t peak = vm->peak_bytes;
+    assert(gc_write_snapshot(vm, SNAPSHOT_PATH));
+    assert(vm->nursery_top == 0);
+    assert(vm->peak_bytes == peak);
+
+    FILE *file = fopen(SNAPSHOT_PATH, "rb");
+    assert(file);
+    fseek(file, 0, SEEK_END);
+    long file_bytes = ftell(file);
+    fclose(file);
+    assert(file_bytes < 100000 * 16);
+    printf("100000 pairs in %ld bytes (%.1f per object)\n", file_bytes, file_bytes / 100000.0);
+
+    HeapGraph graph;
+    assert(heap_graph_load(&graph, SNAPSHOT_PATH));
+    assert(heap_graph_analyze(&graph));
+    assert(graph.count == 100001);
+    uint32_t head = node_of(&graph, vm->value_stack[0].obj_val);
+    assert(graph.retained[head] == 100000 * gc_type_size(OBJ_PAIR));
+    heap_graph_free(&graph);
+    printf("Head of the list retains all of it\n");
+
+    /* A truncated file is refused */
+    file = fopen(SNAPSHOT_PATH, "r+b");
+    assert(file);
+    char *data = (char*)malloc(file_bytes);
+    assert(fread(data, 1, file_bytes, file) == (size_t)file_bytes);
+    fclose(file);
+    file = fopen(SNAPSHOT_PATH, "wb");
+    fwrite(data, 1, file_bytes - 3, file);
+    fclose(file);
+    free(data);
+    assert(!heap_graph_load(&graph, SNAPSHOT_PATH));
+    assert(!gc_write_snapshot(vm, "/nonexistent/dir/heap.snap"));
+    printf("Truncated snapshot and unwritable path reported\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+    remove(SNAPSHOT_PATH);
+
+    printf("PASS Test\n\n");
+}
+
+int main() {
+    printf("=======================================\n");
+    printf("  GC Heap Snapshot Tests\n");
+    printf("=======================================\n\n");
+
+    test_records();
+    test_dominators();
+    test_weak_edges_left_out();
+    test_large_heap_and_errors();
+
+    printf("=======================================\n");
+    printf("  All Tests PASSED\n");
+    printf("=======================================\n");
+
+    return 0;
+}
@@ -0,0 +1,217 @@
+/*
+ * GC Telemetry Tests
+ *
+ * Purpose: Verify the statistics kept by the collector: allocation, freed
+ * and surviving counts, per-kind collection counts, phase times, the event
+ * callback, that logging is off by default, and the JSON dump.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "vm.h"  /* Includes gc.h automatically */
+
+/* Records every event passed to the callback */
+typedef struct {
+    int count;
+    int by_kind[3];
+    GCCycleStats last;
+} EventLog;
+
+static void record_event(VM *vm, const GCCycleStats *cycle, void *user_data) {
+    EventLog *log = (EventLog*)user_data;
+    (void)vm;
+    log->count++;
+    log->by_kind[cycle->kind]++;
+    log->last = *cycle;
+}
+
+void test_counts() {
+    printf("Test: Allocated, Freed and Surviving Counts\n");
+    printf("-------------------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < 300; i++) {
+        vm->value_stack[0] = VAL_OBJ(new_pair(vm, NULL, vm->value_stack[0].obj_val));
+        new_pair(vm, NULL, NULL);  /* garbage */
+    }
+    gc(vm);
+
+    const GCStats *stats = gc_get_stats(vm);
+    assert(stats->collections == 1);
+    assert(stats->objects_allocated == 600);
+    assert(stats->bytes_allocated == 600 * gc_type_size(OBJ_PAIR));
+    assert(stats->objects_freed == 300);
+    assert(stats->objects_surviving == 300);
+    assert(stats->last.kind == GC_EVENT_FULL);
+    assert(stats->last.objects_freed == 300);
+    assert(stats->last.objects_surviving == 300);
+    assert(stats->last.pause_us >= stats->last.mark_us);
+    assert(stats->pauses.count == 1);
+    printf("600 allocated, 300 freed, 300 surviving\n");
+
+    pop(vm);
+    gc(vm);
+    assert(stats->collections == 2);
+    assert(stats->objects_freed == 600);
+    assert(stats->bytes_freed == stats->bytes_allocated);
+    assert(stats->objects_surviving == 0);
+    printf("Dropping the root frees the rest\n");
+
+    gc_reset_stats(vm);
+    assert(stats->collections == 0 && stats->objects_allocated == 0);
+    assert(stats->pauses.count == 0);
+    printf("Reset clears the totals\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_callback_kinds() {
+    printf("Test: Event Callback per Collection Kind\n");
+    printf("----------------------------------------\n");
+
+    GCMode modes[] = {GC_MODE_MARK_SWEEP, GC_MODE_GENERATIONAL, GC_MODE_INCREMENTAL};
+    GCEventKind kinds[] = {GC_EVENT_FULL, GC_EVENT_MINOR, GC_EVENT_INCREMENTAL};
+
+    for (int m = 0; m < 3; m++) {
+        VM *vm = vm_create();
+        EventLog log = {0};
+        gc_set_mode(vm, modes[m]);
+        gc_set_event_callback(vm, record_event, &log);
+
+        push(vm, VAL_OBJ(new_pair(vm, NULL, NULL)));
+        for (int i = 0; i < 50000; i++) {
+            new_pair(vm, NULL, NULL);
+        }
+
+        const GCStats *stats = gc_get_stats(vm);
+        assert(log.by_kind[kinds[m]] > 0);
+        assert(log.count == stats->collections + stats->minor_collections +
+                            stats->incremental_cycles);
+        printf("Mode %d: %d events, %d of the expected kind\n",
+               m, log.count, log.by_kind[kinds[m]]);
+
+        gc_set_event_callback(vm, NULL, NULL);
+        gc_cleanup(vm);
+        vm_destroy(vm);
+    }
+
+    printf("PASS Test\n\n");
+}
+
+void test_incremental_cycle_totals() {
+    printf("Test: Incremental Cycle Reported Once\n");
+    printf("-------------------------------------\n");
+
+    VM *vm = vm_create();
+    EventLog log = {0};
+    gc_set_auto_collect(vm, false);
+    gc_set_mode(vm, GC_MODE_INCREMENTAL);
+    gc_set_event_callback(vm, record_event, &log);
+
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < 5000; i++) {
+        vm->value_stack[0] = VAL_OBJ(new_pair(vm, NULL, vm->value_stack[0].obj_val));
+        new_pair(vm, NULL, NULL);
+    }
+
+    /* Small slices: many pauses, one event */
+    gc_set_slice_work(vm, 100);
+    int slices = 0;
+    do {
+        gc_incremental_step(vm);
+        slices++;
+    } while (vm->gc_phase != GC_PHASE_IDLE);
+
+    assert(slices > 1);
+    assert(log.count == 1);
+    assert(log.last.kind == GC_EVENT_INCREMENTAL);
+    assert(log.last.objects_freed == 5000);
+    assert(log.last.objects_surviving == 5000);
+    assert(gc_get_stats(vm)->pauses.count == slices);
+    printf("%d slices, one event freeing 5000 objects\n", slices);
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_verbose_off_by_default() {
+    printf("Test: Logging Off by Default\n");
+    printf("----------------------------\n");
+
+    VM *vm = vm_create();
+    assert(vm->gc_verbose == false);
+    assert(vm->gc_callback == NULL);
+
+    gc_set_verbose(vm, true);
+    assert(vm->gc_verbose == true);
+    gc_set_verbose(vm, false);
+    printf("No log or callback unless requested\n");
+
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_json_dump() {
+    printf("Test: JSON Statistics Dump\n");
+    printf("--------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    for (int i = 0; i < 100; i++) {
+        new_pair(vm, NULL, NULL);
+    }
+    gc(vm);
+
+    FILE *out = tmpfile();
+    assert(out != NULL);
+    gc_write_stats_json(vm, out);
+
+    char buffer[4096];
+    rewind(out);
+    size_t len = fread(buffer, 1, sizeof(buffer) - 1, out);
+    buffer[len] = '\0';
+    fclose(out);
+
+    assert(buffer[0] == '{');
+    assert(strstr(buffer, "\"collections\": 1,"));
+    assert(strstr(buffer, "\"freed\": {\"objects\": 100,"));
+    assert(strstr(buffer, "\"surviving\": {\"objects\": 0,"));
+    assert(strstr(buffer, "\"phase_us\""));
+    assert(strstr(buffer, "\"histogram\": [{"));
+    printf("JSON contains counts, phases and histogram\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+int main() {
+    printf("=======================================\n");
+    printf("  GC Telemetry Tests\n");
+    printf("=======================================\n\n");
+
+    test_counts();
+    test_callback_kinds();
+    test_incremental_cycle_totals();
+    test_verbose_off_by_default();
+    test_json_dump();
+
+    printf("=======================================\n");
+    printf("  All Tests PASSED\n");
+    printf("=======================================\n");
+
+    return 0;
+}
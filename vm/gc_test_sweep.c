@@ -35,7 +35,8 @@ void test_unreachable_collection() {
 
     /* Object should be freed, heap should be empty */
     assert(vm->num_objects == 0);
-    assert(vm->first_object == NULL);
+    HeapIterator it;
+    assert(gc_heap_first(vm, &it) == NULL);
     printf("After GC: 0 objects (object freed)\n");
 
     vm_destroy(vm);
@@ -118,6 +119,7 @@ void test_gc_threshold_update() {
 
     /* Disable auto GC to control when GC runs */
     gc_set_auto_collect(vm, false);
+    gc_set_pacing(vm, GC_PACING_OBJECTS);
 
     assert(vm->max_objects == 8);
     printf("Initial threshold: %d\n", vm->max_objects);
@@ -0,0 +1,320 @@
+/*
+ * Weak Reference and Ephemeron Tests
+ *
+ * Purpose: Verify that weak references do not keep their targets alive and
+ * are cleared when the target is collected, that weak-keyed maps keep a
+ * value only while its key is reachable (even when the value refers back
+ * to the key), and that clearing works with every collector mode.
+ *
+ * Test case:
+ *   Obj* a = new_pair(NULL, NULL);
+ *   Obj* w = new_weak_ref(a);
+ *   push(vm, VAL_OBJ(w));
+ *   gc(vm);
+ *   Expected: a is freed, weak_get(w) == NULL
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "vm.h"  /* Includes gc.h automatically */
+
+void test_weak_ref_cleared() {
+    printf("Test: Weak Reference Does Not Keep Target\n");
+    printf("-----------------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    Object *a = new_pair(vm, NULL, NULL);
+    Object *w = new_weak_ref(vm, a);
+    assert(w->type == OBJ_WEAK && weak_get(w) == a);
+    push(vm, VAL_OBJ(w));
+
+    /* Marking does not follow the weak reference */
+    gc_mark_roots(vm);
+    assert(w->marked == true);
+    assert(a->marked == false);
+    printf("Weak reference marked, target not\n");
+
+    gc_sweep(vm);
+    assert(weak_get(w) == NULL);
+    assert(vm->num_objects == 1);
+    printf("Target freed and weak reference cleared\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_weak_ref_kept() {
+    printf("Test: Weak Reference to a Live Object\n");
+    printf("-------------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    Object *a = new_pair(vm, NULL, NULL);
+    push(vm, VAL_OBJ(a));
+    push(vm, VAL_OBJ(new_weak_ref(vm, a)));
+    push(vm, VAL_OBJ(new_weak_ref(vm, NULL)));
+
+    gc(vm);
+    assert(vm->num_objects == 3);
+    assert(weak_get(vm->value_stack[1].obj_val) == a);
+    assert(weak_get(vm->value_stack[2].obj_val) == NULL);
+    printf("Strongly held target survives; weak reference intact\n");
+
+    /* Dropping the strong root lets the target go */
+    vm->value_stack[0] = VAL_OBJ(NULL);
+    gc(vm);
+    assert(vm->num_objects == 2);
+    assert(weak_get(vm->value_stack[1].obj_val) == NULL);
+    printf("Target freed once only the weak reference is left\n");
+
+    /* Dead weak references leave the collector's list */
+    pop(vm);
+    pop(vm);
+    gc(vm);
+    assert(vm->num_objects == 0);
+    assert(vm->weak_objects.count == 0);
+    printf("Unreachable weak references collected and forgotten\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_ephemeron_entries() {
+    printf("Test: Weak-Keyed Map Entries Follow Their Keys\n");
+    printf("----------------------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    /* value_stack[0]: map, [1]: live key */
+    push(vm, VAL_OBJ(new_weak_map(vm)));
+    push(vm, VAL_OBJ(new_pair(vm, NULL, NULL)));
+    Object *map = vm->value_stack[0].obj_val;
+    Object *live_key = vm->value_stack[1].obj_val;
+    Object *dead_key = new_pair(vm, NULL, NULL);
+
+    /* Each value refers back to its key */
+    assert(map_set(vm, map, VAL_OBJ(live_key), VAL_OBJ(new_pair(vm, live_key, NULL))));
+    assert(map_set(vm, map, VAL_OBJ(dead_key), VAL_OBJ(new_pair(vm, dead_key, NULL))));
+    assert(map_set(vm, map, VAL_INT(5), VAL_OBJ(new_pair(vm, NULL, NULL))));
+    assert(map->map.count == 3);
+
+    gc(vm);
+
+    /* map, table, live key, its value, the integer key's value */
+    assert(vm->num_objects == 5);
+    assert(map->map.count == 2);
+    Value value;
+    assert(map_get(map, VAL_OBJ(live_key), &value));
+    assert(value.obj_val->pair.left == live_key);
+    assert(map_get(map, VAL_INT(5), NULL));
+    printf("Dead key's entry removed though its value pointed at it\n");
+
+    /* Dropping the last key empties the map of object keys */
+    pop(vm);
+    gc(vm);
+    assert(map->map.count == 1);
+    assert(vm->num_objects == 3);
+    printf("Integer keys are held strongly\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_ephemeron_chain() {
+    printf("Test: Chained Ephemerons\n");
+    printf("------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    /* k0 is rooted; map[k0] = k1, map[k1] = k2, map[k2] = k3 */
+    push(vm, VAL_OBJ(new_weak_map(vm)));
+    Object *keys[4];
+    for (int i = 0; i < 4; i++) {
+        keys[i] = new_pair(vm, NULL, NULL);
+    }
+    push(vm, VAL_OBJ(keys[0]));
+
+    /* Inserted last link first, so one pass over the table is not enough */
+    Object *map = vm->value_stack[0].obj_val;
+    for (int i = 2; i >= 0; i--) {
+        assert(map_set(vm, map, VAL_OBJ(keys[i]), VAL_OBJ(keys[i + 1])));
+    }
+
+    gc(vm);
+    assert(map->map.count == 3);
+    assert(vm->num_objects == 2 + 4);
+    printf("Values reached through other entries' values are kept\n");
+
+    pop(vm);
+    gc(vm);
+    assert(map->map.count == 0);
+    assert(vm->num_objects == 2);
+    printf("Whole chain freed once the first key is dropped\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_cache_shrinks() {
+    printf("Test: Memoization Cache Shrinks\n");
+    printf("-------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    /* 1000 cached results; only the last 10 keys are still in use */
+    push(vm, VAL_OBJ(new_weak_map(vm)));
+    push(vm, VAL_OBJ(new_array(vm, 10)));
+    for (int i = 0; i < 1000; i++) {
+        Object *key = new_pair(vm, NULL, NULL);
+        array_set(vm, vm->value_stack[1].obj_val, i % 10, VAL_OBJ(key));
+        Object *result = new_bytes(vm, 64);
+        assert(map_set(vm, vm->value_stack[0].obj_val, VAL_OBJ(key), VAL_OBJ(result)));
+    }
+    Object *map = vm->value_stack[0].obj_val;
+    assert(map->map.count == 1000);
+
+    gc(vm);
+    assert(map->map.count == 10);
+    Object *keys = vm->value_stack[1].obj_val;
+    for (int i = 0; i < 10; i++) {
+        assert(map_get(map, keys->array.items[i], NULL));
+    }
+    printf("1000 entries down to the 10 with live keys\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_moving_collectors() {
+    printf("Test: Weak References with Moving Collectors\n");
+    printf("--------------------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+
+    /* Compaction: live target moved, weak reference follows it */
+    push(vm, VAL_OBJ(new_pair(vm, NULL, NULL)));
+    new_pair(vm, NULL, NULL);  /* garbage */
+    push(vm, VAL_OBJ(new_weak_ref(vm, vm->value_stack[0].obj_val)));
+    push(vm, VAL_OBJ(new_weak_ref(vm, new_pair(vm, NULL, NULL))));
+    gc_compact(vm);
+    assert(weak_get(vm->value_stack[1].obj_val) == vm->value_stack[0].obj_val);
+    assert(weak_get(vm->value_stack[2].obj_val) == NULL);
+    assert(vm->weak_objects.items[0] == vm->value_stack[1].obj_val);
+    printf("Compaction: moved target followed, dead one cleared\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    /* Generational: young targets promoted or cleared by a minor collection */
+    vm = vm_create();
+    gc_set_mode(vm, GC_MODE_GENERATIONAL);
+    push(vm, VAL_OBJ(new_pair(vm, NULL, NULL)));
+    push(vm, VAL_OBJ(new_weak_ref(vm, vm->value_stack[0].obj_val)));
+    push(vm, VAL_OBJ(new_weak_ref(vm, new_pair(vm, NULL, NULL))));
+    gc_minor_collect(vm);
+    Object *old_weak = vm->value_stack[1].obj_val;
+    assert(!gc_in_nursery(vm, old_weak));
+    assert(weak_get(old_weak) == vm->value_stack[0].obj_val);
+    assert(weak_get(vm->value_stack[2].obj_val) == NULL);
+    printf("Minor GC: weak reference promoted, young targets forwarded or cleared\n");
+
+    /* A weak reference is not a root for the minor collection */
+    Object *young = new_pair(vm, NULL, NULL);
+    Object *weak = new_weak_ref(vm, young);
+    push(vm, VAL_OBJ(weak));
+    gc_minor_collect(vm);
+    assert(weak_get(vm->value_stack[3].obj_val) == NULL);
+    printf("Unreachable young target cleared\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+void test_incremental_and_background() {
+    printf("Test: Clearing with Incremental and Background Sweep\n");
+    printf("----------------------------------------------------\n");
+
+    VM *vm = vm_create();
+    gc_set_auto_collect(vm, false);
+    gc_set_mode(vm, GC_MODE_INCREMENTAL);
+    gc_set_slice_work(vm, 10);
+
+    /* A 100-cell list keeps the mark phase going for several slices */
+    push(vm, VAL_OBJ(NULL));
+    for (int i = 0; i < 100; i++) {
+        vm->value_stack[0] = VAL_OBJ(new_pair(vm, NULL, vm->value_stack[0].obj_val));
+    }
+    Object *garbage = new_pair(vm, NULL, NULL);
+
+    gc_incremental_step(vm);
+    assert(vm->gc_phase == GC_PHASE_MARK);
+    push(vm, VAL_OBJ(new_weak_ref(vm, garbage)));  /* Allocated black, mid-mark */
+    while (vm->gc_phase != GC_PHASE_IDLE) {
+        gc_incremental_step(vm);
+    }
+    assert(weak_get(vm->value_stack[1].obj_val) == NULL);
+    assert(vm->num_objects == 101);
+    printf("Incremental: weak reference made during marking cleared\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    vm = vm_create();
+    gc_set_auto_collect(vm, false);
+    gc_set_background_sweep(vm, true);
+    push(vm, VAL_OBJ(new_weak_ref(vm, new_pair(vm, NULL, NULL))));
+    push(vm, VAL_OBJ(new_weak_map(vm)));
+    assert(map_set(vm, vm->value_stack[1].obj_val, VAL_OBJ(new_pair(vm, NULL, NULL)), VAL_INT(1)));
+
+    gc(vm);
+    assert(weak_get(vm->value_stack[0].obj_val) == NULL);
+    assert(vm->value_stack[1].obj_val->map.count == 0);
+    gc_finish_sweep(vm);
+    assert(vm->num_objects == 3);
+    printf("Background sweep: cleared before the sweeper runs\n");
+
+    gc_cleanup(vm);
+    vm_destroy(vm);
+
+    printf("PASS Test\n\n");
+}
+
+int main() {
+    printf("=======================================\n");
+    printf("  GC Weak Reference Tests\n");
+    printf("=======================================\n\n");
+
+    test_weak_ref_cleared();
+    test_weak_ref_kept();
+    test_ephemeron_entries();
+    test_ephemeron_chain();
+    test_cache_shrinks();
+    test_moving_collectors();
+    test_incremental_and_background();
+
+    printf("=======================================\n");
+    printf("  All Tests PASSED\n");
+    printf("=======================================\n");
+
+    return 0;
+}
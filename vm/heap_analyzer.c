@@ -0,0 +1,208 @@
+/*
+ * Heap snapshot analyzer: reads a file written by gc_write_snapshot (for
+ * example with vm --gc-snapshot=FILE) and reports what the heap holds and
+ * what keeps it alive.
+ *
+ *   - objects and bytes per type, and the bytes each type retains (freed
+ *     if every object of that type became unreachable)
+ *   - the objects retaining the most memory, by dominator tree: an object's
+ *     retained size is what would be freed if it alone were dropped
+ *   - for each of those, the shortest path to it from the value stack
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "snapshot.h"
+
+#define DEFAULT_TOP 10
+#define MAX_PATH_SHOWN 12   /* Longer paths show their two ends */
+
+static void print_usage(const char *program_name) {
+    printf("Usage: %s [--top=N] <snapshot_file>\n", program_name);
+    printf("\n");
+    printf("Summarizes a heap snapshot written by 'vm --gc-snapshot=FILE'.\n");
+    printf("\n");
+    printf("Options:\n");
+    printf("  -h, --help     Show this help message\n");
+    printf("  --top=N        Number of top retainers to show (default %d)\n", DEFAULT_TOP);
+}
+
+static void format_bytes(uint64_t bytes, char *out, size_t size) {
+    if (bytes >= 10 * 1024 * 1024) {
+        snprintf(out, size, "%.1f MB", bytes / (1024.0 * 1024.0));
+    } else if (bytes >= 10 * 1024) {
+        snprintf(out, size, "%.1f KB", bytes / 1024.0);
+    } else {
+        snprintf(out, size, "%llu B", (unsigned long long)bytes);
+    }
+}
+
+static const char* type_name(HeapGraph *graph, uint32_t node) {
+    return graph->type[node] < graph->type_count ? graph->type_names[graph->type[node]] : "?";
+}
+
+/*
+ * Bytes retained by all objects of a type together: the retained sizes of
+ * those with no object of the same type above them in the dominator tree.
+ * Dominators come before what they dominate in breadth-first order, so one
+ * pass over that order carries a bit set of the types above each node.
+ */
+static void print_types(HeapGraph *graph) {
+    int types = graph->type_count;
+    uint64_t counts[SNAPSHOT_MAX_TYPES] = {0};
+    uint64_t bytes[SNAPSHOT_MAX_TYPES] = {0};
+    uint64_t retained[SNAPSHOT_MAX_TYPES] = {0};
+    uint64_t *above = (uint64_t*)calloc(graph->count, sizeof(uint64_t));
+    if (!above) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return;
+    }
+
+    for (uint32_t i = 1; i < graph->count; i++) {
+        counts[graph->type[i]]++;
+        bytes[graph->type[i]] += graph->size[i];
+    }
+    for (uint32_t i = 1; i < graph->reached; i++) {
+        uint32_t v = graph->bfs_order[i];
+        uint32_t dom = graph->idom[v];
+        above[v] = dom == 0 ? 0 : above[dom] | (1ULL << graph->type[dom]);
+        if (!(above[v] & (1ULL << graph->type[v]))) {
+            retained[graph->type[v]] += graph->retained[v];
+        }
+    }
+    free(above);
+
+    printf("%-10s %10s %12s %12s %7s\n", "type", "objects", "bytes", "retained", "share");
+    for (int t = 0; t < types; t++) {
+        if (counts[t] == 0) continue;
+        char shallow[32], kept[32];
+        format_bytes(bytes[t], shallow, sizeof(shallow));
+        format_bytes(retained[t], kept, sizeof(kept));
+        double share = graph->total_bytes ? 100.0 * bytes[t] / graph->total_bytes : 0.0;
+        printf("%-10s %10llu %12s %12s %6.1f%%\n", graph->type_names[t],
+               (unsigned long long)counts[t], shallow, kept, share);
+    }
+}
+
+static void print_node(HeapGraph *graph, uint32_t node) {
+    printf("%s@%llx", type_name(graph, node), (unsigned long long)(graph->id[node] << 3));
+}
+
+/* stack[i] -> map@... -> array@... -> node; long paths show both ends */
+static void print_path(HeapGraph *graph, uint32_t node) {
+    uint32_t hops = 0;
+    for (uint32_t v = node; v != 0; v = graph->parent[v]) {
+        hops++;
+    }
+    uint32_t *path = (uint32_t*)malloc(hops * sizeof(uint32_t));
+    if (!path) return;
+    uint32_t i = hops;
+    for (uint32_t v = node; v != 0; v = graph->parent[v]) {
+        path[--i] = v;
+    }
+
+    printf("    stack[%u]", graph->root_slot[path[0]]);
+    for (i = 0; i < hops; i++) {
+        if (hops > MAX_PATH_SHOWN && i == 3) {
+            printf(" -> ... %u more ...", hops - MAX_PATH_SHOWN);
+            i = hops - (MAX_PATH_SHOWN - 3);
+        }
+        printf(" -> ");
+        print_node(graph, path[i]);
+    }
+    printf("\n");
+    free(path);
+}
+
+static void print_top_retainers(HeapGraph *graph, int top) {
+    uint32_t *best = (uint32_t*)malloc(top * sizeof(uint32_t));
+    int found = 0;
+    if (!best) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return;
+    }
+
+    /* Insertion into a sorted array of the top entries */
+    for (uint32_t v = 1; v < graph->count; v++) {
+        if (graph->parent[v] == HEAP_GRAPH_NONE) continue;
+        uint64_t size = graph->retained[v];
+        if (found == top && size <= graph->retained[best[top - 1]]) continue;
+        int i = found < top ? found++ : top - 1;
+        while (i > 0 && graph->retained[best[i - 1]] < size) {
+            best[i] = best[i - 1];
+            i--;
+        }
+        best[i] = v;
+    }
+
+    printf("%4s %12s %12s %10s  %s\n", "rank", "retained", "self", "objects", "object");
+    for (int i = 0; i < found; i++) {
+        uint32_t v = best[i];
+        char kept[32], self[32];
+        format_bytes(graph->retained[v], kept, sizeof(kept));
+        format_bytes(graph->size[v], self, sizeof(self));
+        printf("%4d %12s %12s %10u  ", i + 1, kept, self, graph->dominated[v]);
+        print_node(graph, v);
+        printf("\n");
+        print_path(graph, v);
+    }
+    free(best);
+}
+
+int main(int argc, char *argv[]) {
+    const char *filename = NULL;
+    int top = DEFAULT_TOP;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else if (strncmp(argv[i], "--top=", 6) == 0) {
+            char *end;
+            long value = strtol(argv[i] + 6, &end, 10);
+            if (end == argv[i] + 6 || *end != '\0' || value < 1 || value > 100000) {
+                fprintf(stderr, "Error: Invalid option '%s'\n\n", argv[i]);
+                print_usage(argv[0]);
+                return 1;
+            }
+            top = (int)value;
+        } else if (filename == NULL) {
+            filename = argv[i];
+        } else {
+            fprintf(stderr, "Error: Unexpected argument '%s'\n\n", argv[i]);
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (filename == NULL) {
+        fprintf(stderr, "Error: No snapshot file specified.\n\n");
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    HeapGraph graph;
+    if (!heap_graph_load(&graph, filename)) return 1;
+    if (!heap_graph_analyze(&graph)) {
+        heap_graph_free(&graph);
+        return 1;
+    }
+
+    char total[32];
+    format_bytes(graph.total_bytes, total, sizeof(total));
+    printf("Heap snapshot: %s\n", filename);
+    printf("  Objects: %u   Bytes: %s   Roots: %u\n",
+           graph.count - 1, total, graph.edge_start[1] - graph.edge_start[0]);
+    if (graph.unreachable > 0) {
+        printf("  Unreachable from the roots: %u objects\n", graph.unreachable);
+    }
+
+    printf("\nBy type:\n");
+    print_types(&graph);
+
+    printf("\nTop retainers:\n");
+    print_top_retainers(&graph, top);
+
+    heap_graph_free(&graph);
+    return 0;
+}
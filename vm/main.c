@@ -5,12 +5,27 @@
 #include "bytecode_loader.h"
 
 static void print_usage(const char *program_name) {
-    printf("Usage: %s <bytecode_file>\n", program_name);
+    printf("Usage: %s [options] <bytecode_file>\n", program_name);
     printf("\n");
     printf("Runs a bytecode program on the virtual machine.\n");
     printf("\n");
     printf("Options:\n");
-    printf("  -h, --help     Show this help message\n");
+    printf("  -h, --help               Show this help message\n");
+    printf("  --gc-pacing=MODE         Collection trigger: bytes (default) or objects\n");
+    printf("  --gc-min-heap=SIZE       Never collect below SIZE (default 256K)\n");
+    printf("  --gc-max-heap=SIZE       Fail allocations beyond SIZE (default unlimited)\n");
+    printf("  --gc-target-heap=SIZE    Heap size before the first collection (default 1M)\n");
+    printf("  --gc-soft-limit=SIZE     Keep the trigger below SIZE (default none)\n");
+    printf("  --gc-growth=FACTOR       Heap growth after a collection (default 2.0)\n");
+    printf("  --gc-verbose             Log every collection to stderr\n");
+    printf("  --gc-stats[=FILE]        Write GC statistics as JSON to FILE (default stderr)\n");
+    printf("  --gc-snapshot=FILE       Write a heap snapshot to FILE when the program ends\n");
+    printf("  --gc-profile[=FILE]      Write an allocation profile to FILE (default stderr)\n");
+    printf("  --gc-profile-rate=SIZE   Bytes between allocation samples (default 64K)\n");
+    printf("  --exec-profile=FILE      Write instruction and branch counts to FILE,\n");
+    printf("                           for the assembler's --profile option\n");
+    printf("\n");
+    printf("SIZE is a byte count with an optional K, M or G suffix.\n");
     printf("\n");
     printf("Bytecode file format:\n");
     printf("  - Magic number: 0xCAFEBABE (4 bytes)\n");
@@ -19,13 +34,174 @@ static void print_usage(const char *program_name) {
     printf("  - Code: N bytes of bytecode instructions\n");
 }
 
-static int run_bytecode_file(const char *filename) {
+/* Parse a byte count such as 4096, 512K, 64M or 2G */
+static bool parse_size(const char *text, size_t *out) {
+    char *end;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (end == text) return false;
+
+    switch (*end) {
+        case 'k': case 'K': value <<= 10; end++; break;
+        case 'm': case 'M': value <<= 20; end++; break;
+        case 'g': case 'G': value <<= 30; end++; break;
+        default: break;
+    }
+    if (*end != '\0') return false;
+
+    *out = (size_t)value;
+    return true;
+}
+
+/* Command-line settings for a run */
+typedef struct {
+    GCHeapPolicy policy;
+    bool gc_verbose;
+    bool gc_stats;
+    const char *gc_stats_file;   /* NULL for stderr */
+    const char *gc_snapshot_file;
+    bool gc_profile;
+    const char *gc_profile_file; /* NULL for stderr */
+    size_t gc_profile_rate;      /* 0 for the default */
+    const char *exec_profile_file;
+} RunOptions;
+
+static bool option_is(const char *arg, size_t name_len, const char *name) {
+    return strlen(name) == name_len && strncmp(arg, name, name_len) == 0;
+}
+
+/* Apply one --gc-* option; false if it is not a valid one */
+static bool parse_gc_option(const char *arg, RunOptions *options) {
+    GCHeapPolicy *policy = &options->policy;
+
+    if (strcmp(arg, "--gc-verbose") == 0) {
+        options->gc_verbose = true;
+        return true;
+    }
+    if (strcmp(arg, "--gc-stats") == 0) {
+        options->gc_stats = true;
+        return true;
+    }
+    if (strcmp(arg, "--gc-profile") == 0) {
+        options->gc_profile = true;
+        return true;
+    }
+
+    const char *eq = strchr(arg, '=');
+    if (!eq) return false;
+
+    size_t name_len = (size_t)(eq - arg);
+    const char *value = eq + 1;
+
+    if (option_is(arg, name_len, "--gc-stats")) {
+        options->gc_stats = true;
+        options->gc_stats_file = value;
+        return *value != '\0';
+    }
+    if (option_is(arg, name_len, "--gc-snapshot")) {
+        options->gc_snapshot_file = value;
+        return *value != '\0';
+    }
+    if (option_is(arg, name_len, "--gc-profile")) {
+        options->gc_profile = true;
+        options->gc_profile_file = value;
+        return *value != '\0';
+    }
+    if (option_is(arg, name_len, "--gc-profile-rate")) {
+        options->gc_profile = true;
+        return parse_size(value, &options->gc_profile_rate) && options->gc_profile_rate > 0;
+    }
+
+    if (option_is(arg, name_len, "--gc-pacing")) {
+        if (strcmp(value, "bytes") == 0) {
+            policy->pacing = GC_PACING_BYTES;
+        } else if (strcmp(value, "objects") == 0) {
+            policy->pacing = GC_PACING_OBJECTS;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    if (option_is(arg, name_len, "--gc-growth")) {
+        char *end;
+        policy->growth_factor = strtod(value, &end);
+        return end != value && *end == '\0';
+    }
+    if (option_is(arg, name_len, "--gc-min-heap")) {
+        return parse_size(value, &policy->min_heap);
+    }
+    if (option_is(arg, name_len, "--gc-max-heap")) {
+        return parse_size(value, &policy->max_heap);
+    }
+    if (option_is(arg, name_len, "--gc-target-heap")) {
+        return parse_size(value, &policy->target_heap);
+    }
+    if (option_is(arg, name_len, "--gc-soft-limit")) {
+        return parse_size(value, &policy->soft_limit);
+    }
+    return false;
+}
+
+static bool write_gc_stats(VM *vm, const char *path) {
+    if (path == NULL) {
+        gc_write_stats_json(vm, stderr);
+        return true;
+    }
+
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "Error: Cannot open GC stats file '%s'\n", path);
+        return false;
+    }
+    gc_write_stats_json(vm, out);
+    fclose(out);
+    return true;
+}
+
+static bool write_gc_profile(VM *vm, const char *path) {
+    if (path == NULL) {
+        gc_profile_report(vm, stderr, 0);
+        return true;
+    }
+
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "Error: Cannot open allocation profile file '%s'\n", path);
+        return false;
+    }
+    gc_profile_report(vm, out, 0);
+    fclose(out);
+    return true;
+}
+
+static bool write_exec_profile(VM *vm, const char *path) {
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "Error: Cannot open execution profile file '%s'\n", path);
+        return false;
+    }
+    bool written = vm_exec_profile_write(vm, out);
+    fclose(out);
+    return written;
+}
+
+static int run_bytecode_file(const char *filename, const RunOptions *options) {
     VM *vm = vm_create();
     if (!vm) {
         fprintf(stderr, "Error: Failed to create VM\n");
         return 1;
     }
 
+    if (!gc_set_heap_policy(vm, &options->policy)) {
+        vm_destroy(vm);
+        return 1;
+    }
+    gc_set_verbose(vm, options->gc_verbose);
+    if (options->gc_profile &&
+        !gc_profile_start(vm, GC_SAMPLE_BYTES, options->gc_profile_rate)) {
+        vm_destroy(vm);
+        return 1;
+    }
+
     printf("Loading: %s\n", filename);
     VMError load_result = vm_load_bytecode_file(vm, filename);
     if (load_result != VM_OK) {
@@ -35,6 +211,11 @@ static int run_bytecode_file(const char *filename) {
     }
 
     printf("Loaded %d bytes of bytecode\n", vm->code_size);
+    if (options->exec_profile_file && !vm_exec_profile_start(vm)) {
+        vm_free_bytecode(vm);
+        vm_destroy(vm);
+        return 1;
+    }
     printf("\n");
 
     printf("Running...\n");
@@ -58,22 +239,55 @@ static int run_bytecode_file(const char *filename) {
     printf("\n");
     vm_dump_state(vm);
 
+    bool outputs_ok = !options->gc_stats || write_gc_stats(vm, options->gc_stats_file);
+    if (options->gc_profile && !write_gc_profile(vm, options->gc_profile_file)) {
+        outputs_ok = false;
+    }
+    if (options->gc_snapshot_file && !gc_write_snapshot(vm, options->gc_snapshot_file)) {
+        outputs_ok = false;
+    }
+    if (options->exec_profile_file && !write_exec_profile(vm, options->exec_profile_file)) {
+        outputs_ok = false;
+    }
+
+    vm_free_bytecode(vm);
     vm_destroy(vm);
 
-    return (run_result == VM_OK) ? 0 : 1;
+    return (run_result == VM_OK && outputs_ok) ? 0 : 1;
 }
 
 int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Error: No bytecode file specified.\n\n");
-        print_usage(argv[0]);
-        return 1;
+    RunOptions options = {0};
+    const char *filename = NULL;
+
+    gc_default_heap_policy(&options.policy);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else if (strncmp(argv[i], "--gc-", 5) == 0) {
+            if (!parse_gc_option(argv[i], &options)) {
+                fprintf(stderr, "Error: Invalid GC option '%s'\n\n", argv[i]);
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--exec-profile=", 15) == 0 && argv[i][15] != '\0') {
+            options.exec_profile_file = argv[i] + 15;
+        } else if (filename == NULL) {
+            filename = argv[i];
+        } else {
+            fprintf(stderr, "Error: Unexpected argument '%s'\n\n", argv[i]);
+            print_usage(argv[0]);
+            return 1;
+        }
     }
 
-    if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) {
+    if (filename == NULL) {
+        fprintf(stderr, "Error: No bytecode file specified.\n\n");
         print_usage(argv[0]);
-        return 0;
+        return 1;
     }
 
-    return run_bytecode_file(argv[1]);
+    return run_bytecode_file(filename, &options);
 }
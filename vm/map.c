@@ -0,0 +1,296 @@
+/*
+ * Map objects: open-addressed hash tables with linear probing.
+ *
+ * The entries of a map live in an OBJ_ARRAY holding 2 * capacity Values,
+ * key then value, so the collector traces, promotes and compacts them like
+ * any other array. A free slot has the key VAL_OBJ(NULL); its value is 0
+ * if the slot was never used and 1 if the entry was deleted (a tombstone,
+ * which probes must step over).
+ *
+ * Growing a table in one go would rehash every entry in a single pause.
+ * Instead the full table is kept as old_table beside a new one, and each
+ * map_set or map_delete moves MAP_MIGRATE_SLOTS old slots across, so the
+ * work of a resize is spread over the updates that follow. Lookups check
+ * the new table first and then the old one until it has been drained.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "vm.h"  /* Includes gc.h automatically */
+
+#define MAP_MIN_CAPACITY 8
+#define MAP_MAX_CAPACITY (1u << 29)  /* Table length 2 * capacity must fit an int */
+#define MAP_MIGRATE_SLOTS 64         /* Old-table slots moved per update while resizing */
+#define SLOT_EMPTY 0
+#define SLOT_DELETED 1
+
+static uint32_t capacity_of(Object *table) {
+    return table->array.length / 2;
+}
+
+static Value* slot_at(Object *table, uint32_t index) {
+    return &table->array.items[2 * index];
+}
+
+/* Empty or deleted; slot[1] tells which */
+static bool slot_free(Value *slot) {
+    return slot[0].type == VAL_OBJ && slot[0].obj_val == NULL;
+}
+
+static bool keys_equal(Value a, Value b) {
+    if (a.type != b.type) return false;
+    return a.type == VAL_INT ? a.int_val == b.int_val : a.obj_val == b.obj_val;
+}
+
+/* MurmurHash3 finalizer: nearby integers land far apart in the table */
+static uint32_t mix32(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+/*
+ * Objects move, so their address cannot be their hash. Each object gets a
+ * hash the first time it is used as a key, kept in its header.
+ */
+uint32_t gc_identity_hash(VM *vm, Object *obj) {
+    if (obj->hash == 0) {
+        uint32_t hash = mix32(++vm->identity_hashes);
+        obj->hash = hash ? hash : 1;
+    }
+    return obj->hash;
+}
+
+static uint32_t key_hash(VM *vm, Value key) {
+    if (key.type == VAL_INT) return mix32((uint32_t)key.int_val);
+    return gc_identity_hash(vm, key.obj_val);
+}
+
+/* Hash of a key being looked up; false if it cannot be in any map */
+static bool lookup_hash(Value key, uint32_t *hash) {
+    if (key.type == VAL_INT) {
+        *hash = mix32((uint32_t)key.int_val);
+        return true;
+    }
+    if (key.obj_val == NULL || key.obj_val->hash == 0) return false;
+    *hash = key.obj_val->hash;
+    return true;
+}
+
+/* Tables always keep empty slots, so every probe ends */
+static bool find_slot(Object *table, Value key, uint32_t hash, uint32_t *index) {
+    if (table == NULL) return false;
+
+    uint32_t mask = capacity_of(table) - 1;
+    for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+        Value *slot = slot_at(table, i);
+        if (slot_free(slot)) {
+            if (slot[1].int_val == SLOT_EMPTY) return false;
+        } else if (keys_equal(slot[0], key)) {
+            *index = i;
+            return true;
+        }
+    }
+}
+
+static void clear_slot(VM *vm, Object *table, uint32_t index) {
+    array_set(vm, table, 2 * index, VAL_OBJ(NULL));
+    array_set(vm, table, 2 * index + 1, VAL_INT(SLOT_DELETED));
+}
+
+/* Add a key known not to be in map->map.table */
+static void insert_slot(VM *vm, Object *map, Value key, uint32_t hash, Value value) {
+    Object *table = map->map.table;
+    uint32_t mask = capacity_of(table) - 1;
+    uint32_t i = hash & mask;
+    while (!slot_free(slot_at(table, i))) {
+        i = (i + 1) & mask;
+    }
+    if (slot_at(table, i)[1].int_val == SLOT_DELETED) {
+        map->map.tombstones--;
+    }
+    array_set(vm, table, 2 * i, key);
+    array_set(vm, table, 2 * i + 1, value);
+}
+
+/* Move up to slots entries from old_table into table */
+static void migrate(VM *vm, Object *map, uint32_t slots) {
+    Object *old = map->map.old_table;
+    if (old == NULL) return;
+
+    uint32_t capacity = capacity_of(old);
+    while (slots > 0 && map->map.migrated < capacity) {
+        uint32_t i = map->map.migrated++;
+        Value *slot = slot_at(old, i);
+        if (!slot_free(slot)) {
+            Value key = slot[0];
+            Value value = slot[1];
+            insert_slot(vm, map, key, key_hash(vm, key), value);
+            clear_slot(vm, old, i);
+        }
+        slots--;
+    }
+
+    if (map->map.migrated == capacity) {
+        map->map.old_table = NULL;
+        map->map.migrated = 0;
+    }
+}
+
+/*
+ * Switch to a table with room for twice the live entries; the current one
+ * becomes old_table. Allocating may collect, so the map, key and value are
+ * parked on the value stack and read back afterwards.
+ */
+static bool grow(VM *vm, Value *map, Value *key, Value *value) {
+    if (vm->stack_count + 3 > VM_STACK_MAX) {
+        fprintf(stderr, "Error: Stack overflow\n");
+        return false;
+    }
+
+    /* Finish the previous resize, so there are never more than two tables */
+    migrate(vm, map->obj_val, UINT32_MAX);
+
+    uint32_t needed = map->obj_val->map.count + 1;
+    uint32_t capacity = MAP_MIN_CAPACITY;
+    while (capacity < MAP_MAX_CAPACITY && capacity < 2 * needed) {
+        capacity *= 2;
+    }
+    if (needed * 4 > capacity * 3) {
+        fprintf(stderr, "Error: Map of %u entries too large\n", needed);
+        return false;
+    }
+
+    vm->value_stack[vm->stack_count++] = *map;
+    vm->value_stack[vm->stack_count++] = *key;
+    vm->value_stack[vm->stack_count++] = *value;
+
+    Object *table = new_array(vm, (int)(2 * capacity));
+
+    *value = vm->value_stack[--vm->stack_count];
+    *key = vm->value_stack[--vm->stack_count];
+    *map = vm->value_stack[--vm->stack_count];
+    if (!table) return false;
+
+    /* Fresh table: no barrier needed to store NULL keys */
+    for (uint32_t i = 0; i < capacity; i++) {
+        table->array.items[2 * i] = VAL_OBJ(NULL);
+    }
+
+    Object *owner = map->obj_val;
+    gc_write_barrier(vm, owner, owner->map.table);
+    owner->map.old_table = owner->map.table;
+    gc_write_barrier(vm, owner, table);
+    owner->map.table = table;
+    owner->map.tombstones = 0;
+    owner->map.migrated = 0;
+    return true;
+}
+
+/* Empty map; its table is allocated by the first map_set */
+Object* new_map(VM *vm) {
+    return gc_alloc_object(vm, OBJ_MAP);
+}
+
+/* Look up key; if found, store its value in *value (when not NULL) */
+bool map_get(Object *map, Value key, Value *value) {
+    uint32_t hash;
+    uint32_t index;
+    if (!lookup_hash(key, &hash)) return false;
+
+    Object *table = map->map.table;
+    if (!find_slot(table, key, hash, &index)) {
+        table = map->map.old_table;
+        if (!find_slot(table, key, hash, &index)) return false;
+    }
+    if (value) *value = slot_at(table, index)[1];
+    return true;
+}
+
+/* Add or replace an entry; false if the key is NULL or out of memory */
+bool map_set(VM *vm, Object *map, Value key, Value value) {
+    if (gc_is_frozen(map)) {
+        fprintf(stderr, "Error: Map is frozen\n");
+        return false;
+    }
+    if (key.type == VAL_OBJ && key.obj_val == NULL) {
+        fprintf(stderr, "Error: Map key is NULL\n");
+        return false;
+    }
+    uint32_t hash = key_hash(vm, key);
+    uint32_t index;
+
+    /* Keep the load (live entries plus tombstones) at or below 3/4 */
+    Object *table = map->map.table;
+    if (table == NULL ||
+        (map->map.count + map->map.tombstones + 1) * 4 > capacity_of(table) * 3) {
+        Value root = VAL_OBJ(map);
+        if (!grow(vm, &root, &key, &value)) return false;
+        map = root.obj_val;
+    }
+
+    migrate(vm, map, MAP_MIGRATE_SLOTS);
+
+    if (find_slot(map->map.table, key, hash, &index)) {
+        array_set(vm, map->map.table, 2 * index + 1, value);
+        return true;
+    }
+    if (find_slot(map->map.old_table, key, hash, &index)) {
+        clear_slot(vm, map->map.old_table, index);
+        map->map.count--;
+    }
+
+    insert_slot(vm, map, key, hash, value);
+    map->map.count++;
+    return true;
+}
+
+/* Remove key; false if it was not in the map or the map is frozen */
+bool map_delete(VM *vm, Object *map, Value key) {
+    uint32_t hash;
+    uint32_t index;
+
+    if (gc_is_frozen(map)) {
+        fprintf(stderr, "Error: Map is frozen\n");
+        return false;
+    }
+    migrate(vm, map, MAP_MIGRATE_SLOTS);
+    if (!lookup_hash(key, &hash)) return false;
+
+    if (find_slot(map->map.table, key, hash, &index)) {
+        clear_slot(vm, map->map.table, index);
+        map->map.tombstones++;
+    } else if (find_slot(map->map.old_table, key, hash, &index)) {
+        clear_slot(vm, map->map.old_table, index);
+    } else {
+        return false;
+    }
+    map->map.count--;
+    return true;
+}
+
+/*
+ * Called by the collector on a weak-keyed map after marking: entries whose
+ * object key was not marked are removed.
+ */
+void map_drop_dead_keys(VM *vm, Object *map) {
+    Object *tables[2] = {map->map.table, map->map.old_table};
+
+    for (int t = 0; t < 2; t++) {
+        Object *table = tables[t];
+        if (table == NULL) continue;
+
+        uint32_t capacity = capacity_of(table);
+        for (uint32_t i = 0; i < capacity; i++) {
+            Value *slot = slot_at(table, i);
+            if (slot_free(slot) || slot[0].type != VAL_OBJ || slot[0].obj_val->marked) continue;
+
+            clear_slot(vm, table, i);
+            map->map.count--;
+            if (table == map->map.table) map->map.tombstones++;
+        }
+    }
+}
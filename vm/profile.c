@@ -0,0 +1,394 @@
+/*
+ * Sampling allocation profiler.
+ *
+ * alloc_object counts allocated bytes down in vm->sample_countdown and
+ * calls gc_profile_sample when the count runs out, so an allocation that is
+ * not sampled costs one subtraction. In object mode the countdown is kept
+ * at zero and every allocation comes here to be counted. A sample records the allocating
+ * instruction and the CALL instructions on the return stack, adds an
+ * estimate to that site's totals and keeps the object on a list. After
+ * each collection has marked, and before it frees anything, the list is
+ * checked: a sampled object either survived the collection or is dropped,
+ * which gives each site the share of its objects that outlive their first
+ * collection.
+ *
+ * In byte mode the distance between samples is drawn uniformly from
+ * 1 .. 2 * interval - 1, so allocation patterns that repeat every few
+ * objects cannot hide from (or always hit) the sampler. Every interval
+ * crossed stands for interval bytes; an object bigger than the interval
+ * may cross several.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "vm.h"  /* Includes gc.h automatically */
+
+#define CALL_LENGTH 5              /* CALL opcode + 4-byte target */
+#define INITIAL_SITES 64
+
+/* Sample states: collections seen since it was allocated */
+enum {
+    SAMPLE_NEW,                    /* None yet */
+    SAMPLE_BLACK,                  /* Allocated marked during an incremental cycle */
+    SAMPLE_SURVIVED                /* Outlived at least one */
+};
+
+static uint64_t next_random(GCProfile *profile) {
+    /* xorshift64* */
+    uint64_t x = profile->rng;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    profile->rng = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static long next_interval(GCProfile *profile) {
+    if (profile->unit == GC_SAMPLE_OBJECTS) {
+        return (long)profile->interval;
+    }
+    return 1 + (long)(next_random(profile) % (2 * profile->interval - 1));
+}
+
+bool gc_profile_start(VM *vm, GCSampleUnit unit, size_t interval) {
+    if (interval == 0) {
+        if (unit == GC_SAMPLE_OBJECTS) {
+            fprintf(stderr, "Error: Object sampling needs an interval\n");
+            return false;
+        }
+        interval = GC_PROFILE_DEFAULT_INTERVAL;
+    }
+    if (interval > (size_t)1 << 40) {
+        fprintf(stderr, "Error: Sampling interval %zu is too large\n", interval);
+        return false;
+    }
+
+    gc_profile_stop(vm);
+
+    GCProfile *profile = (GCProfile*)calloc(1, sizeof(GCProfile));
+    if (!profile) {
+        fprintf(stderr, "Error: Out of memory for the allocation profiler\n");
+        return false;
+    }
+    profile->unit = unit;
+    profile->interval = interval;
+    profile->rng = 0x9E3779B97F4A7C15ULL;
+    vm->profile = profile;
+    if (unit == GC_SAMPLE_OBJECTS) {
+        profile->objects_left = (long)interval;
+        vm->sample_countdown = 0;
+    } else {
+        vm->sample_countdown = next_interval(profile);
+    }
+    return true;
+}
+
+void gc_profile_stop(VM *vm) {
+    GCProfile *profile = vm->profile;
+    if (!profile) return;
+
+    free(profile->sites);
+    free(profile->site_index);
+    free(profile->samples);
+    free(profile);
+    vm->profile = NULL;
+    vm->sample_countdown = LONG_MAX;
+}
+
+static uint32_t site_hash(const GCAllocSite *site) {
+    /* FNV-1a over the fields that identify a site */
+    uint32_t hash = 2166136261u;
+    uint32_t words[2 + GC_PROFILE_MAX_FRAMES];
+    int count = 0;
+
+    words[count++] = (uint32_t)site->pc;
+    words[count++] = ((uint32_t)site->type << 8) | (uint32_t)site->depth;
+    for (int i = 0; i < site->depth; i++) {
+        words[count++] = (uint32_t)site->callers[i];
+    }
+    for (int i = 0; i < count; i++) {
+        hash = (hash ^ words[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static bool same_site(const GCAllocSite *a, const GCAllocSite *b) {
+    return a->pc == b->pc && a->type == b->type && a->depth == b->depth &&
+           memcmp(a->callers, b->callers, a->depth * sizeof(int32_t)) == 0;
+}
+
+/* Double the index and put every site back; false if out of memory */
+static bool grow_site_index(GCProfile *profile) {
+    uint32_t capacity = profile->index_capacity ? profile->index_capacity * 2 : INITIAL_SITES * 2;
+    uint32_t *index = (uint32_t*)calloc(capacity, sizeof(uint32_t));
+    if (!index) return false;
+
+    for (int i = 0; i < profile->site_count; i++) {
+        uint32_t slot = site_hash(&profile->sites[i]) & (capacity - 1);
+        while (index[slot] != 0) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        index[slot] = (uint32_t)i + 1;
+    }
+    free(profile->site_index);
+    profile->site_index = index;
+    profile->index_capacity = capacity;
+    return true;
+}
+
+/* Site number for key, added with zero counts if new; -1 if out of memory */
+static int find_site(GCProfile *profile, const GCAllocSite *key) {
+    if ((uint32_t)(profile->site_count + 1) * 2 > profile->index_capacity &&
+        !grow_site_index(profile)) {
+        return -1;
+    }
+
+    uint32_t mask = profile->index_capacity - 1;
+    uint32_t slot = site_hash(key) & mask;
+    while (profile->site_index[slot] != 0) {
+        int site = (int)profile->site_index[slot] - 1;
+        if (same_site(&profile->sites[site], key)) return site;
+        slot = (slot + 1) & mask;
+    }
+
+    if (profile->site_count == profile->site_capacity) {
+        int capacity = profile->site_capacity ? profile->site_capacity * 2 : INITIAL_SITES;
+        GCAllocSite *sites = (GCAllocSite*)realloc(profile->sites, capacity * sizeof(GCAllocSite));
+        if (!sites) return -1;
+        profile->sites = sites;
+        profile->site_capacity = capacity;
+    }
+
+    int site = profile->site_count++;
+    profile->sites[site] = *key;
+    profile->site_index[slot] = (uint32_t)site + 1;
+    return site;
+}
+
+static bool push_sample(GCProfile *profile, GCSample sample) {
+    if (profile->sample_count == profile->sample_capacity) {
+        int capacity = profile->sample_capacity ? profile->sample_capacity * 2 : INITIAL_SITES;
+        GCSample *samples = (GCSample*)realloc(profile->samples, capacity * sizeof(GCSample));
+        if (!samples) return false;
+        profile->samples = samples;
+        profile->sample_capacity = capacity;
+    }
+    profile->samples[profile->sample_count++] = sample;
+    return true;
+}
+
+/* Called by alloc_object once the countdown has run out; obj is initialized */
+void gc_profile_sample(VM *vm, Object *obj, size_t size) {
+    GCProfile *profile = vm->profile;
+    uint64_t weight;
+
+    if (!profile) {
+        vm->sample_countdown = LONG_MAX;
+        return;
+    }
+    if (profile->unit == GC_SAMPLE_BYTES) {
+        long crossed = 0;
+        do {
+            vm->sample_countdown += next_interval(profile);
+            crossed++;
+        } while (vm->sample_countdown <= 0);
+        weight = (uint64_t)crossed * profile->interval;
+    } else {
+        vm->sample_countdown = 0;
+        if (--profile->objects_left > 0) return;
+        profile->objects_left = next_interval(profile);
+        weight = (uint64_t)profile->interval * size;
+    }
+
+    GCAllocSite key;
+    memset(&key, 0, sizeof(key));
+    key.pc = -1;
+    key.type = obj->type;
+    if (vm->running) {
+        /* The instructions that allocate have no operands */
+        key.pc = vm->pc - 1;
+        for (int i = vm->rsp - 1; i >= 0 && key.depth < GC_PROFILE_MAX_FRAMES; i--) {
+            key.callers[key.depth++] = vm->return_stack[i] - CALL_LENGTH;
+        }
+    }
+
+    /* Out of memory: the sample is lost, the program carries on */
+    int index = find_site(profile, &key);
+    if (index < 0) return;
+    GCSample sample = {obj, (uint32_t)index, SAMPLE_NEW, weight};
+    if (vm->gc_mode == GC_MODE_INCREMENTAL && vm->gc_phase == GC_PHASE_MARK) {
+        sample.state = SAMPLE_BLACK;
+    }
+    if (!push_sample(profile, sample)) return;
+
+    GCAllocSite *site = &profile->sites[index];
+    site->samples++;
+    site->objects += (weight + size / 2) / size;
+    site->bytes += weight;
+    site->live++;
+    site->live_bytes += weight;
+    profile->total_samples++;
+}
+
+static void drop_sample(GCProfile *profile, GCSample *sample) {
+    GCAllocSite *site = &profile->sites[sample->site];
+    if (sample->state == SAMPLE_NEW) site->died++;
+    site->live--;
+    site->live_bytes -= sample->weight;
+}
+
+static void record_survival(GCProfile *profile, GCSample *sample) {
+    if (sample->state == SAMPLE_NEW) {
+        profile->sites[sample->site].survived++;
+        sample->state = SAMPLE_SURVIVED;
+    } else if (sample->state == SAMPLE_BLACK) {
+        /* Kept by the cycle it was allocated in: judged by the next one */
+        sample->state = SAMPLE_NEW;
+    }
+}
+
+/* Full collection: marking is complete and nothing has been freed */
+void gc_profile_after_mark(VM *vm) {
+    GCProfile *profile = vm->profile;
+    int kept = 0;
+
+    for (int i = 0; i < profile->sample_count; i++) {
+        GCSample *sample = &profile->samples[i];
+        if (!sample->obj->marked) {
+            drop_sample(profile, sample);
+            continue;
+        }
+        record_survival(profile, sample);
+        profile->samples[kept++] = *sample;
+    }
+    profile->sample_count = kept;
+}
+
+/* Minor collection: young samples were promoted or died; old ones are untouched */
+void gc_profile_after_minor(VM *vm) {
+    GCProfile *profile = vm->profile;
+    int kept = 0;
+
+    for (int i = 0; i < profile->sample_count; i++) {
+        GCSample *sample = &profile->samples[i];
+        if (gc_in_nursery(vm, sample->obj)) {
+            if (!(sample->obj->flags & OBJ_FLAG_FORWARDED)) {
+                drop_sample(profile, sample);
+                continue;
+            }
+            sample->obj = sample->obj->forward;
+            record_survival(profile, sample);
+        }
+        profile->samples[kept++] = *sample;
+    }
+    profile->sample_count = kept;
+}
+
+/* Compaction: every sample left is live; all but large objects have moved */
+void gc_profile_after_compact(VM *vm) {
+    GCProfile *profile = vm->profile;
+    for (int i = 0; i < profile->sample_count; i++) {
+        Object *obj = profile->samples[i].obj;
+        if (obj->flags & OBJ_FLAG_FORWARDED) {
+            profile->samples[i].obj = obj->forward;
+        }
+    }
+}
+
+static const char *type_names[] = {
+    "pair", "function", "closure", "map", "weak", "array", "bytes"
+};
+
+static void format_bytes(uint64_t bytes, char *out, size_t size) {
+    if (bytes >= 10 * 1024 * 1024) {
+        snprintf(out, size, "%.1f MB", bytes / (1024.0 * 1024.0));
+    } else if (bytes >= 10 * 1024) {
+        snprintf(out, size, "%.1f KB", bytes / 1024.0);
+    } else {
+        snprintf(out, size, "%llu B", (unsigned long long)bytes);
+    }
+}
+
+static int compare_bytes(const void *a, const void *b) {
+    const GCAllocSite *x = *(const GCAllocSite* const*)a;
+    const GCAllocSite *y = *(const GCAllocSite* const*)b;
+    if (x->bytes != y->bytes) return x->bytes < y->bytes ? 1 : -1;
+    return (x->pc > y->pc) - (x->pc < y->pc);
+}
+
+/* Sites by estimated bytes allocated, most first */
+void gc_profile_report(VM *vm, FILE *out, int max_sites) {
+    GCProfile *profile = vm->profile;
+    if (!profile) {
+        fprintf(out, "Allocation profile: profiler not running\n");
+        return;
+    }
+
+    const GCAllocSite **order = (const GCAllocSite**)malloc(
+        (profile->site_count + 1) * sizeof(GCAllocSite*));
+    if (!order) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return;
+    }
+    uint64_t total_bytes = 0;
+    uint64_t total_objects = 0;
+    for (int i = 0; i < profile->site_count; i++) {
+        order[i] = &profile->sites[i];
+        total_bytes += profile->sites[i].bytes;
+        total_objects += profile->sites[i].objects;
+    }
+    qsort(order, profile->site_count, sizeof(GCAllocSite*), compare_bytes);
+
+    char text[32];
+    if (profile->unit == GC_SAMPLE_BYTES) {
+        format_bytes(profile->interval, text, sizeof(text));
+        fprintf(out, "Allocation profile: %ld samples, one per %s allocated\n",
+                profile->total_samples, text);
+    } else {
+        fprintf(out, "Allocation profile: %ld samples, one per %zu objects\n",
+                profile->total_samples, profile->interval);
+    }
+    format_bytes(total_bytes, text, sizeof(text));
+    fprintf(out, "Estimated %s in %llu objects at %d site%s\n\n",
+            text, (unsigned long long)total_objects, profile->site_count,
+            profile->site_count == 1 ? "" : "s");
+
+    int shown = profile->site_count;
+    if (max_sites > 0 && max_sites < shown) shown = max_sites;
+
+    fprintf(out, "%10s %6s %10s %9s %10s  %-8s %s\n",
+            "bytes", "share", "objects", "survived", "live", "type", "site");
+    for (int i = 0; i < shown; i++) {
+        const GCAllocSite *site = order[i];
+        char bytes[32], live[32], survived[16];
+        format_bytes(site->bytes, bytes, sizeof(bytes));
+        format_bytes(site->live_bytes, live, sizeof(live));
+        long judged = site->survived + site->died;
+        if (judged > 0) {
+            snprintf(survived, sizeof(survived), "%.1f%%", 100.0 * site->survived / judged);
+        } else {
+            snprintf(survived, sizeof(survived), "-");
+        }
+        const char *type = site->type < sizeof(type_names) / sizeof(type_names[0])
+                           ? type_names[site->type] : "?";
+
+        fprintf(out, "%10s %5.1f%% %10llu %9s %10s  %-8s ",
+                bytes, total_bytes ? 100.0 * site->bytes / total_bytes : 0.0,
+                (unsigned long long)site->objects, survived, live, type);
+        if (site->pc < 0) {
+            fprintf(out, "(outside vm_run)\n");
+            continue;
+        }
+        fprintf(out, "pc %d", site->pc);
+        for (int f = 0; f < site->depth; f++) {
+            fprintf(out, " <- %d", site->callers[f]);
+        }
+        fprintf(out, "\n");
+    }
+    if (shown < profile->site_count) {
+        fprintf(out, "(%d more sites)\n", profile->site_count - shown);
+    }
+    free(order);
+}
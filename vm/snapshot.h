@@ -0,0 +1,96 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+/*
+ * Heap snapshot file format and the reader used by offline tools.
+ *
+ * Written by gc_write_snapshot(). All integers are unsigned LEB128 varints
+ * unless noted. An object's id is its address divided by 8, so it is only
+ * meaningful within one snapshot.
+ *
+ *   magic      4 bytes "VMHS"
+ *   version    4 bytes, little-endian (SNAPSHOT_VERSION)
+ *   types      count, then per type: name length, name bytes
+ *   roots      count, then per object on the value stack: its stack index
+ *              and its id
+ *   objects    per object: type byte, id, size in bytes, edge count, then
+ *              each edge as the zigzag-encoded difference target id - id
+ *   trailer    SNAPSHOT_END byte, object count, total bytes
+ *
+ * Only strong references are edges: weak references and the keys of
+ * weak-keyed maps are left out, since they do not keep anything alive.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SNAPSHOT_MAGIC "VMHS"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_END 0xFF          /* Type byte that starts the trailer */
+#define SNAPSHOT_MAX_TYPES 64
+
+/* One object, as returned by snapshot_next */
+typedef struct {
+    uint64_t id;
+    uint8_t type;              /* Index into SnapshotReader.type_names */
+    uint64_t size;
+    uint32_t edge_count;
+    const uint64_t *edges;     /* Target ids; valid until the next call */
+} SnapshotRecord;
+
+typedef struct {
+    FILE *in;
+    int type_count;
+    char *type_names[SNAPSHOT_MAX_TYPES];
+    uint32_t root_count;
+    uint64_t *roots;           /* Value stack order; an object may appear twice */
+    uint32_t *root_slots;      /* Value stack index of each root */
+    uint64_t *edges;
+    uint32_t edge_capacity;
+    bool complete;             /* Trailer read and consistent */
+    uint64_t object_count;     /* From the trailer */
+    uint64_t total_bytes;      /* From the trailer */
+    uint64_t records_read;
+} SnapshotReader;
+
+bool snapshot_open(SnapshotReader *reader, const char *path);
+bool snapshot_next(SnapshotReader *reader, SnapshotRecord *record);  /* false at the end or on error */
+void snapshot_close(SnapshotReader *reader);
+
+/*
+ * A whole snapshot loaded as a graph, with node 0 standing for the roots
+ * (its edges go to every object on the value stack) and nodes 1..count-1
+ * the objects in file order. Edges are stored per node (edge_start[i] to
+ * edge_start[i + 1]) as node indexes.
+ */
+typedef struct {
+    uint32_t count;            /* Objects + 1 for the root node */
+    uint64_t *id;
+    uint8_t *type;
+    uint64_t *size;
+    uint32_t *edge_start;      /* count + 1 entries */
+    uint32_t *edges;
+    uint32_t *root_slots;      /* Value stack index of each edge of node 0 */
+    int type_count;
+    char *type_names[SNAPSHOT_MAX_TYPES];
+    uint64_t total_bytes;
+
+    /* Filled in by heap_graph_analyze */
+    uint32_t *idom;            /* Immediate dominator; idom[0] == 0 */
+    uint64_t *retained;        /* Bytes freed if the node became unreachable */
+    uint32_t *dominated;       /* Objects freed with it, itself included */
+    uint32_t *parent;          /* Previous node on a shortest path from the roots */
+    uint32_t *root_slot;       /* Value stack index, for nodes whose parent is 0 */
+    uint32_t *bfs_order;       /* Reachable nodes, breadth-first from node 0 */
+    uint32_t reached;          /* Entries in bfs_order */
+    uint32_t unreachable;      /* Objects not reachable from the roots */
+} HeapGraph;
+
+#define HEAP_GRAPH_NONE UINT32_MAX
+
+bool heap_graph_load(HeapGraph *graph, const char *path);
+bool heap_graph_analyze(HeapGraph *graph);
+void heap_graph_free(HeapGraph *graph);
+
+#endif
@@ -0,0 +1,470 @@
+/*
+ * Reading heap snapshots and analyzing them offline: loading the object
+ * graph, dominators, retained sizes and shortest retainer paths. Does not
+ * depend on the VM, so analysis tools link only this file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "snapshot.h"
+
+static bool get_varint(FILE *in, uint64_t *value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = fgetc(in);
+        if (byte == EOF) return false;
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool get_u32(FILE *in, uint32_t *value) {
+    uint64_t wide;
+    if (!get_varint(in, &wide) || wide > UINT32_MAX) return false;
+    *value = (uint32_t)wide;
+    return true;
+}
+
+static void free_names(char **names, int count) {
+    for (int i = 0; i < count; i++) {
+        free(names[i]);
+    }
+}
+
+bool snapshot_open(SnapshotReader *reader, const char *path) {
+    memset(reader, 0, sizeof(*reader));
+    reader->in = fopen(path, "rb");
+    if (!reader->in) {
+        fprintf(stderr, "Error: Cannot open heap snapshot '%s'\n", path);
+        return false;
+    }
+
+    unsigned char header[8];
+    uint64_t count;
+    if (fread(header, 1, 8, reader->in) != 8 || memcmp(header, SNAPSHOT_MAGIC, 4) != 0) {
+        fprintf(stderr, "Error: '%s' is not a heap snapshot\n", path);
+        goto fail;
+    }
+    uint32_t version = header[4] | header[5] << 8 | header[6] << 16 | (uint32_t)header[7] << 24;
+    if (version != SNAPSHOT_VERSION) {
+        fprintf(stderr, "Error: Unsupported heap snapshot version %u\n", version);
+        goto fail;
+    }
+
+    if (!get_varint(reader->in, &count) || count > SNAPSHOT_MAX_TYPES) goto corrupt;
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t length;
+        if (!get_varint(reader->in, &length) || length > 255) goto corrupt;
+        char *name = (char*)malloc(length + 1);
+        if (!name) goto corrupt;
+        reader->type_names[reader->type_count++] = name;
+        if (fread(name, 1, length, reader->in) != length) goto corrupt;
+        name[length] = '\0';
+    }
+
+    if (!get_u32(reader->in, &reader->root_count)) goto corrupt;
+    reader->roots = (uint64_t*)malloc((reader->root_count + 1) * sizeof(uint64_t));
+    reader->root_slots = (uint32_t*)malloc((reader->root_count + 1) * sizeof(uint32_t));
+    if (!reader->roots || !reader->root_slots) goto corrupt;
+    for (uint32_t i = 0; i < reader->root_count; i++) {
+        if (!get_u32(reader->in, &reader->root_slots[i]) ||
+            !get_varint(reader->in, &reader->roots[i])) {
+            goto corrupt;
+        }
+    }
+    return true;
+
+corrupt:
+    fprintf(stderr, "Error: Heap snapshot '%s' is truncated or corrupt\n", path);
+fail:
+    snapshot_close(reader);
+    return false;
+}
+
+bool snapshot_next(SnapshotReader *reader, SnapshotRecord *record) {
+    int type = fgetc(reader->in);
+    if (type == SNAPSHOT_END) {
+        reader->complete = get_varint(reader->in, &reader->object_count) &&
+                           get_varint(reader->in, &reader->total_bytes) &&
+                           reader->object_count == reader->records_read;
+        return false;
+    }
+    if (type == EOF || type >= reader->type_count) return false;
+
+    record->type = (uint8_t)type;
+    if (!get_varint(reader->in, &record->id) ||
+        !get_varint(reader->in, &record->size) ||
+        !get_u32(reader->in, &record->edge_count)) {
+        return false;
+    }
+
+    if (record->edge_count > reader->edge_capacity) {
+        uint64_t *edges = (uint64_t*)realloc(reader->edges, record->edge_count * sizeof(uint64_t));
+        if (!edges) {
+            fprintf(stderr, "Error: Out of memory reading heap snapshot\n");
+            return false;
+        }
+        reader->edges = edges;
+        reader->edge_capacity = record->edge_count;
+    }
+    for (uint32_t i = 0; i < record->edge_count; i++) {
+        uint64_t zigzag;
+        if (!get_varint(reader->in, &zigzag)) return false;
+        int64_t delta = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+        reader->edges[i] = record->id + (uint64_t)delta;
+    }
+    record->edges = reader->edges;
+    reader->records_read++;
+    return true;
+}
+
+void snapshot_close(SnapshotReader *reader) {
+    if (reader->in) fclose(reader->in);
+    free_names(reader->type_names, reader->type_count);
+    free(reader->roots);
+    free(reader->root_slots);
+    free(reader->edges);
+    memset(reader, 0, sizeof(*reader));
+}
+
+/* ---- Loading the graph ---- */
+
+/* Open-addressed table from object id to node index */
+typedef struct {
+    uint64_t *ids;
+    uint32_t *nodes;
+    uint64_t mask;
+} IdTable;
+
+static uint64_t hash_id(uint64_t id) {
+    id ^= id >> 33;
+    id *= 0xff51afd7ed558ccdULL;
+    id ^= id >> 33;
+    return id;
+}
+
+static bool id_table_init(IdTable *table, uint32_t entries) {
+    uint64_t capacity = 16;
+    while (capacity < 2 * (uint64_t)entries) capacity *= 2;
+    table->ids = (uint64_t*)malloc(capacity * sizeof(uint64_t));
+    table->nodes = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    table->mask = capacity - 1;
+    if (!table->ids || !table->nodes) return false;
+    memset(table->nodes, 0xff, capacity * sizeof(uint32_t));
+    return true;
+}
+
+static void id_table_put(IdTable *table, uint64_t id, uint32_t node) {
+    uint64_t i = hash_id(id) & table->mask;
+    while (table->nodes[i] != HEAP_GRAPH_NONE) {
+        i = (i + 1) & table->mask;
+    }
+    table->ids[i] = id;
+    table->nodes[i] = node;
+}
+
+static uint32_t id_table_get(IdTable *table, uint64_t id) {
+    for (uint64_t i = hash_id(id) & table->mask;; i = (i + 1) & table->mask) {
+        if (table->nodes[i] == HEAP_GRAPH_NONE) return HEAP_GRAPH_NONE;
+        if (table->ids[i] == id) return table->nodes[i];
+    }
+}
+
+/* Append to a growable uint64 array */
+static bool push_u64(uint64_t **items, size_t *count, size_t *capacity, uint64_t value) {
+    if (*count >= *capacity) {
+        size_t grown = *capacity < 1024 ? 1024 : *capacity * 2;
+        uint64_t *resized = (uint64_t*)realloc(*items, grown * sizeof(uint64_t));
+        if (!resized) return false;
+        *items = resized;
+        *capacity = grown;
+    }
+    (*items)[(*count)++] = value;
+    return true;
+}
+
+/* Per object while reading: id, type, size and index of its first edge */
+#define NODE_FIELDS 4
+
+/*
+ * Read every record, then turn edge ids into node indexes. Edges to ids
+ * not in the snapshot are dropped. A snapshot holds only the VM's own
+ * heap, so these are references into frozen segments or, for a VM on a
+ * shared heap, to shared objects; they are expected, not corruption.
+ */
+bool heap_graph_load(HeapGraph *graph, const char *path) {
+    SnapshotReader reader;
+    SnapshotRecord record;
+    uint64_t *nodes = NULL;
+    size_t node_words = 0, node_capacity = 0;
+    uint64_t *edge_ids = NULL;
+    size_t edge_count = 0, edge_capacity = 0;
+    IdTable table = {NULL, NULL, 0};
+    const char *error = "Out of memory loading heap snapshot";
+
+    memset(graph, 0, sizeof(*graph));
+    if (!snapshot_open(&reader, path)) return false;
+
+    /* Node 0 stands for the roots: its edges are the value stack entries */
+    for (int i = 0; i < NODE_FIELDS; i++) {
+        if (!push_u64(&nodes, &node_words, &node_capacity, 0)) goto fail;
+    }
+    for (uint32_t i = 0; i < reader.root_count; i++) {
+        if (!push_u64(&edge_ids, &edge_count, &edge_capacity, reader.roots[i])) goto fail;
+    }
+
+    while (snapshot_next(&reader, &record)) {
+        if (!push_u64(&nodes, &node_words, &node_capacity, record.id) ||
+            !push_u64(&nodes, &node_words, &node_capacity, record.type) ||
+            !push_u64(&nodes, &node_words, &node_capacity, record.size) ||
+            !push_u64(&nodes, &node_words, &node_capacity, edge_count)) {
+            goto fail;
+        }
+        for (uint32_t i = 0; i < record.edge_count; i++) {
+            if (!push_u64(&edge_ids, &edge_count, &edge_capacity, record.edges[i])) goto fail;
+        }
+    }
+    if (!reader.complete) {
+        error = "Heap snapshot is truncated or corrupt";
+        goto fail;
+    }
+    if (node_words / NODE_FIELDS >= UINT32_MAX || edge_count >= UINT32_MAX) {
+        error = "Heap snapshot is too large";
+        goto fail;
+    }
+
+    uint32_t count = (uint32_t)(node_words / NODE_FIELDS);
+    graph->count = count;
+    graph->total_bytes = reader.total_bytes;
+    graph->id = (uint64_t*)malloc(count * sizeof(uint64_t));
+    graph->type = (uint8_t*)malloc(count);
+    graph->size = (uint64_t*)malloc(count * sizeof(uint64_t));
+    graph->edge_start = (uint32_t*)malloc((count + 1) * sizeof(uint32_t));
+    graph->edges = (uint32_t*)malloc((edge_count + 1) * sizeof(uint32_t));
+    graph->root_slots = (uint32_t*)malloc((reader.root_count + 1) * sizeof(uint32_t));
+    if (!graph->id || !graph->type || !graph->size || !graph->edge_start ||
+        !graph->edges || !graph->root_slots || !id_table_init(&table, count)) {
+        goto fail;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t *node = &nodes[NODE_FIELDS * i];
+        graph->id[i] = node[0];
+        graph->type[i] = (uint8_t)node[1];
+        graph->size[i] = node[2];
+        graph->edge_start[i] = (uint32_t)node[3];
+        if (i > 0) id_table_put(&table, graph->id[i], i);
+    }
+    graph->edge_start[count] = (uint32_t)edge_count;
+    free(nodes);
+    nodes = NULL;
+
+    /* Convert edges in place, dropping unknown targets */
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t start = graph->edge_start[i];
+        uint32_t end = graph->edge_start[i + 1];
+        graph->edge_start[i] = kept;
+        for (uint32_t e = start; e < end; e++) {
+            uint32_t target = id_table_get(&table, edge_ids[e]);
+            if (target == HEAP_GRAPH_NONE) continue;
+            if (i == 0) graph->root_slots[kept] = reader.root_slots[e];
+            graph->edges[kept++] = target;
+        }
+    }
+    graph->edge_start[count] = kept;
+
+    for (int i = 0; i < reader.type_count; i++) {
+        graph->type_names[i] = reader.type_names[i];
+        reader.type_names[i] = NULL;
+    }
+    graph->type_count = reader.type_count;
+
+    free(table.ids);
+    free(table.nodes);
+    free(edge_ids);
+    snapshot_close(&reader);
+    return true;
+
+fail:
+    fprintf(stderr, "Error: %s ('%s')\n", error, path);
+    free(table.ids);
+    free(table.nodes);
+    free(nodes);
+    free(edge_ids);
+    snapshot_close(&reader);
+    heap_graph_free(graph);
+    return false;
+}
+
+/* ---- Dominators ---- */
+
+/* Walk up the dominator tree from a and b until they meet (postorder numbers grow upwards) */
+static uint32_t intersect(const uint32_t *idom, const uint32_t *post, uint32_t a, uint32_t b) {
+    while (a != b) {
+        while (post[a] < post[b]) a = idom[a];
+        while (post[b] < post[a]) b = idom[b];
+    }
+    return a;
+}
+
+/*
+ * Dominator tree by the iterative algorithm of Cooper, Harvey and Kennedy,
+ * over the reverse postorder of a depth-first walk from the root node.
+ * Then retained sizes (each node's size added to its dominator, leaves
+ * first) and a breadth-first walk for the shortest path to each object.
+ */
+bool heap_graph_analyze(HeapGraph *graph) {
+    uint32_t n = graph->count;
+    uint32_t *post = (uint32_t*)malloc(n * sizeof(uint32_t));      /* Postorder number */
+    uint32_t *order = (uint32_t*)malloc(n * sizeof(uint32_t));     /* Nodes by postorder */
+    uint32_t *stack = (uint32_t*)malloc(n * sizeof(uint32_t));
+    uint32_t *next_edge = (uint32_t*)malloc(n * sizeof(uint32_t));
+    uint32_t *pred_start = (uint32_t*)calloc(n + 1, sizeof(uint32_t));
+    uint32_t *preds = (uint32_t*)malloc((graph->edge_start[n] + 1) * sizeof(uint32_t));
+    graph->idom = (uint32_t*)malloc(n * sizeof(uint32_t));
+    graph->retained = (uint64_t*)malloc(n * sizeof(uint64_t));
+    graph->dominated = (uint32_t*)malloc(n * sizeof(uint32_t));
+    graph->parent = (uint32_t*)malloc(n * sizeof(uint32_t));
+    graph->root_slot = (uint32_t*)malloc(n * sizeof(uint32_t));
+    graph->bfs_order = (uint32_t*)malloc(n * sizeof(uint32_t));
+    bool ok = post && order && stack && next_edge && pred_start && preds && graph->idom &&
+              graph->retained && graph->dominated && graph->parent && graph->root_slot &&
+              graph->bfs_order;
+    if (!ok) {
+        fprintf(stderr, "Error: Out of memory analyzing heap snapshot\n");
+        goto done;
+    }
+
+    /* Depth-first postorder from the root node */
+    uint32_t visited = 0;
+    memset(post, 0xff, n * sizeof(uint32_t));
+    int top = 0;
+    stack[top++] = 0;
+    next_edge[0] = graph->edge_start[0];
+    post[0] = HEAP_GRAPH_NONE - 1;  /* On the stack */
+    while (top > 0) {
+        uint32_t node = stack[top - 1];
+        if (next_edge[node] < graph->edge_start[node + 1]) {
+            uint32_t target = graph->edges[next_edge[node]++];
+            if (post[target] == HEAP_GRAPH_NONE) {
+                post[target] = HEAP_GRAPH_NONE - 1;
+                next_edge[target] = graph->edge_start[target];
+                stack[top++] = target;
+            }
+        } else {
+            top--;
+            post[node] = visited;
+            order[visited++] = node;
+        }
+    }
+    graph->unreachable = n - visited;
+
+    /* Predecessors, among reachable nodes */
+    for (uint32_t v = 0; v < n; v++) {
+        if (post[v] == HEAP_GRAPH_NONE) continue;
+        for (uint32_t e = graph->edge_start[v]; e < graph->edge_start[v + 1]; e++) {
+            pred_start[graph->edges[e] + 1]++;
+        }
+    }
+    for (uint32_t v = 0; v < n; v++) {
+        pred_start[v + 1] += pred_start[v];
+    }
+    memcpy(next_edge, pred_start, n * sizeof(uint32_t));
+    for (uint32_t v = 0; v < n; v++) {
+        if (post[v] == HEAP_GRAPH_NONE) continue;
+        for (uint32_t e = graph->edge_start[v]; e < graph->edge_start[v + 1]; e++) {
+            uint32_t target = graph->edges[e];
+            preds[next_edge[target]++] = v;
+        }
+    }
+
+    for (uint32_t v = 0; v < n; v++) {
+        graph->idom[v] = HEAP_GRAPH_NONE;
+    }
+    graph->idom[0] = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        /* Reverse postorder, skipping the root (last in postorder) */
+        for (uint32_t i = visited - 1; i-- > 0;) {
+            uint32_t v = order[i];
+            uint32_t dom = HEAP_GRAPH_NONE;
+            for (uint32_t p = pred_start[v]; p < pred_start[v + 1]; p++) {
+                uint32_t pred = preds[p];
+                if (graph->idom[pred] == HEAP_GRAPH_NONE) continue;
+                dom = dom == HEAP_GRAPH_NONE ? pred : intersect(graph->idom, post, pred, dom);
+            }
+            if (dom != graph->idom[v]) {
+                graph->idom[v] = dom;
+                changed = true;
+            }
+        }
+    }
+
+    /* Retained sizes: children come before their dominator in postorder */
+    for (uint32_t v = 0; v < n; v++) {
+        graph->retained[v] = post[v] == HEAP_GRAPH_NONE ? 0 : graph->size[v];
+        graph->dominated[v] = post[v] == HEAP_GRAPH_NONE ? 0 : 1;
+    }
+    graph->size[0] = 0;
+    graph->retained[0] = 0;
+    graph->dominated[0] = 0;
+    for (uint32_t i = 0; i + 1 < visited; i++) {
+        uint32_t v = order[i];
+        graph->retained[graph->idom[v]] += graph->retained[v];
+        graph->dominated[graph->idom[v]] += graph->dominated[v];
+    }
+
+    /* Shortest paths from the roots, breadth first */
+    for (uint32_t v = 0; v < n; v++) {
+        graph->parent[v] = HEAP_GRAPH_NONE;
+        graph->root_slot[v] = HEAP_GRAPH_NONE;
+    }
+    uint32_t *queue = graph->bfs_order;
+    uint32_t tail = 0;
+    queue[tail++] = 0;
+    graph->parent[0] = 0;
+    for (uint32_t head = 0; head < tail; head++) {
+        uint32_t node = queue[head];
+        for (uint32_t e = graph->edge_start[node]; e < graph->edge_start[node + 1]; e++) {
+            uint32_t target = graph->edges[e];
+            if (graph->parent[target] != HEAP_GRAPH_NONE) continue;
+            graph->parent[target] = node;
+            if (node == 0) graph->root_slot[target] = graph->root_slots[e];
+            queue[tail++] = target;
+        }
+    }
+    graph->reached = tail;
+
+done:
+    free(post);
+    free(order);
+    free(stack);
+    free(next_edge);
+    free(pred_start);
+    free(preds);
+    return ok;
+}
+
+void heap_graph_free(HeapGraph *graph) {
+    free(graph->id);
+    free(graph->type);
+    free(graph->size);
+    free(graph->edge_start);
+    free(graph->edges);
+    free(graph->root_slots);
+    free_names(graph->type_names, graph->type_count);
+    free(graph->idom);
+    free(graph->retained);
+    free(graph->dominated);
+    free(graph->parent);
+    free(graph->root_slot);
+    free(graph->bfs_order);
+    memset(graph, 0, sizeof(*graph));
+}
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "vm.h"  /* Includes gc.h automatically */
+#include "instructions.h"
 
 VM* vm_create(void) {
     VM *vm = (VM*)malloc(sizeof(VM));
@@ -33,6 +34,8 @@ VM* vm_create(void) {
     vm->code_size = 0;
     vm->running = false;
     vm->error = VM_OK;
+    vm->instructions_executed = 0;
+    vm->exec_profile = NULL;
 
     /* Initialize GC */
     gc_init(vm);
@@ -44,6 +47,7 @@ void vm_destroy(VM *vm) {
     if (vm) {
         /* Cleanup GC first */
         gc_cleanup(vm);
+        vm_exec_profile_stop(vm);
 
         if (vm->stack) free(vm->stack);
         if (vm->memory) free(vm->memory);
@@ -54,24 +58,332 @@ void vm_destroy(VM *vm) {
 }
 
 VMError vm_load_program(VM *vm, uint8_t *bytecode, int size) {
-    /* Stub - not needed for GC tests */
     vm->code = bytecode;
     vm->code_size = size;
+    vm->pc = 0;
+    vm->sp = 0;
+    vm->rsp = 0;
+    vm->running = false;
+    vm->error = VM_OK;
+    vm->instructions_executed = 0;
     return VM_OK;
 }
 
+/* Stop with an error; vm_run returns it */
+static void vm_fail(VM *vm, VMError error) {
+    vm->error = error;
+    vm->running = false;
+}
+
+static bool vm_push(VM *vm, int32_t value) {
+    if (vm->sp >= STACK_SIZE) {
+        vm_fail(vm, VM_ERROR_STACK_OVERFLOW);
+        return false;
+    }
+    vm->stack[vm->sp++] = value;
+    return true;
+}
+
+static bool vm_pop(VM *vm, int32_t *value) {
+    if (vm->sp <= 0) {
+        vm_fail(vm, VM_ERROR_STACK_UNDERFLOW);
+        return false;
+    }
+    *value = vm->stack[--vm->sp];
+    return true;
+}
+
+static bool read_operand(VM *vm, int32_t *operand) {
+    if (vm->pc + 4 > vm->code_size) {
+        vm_fail(vm, VM_ERROR_CODE_BOUNDS);
+        return false;
+    }
+    uint8_t *bytes = vm->code + vm->pc;
+    *operand = (int32_t)((uint32_t)bytes[0] |
+                         ((uint32_t)bytes[1] << 8) |
+                         ((uint32_t)bytes[2] << 16) |
+                         ((uint32_t)bytes[3] << 24));
+    vm->pc += 4;
+    return true;
+}
+
+/* Jumps and calls are safepoints: every loop passes one */
+static bool jump_to(VM *vm, int32_t target) {
+    if (target < 0 || target >= vm->code_size) {
+        vm_fail(vm, VM_ERROR_CODE_BOUNDS);
+        return false;
+    }
+    if (vm->shared_heap) gc_safepoint(vm);
+    vm->pc = target;
+    return true;
+}
+
+/*
+ * Heap objects are held on the value stack, which the collector scans as
+ * its roots; the integer stack never holds object references.
+ */
+static Object* top_object(VM *vm) {
+    if (vm->stack_count <= 0) {
+        vm_fail(vm, VM_ERROR_STACK_UNDERFLOW);
+        return NULL;
+    }
+    Value *top = &vm->value_stack[vm->stack_count - 1];
+    if (top->type != VAL_OBJ || top->obj_val == NULL) {
+        vm_fail(vm, VM_ERROR_TYPE_MISMATCH);
+        return NULL;
+    }
+    return top->obj_val;
+}
+
+static Object* object_operand(VM *vm, ObjectType type) {
+    Object *obj = top_object(vm);
+    if (obj && obj->type != type) {
+        vm_fail(vm, VM_ERROR_TYPE_MISMATCH);
+        return NULL;
+    }
+    return obj;
+}
+
+/* Operand of a store: frozen objects are read-only */
+static Object* writable_operand(VM *vm, ObjectType type) {
+    Object *obj = object_operand(vm, type);
+    if (gc_is_frozen(obj)) {
+        vm_fail(vm, VM_ERROR_READ_ONLY);
+        return NULL;
+    }
+    return obj;
+}
+
+static void push_object(VM *vm, Object *obj) {
+    if (!obj) {
+        vm_fail(vm, VM_ERROR_OUT_OF_MEMORY);
+        return;
+    }
+    if (vm->stack_count >= VM_STACK_MAX) {
+        vm_fail(vm, VM_ERROR_STACK_OVERFLOW);
+        return;
+    }
+    vm->value_stack[vm->stack_count++] = VAL_OBJ(obj);
+}
+
+static bool in_bounds(VM *vm, int32_t index, uint32_t length) {
+    if (index < 0 || (uint32_t)index >= length) {
+        vm_fail(vm, VM_ERROR_MEMORY_BOUNDS);
+        return false;
+    }
+    return true;
+}
+
+static void execute(VM *vm, uint8_t opcode) {
+    int32_t a, b, operand;
+    Object *obj;
+
+    switch (opcode) {
+        case OP_PUSH:
+            if (read_operand(vm, &operand)) vm_push(vm, operand);
+            break;
+        case OP_POP:
+            vm_pop(vm, &a);
+            break;
+        case OP_DUP:
+            if (vm_pop(vm, &a) && vm_push(vm, a)) vm_push(vm, a);
+            break;
+
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_CMP:
+            if (!vm_pop(vm, &b) || !vm_pop(vm, &a)) break;
+            switch (opcode) {
+                case OP_ADD: vm_push(vm, (int32_t)((uint32_t)a + (uint32_t)b)); break;
+                case OP_SUB: vm_push(vm, (int32_t)((uint32_t)a - (uint32_t)b)); break;
+                case OP_MUL: vm_push(vm, (int32_t)((uint32_t)a * (uint32_t)b)); break;
+                case OP_CMP: vm_push(vm, a < b ? 1 : 0); break;
+                default:
+                    if (b == 0) {
+                        vm_fail(vm, VM_ERROR_DIVISION_BY_ZERO);
+                    } else if (a == INT32_MIN && b == -1) {
+                        vm_push(vm, INT32_MIN);
+                    } else {
+                        vm_push(vm, a / b);
+                    }
+                    break;
+            }
+            break;
+
+        case OP_JMP:
+            if (read_operand(vm, &operand)) jump_to(vm, operand);
+            break;
+        case OP_JZ:
+        case OP_JNZ:
+            if (!read_operand(vm, &operand) || !vm_pop(vm, &a)) break;
+            if ((a == 0) == (opcode == OP_JZ)) jump_to(vm, operand);
+            break;
+
+        case OP_STORE:
+        case OP_LOAD:
+            if (!read_operand(vm, &operand)) break;
+            if (operand < 0 || operand >= MEMORY_SIZE) {
+                vm_fail(vm, VM_ERROR_MEMORY_BOUNDS);
+            } else if (opcode == OP_LOAD) {
+                vm_push(vm, vm->memory[operand]);
+            } else if (vm_pop(vm, &a)) {
+                vm->memory[operand] = a;
+            }
+            break;
+
+        case OP_CALL:
+            if (!read_operand(vm, &operand)) break;
+            if (vm->rsp >= RETURN_STACK_SIZE) {
+                vm_fail(vm, VM_ERROR_RETURN_STACK_OVERFLOW);
+                break;
+            }
+            vm->return_stack[vm->rsp++] = vm->pc;
+            jump_to(vm, operand);
+            break;
+        case OP_RET:
+            if (vm->rsp <= 0) {
+                vm_fail(vm, VM_ERROR_RETURN_STACK_UNDERFLOW);
+                break;
+            }
+            vm->pc = vm->return_stack[--vm->rsp];
+            break;
+
+        case OP_NEWARRAY:
+        case OP_NEWBYTES:
+            if (!vm_pop(vm, &a)) break;
+            if (a < 0) {
+                vm_fail(vm, VM_ERROR_MEMORY_BOUNDS);
+                break;
+            }
+            push_object(vm, opcode == OP_NEWARRAY ? new_array(vm, a) : new_bytes(vm, a));
+            break;
+        case OP_ALOAD:
+            if (!(obj = object_operand(vm, OBJ_ARRAY)) || !vm_pop(vm, &a)) break;
+            if (!in_bounds(vm, a, obj->array.length)) break;
+            if (obj->array.items[a].type != VAL_INT) {
+                vm_fail(vm, VM_ERROR_TYPE_MISMATCH);
+                break;
+            }
+            vm_push(vm, obj->array.items[a].int_val);
+            break;
+        case OP_ASTORE:
+            if (!(obj = writable_operand(vm, OBJ_ARRAY)) || !vm_pop(vm, &b) || !vm_pop(vm, &a)) break;
+            if (in_bounds(vm, a, obj->array.length)) {
+                array_set(vm, obj, (uint32_t)a, VAL_INT(b));
+            }
+            break;
+        case OP_ALEN:
+            if (!(obj = top_object(vm))) break;
+            if (obj->type == OBJ_ARRAY) {
+                vm_push(vm, (int32_t)obj->array.length);
+            } else if (obj->type == OBJ_BYTES) {
+                vm_push(vm, (int32_t)obj->bytes.length);
+            } else if (obj->type == OBJ_MAP) {
+                vm_push(vm, (int32_t)obj->map.count);
+            } else {
+                vm_fail(vm, VM_ERROR_TYPE_MISMATCH);
+            }
+            break;
+        case OP_BLOAD:
+            if (!(obj = object_operand(vm, OBJ_BYTES)) || !vm_pop(vm, &a)) break;
+            if (in_bounds(vm, a, obj->bytes.length)) vm_push(vm, obj->bytes.data[a]);
+            break;
+        case OP_BSTORE:
+            if (!(obj = writable_operand(vm, OBJ_BYTES)) || !vm_pop(vm, &b) || !vm_pop(vm, &a)) break;
+            if (in_bounds(vm, a, obj->bytes.length)) obj->bytes.data[a] = (unsigned char)b;
+            break;
+        case OP_DROP:
+            if (vm->stack_count <= 0) {
+                vm_fail(vm, VM_ERROR_STACK_UNDERFLOW);
+            } else {
+                vm->stack_count--;
+            }
+            break;
+        case OP_NEWMAP:
+            push_object(vm, new_map(vm));
+            break;
+        case OP_MAPGET: {
+            Value value = VAL_INT(0);  /* Missing keys read as 0 */
+            if (!(obj = object_operand(vm, OBJ_MAP)) || !vm_pop(vm, &a)) break;
+            map_get(obj, VAL_INT(a), &value);
+            vm_push(vm, value.type == VAL_INT ? value.int_val : 0);
+            break;
+        }
+        case OP_MAPSET:
+            if (!(obj = writable_operand(vm, OBJ_MAP)) || !vm_pop(vm, &b) || !vm_pop(vm, &a)) break;
+            if (!map_set(vm, obj, VAL_INT(a), VAL_INT(b))) {
+                vm_fail(vm, VM_ERROR_OUT_OF_MEMORY);
+            }
+            break;
+        case OP_MAPDEL:
+            if (!(obj = writable_operand(vm, OBJ_MAP)) || !vm_pop(vm, &a)) break;
+            vm_push(vm, map_delete(vm, obj, VAL_INT(a)) ? 1 : 0);
+            break;
+
+        case OP_HALT:
+            vm->running = false;
+            break;
+
+        default:
+            vm_fail(vm, VM_ERROR_INVALID_OPCODE);
+            break;
+    }
+}
+
+/* vm_run's loop with execution counts; kept apart so the plain loop stays lean */
+static void run_profiled(VM *vm, ExecProfile *profile) {
+    while (vm->running && vm->pc < vm->code_size) {
+        int at = vm->pc;
+        uint8_t opcode = vm->code[at];
+        execute(vm, vm->code[vm->pc++]);
+        vm->instructions_executed++;
+
+        profile->executed[at]++;
+        switch (opcode) {
+            case OP_JMP: case OP_JZ: case OP_JNZ: case OP_CALL:
+                if (vm->pc != at + 5) profile->taken[at]++;
+                break;
+            case OP_RET:
+                if (vm->pc != at + 1) profile->taken[at]++;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/* Run from the current pc until HALT, the end of the code, or an error */
 VMError vm_run(VM *vm) {
-    /* Stub - not needed for GC tests */
-    (void)vm;  /* Suppress unused parameter warning */
-    return VM_OK;
+    vm->running = true;
+    vm->error = VM_OK;
+
+    ExecProfile *profile = vm->exec_profile;
+    if (profile && profile->code_size == vm->code_size) {
+        run_profiled(vm, profile);
+    } else {
+        while (vm->running && vm->pc < vm->code_size) {
+            execute(vm, vm->code[vm->pc++]);
+            vm->instructions_executed++;
+        }
+    }
+    vm->running = false;
+    return vm->error;
 }
 
 void vm_dump_state(VM *vm) {
     printf("VM State:\n");
     printf("  Stack Pointer: %d\n", vm->sp);
     printf("  Program Counter: %d\n", vm->pc);
+    printf("  Instructions Executed: %llu\n", (unsigned long long)vm->instructions_executed);
     printf("  GC Objects: %d\n", vm->num_objects);
-    printf("  GC Threshold: %d\n", vm->max_objects);
+    if (vm->heap_policy.pacing == GC_PACING_OBJECTS) {
+        printf("  GC Threshold: %d objects\n", vm->max_objects);
+    } else {
+        printf("  GC Heap: %zu bytes, next GC at %zu bytes\n",
+               vm->bytes_allocated, vm->next_gc_bytes);
+    }
     printf("  Auto GC: %s\n", vm->auto_gc ? "enabled" : "disabled");
 }
 
@@ -87,6 +399,9 @@ const char* vm_error_string(VMError error) {
         case VM_ERROR_RETURN_STACK_OVERFLOW: return "Return Stack Overflow";
         case VM_ERROR_RETURN_STACK_UNDERFLOW: return "Return Stack Underflow";
         case VM_ERROR_FILE_IO: return "File I/O Error";
+        case VM_ERROR_TYPE_MISMATCH: return "Type Mismatch";
+        case VM_ERROR_OUT_OF_MEMORY: return "Out of Memory";
+        case VM_ERROR_READ_ONLY: return "Write to Frozen Object";
         default: return "Unknown Error";
     }
 }
@@ -20,9 +20,19 @@ typedef enum {
     VM_ERROR_CODE_BOUNDS,
     VM_ERROR_RETURN_STACK_OVERFLOW,
     VM_ERROR_RETURN_STACK_UNDERFLOW,
-    VM_ERROR_FILE_IO
+    VM_ERROR_FILE_IO,
+    VM_ERROR_TYPE_MISMATCH,
+    VM_ERROR_OUT_OF_MEMORY,
+    VM_ERROR_READ_ONLY
 } VMError;
 
+/* Per-offset instruction counts; see vm_exec_profile_start */
+typedef struct {
+    uint64_t *executed;        /* Times an instruction started at this offset */
+    uint64_t *taken;           /* Times it went somewhere other than the next instruction */
+    int code_size;             /* Of the program the counts belong to */
+} ExecProfile;
+
 typedef struct VM {
     /* Original VM fields */
     int32_t *stack;
@@ -35,14 +45,69 @@ typedef struct VM {
     int rsp;
     bool running;
     VMError error;
+    uint64_t instructions_executed;  /* Since the program was loaded */
 
     /* GC-related fields (Lab 5) */
-    Object *first_object;
+    SizeClass size_classes[GC_SIZE_CLASSES];  /* Chunked old-generation heap */
+    LargeObject *large_objects;  /* Objects over GC_LARGE_OBJECT_BYTES */
     int num_objects;
     int max_objects;
     Value *value_stack;
     int stack_count;
     bool auto_gc;  /* Enable/disable automatic GC triggering */
+    uint32_t identity_hashes;  /* Identity hashes handed out so far */
+    ObjectStack weak_objects;  /* Weak references and weak-keyed maps */
+
+    /* Generational GC: nursery + remembered set */
+    GCMode gc_mode;
+    unsigned char *nursery;    /* Bump-allocated young generation */
+    size_t nursery_top;        /* Bytes in use */
+    size_t nursery_capacity;   /* Bytes */
+    int nursery_objects;       /* Objects in use */
+    ObjectStack remembered_set;  /* Old objects that may point into the nursery */
+
+    /* Incremental GC: tri-color marking state */
+    GCPhase gc_phase;
+    ObjectStack gray_stack;    /* Marked objects whose fields are not yet scanned */
+    int sweep_class;           /* Size class being swept */
+    HeapChunk **sweep_link;    /* Link to the chunk being swept */
+    int sweep_slot;            /* Next slot to sweep in that chunk */
+    int alloc_since_step;
+    double pause_target_us;
+    int slice_work;            /* Optional per-slice work cap, in objects */
+    GCCycleStats cycle;        /* Incremental cycle in progress */
+
+    /* Parallel marking */
+    int mark_threads;          /* Mark threads for full collections (1 = serial) */
+
+    /* Background sweeping */
+    bool background_sweep;
+    BackgroundSweep *sweep;    /* Sweep in progress or swept chunks left; NULL if none */
+
+    /* Compaction */
+    int compact_interval;      /* Compact every n-th full collection (0 = never) */
+    int collections_since_compact;
+
+    /* Shared heap */
+    GCSharedHeap *shared_heap;  /* NULL unless attached; see gc_shared_heap_attach */
+    HeapChunk *tlab[GC_SIZE_CLASSES];  /* Chunks of the shared heap only this VM allocates from */
+
+    /* Heap pacing */
+    GCHeapPolicy heap_policy;
+    size_t bytes_allocated;    /* Bytes in live and not yet collected objects */
+    size_t peak_bytes;         /* Highest bytes_allocated seen */
+    size_t next_gc_bytes;      /* Byte trigger for the next collection */
+    size_t cycle_start_bytes;  /* bytes_allocated when the incremental cycle began */
+    double last_survival;      /* Fraction of bytes that survived the last collection */
+
+    /* Telemetry */
+    GCStats gc_stats;
+    GCEventCallback gc_callback;
+    void *gc_callback_data;
+    bool gc_verbose;           /* Log each cycle to stderr */
+    GCProfile *profile;        /* Allocation sampling; NULL when off */
+    long sample_countdown;     /* Bytes to the next sample; LONG_MAX when off */
+    ExecProfile *exec_profile; /* Instruction counts; NULL when off */
 } VM;
 
 VM* vm_create(void);
@@ -52,4 +117,15 @@ VMError vm_run(VM *vm);
 void vm_dump_state(VM *vm);
 const char* vm_error_string(VMError error);
 
+/*
+ * Execution profiler, in exec_profile.c. Start it after loading the
+ * program: vm_run then counts every instruction it executes, and the
+ * profile written afterwards is what the assembler's --profile option
+ * reads. Starting again discards earlier counts.
+ */
+bool vm_exec_profile_start(VM *vm);
+void vm_exec_profile_stop(VM *vm);
+bool vm_exec_profile_write(VM *vm, FILE *out);
+uint32_t vm_code_hash(const uint8_t *code, int size);  /* FNV-1a */
+
 #endif